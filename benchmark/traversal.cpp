@@ -0,0 +1,361 @@
+// cpu traversal benchmark, traces primary and diffuse rays from a ring of
+// viewpoints around the scene through the binary bvh and the cwbvh and
+// reports throughput, node visits and triangle tests per ray, --check-sah
+// also fails the run when the parallel binned builder's sah cost regresses
+// against the sweep builder's
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "assets.hpp"
+#include "bvh_builder.hpp"
+#include "cpu_tracer.hpp"
+#include "cwbvh.hpp"
+#include "horizon/core/logger.hpp"
+#include "job_system.hpp"
+#include "math/math.hpp"
+
+static constexpr const char *usage =
+    "Usage: [traversal_benchmark] [options] [model]\n"
+    "  --width <n>                rays per viewpoint row\n"
+    "  --height <n>               rays per viewpoint column\n"
+    "  --viewpoints <n>           viewpoints on a ring around the scene\n"
+    "  --fov <degrees>            vertical field of view\n"
+    "  --no-bvh-cache             always rebuild the bvh\n"
+    "  --bvh-builder <name>       sweep | binned (parallel binned sah)\n"
+    "  --triangle-format <name>   full | indexed | quantized\n"
+    "  --check-sah                fail if the binned sah cost is more than 5%\n"
+    "                             over the sweep sah cost";
+
+// how much worse than the sweep builder's the binned builder's sah cost may
+// be before --check-sah fails, binning only approximates the sweep's splits
+static constexpr float sah_tolerance = 0.05f;
+
+struct benchmark_options_t {
+  std::string model_path;
+  uint32_t    width           = 640;
+  uint32_t    height          = 360;
+  uint32_t    viewpoints      = 4;
+  float       fov             = 45.f;
+  bool        bvh_cache       = true;
+  std::string bvh_builder     = "sweep";
+  std::string triangle_format = "full";
+  bool        check_sah       = false;
+};
+
+static benchmark_options_t parse_benchmark_options(const int    argc,
+                                                   const char **argv) {
+  benchmark_options_t options{};
+
+  auto next = [&](int &i) -> std::string_view {
+    check(i + 1 < argc, "{} expects a value\n{}", argv[i], usage);
+    return argv[++i];
+  };
+  auto to_uint = [&](std::string_view value) -> uint32_t {
+    return static_cast<uint32_t>(std::stoul(std::string{value}));
+  };
+
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    if (arg == "--width") {
+      options.width = to_uint(next(i));
+    } else if (arg == "--height") {
+      options.height = to_uint(next(i));
+    } else if (arg == "--viewpoints") {
+      options.viewpoints = to_uint(next(i));
+    } else if (arg == "--fov") {
+      options.fov = std::stof(std::string{next(i)});
+    } else if (arg == "--no-bvh-cache") {
+      options.bvh_cache = false;
+    } else if (arg == "--bvh-builder") {
+      options.bvh_builder = next(i);
+    } else if (arg == "--triangle-format") {
+      options.triangle_format = next(i);
+    } else if (arg == "--check-sah") {
+      options.check_sah = true;
+    } else {
+      check(!arg.starts_with("--"), "unknown option {}\n{}", arg, usage);
+      check(options.model_path.empty(), "{}", usage);
+      options.model_path = arg;
+    }
+  }
+
+  check(!options.model_path.empty(), "{}", usage);
+  check(options.width > 0 && options.height > 0 && options.viewpoints > 0,
+        "width, height and viewpoints must be non zero");
+  check(options.bvh_builder == "sweep" || options.bvh_builder == "binned",
+        "unknown bvh builder {}\n{}", options.bvh_builder, usage);
+  check(options.triangle_format == "full" ||
+            options.triangle_format == "indexed" ||
+            options.triangle_format == "quantized",
+        "unknown triangle format {}\n{}", options.triangle_format, usage);
+  return options;
+}
+
+// same generator as pcg_hash and random_float in random.slang, so runs are
+// deterministic
+static uint32_t pcg_hash(uint32_t seed) {
+  const uint32_t state = seed * 747796405u + 2891336453u;
+  const uint32_t word =
+      ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+static float random_float(uint32_t &state) {
+  state = pcg_hash(state);
+  return float(state) / 4294967296.f;
+}
+
+struct scene_bounds_t {
+  math::vec3 min, max;
+};
+
+static scene_bounds_t compute_bounds(const std::vector<triangle_t> &triangles) {
+  scene_bounds_t bounds{math::vec3{1e30f}, math::vec3{-1e30f}};
+  for (const auto &triangle : triangles) {
+    const math::triangle_t &t = triangle.triangle;
+    bounds.min = math::min(bounds.min, math::min(t.v0, math::min(t.v1, t.v2)));
+    bounds.max = math::max(bounds.max, math::max(t.v0, math::max(t.v1, t.v2)));
+  }
+  return bounds;
+}
+
+// pinhole camera on a ring around the scene, looking at its center
+static std::vector<cpu_ray_t> generate_primary_rays(
+    const benchmark_options_t &options, const scene_bounds_t &bounds,
+    uint32_t viewpoint) {
+  const math::vec3 center = (bounds.min + bounds.max) * 0.5f;
+  const float      radius = math::length(bounds.max - bounds.min) * 0.5f;
+  const float      angle =
+      2.f * 3.14159265f * float(viewpoint) / float(options.viewpoints);
+  const math::vec3 eye =
+      center +
+      math::vec3{std::cos(angle), 0.25f, std::sin(angle)} * (radius * 1.2f);
+
+  const math::vec3 forward = math::normalize(center - eye);
+  const math::vec3 right =
+      math::normalize(math::cross(forward, math::vec3{0, 1, 0}));
+  const math::vec3 up = math::cross(right, forward);
+  const float      tan_half_fov =
+      std::tan(options.fov * 0.5f * 3.14159265f / 180.f);
+  const float aspect = float(options.width) / float(options.height);
+
+  std::vector<cpu_ray_t> rays;
+  rays.reserve(options.width * options.height);
+  for (uint32_t y = 0; y < options.height; y++) {
+    for (uint32_t x = 0; x < options.width; x++) {
+      const float u = (2.f * (x + 0.5f) / options.width - 1.f) * aspect;
+      const float v = 1.f - 2.f * (y + 0.5f) / options.height;
+      const math::vec3 direction = math::normalize(
+          forward + (right * u + up * v) * tan_half_fov);
+      rays.push_back(cpu_ray_t::create(eye, direction));
+    }
+  }
+  return rays;
+}
+
+// one uniform hemisphere bounce per primary hit, the incoherent case
+static std::vector<cpu_ray_t> generate_diffuse_rays(
+    const std::vector<cpu_ray_t> &primary, const std::vector<cpu_hit_t> &hits,
+    const std::vector<triangle_t> &triangles) {
+  std::vector<cpu_ray_t> rays;
+  for (uint32_t i = 0; i < primary.size(); i++) {
+    if (!hits[i].did_intersect()) continue;
+    const math::triangle_t &t = triangles[hits[i].prim_index].triangle;
+    math::vec3 n = math::normalize(math::cross(t.v1 - t.v0, t.v2 - t.v0));
+    if (math::dot(n, primary[i].direction) > 0) n = -n;
+
+    uint32_t         seed = i;
+    const float      z    = 1.f - 2.f * random_float(seed);
+    const float      r    = std::sqrt(std::max(0.f, 1.f - z * z));
+    const float      phi  = 2.f * 3.14159265f * random_float(seed);
+    const math::vec3 sphere{r * std::cos(phi), r * std::sin(phi), z};
+    const math::vec3 direction =
+        math::dot(sphere, n) < 0 ? -sphere : sphere;
+
+    const math::vec3 origin =
+        primary[i].origin + primary[i].direction * hits[i].t;
+    rays.push_back(cpu_ray_t::create(origin, direction));
+  }
+  return rays;
+}
+
+struct run_result_t {
+  std::vector<cpu_hit_t> hits;
+  traversal_stats_t      stats;
+  double                 seconds;
+};
+
+template <typename trace_t>
+static run_result_t run(const std::vector<cpu_ray_t> &rays, trace_t trace) {
+  run_result_t result{};
+  result.hits.resize(rays.size());
+  std::atomic<uint64_t> node_visits = 0, triangle_tests = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  job_system_t::global().parallel_for(
+      rays.size(), 1024, [&](uint32_t begin, uint32_t end) {
+        traversal_stats_t stats{};
+        for (uint32_t i = begin; i < end; i++)
+          result.hits[i] = trace(rays[i], stats);
+        node_visits += stats.node_visits;
+        triangle_tests += stats.triangle_tests;
+      });
+  std::chrono::duration<double> took =
+      std::chrono::steady_clock::now() - start;
+
+  result.stats   = {node_visits, triangle_tests};
+  result.seconds = took.count();
+  return result;
+}
+
+struct totals_t {
+  uint64_t          rays    = 0;
+  double            seconds = 0;
+  traversal_stats_t stats{};
+};
+
+static void report(const char *name, uint64_t rays, double seconds,
+                   const traversal_stats_t &stats) {
+  horizon_info(
+      "{:>16}: {:>10} rays, {:8.2f} Mrays/s, {:7.2f} nodes/ray, {:7.2f} "
+      "triangles/ray",
+      name, rays, rays / seconds * 1e-6, double(stats.node_visits) / rays,
+      double(stats.triangle_tests) / rays);
+}
+
+static void accumulate(totals_t &totals, uint64_t rays,
+                       const run_result_t &result) {
+  totals.rays += rays;
+  totals.seconds += result.seconds;
+  totals.stats.node_visits += result.stats.node_visits;
+  totals.stats.triangle_tests += result.stats.triangle_tests;
+}
+
+// hits agree if they found the same triangle or the same distance, ties
+// between overlapping triangles can go either way
+static uint64_t count_mismatches(const std::vector<cpu_hit_t> &a,
+                                 const std::vector<cpu_hit_t> &b) {
+  uint64_t mismatches = 0;
+  for (uint32_t i = 0; i < a.size(); i++) {
+    if (a[i].prim_index == b[i].prim_index) continue;
+    if (a[i].did_intersect() && b[i].did_intersect() &&
+        std::abs(a[i].t - b[i].t) <= 1e-5f * std::max(1.f, a[i].t))
+      continue;
+    mismatches++;
+  }
+  return mismatches;
+}
+
+// builds both builders over the same unsplit triangle bounds so only the
+// split search differs, returns false if binned is over the tolerance
+static bool check_sah(const std::vector<triangle_t> &triangles) {
+  std::vector<math::aabb_t> aabbs(triangles.size());
+  for (uint32_t i = 0; i < triangles.size(); i++) {
+    const math::triangle_t &t = triangles[i].triangle;
+    aabbs[i].min = math::min(t.v0, math::min(t.v1, t.v2));
+    aabbs[i].max = math::max(t.v0, math::max(t.v1, t.v2));
+  }
+
+  const float sweep  = bvh_sah_cost(bvh::build_bvh_sweep_sah(aabbs));
+  const float binned = bvh_sah_cost(build_bvh_binned_sah_parallel(aabbs));
+  const float ratio  = binned / sweep;
+  horizon_info("sah cost sweep {}, binned {}, binned is {}x of sweep", sweep,
+               binned, ratio);
+  if (ratio <= 1.f + sah_tolerance) return true;
+  horizon_info("binned sah cost is more than {}% over sweep",
+               sah_tolerance * 100.f);
+  return false;
+}
+
+int main(int argc, char **argv) {
+  try {
+    const benchmark_options_t options =
+        parse_benchmark_options(argc, (const char **)(argv));
+
+    assets_manager_t assets_manager{};
+    assets_manager.bvh_build_config.use_cache = options.bvh_cache;
+    assets_manager.bvh_build_config.builder =
+        options.bvh_builder == "binned" ? bvh_builder_t::e_binned_sah_parallel
+                                        : bvh_builder_t::e_sweep_sah;
+    assets_manager.bvh_build_config.triangle_format =
+        options.triangle_format == "indexed" ? triangle_format_t::e_indexed
+        : options.triangle_format == "quantized"
+            ? triangle_format_t::e_quantized
+            : triangle_format_t::e_full;
+    assets_manager.load_model_from_path(options.model_path);
+
+    const cpu_scene_t scene = assets_manager.build_cpu_scene();
+    const cwbvh_t     cwbvh =
+        build_cwbvh(scene.bvh.nodes.data(), scene.bvh.prim_indices.data(),
+                    scene.bvh.prim_indices.size(), scene.triangles.data());
+    const scene_bounds_t bounds = compute_bounds(scene.triangles);
+    horizon_info("{} triangles, {} bvh2 nodes, {} cwbvh nodes, {} threads",
+                 scene.triangles.size(), scene.bvh.nodes.size(),
+                 cwbvh.nodes.size(), job_system_t::global().thread_count());
+    const bool sah_ok = !options.check_sah || check_sah(scene.triangles);
+
+    auto trace_bvh2 = [&](const cpu_ray_t &ray, traversal_stats_t &stats) {
+      return intersect_bvh(scene.bvh.nodes.data(),
+                           scene.bvh.prim_indices.data(),
+                           scene.triangles.data(), ray, stats);
+    };
+    auto trace_cwbvh = [&](const cpu_ray_t &ray, traversal_stats_t &stats) {
+      return intersect_cwbvh(cwbvh.nodes.data(), cwbvh.prim_indices.data(),
+                             scene.triangles.data(), ray, stats);
+    };
+
+    totals_t primary_bvh2, primary_cwbvh, diffuse_bvh2, diffuse_cwbvh;
+    uint64_t mismatches = 0;
+    for (uint32_t viewpoint = 0; viewpoint < options.viewpoints;
+         viewpoint++) {
+      horizon_info("viewpoint {}", viewpoint);
+      const std::vector<cpu_ray_t> primary =
+          generate_primary_rays(options, bounds, viewpoint);
+      const run_result_t bvh2 = run(primary, trace_bvh2);
+      const run_result_t wide = run(primary, trace_cwbvh);
+      report("primary bvh2", primary.size(), bvh2.seconds, bvh2.stats);
+      report("primary cwbvh", primary.size(), wide.seconds, wide.stats);
+      accumulate(primary_bvh2, primary.size(), bvh2);
+      accumulate(primary_cwbvh, primary.size(), wide);
+      mismatches += count_mismatches(bvh2.hits, wide.hits);
+
+      const std::vector<cpu_ray_t> diffuse =
+          generate_diffuse_rays(primary, bvh2.hits, scene.triangles);
+      if (diffuse.empty()) continue;
+      const run_result_t diffuse_bvh2_result  = run(diffuse, trace_bvh2);
+      const run_result_t diffuse_cwbvh_result = run(diffuse, trace_cwbvh);
+      report("diffuse bvh2", diffuse.size(), diffuse_bvh2_result.seconds,
+             diffuse_bvh2_result.stats);
+      report("diffuse cwbvh", diffuse.size(), diffuse_cwbvh_result.seconds,
+             diffuse_cwbvh_result.stats);
+      accumulate(diffuse_bvh2, diffuse.size(), diffuse_bvh2_result);
+      accumulate(diffuse_cwbvh, diffuse.size(), diffuse_cwbvh_result);
+      mismatches += count_mismatches(diffuse_bvh2_result.hits,
+                                     diffuse_cwbvh_result.hits);
+    }
+
+    horizon_info("all viewpoints");
+    report("primary bvh2", primary_bvh2.rays, primary_bvh2.seconds,
+           primary_bvh2.stats);
+    report("primary cwbvh", primary_cwbvh.rays, primary_cwbvh.seconds,
+           primary_cwbvh.stats);
+    if (diffuse_bvh2.rays > 0) {
+      report("diffuse bvh2", diffuse_bvh2.rays, diffuse_bvh2.seconds,
+             diffuse_bvh2.stats);
+      report("diffuse cwbvh", diffuse_cwbvh.rays, diffuse_cwbvh.seconds,
+             diffuse_cwbvh.stats);
+    }
+    horizon_info("bvh2 and cwbvh disagree on {} rays", mismatches);
+    return mismatches == 0 && sah_ok ? 0 : 1;
+  } catch (const std::exception &e) {
+    std::cout << e.what() << '\n';
+    return 1;
+  }
+}
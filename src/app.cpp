@@ -1,9 +1,19 @@
 #include "app.hpp"
 
+#include <GLFW/glfw3.h>
 #include <vulkan/vulkan_core.h>
 
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <string>
+#include <utility>
+
 #include "assets.hpp"
 #include "editor_camera.hpp"
+#include "frame_pacer.hpp"
 #include "horizon/core/components.hpp"
 #include "horizon/core/core.hpp"
 #include "horizon/core/ecs.hpp"
@@ -14,31 +24,117 @@
 #include "horizon/gfx/helper.hpp"
 #include "horizon/gfx/rendergraph.hpp"
 #include "horizon/gfx/types.hpp"
+#include "image_writer.hpp"
 #include "imgui.h"
 #include "math/math.hpp"
 #include "model/model.hpp"
+#include "options.hpp"
 #include "renderer.hpp"
+#include "shader_reload.hpp"
+#include "streaming.hpp"
+#include "tlas.hpp"
+#include "traversal_stats.hpp"
+#include "virtual_texture.hpp"
+
+// headless mode needs the null platform, without it a real window and
+// swapchain would be opened on nodes that have neither a display nor a gpu
+#if !defined(GLFW_PLATFORM_NULL)
+#error "aurora needs glfw 3.4 or newer for its headless mode"
+#endif
+
+// what the streamer may copy into its pool per frame
+static constexpr VkDeviceSize streaming_upload_budget = 32 * 1024 * 1024;
+// what the texture streamer may copy into its cache per frame
+static constexpr VkDeviceSize texture_upload_budget = 8 * 1024 * 1024;
+
+static renderer_t::rendering_mode_t rendering_mode_from_string(
+    const std::string& mode) {
+  if (mode == "debug_raytracer")
+    return renderer_t::rendering_mode_t::e_debug_raytracer;
+  if (mode == "raytracer") return renderer_t::rendering_mode_t::e_raytracer;
+  if (mode == "path_tracer")
+    return renderer_t::rendering_mode_t::e_path_tracer;
+  if (mode == "wavefront")
+    return renderer_t::rendering_mode_t::e_wavefront_path_tracer;
+  return renderer_t::rendering_mode_t::e_diffuse;
+}
+
+// the last frame of the gpu timers that have a result
+static std::vector<timing_t> gpu_timings(const gpu_auto_timer_t& auto_timer) {
+  std::vector<timing_t> timings;
+  for (timer_id_t id = 0; id < auto_timer.scopes.size(); id++) {
+    const timer_history_t& gpu = auto_timer.scopes[id].gpu;
+    if (!gpu.samples.empty()) timings.push_back({timer_name(id), gpu.last});
+  }
+  return timings;
+}
 
 app_t::app_t(const int argc, const char** argv) : argc(argc), argv(argv) {
-  check(argc == 2, "Usage: [aurora] [model]");
-  window     = core::make_ref<core::window_t>("aurora", 640, 420);
+  options = parse_options(argc, argv);
+
+  if (options.headless) {
+    // render nodes have no display, the null platform still gives us a window
+    // whose swapchain is backed by VK_EXT_headless_surface (lavapipe has it)
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    window = core::make_ref<core::window_t>("aurora", options.width,
+                                            options.height);
+    check(glfwGetPlatform() == GLFW_PLATFORM_NULL,
+          "headless mode could not select glfw's null platform");
+  } else {
+    window = core::make_ref<core::window_t>("aurora", 640, 420);
+  }
   context    = core::make_ref<gfx::context_t>(false /*validations*/);
   base       = core::make_ref<gfx::base_t>(window, context);
   auto_timer = core::make_ref<gpu_auto_timer_t>(base);
-  renderer =
-      core::make_ref<renderer_t>(window, context, base, auto_timer, argc, argv);
+  shader_cache = core::make_ref<shader_cache_t>(context, ".aurora_cache",
+                                                options.shader_cache);
+  renderer = core::make_ref<renderer_t>(window, context, base, auto_timer,
+                                        shader_cache, argc, argv);
 
-  gfx::helper::imgui_init(
-      *window, *context, base->_swapchain,
-      context->get_image(context->get_swapchain_images(base->_swapchain)[0])
-          .config.vk_format);
+  if (!options.headless) {
+    // traversal is what gets tuned, so everything that includes
+    // intersection.slang is watched, the other pipelines need a restart
+    shader_reloader = core::make_ref<shader_reloader_t>(context, shader_cache,
+                                                        "assets/shaders");
+    shader_reloader->watch("raytracer", "assets/shaders/raytracer.slang",
+                           renderer->raytracer->pl, &renderer->raytracer->p);
+    shader_reloader->watch(
+        "debug raytracer", "assets/shaders/debug_raytracing.slang",
+        renderer->debug_raytracer->pl, &renderer->debug_raytracer->p);
+    wavefront_t& wavefront = *renderer->wavefront;
+    const std::pair<std::string, gfx::handle_pipeline_t*> kernels[] = {
+        {"wavefront_generate", &wavefront.generate},
+        {"wavefront_prepare", &wavefront.prepare},
+        {"wavefront_extend", &wavefront.extend},
+        {"wavefront_connect", &wavefront.connect},
+        {"wavefront_sort_count", &wavefront.sort_count},
+        {"wavefront_sort_scan", &wavefront.sort_scan},
+        {"wavefront_sort_scatter", &wavefront.sort_scatter},
+        {"wavefront_shade", &wavefront.shade},
+        {"wavefront_accumulate", &wavefront.accumulate},
+    };
+    for (const auto& [name, pipeline] : kernels)
+      shader_reloader->watch(name, "assets/shaders/" + name + ".slang",
+                             wavefront.pl, pipeline);
+  }
+
+  if (!options.headless) {
+    // before imgui sees the swapchain, the settings window starts from the
+    // mode that was actually set
+    options.present_mode = to_string(set_present_mode(
+        *base, present_mode_from_string(options.present_mode)));
+    gfx::helper::imgui_init(
+        *window, *context, base->_swapchain,
+        context->get_image(context->get_swapchain_images(base->_swapchain)[0])
+            .config.vk_format);
+  }
 
   horizon_info("initialised app");
 }
 
 app_t::~app_t() {
   context->wait_idle();
-  gfx::helper::imgui_shutdown();
+  if (!options.headless) gfx::helper::imgui_shutdown();
   horizon_info("destroyed app");
 }
 
@@ -46,32 +142,246 @@ void app_t::run() {
   horizon_info("running app");
 
   assets_manager_t assets_manager{};
-  assets_manager.load_model_from_path(argv[1]);
+  assets_manager.bvh_build_config.use_cache = options.bvh_cache;
+  assets_manager.bvh_build_config.builder =
+      options.bvh_builder == "binned" ? bvh_builder_t::e_binned_sah_parallel
+                                      : bvh_builder_t::e_sweep_sah;
+  assets_manager.bvh_build_config.compare_builders =
+      options.bvh_compare_builders;
+  assets_manager.bvh_build_config.two_level = options.two_level;
+  assets_manager.bvh_build_config.triangle_format =
+      options.triangle_format == "indexed"     ? triangle_format_t::e_indexed
+      : options.triangle_format == "quantized" ? triangle_format_t::e_quantized
+                                               : triangle_format_t::e_full;
+  assets_manager.bvh_build_config.streaming = options.streaming;
+  assets_manager.bvh_build_config.cluster_triangles =
+      options.streaming_triangles;
+  assets_manager.texture_config.compression =
+      options.texture_compression == "none"  ? texture_compression_t::e_none
+      : options.texture_compression == "bc1" ? texture_compression_t::e_bc1
+      : options.texture_compression == "bc7" ? texture_compression_t::e_bc7
+                                             : texture_compression_t::e_auto;
+  assets_manager.fit_texture_config(*context);
+  assets_manager.texture_config.use_cache        = options.texture_cache;
+  assets_manager.texture_config.virtual_textures = options.virtual_textures;
+  // the window keeps drawing a progress bar while the cpu half of loading
+  // runs on another thread, only the upload needs the context
+  std::future<void> loading = std::async(std::launch::async, [&] {
+    assets_manager.load_model_from_path(options.model_path);
+    assets_manager.prepare_cpu();
+  });
+  if (!options.headless &&
+      !show_loading_progress(assets_manager.progress, loading)) {
+    loading.wait();
+    return;
+  }
+  loading.get();
+
+  auto renderer_data = assets_manager.upload(base, context, renderer->bwhite);
+  if (renderer_data.clusters)
+    renderer->streamer = core::make_ref<geometry_streamer_t>(
+        context, base, renderer_data.clusters,
+        VkDeviceSize(options.streaming_budget) * 1024 * 1024,
+        streaming_upload_budget);
+  if (renderer_data.virtual_textures)
+    renderer->texture_streamer = core::make_ref<texture_streamer_t>(
+        context, base, renderer_data.virtual_textures,
+        VkDeviceSize(options.texture_budget) * 1024 * 1024,
+        texture_upload_budget);
+
+  renderer->rendering_mode = rendering_mode_from_string(options.mode);
+
+  renderer->raytracer->use_cwbvh       = options.cwbvh;
+  renderer->debug_raytracer->use_cwbvh = options.cwbvh;
+  renderer->wavefront->use_cwbvh       = options.cwbvh;
+
+  renderer->spp             = options.spp;
+  renderer->bounces         = options.bounces;
+  renderer->target_samples  = options.target_samples;
+  renderer->noise_threshold = options.noise_threshold;
+  renderer->temporal        = options.temporal;
+  renderer->restir          = options.restir;
+
+  if (options.headless)
+    run_headless(renderer_data);
+  else
+    run_interactive(renderer_data);
+
+  context->wait_idle();
+}
+
+bool app_t::show_loading_progress(const load_progress_t& progress,
+                                  std::future<void>&     loading) {
+  while (loading.wait_for(std::chrono::milliseconds(16)) !=
+         std::future_status::ready) {
+    window->poll_events();
+    if (window->should_close()) return false;
+
+    base->begin();
+
+    gfx::rendergraph_t rg{};
+    VkRect2D           vk_rect_2d{};
+    auto [width, height]     = window->dimensions();
+    vk_rect_2d.extent.width  = width;
+    vk_rect_2d.extent.height = height;
+    rg.add_pass([&](gfx::handle_commandbuffer_t cmd) {
+        gfx::rendering_attachment_t color{};
+        color.handle_image_view = base->current_swapchain_image_view();
+        color.image_layout      = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        color.load_op           = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        color.store_op          = VK_ATTACHMENT_STORE_OP_STORE;
+        color.clear_value       = {0, 0, 0, 0};
+        base->cmd_begin_rendering(cmd, {color}, std::nullopt, vk_rect_2d);
+        gfx::helper::imgui_newframe();
+
+        const ImVec2 center = ImGui::GetMainViewport()->GetCenter();
+        ImGui::SetNextWindowPos(center, ImGuiCond_Always, ImVec2(0.5f, 0.5f));
+        ImGui::Begin("loading", nullptr,
+                     ImGuiWindowFlags_NoDecoration |
+                         ImGuiWindowFlags_AlwaysAutoResize |
+                         ImGuiWindowFlags_NoMove);
+        ImGui::Text("%s", options.model_path.string().c_str());
+        const uint32_t done = progress.done, total = progress.total;
+        char           overlay[64];
+        if (total > 0)
+          std::snprintf(overlay, sizeof(overlay), "%s %u / %u",
+                        to_string(progress.stage.load()), done, total);
+        else
+          std::snprintf(overlay, sizeof(overlay), "%s",
+                        to_string(progress.stage.load()));
+        // a negative fraction animates an indeterminate bar
+        ImGui::ProgressBar(
+            total > 0 ? float(done) / float(total) : -float(ImGui::GetTime()),
+            ImVec2(400, 0), overlay);
+        ImGui::End();
+
+        gfx::helper::imgui_endframe(*context, cmd);
+        base->cmd_end_rendering(cmd);
+      })
+        .add_write_image(base->current_swapchain_image(), 0,
+                         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    rg.add_pass([](gfx::handle_commandbuffer_t) {})
+        .add_write_image(base->current_swapchain_image(), 0,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    base->render_rendergraph(rg, base->current_commandbuffer());
+
+    base->end();
+  }
+  return true;
+}
 
-  auto renderer_data = assets_manager.prepare(base, context, renderer->bwhite);
+void app_t::run_headless(renderer_data_t& renderer_data) {
+  editor_camera_t camera{*window};
+  camera.fov = options.camera_fov;
+  camera.set_pose(options.camera_position, options.camera_yaw,
+                  options.camera_pitch, options.width, options.height);
+
+  renderer->recreate_sized_resources(options.width, options.height);
+
+  gfx::config_buffer_t cb{};
+  cb.vk_size = sizeof(math::vec4) * options.width * options.height;
+  cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  cb.vma_allocation_create_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+  gfx::handle_buffer_t pixels    = context->create_buffer(cb);
+
+  static const auto cpu_frame_timer  = intern_timer("cpu frame");
+  static const auto cpu_record_timer = intern_timer("cpu record");
+
+  for (uint32_t frame = 0; frame < options.frames; frame++) {
+    window->poll_events();
+    cpu_scope_t frame_scope{*auto_timer, cpu_frame_timer};
+
+    base->begin();
+
+    gfx::rendergraph_t       rg{};
+    std::vector<gfx::pass_t> renderer_passes;
+    {
+      cpu_scope_t record_scope{*auto_timer, cpu_record_timer};
+      renderer_passes = renderer->get_passes(
+          renderer_data, reinterpret_cast<core::camera_t&>(camera));
+    }
+    rg.passes.insert(rg.passes.end(), renderer_passes.begin(),
+                     renderer_passes.end());
+    if (frame + 1 == options.frames)
+      rg.passes.push_back(renderer->get_readback_pass(pixels));
+    // nothing is drawn to the swapchain, but it still has to be presentable
+    rg.add_pass([&](gfx::handle_commandbuffer_t cmd) {
+        auto_timer->end_frame(cmd);
+      })
+        .add_write_image(base->current_swapchain_image(), 0,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    base->render_rendergraph(rg, base->current_commandbuffer());
+
+    base->end();
+  }
+
+  context->wait_idle();
+  auto_timer->flush();
+
+  // lets runs with different settings be compared from the log
+  std::vector<timing_t> timings = gpu_timings(*auto_timer);
+  for (const auto& [name, ms] : timings) horizon_info("{} took {}ms", name, ms);
+
+  if (!options.stats_output.empty()) {
+    renderer->debug_raytracer->read_latest_stats();
+    write_traversal_stats(options.stats_output,
+                          renderer->debug_raytracer->stats, timings);
+  }
+  if (!options.trace_output.empty())
+    auto_timer->write_chrome_trace(options.trace_output);
+
+  write_image(options.output,
+              reinterpret_cast<math::vec4*>(context->map_buffer(pixels)),
+              options.width, options.height);
+  context->destroy_buffer(pixels);
+}
+
+void app_t::run_interactive(renderer_data_t& renderer_data) {
+  static const auto cpu_frame_timer  = intern_timer("cpu frame");
+  static const auto cpu_record_timer = intern_timer("cpu record");
 
   uint32_t image_width = 5, image_height = 5;
 
   core::frame_timer_t frame_timer{60.f};
-  float               target_fps = 60.f;
-  auto                last_time  = std::chrono::system_clock::now();
+  frame_pacer_t       pacer{options.target_fps};
+  uint32_t            frames = 0;
   editor_camera_t     camera{*window};
   camera.camera_speed_multiplyer = 100.f;
+  camera.fov                     = options.camera_fov;
+  {
+    auto [width, height] = window->dimensions();
+    camera.set_pose(options.camera_position, options.camera_yaw,
+                    options.camera_pitch, width, height);
+  }
+
+  // a benchmark reports over every frame it ran, not the rolling window
+  if (options.benchmark_frames)
+    for (timer_history_t* history : {&pacer.interval, &pacer.cpu,
+                                     &pacer.present, &auto_timer->gpu_frame})
+      history->capacity =
+          std::max(options.benchmark_frames, timer_history_t::default_capacity);
 
   while (!window->should_close()) {
+    // input is polled after the wait, so it is as fresh as it can be
+    pacer.wait();
     window->poll_events();
     if (window->get_key_pressed(core::key_t::e_q)) break;
     if (window->get_key_pressed(core::key_t::e_escape)) break;
+    if (options.benchmark_frames && frames++ == options.benchmark_frames)
+      break;
 
-    auto current_time    = std::chrono::system_clock::now();
-    auto time_difference = current_time - last_time;
-    if (time_difference.count() / 1e6 < 1000.f / target_fps) {
-      continue;
-    }
-    last_time                  = current_time;
     core::timer::duration_t dt = frame_timer.update();
+    cpu_scope_t             frame_scope{*auto_timer, cpu_frame_timer};
 
+    // a reloaded path tracer would mix samples of two shaders
+    if (shader_reloader->update()) renderer->reset_accumulation();
+
+    pacer.present_begin();
     base->begin();
+    pacer.present_end();
 
     gfx::rendergraph_t rg{};
     VkRect2D           vk_rect_2d{};
@@ -79,12 +389,19 @@ void app_t::run() {
     vk_rect_2d.extent.width  = width;
     vk_rect_2d.extent.height = height;
     renderer->recreate_sized_resources(image_width, image_height);
-    auto renderer_passes = renderer->get_passes(
-        renderer_data, reinterpret_cast<core::camera_t&>(camera));
+    std::vector<gfx::pass_t> renderer_passes;
+    {
+      cpu_scope_t record_scope{*auto_timer, cpu_record_timer};
+      renderer_passes = renderer->get_passes(
+          renderer_data, reinterpret_cast<core::camera_t&>(camera));
+    }
     rg.passes.insert(rg.passes.end(), renderer_passes.begin(),
                      renderer_passes.end());
 
-    static bool clear_auto_timer = false;
+    static bool clear_auto_timer    = false;
+    static bool change_present_mode = false;
+    static int  present_mode =
+        static_cast<int>(present_mode_from_string(options.present_mode));
     rg.add_pass([&](gfx::handle_commandbuffer_t cmd) {
         gfx::rendering_attachment_t color{};
         color.handle_image_view = base->current_swapchain_image_view();
@@ -168,14 +485,38 @@ void app_t::run() {
         if (settings) {
           ImGui::Begin("settings", &settings);
           ImGui::Text("%f fps", ImGui::GetIO().Framerate);
+          const char* present_modes[] = {"fifo", "mailbox", "immediate"};
+          // the swapchain is recreated once the frame is submitted
+          if (ImGui::Combo("present mode", &present_mode, present_modes,
+                           IM_ARRAYSIZE(present_modes)))
+            change_present_mode = true;
+          float target_fps = pacer.target_fps;
+          if (ImGui::DragFloat("fps limit", &target_fps, 1.f, 0.f, 1000.f,
+                               target_fps > 0.f ? "%.0f" : "uncapped"))
+            pacer.set_target_fps(target_fps);
+          auto frame_text = [](const char*            name,
+                               const timer_history_t& history) {
+            ImGui::Text("%s %.3f avg %.3f p99 %.3fms", name, history.last,
+                        history.avg(), history.p99());
+          };
+          frame_text("cpu", pacer.cpu);
+          frame_text("gpu", auto_timer->gpu_frame);
+          frame_text("present", pacer.present);
           ImGui::DragFloat("camera speed", &camera.camera_speed_multiplyer);
           const char* rendering_modes[] = {"diffuse", "debug_raytracer",
-                                           "raytracer"};
-          static int  current_mode      = 0;
+                                           "raytracer", "path_tracer",
+                                           "wavefront"};
+          static int  current_mode =
+              static_cast<int>(renderer->rendering_mode);
           if (ImGui::Combo("Rendering Mode", &current_mode, rendering_modes,
                            IM_ARRAYSIZE(rendering_modes))) {
             switch (current_mode) {
               case 0:
+                // streamed scenes have no vertices to rasterize
+                if (renderer->streamer) {
+                  current_mode = static_cast<int>(renderer->rendering_mode);
+                  break;
+                }
                 renderer->rendering_mode =
                     renderer_t::rendering_mode_t::e_diffuse;
                 break;
@@ -187,14 +528,228 @@ void app_t::run() {
                 renderer->rendering_mode =
                     renderer_t::rendering_mode_t::e_raytracer;
                 break;
+              case 3:
+                renderer->rendering_mode =
+                    renderer_t::rendering_mode_t::e_path_tracer;
+                break;
+              case 4:
+                // the wavefront kernels only trace the flat bvh and sample
+                // whole textures
+                if (renderer->streamer || renderer->texture_streamer) {
+                  current_mode = static_cast<int>(renderer->rendering_mode);
+                  break;
+                }
+                renderer->rendering_mode =
+                    renderer_t::rendering_mode_t::e_wavefront_path_tracer;
+                break;
             }
+            // both path tracers share the accumulation image
+            renderer->reset_accumulation();
             clear_auto_timer = true;
           }
-          for (auto [name, timer] : auto_timer->timers) {
-            auto t = context->timer_get_time(base->timer(timer));
-            if (t) {
-              ImGui::Text("%s took %fms", name.c_str(), *t);
+          ImGui::Text("%u unique triangles, %u instanced",
+                      renderer_data.unique_triangles_count,
+                      renderer_data.triangles_count);
+          ImGui::Text("textures: %.1f MiB, %.1f MiB as rgba8",
+                      renderer_data.texture_bytes / (1024.f * 1024.f),
+                      renderer_data.uncompressed_texture_bytes /
+                          (1024.f * 1024.f));
+          ImGui::Text("shaders: %u cached, %u compiled in %.1fms",
+                      shader_cache->hits, shader_cache->misses,
+                      shader_cache->compile_ms);
+          // traversal variants, the raytracers and the wavefront kernels
+          // are recompiled in the background and swapped in once they
+          // compile
+          static bool     combine_leaves    = true;
+          static uint32_t shared_stack_size = 16;
+          const uint32_t  min_stack = 4, max_stack = 32;
+
+          bool variant_changed = ImGui::Checkbox("combine leaf intersections",
+                                                 &combine_leaves);
+          variant_changed |= ImGui::SliderScalar(
+              "shared stack size", ImGuiDataType_U32, &shared_stack_size,
+              &min_stack, &max_stack);
+          if (variant_changed) {
+            std::vector<shader_define_t> defines;
+            if (!combine_leaves)
+              defines.push_back(
+                  {"DONT_COMBINE_LEAF_PRIMITIVE_INTERSECTIONS", ""});
+            if (shared_stack_size != 16)
+              defines.push_back(
+                  {"SHARED_STACK_SIZE", std::to_string(shared_stack_size)});
+            shader_reloader->set_defines(defines);
+          }
+          ImGui::Text("shader reloads: %u%s", shader_reloader->reloads,
+                      shader_reloader->compiling ? ", compiling" : "");
+          for (const auto& program : shader_reloader->programs)
+            if (!program.error.empty())
+              ImGui::TextWrapped("%s failed to compile:\n%s",
+                                 program.name.c_str(), program.error.c_str());
+          if (ImGui::Checkbox("cwbvh", &renderer->raytracer->use_cwbvh)) {
+            renderer->debug_raytracer->use_cwbvh =
+                renderer->raytracer->use_cwbvh;
+            renderer->wavefront->use_cwbvh = renderer->raytracer->use_cwbvh;
+            clear_auto_timer = true;
+          }
+          if (renderer->rendering_mode !=
+                  renderer_t::rendering_mode_t::e_diffuse &&
+              renderer_data.blas_bvh2_nodes != core::null_handle) {
+            const tlas_t& tlas = *renderer->tlas;
+            ImGui::Text("tlas: %zu instances, %zu nodes, %.3fms",
+                        tlas.instances.size(), tlas.bvh.nodes.size(),
+                        tlas.last_update_ms);
+            ImGui::Text("%u rebuilds, %u refits", tlas.rebuilds, tlas.refits);
+          }
+          if (renderer->rendering_mode !=
+                  renderer_t::rendering_mode_t::e_diffuse &&
+              renderer->streamer) {
+            const geometry_streamer_t& streamer = *renderer->streamer;
+            ImGui::Text("streaming: %u/%u pages, %.1f/%.1f MiB, %.3fms",
+                        streamer.resident, streamer.pages_count,
+                        streamer.pool_size / (1024.f * 1024.f),
+                        streamer.clusters->pages_size / (1024.f * 1024.f),
+                        streamer.last_update_ms);
+            ImGui::Text("%u misses, %u page ins, %u evictions, %.1f KiB",
+                        streamer.misses, streamer.page_ins, streamer.evictions,
+                        streamer.uploaded_bytes / 1024.f);
+            ImGui::Text("scene is %.2fx the vram it takes",
+                        streamer.scene_to_vram);
+          }
+          if (renderer->texture_streamer) {
+            const texture_streamer_t& streamer = *renderer->texture_streamer;
+            ImGui::Text("virtual textures: %u/%u slots, %u pages, %.3fms",
+                        streamer.resident, streamer.slots_count,
+                        streamer.file->pages_count, streamer.last_update_ms);
+            ImGui::Text("%u misses, %u page ins, %u evictions, %.1f KiB",
+                        streamer.misses, streamer.page_ins, streamer.evictions,
+                        streamer.uploaded_bytes / 1024.f);
+          }
+          if (renderer->rendering_mode ==
+              renderer_t::rendering_mode_t::e_diffuse) {
+            const char* geometries[] = {"vertices", "meshlets",
+#ifdef AURORA_MESH_SHADERS
+                                        "mesh shader",
+#endif
+            };
+            int geometry = static_cast<int>(renderer->diffuse_geometry);
+            if (ImGui::Combo("geometry", &geometry, geometries,
+                             IM_ARRAYSIZE(geometries))) {
+              renderer->diffuse_geometry =
+                  static_cast<diffuse_geometry_t>(geometry);
+              clear_auto_timer = true;
             }
+            ImGui::Checkbox("frustum culling", &renderer->culling->frustum);
+            ImGui::Checkbox("occlusion culling",
+                            &renderer->culling->occlusion);
+            ImGui::Checkbox("backface culling", &renderer->culling->backface);
+            const culling_counters_t& counters =
+                renderer->culling->last_counters;
+            ImGui::Text("%u / %u meshes drawn", counters.draw_count,
+                        renderer_data.meshes_count);
+            ImGui::Text("%u frustum culled, %u occlusion culled",
+                        counters.frustum_culled, counters.occlusion_culled);
+            if (renderer->diffuse_geometry !=
+                diffuse_geometry_t::e_vertices) {
+              ImGui::Text("%u / %u meshlets drawn", counters.meshlet_draw_count,
+                          renderer_data.meshlet_instances_count);
+              ImGui::Text("%u frustum culled, %u backface culled",
+                          counters.meshlet_frustum_culled,
+                          counters.meshlet_backface_culled);
+            }
+          }
+          if (renderer->rendering_mode ==
+              renderer_t::rendering_mode_t::e_debug_raytracer) {
+            debug_raytracer_t& debug_raytracer = *renderer->debug_raytracer;
+            ImGui::DragFloat("heatmap max", &debug_raytracer.heatmap_max, 1.f,
+                             1.f, 4096.f);
+            ImGui::Checkbox("traversal stats", &debug_raytracer.collect_stats);
+            const traversal_summary_t& stats = debug_raytracer.stats;
+            if (debug_raytracer.collect_stats && stats.frame != 0) {
+              ImGui::Text("%u rays, %u hits", stats.rays, stats.hits);
+              for (auto [name, counter] :
+                   {std::pair{"nodes", &stats.nodes},
+                    std::pair{"triangles", &stats.triangles}}) {
+                ImGui::Text("%s: %llu total, %.1f mean, %u max", name,
+                            static_cast<unsigned long long>(counter->total),
+                            counter->mean, counter->max);
+                ImGui::Text("  p50 %.1f, p90 %.1f, p99 %.1f", counter->p50,
+                            counter->p90, counter->p99);
+                // one float per bin, imgui plots floats
+                std::vector<float> histogram(counter->histogram.begin(),
+                                             counter->histogram.end());
+                ImGui::PlotHistogram(name, histogram.data(),
+                                     static_cast<int>(histogram.size()), 0,
+                                     nullptr, 0.f, FLT_MAX, ImVec2(0, 60));
+              }
+              if (ImGui::Button("export csv"))
+                write_traversal_stats(
+                    "traversal_stats.csv", stats,
+                    gpu_timings(*auto_timer));
+              if (ImGui::Button("export json"))
+                write_traversal_stats(
+                    "traversal_stats.json", stats,
+                    gpu_timings(*auto_timer));
+            }
+          }
+          if (renderer->rendering_mode ==
+              renderer_t::rendering_mode_t::e_path_tracer) {
+            const uint32_t min_value = 1, max_spp = 64, max_bounces = 16;
+            ImGui::SliderScalar("spp", ImGuiDataType_U32, &renderer->spp,
+                                &min_value, &max_spp);
+            if (ImGui::SliderScalar("bounces", ImGuiDataType_U32,
+                                    &renderer->bounces, &min_value,
+                                    &max_bounces))
+              renderer->reset_accumulation();
+            // both only decide when to stop, the accumulation stays valid
+            if (ImGui::DragScalar("target samples", ImGuiDataType_U32,
+                                  &renderer->target_samples))
+              renderer->converged = false;
+            if (ImGui::DragFloat("noise threshold", &renderer->noise_threshold,
+                                 0.001f, 0.f, 1.f))
+              renderer->converged = false;
+            // moving the camera reprojects the accumulation, history is
+            // capped at max history samples while it moves
+            ImGui::Checkbox("temporal reprojection", &renderer->temporal);
+            ImGui::SliderFloat("max history", &renderer->max_history, 1.f,
+                               256.f);
+            if (ImGui::Checkbox("restir direct light", &renderer->restir))
+              renderer->reset_accumulation();
+            if (ImGui::Button("restart")) renderer->reset_accumulation();
+          }
+          if (renderer->rendering_mode ==
+              renderer_t::rendering_mode_t::e_wavefront_path_tracer) {
+            const uint32_t min_value = 1, max_bounces = 16;
+            if (ImGui::SliderScalar("bounces", ImGuiDataType_U32,
+                                    &renderer->bounces, &min_value,
+                                    &max_bounces))
+              renderer->reset_accumulation();
+            if (ImGui::DragScalar("target samples", ImGuiDataType_U32,
+                                  &renderer->target_samples))
+              renderer->converged = false;
+            ImGui::Text("%u / %u samples%s", renderer->samples,
+                        renderer->target_samples,
+                        renderer->converged ? ", converged" : "");
+            if (ImGui::Button("restart")) renderer->reset_accumulation();
+          }
+          if (ImGui::CollapsingHeader("timers")) {
+            // last, min, avg and p99 over the last frames, nested scopes are
+            // indented under the scope they ran in
+            for (timer_id_t id = 0; id < auto_timer->scopes.size(); id++) {
+              const auto& scope = auto_timer->scopes[id];
+              auto text = [&](const char* kind, const timer_history_t& h) {
+                if (h.samples.empty()) return;
+                ImGui::Text("%*s%s %s %.3f min %.3f avg %.3f p99 %.3fms",
+                            int(2 * scope.depth), "", kind,
+                            timer_name(id).c_str(), h.last, h.min(), h.avg(),
+                            h.p99());
+              };
+              text("gpu", scope.gpu);
+              text("cpu", scope.cpu);
+            }
+            if (ImGui::Button("export trace"))
+              auto_timer->write_chrome_trace("aurora_trace.json");
+            if (auto_timer->dropped)
+              ImGui::Text("%u scopes did not fit", auto_timer->dropped);
           }
           ImGui::End();
         }
@@ -207,21 +762,41 @@ void app_t::run() {
         .add_write_image(base->current_swapchain_image(), 0,
                          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
                          VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-    rg.add_pass([](gfx::handle_commandbuffer_t) {})
+    rg.add_pass([&](gfx::handle_commandbuffer_t cmd) {
+        auto_timer->end_frame(cmd);
+      })
         .add_write_image(base->current_swapchain_image(), 0,
                          VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
                          VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
     base->render_rendergraph(rg, base->current_commandbuffer());
 
+    pacer.present_begin();
     base->end();
+    pacer.present_end();
 
     if (clear_auto_timer) {
       clear_auto_timer = false;
       auto_timer->clear();
     }
+    if (change_present_mode) {
+      change_present_mode = false;
+      present_mode = static_cast<int>(
+          set_present_mode(*base, static_cast<present_mode_t>(present_mode)));
+    }
+    pacer.end_frame();
   }
 
-  context->wait_idle();
-
-  return;
+  if (options.benchmark_frames) {
+    context->wait_idle();
+    auto_timer->flush();
+    auto log = [](const char* name, const timer_history_t& history) {
+      horizon_info("{} over {} frames: min {}ms avg {}ms p99 {}ms",
+                   name, history.samples.size(), history.min(),
+                   history.avg(), history.p99());
+    };
+    log("frame interval", pacer.interval);
+    log("cpu frame", pacer.cpu);
+    log("gpu frame", auto_timer->gpu_frame);
+    log("present", pacer.present);
+  }
 }
@@ -1,14 +1,18 @@
 #ifndef APP_HPP
 #define APP_HPP
 
+#include <future>
 #include <vector>
 
+#include "assets.hpp"
 #include "horizon/core/core.hpp"
 #include "horizon/core/window.hpp"
 #include "horizon/gfx/base.hpp"
 #include "horizon/gfx/context.hpp"
 #include "model/model.hpp"
+#include "options.hpp"
 #include "renderer.hpp"
+#include "shader_reload.hpp"
 
 class app_t {
  public:
@@ -17,11 +21,22 @@ class app_t {
   void run();
 
  private:
-  core::ref<core::window_t>   window;
-  core::ref<gfx::context_t>   context;
-  core::ref<gfx::base_t>      base;
-  core::ref<gpu_auto_timer_t> auto_timer;
-  core::ref<renderer_t>       renderer;
+  void run_interactive(renderer_data_t &renderer_data);
+  void run_headless(renderer_data_t &renderer_data);
+  // draws a progress bar until loading is ready, false if the window closed
+  bool show_loading_progress(const load_progress_t &progress,
+                             std::future<void>     &loading);
+
+  options_t options;
+
+  core::ref<core::window_t>    window;
+  core::ref<gfx::context_t>    context;
+  core::ref<gfx::base_t>       base;
+  core::ref<gpu_auto_timer_t>  auto_timer;
+  core::ref<shader_cache_t>    shader_cache;
+  core::ref<renderer_t>        renderer;
+  // interactive only, declared last so it stops before the renderer goes
+  core::ref<shader_reloader_t> shader_reloader;
 
   const int    argc;
   const char **argv;
@@ -1,171 +1,1352 @@
 #include "assets.hpp"
 
+#include <stb_image.h>
+
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "buffer_arena.hpp"
 #include "bvh/bvh.hpp"
+#include "bvh_builder.hpp"
+#include "bvh_cache.hpp"
+#include "cwbvh.hpp"
 #include "horizon/core/components.hpp"
 #include "horizon/core/core.hpp"
 #include "horizon/core/logger.hpp"
 #include "horizon/gfx/helper.hpp"
 #include "horizon/gfx/types.hpp"
+#include "job_system.hpp"
 #include "math/triangle.hpp"
 #include "math/utilies.hpp"
+#include "meshlet.hpp"
 #include "model/model.hpp"
+#include "streaming.hpp"
+#include "texture_compression.hpp"
+#include "tlas.hpp"
+#include "triangle_storage.hpp"
+#include "upload_batch.hpp"
+#include "virtual_texture.hpp"
+#include "vulkan_handles.hpp"
+
+const char* to_string(load_stage_t stage) {
+  switch (stage) {
+    case load_stage_t::e_model:
+      return "loading model";
+    case load_stage_t::e_textures:
+      return "decoding textures";
+    case load_stage_t::e_triangles:
+      return "building triangles";
+    case load_stage_t::e_bvh:
+      return "building bvh";
+    case load_stage_t::e_meshlets:
+      return "building meshlets";
+    case load_stage_t::e_upload:
+      return "uploading";
+    case load_stage_t::e_done:
+      return "done";
+  }
+  return "unknown";
+}
+
+void load_progress_t::begin(load_stage_t stage, uint32_t total) {
+  this->done  = 0;
+  this->total = total;
+  this->stage = stage;
+}
 
 void assets_manager_t::load_model_from_path(const std::filesystem::path& path) {
+  progress.begin(load_stage_t::e_model, 0);
   auto raw_model = model::load_model_from_path(path);
   for (auto& raw_mesh : raw_model.meshes) {
-    loaded_meshes.push_back(raw_mesh);
     horizon_info("indices count: {} vertices count: {}",
                  raw_mesh.indices.size(), raw_mesh.vertices.size());
+    loaded_meshes.push_back(std::move(raw_mesh));
   }
 }
 
-renderer_data_t assets_manager_t::prepare(
-    core::ref<gfx::base_t> base, core::ref<gfx::context_t> context,
-    gfx::handle_bindless_image_t bdefault) {
-  std::vector<material_t> materials;
-  std::vector<cpu_mesh_t> cpu_meshes;
-  std::vector<gpu_mesh_t> gpu_meshes;
+static const char* to_string(bvh_builder_t builder) {
+  switch (builder) {
+    case bvh_builder_t::e_sweep_sah:
+      return "sweep sah";
+    case bvh_builder_t::e_binned_sah_parallel:
+      return "parallel binned sah";
+  }
+  return "unknown";
+}
+
+static bvh::bvh_t build_presplit_bvh(
+    const std::vector<math::triangle_t>& triangles,
+    const bvh_build_config_t& config, bvh_builder_t builder) {
+  bvh::bvh_t bvh;
+  if (builder == bvh_builder_t::e_binned_sah_parallel) {
+    auto [aabbs, tri_indices] =
+        presplit_parallel(triangles, config.presplit_factor);
+    bvh = build_bvh_binned_sah_parallel(aabbs);
+    bvh::presplit_remove_indirection(bvh, tri_indices);
+  } else {
+    auto [aabbs, tri_indices] =
+        bvh::presplit(triangles, config.presplit_factor);
+    // auto aabbs = math::aabbs_from_triangles(triangles);
+    bvh = bvh::build_bvh_sweep_sah(aabbs);
+    bvh::presplit_remove_indirection(bvh, tri_indices);
+  }
+  bvh::presplit_remove_duplicates(bvh);
+  return bvh;
+}
+
+static bvh::bvh_t build_bvh(const std::vector<math::triangle_t>& triangles,
+                            const bvh_build_config_t&            config,
+                            bvh_builder_t                        builder) {
+  auto start = std::chrono::steady_clock::now();
+
+  bvh::bvh_t bvh = build_presplit_bvh(triangles, config, builder);
+
+  std::chrono::duration<float, std::milli> took =
+      std::chrono::steady_clock::now() - start;
+  horizon_info("{} bvh: {} triangles, {} nodes, took {}ms, sah cost {}",
+               to_string(builder), triangles.size(), bvh.nodes.size(),
+               took.count(), bvh_sah_cost(bvh));
+  return bvh;
+}
+
+// rgba8 texels of mip 0, decoded on the job system, or the image's
+// compressed mip chain with the texels dropped
+struct decoded_image_t {
+  std::filesystem::path                     path;
+  int                                       width = 0, height = 0;
+  std::unique_ptr<stbi_uc, void (*)(void*)> texels{nullptr, stbi_image_free};
+  core::ref<compressed_texture_t>           compressed;
+};
+
+struct prepared_assets_t {
+  std::vector<decoded_image_t> images;
+  // index into images for every mesh, -1 if the mesh has no diffuse texture
+  std::vector<int32_t>         mesh_images;
+
+  triangle_quantization_t      quantization;
+  encoded_triangles_t          encoded;
+  cwbvh_t                      cwbvh;
+  // empty for meshes that share another mesh's geometry
+  std::vector<mesh_meshlets_t> meshlets;
+  // the mesh whose geometry every mesh uses and the transform that places
+  // it, see find_shared_geometry
+  std::vector<uint32_t>        geometries;
+  std::vector<math::mat4>      transforms;
+  // of every mesh's first triangle in the flat triangles, which hold each
+  // geometry once unless streaming
+  std::vector<uint32_t>        triangle_offsets;
+  uint32_t                     flat_triangles_count   = 0;
+  uint32_t                     unique_triangles_count = 0;
+  // empty unless bvh_build_config_t::two_level is set or meshes are
+  // instanced
+  blas_set_t                   blases;
+
+  // set instead of the flat bvh when streaming
+  core::ref<cluster_file_t> clusters;
+  // set instead of the decoded images with virtual textures
+  core::ref<virtual_texture_file_t> virtual_textures;
+
+  core::ref<bvh_cache_t>  bvh_cache;
   std::vector<triangle_t> triangles;
-  for (uint32_t mesh_index = 0; mesh_index < loaded_meshes.size();
-       mesh_index++) {
-    const auto& raw_mesh     = loaded_meshes[mesh_index];
-    cpu_mesh_t& cpu_mesh     = cpu_meshes.emplace_back();
-    cpu_mesh.vertex_count    = raw_mesh.vertices.size();
-    cpu_mesh.index_count     = raw_mesh.indices.size();
-    cpu_mesh.triangle_offset = triangles.size();
+  bvh::bvh_t              bvh2;
 
-    gfx::config_buffer_t cb{};
-    cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-    {
-      cb.vk_size = sizeof(raw_mesh.vertices[0]) * raw_mesh.vertices.size();
-      cb.vma_allocation_create_flags =
-          VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
-      cpu_mesh.vertex_buffer = gfx::helper::create_buffer_staged(
-          *context, base->_command_pool, cb, raw_mesh.vertices.data(),
-          cb.vk_size);
+  // on a cache hit these point into the mapped file, nothing is copied
+  const void* triangles_data  = nullptr;
+  const void* nodes_data      = nullptr;
+  const void* prim_index_data = nullptr;
+  size_t      nodes_count = 0, prim_indices_count = 0;
+  uint32_t    triangles_count = 0;
+};
+
+// flattens every mesh into triangle_t in mesh order, quantized formats snap
+// the vertices since the bvh has to bound what the gpu decodes
+static std::vector<triangle_t> flatten_triangles(
+    const std::vector<model::raw_mesh_t>& meshes, triangle_format_t format,
+    const triangle_quantization_t& quantization, load_progress_t& progress) {
+  std::vector<uint32_t> offsets;
+  uint32_t              triangles_count = 0;
+  for (const auto& mesh : meshes) {
+    offsets.push_back(triangles_count);
+    triangles_count += mesh.indices.size() / 3;
+  }
+
+  progress.begin(load_stage_t::e_triangles, meshes.size());
+  std::vector<triangle_t> triangles(triangles_count);
+  job_system_t::global().parallel_for(
+      meshes.size(), 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t mesh_index = begin; mesh_index < end; mesh_index++) {
+          auto raw_triangles =
+              model::create_triangles_from_mesh(meshes[mesh_index]);
+          triangle_t* out = triangles.data() + offsets[mesh_index];
+          for (auto triangle : raw_triangles) {
+            if (format == triangle_format_t::e_quantized) {
+              triangle.v0 = quantize_position(quantization, triangle.v0);
+              triangle.v1 = quantize_position(quantization, triangle.v1);
+              triangle.v2 = quantize_position(quantization, triangle.v2);
+            }
+            *out++ = {triangle, mesh_index};
+          }
+          progress.done++;
+        }
+      });
+  return triangles;
+}
+
+// a rotation and a translation, see find_rigid_transform
+struct rigid_transform_t {
+  // rows
+  math::vec3 rotation[3];
+  math::vec3 translation;
+
+  math::vec3 rotate(math::vec3 v) const {
+    return {math::dot(rotation[0], v), math::dot(rotation[1], v),
+            math::dot(rotation[2], v)};
+  }
+  math::vec3 apply(math::vec3 p) const { return rotate(p) + translation; }
+
+  math::mat4 mat4() const {
+    math::mat4 m{1.f};
+    for (uint32_t row = 0; row < 3; row++) {
+      for (uint32_t column = 0; column < 3; column++)
+        m[column][row] = rotation[row][column];
+      m[3][row] = translation[row];
     }
-    {
-      cb.vk_size = sizeof(raw_mesh.indices[0]) * raw_mesh.indices.size();
-      cb.vma_allocation_create_flags =
-          VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
-      cpu_mesh.index_buffer = gfx::helper::create_buffer_staged(
-          *context, base->_command_pool, cb, raw_mesh.indices.data(),
-          cb.vk_size);
+    return m;
+  }
+};
+
+// the rotation and translation that move a's vertices onto b's, both meshes
+// are expected to have the same indices and uvs, a frame is built from the
+// same three vertices of each and every vertex is then checked against it,
+// false if b is not a rigidly moved copy of a, mirrored and scaled copies are
+// not matched
+static bool find_rigid_transform(const model::raw_mesh_t& a,
+                                 const model::raw_mesh_t& b,
+                                 rigid_transform_t&       transform) {
+  const std::vector<model::vertex_t>& va = a.vertices;
+  const std::vector<model::vertex_t>& vb = b.vertices;
+
+  // the vertex farthest from the first and the one farthest off their line
+  // give the best conditioned frame
+  math::vec3 bounds_min{std::numeric_limits<float>::max()};
+  math::vec3 bounds_max{-std::numeric_limits<float>::max()};
+  uint32_t   i1 = 0, i2 = 0;
+  float      farthest = 0.f;
+  for (uint32_t i = 0; i < va.size(); i++) {
+    bounds_min = math::min(bounds_min, va[i].position);
+    bounds_max = math::max(bounds_max, va[i].position);
+    const float d = math::length(va[i].position - va[0].position);
+    if (d > farthest) {
+      farthest = d;
+      i1       = i;
+    }
+  }
+  farthest = 0.f;
+  for (uint32_t i = 0; i < va.size(); i++) {
+    const float d = math::length(math::cross(
+        va[i1].position - va[0].position, va[i].position - va[0].position));
+    if (d > farthest) {
+      farthest = d;
+      i2       = i;
     }
+  }
 
-    {
-      cb.vk_size = sizeof(math::mat4);
-      cb.vma_allocation_create_flags =
-          VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
-      cpu_mesh.transform = context->create_buffer(cb);
-      core::transform_t transform{};
-      *reinterpret_cast<math::mat4*>(context->map_buffer(cpu_mesh.transform)) =
-          transform.mat4();
+  auto frame = [&](const std::vector<model::vertex_t>& v,
+                   math::vec3 (&axes)[3]) {
+    const math::vec3 e1 = v[i1].position - v[0].position;
+    const math::vec3 n  = math::cross(e1, v[i2].position - v[0].position);
+    if (math::length(n) <= 0.f) return false;
+    axes[0] = math::normalize(e1);
+    axes[1] = math::normalize(n);
+    axes[2] = math::cross(axes[0], axes[1]);
+    return true;
+  };
+  math::vec3 fa[3], fb[3];
+  const bool a_frame = frame(va, fa), b_frame = frame(vb, fb);
+  if (a_frame != b_frame) return false;
+  for (uint32_t row = 0; row < 3; row++) {
+    for (uint32_t column = 0; column < 3; column++) {
+      // r = fb * transpose(fa), a mesh without area can only be translated
+      transform.rotation[row][column] =
+          a_frame ? fb[0][row] * fa[0][column] + fb[1][row] * fa[1][column] +
+                        fb[2][row] * fa[2][column]
+                  : float(row == column);
     }
+  }
+  transform.translation = vb[0].position - transform.rotate(va[0].position);
 
-    // cpu_mesh.material_index = materials.size();
-    material_t& material = materials.emplace_back();
+  // relative to the mesh's size, and to how far from the origin the copy is
+  // since that is where float rounding comes from
+  const float position_tolerance =
+      1e-4f * math::length(bounds_max - bounds_min) +
+      1e-6f * math::length(transform.translation);
+  constexpr float direction_tolerance = 1e-3f;
+  for (uint32_t i = 0; i < va.size(); i++) {
+    const model::vertex_t& x = va[i];
+    const model::vertex_t& y = vb[i];
+    if (math::length(transform.apply(x.position) - y.position) >
+            position_tolerance ||
+        math::length(transform.rotate(x.normal) - y.normal) >
+            direction_tolerance ||
+        math::length(transform.rotate(x.tangent) - y.tangent) >
+            direction_tolerance ||
+        math::length(transform.rotate(x.bi_tangent) - y.bi_tangent) >
+            direction_tolerance ||
+        x.uv != y.uv)
+      return false;
+  }
+  return true;
+}
+
+// maps every mesh to the first mesh it is a rigidly moved copy of, a mesh
+// that maps to itself owns its geometry and keeps an identity transform, the
+// others are instances of it that only add a transform and a material, the
+// loader bakes node transforms into the vertices, so the transforms are
+// recovered from the vertices
+static void find_shared_geometry(
+    const std::vector<model::raw_mesh_t>& meshes,
+    std::vector<uint32_t>& geometries, std::vector<math::mat4>& transforms) {
+  // indices and uvs do not change when a mesh is moved, so they narrow the
+  // search down to meshes that can be copies of each other
+  std::vector<uint64_t> hashes(meshes.size());
+  job_system_t::global().parallel_for(
+      meshes.size(), 16, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+          const model::raw_mesh_t& mesh = meshes[i];
+          hashes[i] = hash_bytes(mesh.indices.data(),
+                                 sizeof(mesh.indices[0]) * mesh.indices.size(),
+                                 mesh.vertices.size());
+          for (const auto& vertex : mesh.vertices)
+            hashes[i] = hash_bytes(&vertex.uv, sizeof(vertex.uv), hashes[i]);
+        }
+      });
+
+  geometries.resize(meshes.size());
+  transforms.assign(meshes.size(), math::mat4{1.f});
+  std::unordered_multimap<uint64_t, uint32_t> owners;
+  for (uint32_t mesh_index = 0; mesh_index < meshes.size(); mesh_index++) {
+    const model::raw_mesh_t& mesh = meshes[mesh_index];
+    geometries[mesh_index]        = mesh_index;
+    if (mesh.indices.empty()) continue;
+    auto [begin, end] = owners.equal_range(hashes[mesh_index]);
+    for (auto it = begin; it != end; ++it) {
+      const model::raw_mesh_t& owner = meshes[it->second];
+      rigid_transform_t        transform;
+      if (owner.vertices.size() != mesh.vertices.size() ||
+          owner.indices != mesh.indices ||
+          !find_rigid_transform(owner, mesh, transform))
+        continue;
+      geometries[mesh_index] = it->second;
+      transforms[mesh_index] = transform.mat4();
+      break;
+    }
+    if (geometries[mesh_index] == mesh_index)
+      owners.emplace(hashes[mesh_index], mesh_index);
+  }
+}
+
+// builds a blas per geometry on the job system and concatenates them,
+// instances get the roots of the mesh that owns their geometry, the
+// triangles are the scene's flattened triangles in mesh order
+static blas_set_t build_blases(const std::vector<model::raw_mesh_t>& meshes,
+                               const std::vector<uint32_t>&          geometries,
+                               const triangle_t*                     triangles,
+                               const bvh_build_config_t&             config,
+                               load_progress_t&                      progress) {
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<uint32_t> offsets;
+  uint32_t              triangles_count = 0;
+  for (const auto& mesh : meshes) {
+    offsets.push_back(triangles_count);
+    triangles_count += mesh.indices.size() / 3;
+  }
 
+  progress.begin(load_stage_t::e_bvh, meshes.size());
+  std::vector<bvh::bvh_t> bvhs(meshes.size());
+  std::vector<cwbvh_t>    cwbvhs(meshes.size());
+  job_system_t::global().parallel_for(
+      meshes.size(), 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t mesh_index = begin; mesh_index < end; mesh_index++) {
+          const uint32_t count = meshes[mesh_index].indices.size() / 3;
+          if (count == 0 || geometries[mesh_index] != mesh_index) {
+            progress.done++;
+            continue;
+          }
+          std::vector<math::triangle_t> mesh_triangles;
+          mesh_triangles.reserve(count);
+          for (uint32_t i = 0; i < count; i++)
+            mesh_triangles.push_back(
+                triangles[offsets[mesh_index] + i].triangle);
+          bvhs[mesh_index] =
+              build_presplit_bvh(mesh_triangles, config, config.builder);
+          bvh::bvh_t& bvh = bvhs[mesh_index];
+          // blas prims index the scene's triangles like the flat bvh's do
+          for (uint32_t& prim_index : bvh.prim_indices)
+            prim_index += offsets[mesh_index];
+          cwbvhs[mesh_index] =
+              build_cwbvh(bvh.nodes.data(), bvh.prim_indices.data(),
+                          bvh.prim_indices.size(), triangles);
+          progress.done++;
+        }
+      });
+
+  blas_set_t blases{};
+  for (uint32_t mesh_index = 0; mesh_index < meshes.size(); mesh_index++) {
+    const bvh::bvh_t& bvh   = bvhs[mesh_index];
+    const cwbvh_t&    cwbvh = cwbvhs[mesh_index];
+    const uint32_t    owner = geometries[mesh_index];
+    if (owner != mesh_index) {
+      blases.bvh2_roots.push_back(blases.bvh2_roots[owner]);
+      blases.cwbvh_roots.push_back(blases.cwbvh_roots[owner]);
+      continue;
+    }
+    if (bvh.nodes.empty()) {
+      blases.bvh2_roots.push_back(blas_set_t::null_root);
+      blases.cwbvh_roots.push_back(blas_set_t::null_root);
+      continue;
+    }
+
+    const uint32_t node_base = blases.bvh2_nodes.size();
+    const uint32_t prim_base = blases.bvh2_prim_indices.size();
+    blases.bvh2_roots.push_back(node_base);
+    for (bvh::node_t node : bvh.nodes) {
+      node.first_index += node.is_leaf() ? prim_base : node_base;
+      blases.bvh2_nodes.push_back(node);
+    }
+    blases.bvh2_prim_indices.insert(blases.bvh2_prim_indices.end(),
+                                    bvh.prim_indices.begin(),
+                                    bvh.prim_indices.end());
+
+    const uint32_t wide_base     = blases.cwbvh_nodes.size();
+    const uint32_t triangle_base = blases.cwbvh_prim_indices.size();
+    blases.cwbvh_roots.push_back(wide_base);
+    for (cwbvh_node_t node : cwbvh.nodes) {
+      node.base_index_child += wide_base;
+      node.base_index_triangle += triangle_base;
+      blases.cwbvh_nodes.push_back(node);
+    }
+    blases.cwbvh_prim_indices.insert(blases.cwbvh_prim_indices.end(),
+                                     cwbvh.prim_indices.begin(),
+                                     cwbvh.prim_indices.end());
+  }
+
+  std::chrono::duration<float, std::milli> took =
+      std::chrono::steady_clock::now() - start;
+  horizon_info(
+      "blases: {} meshes, {} bvh2 nodes, {} cwbvh nodes, took {}ms",
+      meshes.size(), blases.bvh2_nodes.size(), blases.cwbvh_nodes.size(),
+      took.count());
+  return blases;
+}
+
+// frees a mesh's vertices and indices, returns the bytes they held
+static size_t release_geometry(model::raw_mesh_t& mesh) {
+  const size_t bytes = sizeof(mesh.vertices[0]) * mesh.vertices.capacity() +
+                       sizeof(mesh.indices[0]) * mesh.indices.capacity();
+  mesh.vertices.clear();
+  mesh.vertices.shrink_to_fit();
+  mesh.indices.clear();
+  mesh.indices.shrink_to_fit();
+  return bytes;
+}
+
+static std::vector<math::triangle_t> strip_mesh_indices(
+    const std::vector<triangle_t>& triangles) {
+  std::vector<math::triangle_t> stripped{};
+  stripped.reserve(triangles.size());
+  for (auto triangle : triangles) stripped.push_back(triangle.triangle);
+  return stripped;
+}
+
+// returns nullptr if caching is off or the cache does not match the meshes
+static core::ref<bvh_cache_t> find_bvh_cache(
+    const std::vector<model::raw_mesh_t>& meshes,
+    const bvh_build_config_t& config, const std::filesystem::path& cache_path,
+    uint64_t bvh_hash) {
+  if (!config.use_cache) return nullptr;
+  core::ref<bvh_cache_t> bvh_cache = load_bvh_cache(cache_path, bvh_hash);
+
+  uint32_t expected_triangles_count = 0;
+  for (const auto& raw_mesh : meshes)
+    expected_triangles_count += raw_mesh.indices.size() / 3;
+  if (bvh_cache && bvh_cache->triangles_count != expected_triangles_count) {
+    horizon_info("bvh cache {} does not match the scene, rebuilding",
+                 cache_path.string());
+    bvh_cache = nullptr;
+  }
+  if (bvh_cache) horizon_info("using bvh cache {}", cache_path.string());
+  return bvh_cache;
+}
+
+// the cluster file is reused if caching is on and it matches, otherwise it is
+// rebuilt, it is mapped either way since streaming pages from it
+static core::ref<cluster_file_t> prepare_clusters(
+    const std::vector<model::raw_mesh_t>& meshes,
+    const bvh_build_config_t&             config,
+    const triangle_quantization_t& quantization, load_progress_t& progress) {
+  const uint64_t              hash = hash_cluster_inputs(meshes, config);
+  const std::filesystem::path path = cluster_file_path(config, hash);
+  core::ref<cluster_file_t>   clusters;
+  if (config.use_cache) clusters = load_cluster_file(path, hash);
+  if (clusters) {
+    horizon_info("using cluster file {}", path.string());
+  } else {
+    const std::vector<triangle_t> triangles = flatten_triangles(
+        meshes, triangle_format_t::e_full, quantization, progress);
+    save_cluster_file(path, hash, meshes, triangles, config, progress);
+    clusters = load_cluster_file(path, hash);
+  }
+  horizon_assert(clusters != nullptr, "failed to map cluster file {}",
+                 path.string());
+  horizon_info(
+      "clusters: {}, at most {} triangles, {} vertices and {} nodes each, {} "
+      "bytes of pages",
+      clusters->clusters_count, clusters->max_triangles,
+      clusters->max_vertices, clusters->max_nodes, clusters->pages_size);
+  return clusters;
+}
+
+static void decode_images(std::vector<decoded_image_t>& images,
+                          load_progress_t&              progress) {
+  progress.begin(load_stage_t::e_textures, images.size());
+  job_system_t::global().parallel_for(
+      images.size(), 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+          decoded_image_t& image = images[i];
+          int              channels;
+          image.texels.reset(stbi_load(image.path.string().c_str(),
+                                       &image.width, &image.height, &channels,
+                                       STBI_rgb_alpha));
+          if (!image.texels)
+            horizon_info("failed to decode {}, using the default texture",
+                         image.path.string());
+          progress.done++;
+        }
+      });
+}
+
+// every image's dds file is reused if caching is on and it matches, nothing
+// is decoded then, otherwise the image is decoded, transcoded and dropped,
+// images that fail to decode keep the default texture
+static void prepare_compressed_textures(std::vector<decoded_image_t>& images,
+                                        const texture_config_t&       config,
+                                        load_progress_t& progress) {
+  auto start = std::chrono::steady_clock::now();
+  std::atomic<uint32_t> cached = 0, transcoded = 0;
+  progress.begin(load_stage_t::e_textures, images.size());
+  job_system_t::global().parallel_for(
+      images.size(), 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+          decoded_image_t& image = images[i];
+          const uint64_t   hash =
+              hash_compressed_texture_inputs(image.path, config.compression);
+          const std::filesystem::path path =
+              compressed_texture_path(config, hash);
+          if (config.use_cache)
+            image.compressed = load_compressed_texture(path, hash);
+          if (image.compressed) {
+            cached++;
+          } else {
+            int channels;
+            image.texels.reset(stbi_load(image.path.string().c_str(),
+                                         &image.width, &image.height,
+                                         &channels, STBI_rgb_alpha));
+            if (!image.texels) {
+              horizon_info("failed to decode {}, using the default texture",
+                           image.path.string());
+              progress.done++;
+              continue;
+            }
+            const texture_compression_t compression = choose_compression(
+                config.compression, image.texels.get(), image.width,
+                image.height);
+            save_compressed_texture(path, hash, image.texels.get(),
+                                    image.width, image.height, compression);
+            // the rgba8 texels are uploaded if the file could not be written
+            image.compressed = load_compressed_texture(path, hash);
+            if (image.compressed) image.texels.reset();
+            transcoded++;
+          }
+          if (image.compressed) {
+            image.width  = image.compressed->width;
+            image.height = image.compressed->height;
+          }
+          progress.done++;
+        }
+      });
+  std::chrono::duration<float, std::milli> took =
+      std::chrono::steady_clock::now() - start;
+  horizon_info(
+      "compressed textures: {} from the cache, {} transcoded, took {}ms",
+      cached.load(), transcoded.load(), took.count());
+}
+
+// the page file is reused if caching is on and it matches, nothing is decoded
+// then, otherwise the images are decoded, cut into pages and dropped, the
+// file is mapped either way since the texture streamer pages from it
+static core::ref<virtual_texture_file_t> prepare_virtual_textures(
+    std::vector<decoded_image_t>& images, const texture_config_t& config,
+    load_progress_t& progress) {
+  std::vector<std::filesystem::path> paths;
+  for (const auto& image : images) paths.push_back(image.path);
+  const uint64_t                    hash = hash_texture_inputs(paths);
+  const std::filesystem::path       path =
+      virtual_texture_file_path(config, hash);
+  core::ref<virtual_texture_file_t> file;
+  if (config.use_cache) file = load_virtual_texture_file(path, hash);
+  if (file) {
+    horizon_info("using page file {}", path.string());
+  } else {
+    decode_images(images, progress);
+    std::vector<texture_texels_t> textures;
+    for (const auto& image : images)
+      textures.push_back({image.texels.get(), uint32_t(image.width),
+                          uint32_t(image.height)});
+    save_virtual_texture_file(path, hash, textures, progress);
+    for (auto& image : images) image.texels.reset();
+    file = load_virtual_texture_file(path, hash);
+  }
+  horizon_assert(file != nullptr, "failed to map page file {}",
+                 path.string());
+  return file;
+}
+
+cpu_scene_t assets_manager_t::build_cpu_scene() {
+  const uint64_t bvh_hash = hash_bvh_inputs(loaded_meshes, bvh_build_config);
+  const std::filesystem::path cache_path =
+      bvh_cache_path(bvh_build_config, bvh_hash);
+  core::ref<bvh_cache_t> bvh_cache = find_bvh_cache(
+      loaded_meshes, bvh_build_config, cache_path, bvh_hash);
+
+  cpu_scene_t scene{};
+  if (bvh_cache) {
+    scene.triangles.assign(bvh_cache->triangles,
+                           bvh_cache->triangles + bvh_cache->triangles_count);
+    scene.bvh.nodes.assign(bvh_cache->nodes,
+                           bvh_cache->nodes + bvh_cache->nodes_count);
+    scene.bvh.prim_indices.assign(
+        bvh_cache->prim_indices,
+        bvh_cache->prim_indices + bvh_cache->prim_indices_count);
+    return scene;
+  }
+
+  scene.triangles = flatten_triangles(
+      loaded_meshes, bvh_build_config.triangle_format,
+      compute_triangle_quantization(loaded_meshes), progress);
+  progress.begin(load_stage_t::e_bvh, 0);
+  scene.bvh = build_bvh(strip_mesh_indices(scene.triangles), bvh_build_config,
+                        bvh_build_config.builder);
+  if (bvh_build_config.use_cache)
+    save_bvh_cache(cache_path, bvh_hash, scene.bvh, scene.triangles);
+  return scene;
+}
+
+renderer_data_t assets_manager_t::prepare(
+    core::ref<gfx::base_t> base, core::ref<gfx::context_t> context,
+    gfx::handle_bindless_image_t bdefault) {
+  fit_texture_config(*context);
+  prepare_cpu();
+  return upload(base, context, bdefault);
+}
+
+void assets_manager_t::fit_texture_config(gfx::context_t& context) {
+  if (texture_compression_supported(context, texture_config.compression))
+    return;
+  horizon_info(
+      "the device can not sample {} textures, uploading rgba8 instead",
+      texture_config.compression == texture_compression_t::e_bc1   ? "bc1"
+      : texture_config.compression == texture_compression_t::e_bc7 ? "bc7"
+                                                                   : "bc");
+  texture_config.compression = texture_compression_t::e_none;
+}
+
+void assets_manager_t::prepare_cpu() {
+  prepared                 = core::make_ref<prepared_assets_t>();
+  prepared_assets_t& scene = *prepared;
+
+  // meshes sharing a texture share the image
+  std::unordered_map<std::string, int32_t> image_indices;
+  for (const auto& raw_mesh : loaded_meshes) {
     auto diffuse_info = std::find_if(
         raw_mesh.material_description.texture_infos.begin(),
         raw_mesh.material_description.texture_infos.end(),
         [](model::texture_info_t info) -> bool {
           return info.texture_type == model::texture_type_t::e_diffuse_map;
         });
-    if (diffuse_info != raw_mesh.material_description.texture_infos.end()) {
-      cpu_mesh.diffuse = gfx::helper::load_image_from_path_instant(
-          *context, base->_command_pool, diffuse_info->file_path,
-          VK_FORMAT_R8G8B8A8_SRGB);
-      cpu_mesh.diffuse_view =
-          context->create_image_view({.handle_image = cpu_mesh.diffuse,
-                                      .debug_name   = diffuse_info->file_path});
-
-      material.bdiffuse = base->new_bindless_image();
-      base->set_bindless_image(material.bdiffuse, cpu_mesh.diffuse_view,
-                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    if (diffuse_info == raw_mesh.material_description.texture_infos.end()) {
+      scene.mesh_images.push_back(-1);
+      continue;
+    }
+    const std::filesystem::path path = diffuse_info->file_path;
+    auto [it, inserted] =
+        image_indices.try_emplace(path.string(), scene.images.size());
+    if (inserted) scene.images.emplace_back().path = path;
+    scene.mesh_images.push_back(it->second);
+  }
+
+  if (texture_config.virtual_textures)
+    scene.virtual_textures =
+        prepare_virtual_textures(scene.images, texture_config, progress);
+  else if (texture_config.compression != texture_compression_t::e_none)
+    prepare_compressed_textures(scene.images, texture_config, progress);
+  else
+    decode_images(scene.images, progress);
+
+  const triangle_format_t triangle_format = bvh_build_config.triangle_format;
+  scene.quantization = compute_triangle_quantization(loaded_meshes);
+  find_shared_geometry(loaded_meshes, scene.geometries, scene.transforms);
+  uint32_t geometries_count = 0;
+  for (uint32_t i = 0; i < loaded_meshes.size(); i++) {
+    const uint32_t count = loaded_meshes[i].indices.size() / 3;
+    scene.triangles_count += count;
+    if (scene.geometries[i] != i) continue;
+    scene.unique_triangles_count += count;
+    geometries_count++;
+  }
+  horizon_info(
+      "instancing: {} meshes share {} geometries, {} unique triangles, {} "
+      "instanced triangles",
+      loaded_meshes.size(), geometries_count, scene.unique_triangles_count,
+      scene.triangles_count);
+
+  // the clusters are cut from the meshes where they are placed, so rays
+  // still see a copy per instance when streaming, instances only share the
+  // rasterized vertices and indices then, otherwise the flat triangles hold
+  // each geometry once and the two level bvh places it
+  const bool instancing = geometries_count != loaded_meshes.size() &&
+                          !bvh_build_config.streaming;
+  if (bvh_build_config.streaming)
+    scene.clusters = prepare_clusters(loaded_meshes, bvh_build_config,
+                                      scene.quantization, progress);
+
+  scene.triangle_offsets.resize(loaded_meshes.size());
+  for (uint32_t i = 0; i < loaded_meshes.size(); i++) {
+    const uint32_t geometry = scene.geometries[i];
+    if (instancing && geometry != i) {
+      scene.triangle_offsets[i] = scene.triangle_offsets[geometry];
+      continue;
+    }
+    scene.triangle_offsets[i] = scene.flat_triangles_count;
+    scene.flat_triangles_count += loaded_meshes[i].indices.size() / 3;
+  }
+
+  // an instance's vertices only ever served to find its transform, every
+  // later step reads its owner's, so flattening sees an empty mesh for it
+  size_t released_bytes = 0;
+  for (uint32_t i = 0; i < loaded_meshes.size(); i++)
+    if (scene.geometries[i] != i)
+      released_bytes += release_geometry(loaded_meshes[i]);
+  if (released_bytes)
+    horizon_info("instancing: released {} bytes of instance geometry",
+                 released_bytes);
+
+  if (bvh_build_config.streaming) {
+    // the flat bvh is never built, rays walk the clusters instead
+  } else if (instancing) {
+    // a flat bvh would need every copy's triangles, only the blases are
+    // built and rays always go through the two level bvh
+    horizon_info("instancing: building blases instead of the flat bvh");
+    scene.triangles = flatten_triangles(loaded_meshes, triangle_format,
+                                        scene.quantization, progress);
+    horizon_assert(scene.triangles.size() == scene.flat_triangles_count,
+                   "expected {} triangles, got {}",
+                   scene.flat_triangles_count, scene.triangles.size());
+    scene.triangles_data = scene.triangles.data();
+    scene.blases = build_blases(loaded_meshes, scene.geometries,
+                                scene.triangles.data(), bvh_build_config,
+                                progress);
+  } else {
+    const uint64_t bvh_hash =
+        hash_bvh_inputs(loaded_meshes, bvh_build_config);
+    const std::filesystem::path cache_path =
+        bvh_cache_path(bvh_build_config, bvh_hash);
+    scene.bvh_cache =
+        find_bvh_cache(loaded_meshes, bvh_build_config, cache_path, bvh_hash);
+    if (scene.bvh_cache) {
+      scene.triangles_data     = scene.bvh_cache->triangles;
+      scene.nodes_data         = scene.bvh_cache->nodes;
+      scene.prim_index_data    = scene.bvh_cache->prim_indices;
+      scene.nodes_count        = scene.bvh_cache->nodes_count;
+      scene.prim_indices_count = scene.bvh_cache->prim_indices_count;
     } else {
-      material.bdiffuse = bdefault;
+      // the flattened triangles are part of the cache
+      scene.triangles = flatten_triangles(loaded_meshes, triangle_format,
+                                          scene.quantization, progress);
+      horizon_assert(scene.triangles.size() == scene.flat_triangles_count,
+                     "expected {} triangles, got {}",
+                     scene.flat_triangles_count, scene.triangles.size());
+
+      progress.begin(load_stage_t::e_bvh, 0);
+      const std::vector<math::triangle_t> tmp_triangles =
+          strip_mesh_indices(scene.triangles);
+
+      scene.bvh2 =
+          build_bvh(tmp_triangles, bvh_build_config, bvh_build_config.builder);
+
+      if (bvh_build_config.compare_builders) {
+        const bvh_builder_t other =
+            bvh_build_config.builder == bvh_builder_t::e_sweep_sah
+                ? bvh_builder_t::e_binned_sah_parallel
+                : bvh_builder_t::e_sweep_sah;
+        const float cost = bvh_sah_cost(scene.bvh2);
+        const float other_cost =
+            bvh_sah_cost(build_bvh(tmp_triangles, bvh_build_config, other));
+        horizon_info("{} sah cost is {}x of {}",
+                     to_string(bvh_build_config.builder), cost / other_cost,
+                     to_string(other));
+      }
+
+      if (bvh_build_config.use_cache)
+        save_bvh_cache(cache_path, bvh_hash, scene.bvh2, scene.triangles);
+
+      scene.triangles_data     = scene.triangles.data();
+      scene.nodes_data         = scene.bvh2.nodes.data();
+      scene.prim_index_data    = scene.bvh2.prim_indices.data();
+      scene.nodes_count        = scene.bvh2.nodes.size();
+      scene.prim_indices_count = scene.bvh2.prim_indices.size();
+    }
+
+    // collapsing is fast compared to the binary build, so it is not cached
+    scene.cwbvh = build_cwbvh(
+        reinterpret_cast<const bvh::node_t*>(scene.nodes_data),
+        reinterpret_cast<const uint32_t*>(scene.prim_index_data),
+        scene.prim_indices_count,
+        reinterpret_cast<const triangle_t*>(scene.triangles_data));
+    horizon_info("bvh2: {} nodes, {} bytes, cwbvh: {} nodes, {} bytes",
+                 scene.nodes_count, scene.nodes_count * sizeof(bvh::node_t),
+                 scene.cwbvh.nodes.size(),
+                 scene.cwbvh.nodes.size() * sizeof(cwbvh_node_t));
+
+    if (bvh_build_config.two_level)
+      scene.blases = build_blases(
+          loaded_meshes, scene.geometries,
+          reinterpret_cast<const triangle_t*>(scene.triangles_data),
+          bvh_build_config, progress);
+
+  }
+
+  for (triangle_format_t format :
+       {triangle_format_t::e_full, triangle_format_t::e_indexed,
+        triangle_format_t::e_quantized})
+    horizon_info("{} triangles: {} bytes{}", to_string(format),
+                 triangle_storage_size(loaded_meshes, format),
+                 format == triangle_format ? " (selected)" : "");
+
+  if (triangle_format != triangle_format_t::e_full)
+    scene.encoded =
+        encode_triangles(loaded_meshes, triangle_format, scene.quantization);
+
+  scene.meshlets.resize(loaded_meshes.size());
+  if (bvh_build_config.streaming) {
+    // nothing is rasterized and hits are shaded from the copies of the
+    // vertices in the cluster file, the meshes are never uploaded
+    released_bytes = 0;
+    for (model::raw_mesh_t& mesh : loaded_meshes)
+      released_bytes += release_geometry(mesh);
+    horizon_info("streaming: released {} bytes of mesh geometry",
+                 released_bytes);
+    return;
+  }
+
+  progress.begin(load_stage_t::e_meshlets, loaded_meshes.size());
+  job_system_t::global().parallel_for(
+      loaded_meshes.size(), 16, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+          if (scene.geometries[i] == i)
+            scene.meshlets[i] = build_meshlets(loaded_meshes[i], i);
+          progress.done++;
+        }
+      });
+  size_t meshlets_count = 0, meshlet_triangles = 0;
+  for (const auto& mesh_meshlets : scene.meshlets) {
+    meshlets_count += mesh_meshlets.meshlets.size();
+    meshlet_triangles += mesh_meshlets.triangles.size();
+  }
+  horizon_info(
+      "meshlets: {}, {} triangles per meshlet", meshlets_count,
+      meshlets_count ? float(meshlet_triangles) / meshlets_count : 0.f);
+}
+
+// mesh data is packed into blocks of at most this size, see buffer_arena_t
+static constexpr VkDeviceSize mesh_arena_block_size = 256 * 1024 * 1024;
+// vertex ranges are aligned to this, index and meshlet ranges to uint32_t
+static constexpr VkDeviceSize vertex_alignment = 16;
+
+static VkDeviceSize align_up(VkDeviceSize size, VkDeviceSize alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+// what the driver rounds the memory of a buffer with these usages up to, a
+// dedicated allocation vma makes for a buffer is its size aligned to this
+static VkDeviceSize buffer_memory_alignment(gfx::context_t&     context,
+                                            VkBufferUsageFlags usage) {
+  VkBufferCreateInfo vk_buffer_create_info{};
+  vk_buffer_create_info.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  vk_buffer_create_info.size        = 1;
+  vk_buffer_create_info.usage       = usage;
+  vk_buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VkBuffer vk_buffer;
+  check(vkCreateBuffer(vk_device(context), &vk_buffer_create_info, nullptr,
+                       &vk_buffer) == VK_SUCCESS,
+        "failed to create a buffer to query its memory requirements");
+  VkMemoryRequirements vk_memory_requirements;
+  vkGetBufferMemoryRequirements(vk_device(context), vk_buffer,
+                                &vk_memory_requirements);
+  vkDestroyBuffer(vk_device(context), vk_buffer, nullptr);
+  return vk_memory_requirements.alignment;
+}
+
+renderer_data_t assets_manager_t::upload(
+    core::ref<gfx::base_t> base, core::ref<gfx::context_t> context,
+    gfx::handle_bindless_image_t bdefault) {
+  horizon_assert(prepared != nullptr, "prepare_cpu has to run before upload");
+  const prepared_assets_t& scene = *prepared;
+  progress.begin(load_stage_t::e_upload, 0);
+  auto start = std::chrono::steady_clock::now();
+
+  upload_batch_t batch{context, base};
+
+  std::vector<gfx::handle_image_t>          images;
+  std::vector<gfx::handle_image_view_t>     image_views;
+  std::vector<gfx::handle_bindless_image_t> bimages;
+  VkDeviceSize texture_bytes = 0, uncompressed_texture_bytes = 0;
+  for (const auto& image : scene.images) {
+    if (image.compressed) {
+      const compressed_texture_t& compressed = *image.compressed;
+      gfx::config_image_t         ci{};
+      ci.vk_width  = compressed.width;
+      ci.vk_height = compressed.height;
+      ci.vk_depth  = 1;
+      ci.vk_type   = VK_IMAGE_TYPE_2D;
+      ci.vk_mips   = compressed.mips_count;
+      ci.vk_format = compressed.format;
+      ci.vk_usage  = VK_IMAGE_USAGE_SAMPLED_BIT;
+      ci.vma_allocation_create_flags =
+          VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+      ci.debug_name = image.path.string();
+      images.push_back(
+          batch.create_image(ci, compressed.data, compressed.size));
+      image_views.push_back(context->create_image_view(
+          {.handle_image = images.back(), .debug_name = image.path.string()}));
+      bimages.push_back(base->new_bindless_image());
+      base->set_bindless_image(bimages.back(), image_views.back(),
+                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+      texture_bytes += compressed.size;
+      uncompressed_texture_bytes +=
+          VkDeviceSize(compressed.width) * compressed.height * 4;
+      continue;
+    }
+    if (!image.texels) {
+      images.push_back(core::null_handle);
+      image_views.push_back(core::null_handle);
+      bimages.push_back(bdefault);
+      continue;
     }
+    gfx::config_image_t ci{};
+    ci.vk_width  = image.width;
+    ci.vk_height = image.height;
+    ci.vk_depth  = 1;
+    ci.vk_type   = VK_IMAGE_TYPE_2D;
+    ci.vk_mips   = 1;
+    ci.vk_format = VK_FORMAT_R8G8B8A8_SRGB;
+    ci.vk_usage  = VK_IMAGE_USAGE_SAMPLED_BIT;
+    ci.vma_allocation_create_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+    ci.debug_name                  = image.path.string();
+    images.push_back(batch.create_image(
+        ci, image.texels.get(), size_t(image.width) * image.height * 4));
+    texture_bytes += VkDeviceSize(image.width) * image.height * 4;
+    uncompressed_texture_bytes += VkDeviceSize(image.width) * image.height * 4;
+    image_views.push_back(context->create_image_view(
+        {.handle_image = images.back(), .debug_name = image.path.string()}));
+    bimages.push_back(base->new_bindless_image());
+    base->set_bindless_image(bimages.back(), image_views.back(),
+                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  }
+
+  std::vector<material_t> materials;
+  std::vector<cpu_mesh_t> cpu_meshes;
+  std::vector<gpu_mesh_t>     gpu_meshes;
+  std::vector<draw_command_t> draw_commands;
+  std::vector<mesh_bounds_t>  mesh_bounds;
+  std::vector<meshlet_t>      meshlets;
+  uint32_t                    meshlet_instances_count = 0;
 
-    auto raw_triangles = model::create_triangles_from_mesh(raw_mesh);
-    for (auto triangle : raw_triangles)
-      triangles.emplace_back(triangle, mesh_index);
+  // the arenas are sized from what the meshes need, a scene smaller than a
+  // block gets a single block of exactly its size
+  VkDeviceSize vertex_bytes = 0, index_bytes = 0;
+  for (uint32_t mesh_index = 0; mesh_index < loaded_meshes.size();
+       mesh_index++) {
+    if (scene.geometries[mesh_index] != mesh_index) continue;
+    const auto& raw_mesh      = loaded_meshes[mesh_index];
+    const auto& mesh_meshlets = scene.meshlets[mesh_index];
+    vertex_bytes += align_up(
+        sizeof(raw_mesh.vertices[0]) * raw_mesh.vertices.size(),
+        vertex_alignment);
+    index_bytes += sizeof(uint32_t) * (raw_mesh.indices.size() +
+                                       mesh_meshlets.vertices.size() +
+                                       mesh_meshlets.triangles.size());
+  }
+  const VkDeviceSize memory_before = allocated_device_memory(*context);
+
+  // a handful of large buffers instead of three allocations per mesh
+  gfx::config_buffer_t arena_config{};
+  arena_config.vk_size               = mesh_arena_block_size;
+  arena_config.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                       VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  arena_config.vma_allocation_create_flags =
+      VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+  buffer_arena_t vertex_arena{context, arena_config, vertex_bytes};
+  buffer_arena_t index_arena{context, arena_config, index_bytes};
+  // transforms stay host visible so they can be animated in place
+  arena_config.vk_size = sizeof(math::mat4) * 4096;
+  arena_config.vma_allocation_create_flags =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+  buffer_arena_t transform_arena{context, arena_config,
+                                 sizeof(math::mat4) * loaded_meshes.size()};
+
+  for (uint32_t mesh_index = 0; mesh_index < loaded_meshes.size();
+       mesh_index++) {
+    const auto& raw_mesh     = loaded_meshes[mesh_index];
+    const uint32_t geometry  = scene.geometries[mesh_index];
+    cpu_mesh_t& cpu_mesh     = cpu_meshes.emplace_back();
+    cpu_mesh.vertex_count    = raw_mesh.vertices.size();
+    cpu_mesh.index_count     = raw_mesh.indices.size();
+    cpu_mesh.triangle_offset = scene.triangle_offsets[mesh_index];
 
     gpu_mesh_t& gpu_mesh = gpu_meshes.emplace_back();
-    gpu_mesh.vertices    = gfx::to<model::vertex_t*>(
-        context->get_buffer_device_address(cpu_mesh.vertex_buffer));
-    gpu_mesh.indices = gfx::to<uint32_t*>(
-        context->get_buffer_device_address(cpu_mesh.index_buffer));
-    gpu_mesh.transform = gfx::to<math::mat4*>(
-        context->get_buffer_device_address(cpu_mesh.transform));
+    if (scene.clusters) {
+      // prepare_cpu released the vertices, hits are shaded from the cluster
+      // pages and nothing is rasterized
+    } else if (geometry != mesh_index) {
+      // an instance reuses the buffers and meshlets its geometry's owner
+      // uploaded, prepare_cpu released its own vertices and indices, only
+      // the transform and material are its own
+      const cpu_mesh_t& owner     = cpu_meshes[geometry];
+      const gpu_mesh_t& gpu_owner = gpu_meshes[geometry];
+      cpu_mesh.vertex_count       = owner.vertex_count;
+      cpu_mesh.index_count        = owner.index_count;
+      cpu_mesh.vertex_buffer      = owner.vertex_buffer;
+      cpu_mesh.vertex_offset      = owner.vertex_offset;
+      cpu_mesh.index_buffer       = owner.index_buffer;
+      cpu_mesh.index_offset       = owner.index_offset;
+      cpu_mesh.meshlet_offset     = owner.meshlet_offset;
+      cpu_mesh.meshlet_count      = owner.meshlet_count;
+      cpu_mesh.bounds             = owner.bounds;
+      gpu_mesh.vertices           = gpu_owner.vertices;
+      gpu_mesh.indices            = gpu_owner.indices;
+      gpu_mesh.meshlet_vertices   = gpu_owner.meshlet_vertices;
+      gpu_mesh.meshlet_triangles  = gpu_owner.meshlet_triangles;
+    } else {
+      const size_t vertices_size =
+          sizeof(raw_mesh.vertices[0]) * raw_mesh.vertices.size();
+      const buffer_arena_t::allocation_t vertices =
+          vertex_arena.allocate(vertices_size, vertex_alignment);
+      batch.upload_buffer(vertices.buffer, vertices.offset,
+                          raw_mesh.vertices.data(), vertices_size);
+      cpu_mesh.vertex_buffer = vertices.buffer;
+      cpu_mesh.vertex_offset = vertices.offset;
+
+      const size_t indices_size =
+          sizeof(raw_mesh.indices[0]) * raw_mesh.indices.size();
+      const buffer_arena_t::allocation_t indices =
+          index_arena.allocate(indices_size, sizeof(uint32_t));
+      batch.upload_buffer(indices.buffer, indices.offset,
+                          raw_mesh.indices.data(), indices_size);
+      cpu_mesh.index_buffer = indices.buffer;
+      cpu_mesh.index_offset = indices.offset;
+
+      // meshlet vertices and triangles are uint32_t like the indices
+      const mesh_meshlets_t& mesh_meshlets = scene.meshlets[mesh_index];
+      const size_t           meshlet_vertices_size =
+          sizeof(uint32_t) * mesh_meshlets.vertices.size();
+      const buffer_arena_t::allocation_t meshlet_vertices =
+          index_arena.allocate(meshlet_vertices_size, sizeof(uint32_t));
+      batch.upload_buffer(meshlet_vertices.buffer, meshlet_vertices.offset,
+                          mesh_meshlets.vertices.data(), meshlet_vertices_size);
+      const size_t meshlet_triangles_size =
+          sizeof(uint32_t) * mesh_meshlets.triangles.size();
+      const buffer_arena_t::allocation_t meshlet_triangles =
+          index_arena.allocate(meshlet_triangles_size, sizeof(uint32_t));
+      batch.upload_buffer(meshlet_triangles.buffer, meshlet_triangles.offset,
+                          mesh_meshlets.triangles.data(),
+                          meshlet_triangles_size);
+      cpu_mesh.meshlet_offset = meshlets.size();
+      cpu_mesh.meshlet_count  = mesh_meshlets.meshlets.size();
+      meshlets.insert(meshlets.end(), mesh_meshlets.meshlets.begin(),
+                      mesh_meshlets.meshlets.end());
+
+      gpu_mesh.vertices = gfx::to<model::vertex_t*>(vertices.address);
+      gpu_mesh.indices  = gfx::to<uint32_t*>(indices.address);
+      gpu_mesh.meshlet_vertices =
+          gfx::to<uint32_t*>(meshlet_vertices.address);
+      gpu_mesh.meshlet_triangles =
+          gfx::to<uint32_t*>(meshlet_triangles.address);
+
+      cpu_mesh.bounds.min = math::vec3{std::numeric_limits<float>::max()};
+      cpu_mesh.bounds.max = math::vec3{-std::numeric_limits<float>::max()};
+      for (const auto& vertex : raw_mesh.vertices) {
+        cpu_mesh.bounds.min = math::min(cpu_mesh.bounds.min, vertex.position);
+        cpu_mesh.bounds.max = math::max(cpu_mesh.bounds.max, vertex.position);
+      }
+    }
+
+    const buffer_arena_t::allocation_t transform =
+        transform_arena.allocate(sizeof(math::mat4), 16);
+    uint8_t* transforms =
+        reinterpret_cast<uint8_t*>(context->map_buffer(transform.buffer));
+    *reinterpret_cast<math::mat4*>(transforms + transform.offset) =
+        scene.transforms[mesh_index];
+    cpu_mesh.transform        = transform.buffer;
+    cpu_mesh.transform_offset = transform.offset;
+
+    // cpu_mesh.material_index = materials.size();
+    material_t&   material    = materials.emplace_back();
+    const int32_t image_index = scene.mesh_images[mesh_index];
+    material.bdiffuse         = bdefault;
+    material.texture          = uint32_t(-1);
+    if (image_index != -1 && scene.virtual_textures) {
+      if (scene.virtual_textures->textures[image_index].width != 0)
+        material.texture = image_index;
+    } else if (image_index != -1) {
+      cpu_mesh.diffuse      = images[image_index];
+      cpu_mesh.diffuse_view = image_views[image_index];
+      material.bdiffuse     = bimages[image_index];
+    }
+
+    gpu_mesh.transform       = gfx::to<math::mat4*>(transform.address);
     gpu_mesh.vertex_count    = cpu_mesh.vertex_count;
     gpu_mesh.index_count     = cpu_mesh.index_count;
     gpu_mesh.triangle_offset = cpu_mesh.triangle_offset;
+    gpu_mesh.meshlet_offset  = cpu_mesh.meshlet_offset;
+    gpu_mesh.meshlet_count   = cpu_mesh.meshlet_count;
+    gpu_mesh.padding         = 0;
+    meshlet_instances_count += cpu_mesh.meshlet_count;
+
+    draw_command_t& draw_command        = draw_commands.emplace_back();
+    draw_command.command.vertexCount   = cpu_mesh.index_count;
+    draw_command.command.instanceCount = 1;
+    draw_command.command.firstVertex   = 0;
+    draw_command.command.firstInstance = 0;
+    draw_command.mesh_index            = mesh_index;
+
+    mesh_bounds.push_back(cpu_mesh.bounds);
+    cpu_mesh.bvh2_root  = blas_set_t::null_root;
+    cpu_mesh.cwbvh_root = blas_set_t::null_root;
+    if (!scene.blases.bvh2_roots.empty()) {
+      cpu_mesh.bvh2_root  = scene.blases.bvh2_roots[mesh_index];
+      cpu_mesh.cwbvh_root = scene.blases.cwbvh_roots[mesh_index];
+    }
+  }
+
+  // the arenas are measured from vma's heap statistics, the per mesh layout
+  // they replace gave every mesh a dedicated vertex, index, transform,
+  // meshlet vertex and meshlet triangle buffer, each its size aligned the
+  // way the driver aligns a dedicated allocation, streamed scenes only have
+  // transforms in them
+  if (!scene.clusters) {
+    const size_t arena_allocations = vertex_arena.blocks.size() +
+                                     index_arena.blocks.size() +
+                                     transform_arena.blocks.size();
+    const VkDeviceSize arena_bytes = vertex_arena.used_bytes +
+                                     index_arena.used_bytes +
+                                     transform_arena.used_bytes;
+    const VkDeviceSize per_mesh_alignment = buffer_memory_alignment(
+        *context, arena_config.vk_buffer_usage_flags |
+                      VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+    VkDeviceSize per_mesh_bytes = 0;
+    for (uint32_t mesh_index = 0; mesh_index < cpu_meshes.size();
+         mesh_index++) {
+      const cpu_mesh_t&      cpu_mesh = cpu_meshes[mesh_index];
+      const mesh_meshlets_t& mesh_meshlets =
+          scene.meshlets[scene.geometries[mesh_index]];
+      for (const VkDeviceSize size :
+           {VkDeviceSize(sizeof(model::vertex_t)) * cpu_mesh.vertex_count,
+            VkDeviceSize(sizeof(uint32_t)) * cpu_mesh.index_count,
+            VkDeviceSize(sizeof(math::mat4)),
+            VkDeviceSize(sizeof(uint32_t)) * mesh_meshlets.vertices.size(),
+            VkDeviceSize(sizeof(uint32_t)) * mesh_meshlets.triangles.size()})
+        per_mesh_bytes += align_up(size, per_mesh_alignment);
+    }
+    horizon_info(
+        "mesh buffers: {} allocations holding {} bytes take {} bytes of "
+        "device memory, per mesh buffers would take {} allocations and {} "
+        "bytes",
+        arena_allocations, arena_bytes,
+        allocated_device_memory(*context) - memory_before,
+        cpu_meshes.size() * 5, per_mesh_bytes);
   }
 
-  gfx::handle_buffer_t triangles_buffer;
-  gfx::handle_buffer_t bvh2_nodes;
-  gfx::handle_buffer_t bvh2_prim_indices;
+  gfx::handle_buffer_t triangles_buffer      = core::null_handle;
+  gfx::handle_buffer_t triangle_positions    = core::null_handle;
+  gfx::handle_buffer_t triangle_indices      = core::null_handle;
+  gfx::handle_buffer_t triangle_mesh_indices = core::null_handle;
+  gfx::handle_buffer_t triangle_storage;
+  gfx::handle_buffer_t bvh2_nodes              = core::null_handle;
+  gfx::handle_buffer_t bvh2_prim_indices       = core::null_handle;
+  gfx::handle_buffer_t cwbvh_nodes             = core::null_handle;
+  gfx::handle_buffer_t cwbvh_prim_indices      = core::null_handle;
   gfx::handle_buffer_t materials_buffer;
   gfx::handle_buffer_t meshes_buffer;
+  gfx::handle_buffer_t draw_commands_buffer;
+  gfx::handle_buffer_t mesh_bounds_buffer;
+  gfx::handle_buffer_t meshlets_buffer         = core::null_handle;
+  gfx::handle_buffer_t blas_bvh2_nodes         = core::null_handle;
+  gfx::handle_buffer_t blas_bvh2_prim_indices  = core::null_handle;
+  gfx::handle_buffer_t blas_cwbvh_nodes        = core::null_handle;
+  gfx::handle_buffer_t blas_cwbvh_prim_indices = core::null_handle;
+
+  const triangle_format_t triangle_format = bvh_build_config.triangle_format;
 
   gfx::config_buffer_t cb{};
   cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  cb.vma_allocation_create_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+  triangle_storage_t storage{};
+  storage.format             = static_cast<uint32_t>(triangle_format);
+  storage.quantization_min   = scene.quantization.min;
+  storage.quantization_scale = scene.quantization.scale;
+  if (scene.clusters) {
+    // the streamer pages the clusters' triangles in, see geometry_streamer_t
+  } else if (triangle_format == triangle_format_t::e_full) {
+    cb.vk_size        = sizeof(triangle_t) * scene.flat_triangles_count;
+    triangles_buffer  = batch.create_buffer(cb, scene.triangles_data);
+    storage.triangles = gfx::to<triangle_t*>(
+        context->get_buffer_device_address(triangles_buffer));
+  } else {
+    const encoded_triangles_t& encoded = scene.encoded;
+    if (triangle_format == triangle_format_t::e_indexed) {
+      cb.vk_size         = sizeof(math::vec3) * encoded.positions.size();
+      triangle_positions = batch.create_buffer(cb, encoded.positions.data());
+      storage.positions  = gfx::to<math::vec3*>(
+          context->get_buffer_device_address(triangle_positions));
+    } else {
+      cb.vk_size = sizeof(uint32_t) * encoded.quantized_positions.size();
+      triangle_positions =
+          batch.create_buffer(cb, encoded.quantized_positions.data());
+      storage.quantized_positions = gfx::to<uint32_t*>(
+          context->get_buffer_device_address(triangle_positions));
+    }
+    cb.vk_size       = sizeof(uint32_t) * encoded.indices.size();
+    triangle_indices = batch.create_buffer(cb, encoded.indices.data());
+    storage.indices  = gfx::to<uint32_t*>(
+        context->get_buffer_device_address(triangle_indices));
+    cb.vk_size            = sizeof(uint32_t) * encoded.mesh_indices.size();
+    triangle_mesh_indices =
+        batch.create_buffer(cb, encoded.mesh_indices.data());
+    storage.mesh_indices = gfx::to<uint32_t*>(
+        context->get_buffer_device_address(triangle_mesh_indices));
+  }
   {
-    cb.vk_size                     = sizeof(triangles[0]) * triangles.size();
-    cb.vma_allocation_create_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
-    triangles_buffer               = gfx::helper::create_buffer_staged(
-        *context, base->_command_pool, cb, triangles.data(), cb.vk_size);
+    cb.vk_size       = sizeof(triangle_storage_t);
+    triangle_storage = batch.create_buffer(cb, &storage);
   }
+  // instanced scenes only have the blases
+  if (scene.nodes_count != 0) {
+    cb.vk_size = sizeof(bvh::node_t) * scene.nodes_count;
+    bvh2_nodes = batch.create_buffer(cb, scene.nodes_data);
 
-  std::vector<math::triangle_t> tmp_triangles{};
-  for (auto triangle : triangles) tmp_triangles.push_back(triangle.triangle);
+    cb.vk_size        = sizeof(uint32_t) * scene.prim_indices_count;
+    bvh2_prim_indices = batch.create_buffer(cb, scene.prim_index_data);
 
-  auto [aabbs, tri_indices] = bvh::presplit(tmp_triangles, 0.3);
-  // auto aabbs = math::aabbs_from_triangles(tmp_triangles);
-
-  bvh::bvh_t bvh2 = bvh::build_bvh_sweep_sah(aabbs);
-  bvh::presplit_remove_indirection(bvh2, tri_indices);
-  bvh::presplit_remove_duplicates(bvh2);
+    cb.vk_size  = sizeof(cwbvh_node_t) * scene.cwbvh.nodes.size();
+    cwbvh_nodes = batch.create_buffer(cb, scene.cwbvh.nodes.data());
 
+    cb.vk_size = sizeof(uint32_t) * scene.cwbvh.prim_indices.size();
+    cwbvh_prim_indices =
+        batch.create_buffer(cb, scene.cwbvh.prim_indices.data());
+  }
   {
-    cb.vk_size                     = sizeof(bvh2.nodes[0]) * bvh2.nodes.size();
-    cb.vma_allocation_create_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
-    bvh2_nodes                     = gfx::helper::create_buffer_staged(
-        *context, base->_command_pool, cb, bvh2.nodes.data(), cb.vk_size);
+    cb.vk_size       = sizeof(materials[0]) * materials.size();
+    materials_buffer = batch.create_buffer(cb, materials.data());
   }
   {
-    cb.vk_size = sizeof(bvh2.prim_indices[0]) * bvh2.prim_indices.size();
-    cb.vma_allocation_create_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
-    bvh2_prim_indices =
-        gfx::helper::create_buffer_staged(*context, base->_command_pool, cb,
-                                          bvh2.prim_indices.data(), cb.vk_size);
+    cb.vk_size    = sizeof(gpu_meshes[0]) * gpu_meshes.size();
+    meshes_buffer = batch.create_buffer(cb, gpu_meshes.data());
   }
-
   {
-    cb.vk_size                     = sizeof(materials[0]) * materials.size();
-    cb.vma_allocation_create_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
-    materials_buffer               = gfx::helper::create_buffer_staged(
-        *context, base->_command_pool, cb, materials.data(), cb.vk_size);
+    cb.vk_size           = sizeof(draw_commands[0]) * draw_commands.size();
+    draw_commands_buffer = batch.create_buffer(cb, draw_commands.data());
   }
   {
-    cb.vk_size                     = sizeof(gpu_meshes[0]) * gpu_meshes.size();
-    cb.vma_allocation_create_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
-    meshes_buffer                  = gfx::helper::create_buffer_staged(
-        *context, base->_command_pool, cb, gpu_meshes.data(), cb.vk_size);
+    cb.vk_size         = sizeof(mesh_bounds[0]) * mesh_bounds.size();
+    mesh_bounds_buffer = batch.create_buffer(cb, mesh_bounds.data());
   }
+  // streamed scenes have no meshlets
+  if (!meshlets.empty()) {
+    cb.vk_size      = sizeof(meshlets[0]) * meshlets.size();
+    meshlets_buffer = batch.create_buffer(cb, meshlets.data());
+  }
+  if (!scene.blases.bvh2_nodes.empty()) {
+    const blas_set_t& blases = scene.blases;
+    cb.vk_size = sizeof(bvh::node_t) * blases.bvh2_nodes.size();
+    blas_bvh2_nodes = batch.create_buffer(cb, blases.bvh2_nodes.data());
+    cb.vk_size = sizeof(uint32_t) * blases.bvh2_prim_indices.size();
+    blas_bvh2_prim_indices =
+        batch.create_buffer(cb, blases.bvh2_prim_indices.data());
+    cb.vk_size = sizeof(cwbvh_node_t) * blases.cwbvh_nodes.size();
+    blas_cwbvh_nodes = batch.create_buffer(cb, blases.cwbvh_nodes.data());
+    cb.vk_size = sizeof(uint32_t) * blases.cwbvh_prim_indices.size();
+    blas_cwbvh_prim_indices =
+        batch.create_buffer(cb, blases.cwbvh_prim_indices.data());
+  }
+
+  // every source above has to stay alive until here
+  batch.submit();
+  std::chrono::duration<float, std::milli> took =
+      std::chrono::steady_clock::now() - start;
+  horizon_info("uploaded {} bytes in {} submissions, took {}ms",
+               batch.uploaded_bytes, batch.submissions, took.count());
+  if (uncompressed_texture_bytes != texture_bytes)
+    horizon_info("textures take {} bytes with their mips instead of {} as "
+                 "rgba8 without, {} saved",
+                 texture_bytes, uncompressed_texture_bytes,
+                 int64_t(uncompressed_texture_bytes - texture_bytes));
+
+  // scene goes away with prepared
+  const uint32_t triangles_count        = scene.triangles_count;
+  const uint32_t unique_triangles_count = scene.unique_triangles_count;
+  core::ref<cluster_file_t>         clusters = scene.clusters;
+  core::ref<virtual_texture_file_t> virtual_textures =
+      scene.virtual_textures;
+  prepared = nullptr;
+  progress.begin(load_stage_t::e_done, 0);
+
   return {
       triangles_buffer,
+      triangle_positions,
+      triangle_indices,
+      triangle_mesh_indices,
+      triangle_storage,
       bvh2_nodes,
       bvh2_prim_indices,
+      cwbvh_nodes,
+      cwbvh_prim_indices,
       materials_buffer,
       meshes_buffer,
+      draw_commands_buffer,
+      mesh_bounds_buffer,
+      meshlets_buffer,
+      blas_bvh2_nodes,
+      blas_bvh2_prim_indices,
+      blas_cwbvh_nodes,
+      blas_cwbvh_prim_indices,
       cpu_meshes,
       (uint32_t)materials.size(),
       (uint32_t)gpu_meshes.size(),
-      (uint32_t)triangles.size(),
+      triangles_count,
+      (uint32_t)meshlets.size(),
+      unique_triangles_count,
+      meshlet_instances_count,
+      texture_bytes,
+      uncompressed_texture_bytes,
+      clusters,
+      virtual_textures,
   };
 }
@@ -4,9 +4,11 @@
 #define VK_NO_PROTOTYPES
 #include <vulkan/vulkan_core.h>
 
+#include <atomic>
 #include <filesystem>
 #include <vector>
 
+#include "bvh/bvh.hpp"
 #include "horizon/core/core.hpp"
 #include "horizon/gfx/base.hpp"
 #include "horizon/gfx/context.hpp"
@@ -14,62 +16,292 @@
 #include "math/triangle.hpp"
 #include "model/model.hpp"
 
+// bdiffuse is the default texture for virtual textured materials, texture is
+// the diffuse texture's index into the page file then, -1 otherwise
 struct material_t {
   gfx::handle_bindless_image_t bdiffuse;
+  uint32_t                     texture;
 };
 
+// object space bounds of a mesh, culling transforms them by the mesh transform
+struct mesh_bounds_t {
+  math::vec3 min;
+  math::vec3 max;
+};
+
+// vertices, indices and transforms are ranges of pooled buffers shared by
+// many meshes, the offsets are in bytes, meshes that are rigidly moved copies
+// of each other are instances of the first of them and share its vertices,
+// indices, meshlets and blas, their transform places them
 struct cpu_mesh_t {
   gfx::handle_buffer_t vertex_buffer;
+  VkDeviceSize         vertex_offset;
   gfx::handle_buffer_t index_buffer;
+  VkDeviceSize         index_offset;
 
   uint32_t vertex_count;
   uint32_t index_count;
 
   gfx::handle_buffer_t transform;
+  VkDeviceSize         transform_offset;
 
   uint32_t triangle_offset;
+  // range of the mesh's meshlets in renderer_data_t::meshlets_buffer
+  uint32_t meshlet_offset;
+  uint32_t meshlet_count;
+
+  mesh_bounds_t bounds;
+  // roots of the mesh's blas in renderer_data_t's blas buffers, only set if
+  // the two level bvh was built
+  uint32_t      bvh2_root;
+  uint32_t      cwbvh_root;
 
   gfx::handle_image_t      diffuse;
   gfx::handle_image_view_t diffuse_view;
 };
 
+// pointers into the pooled buffers with the mesh's offsets applied, see
+// meshlet_t for the meshlet vertices and triangles
 struct gpu_mesh_t {
   model::vertex_t *vertices;
   uint32_t        *indices;
   math::mat4      *transform;
+  uint32_t        *meshlet_vertices;
+  uint32_t        *meshlet_triangles;
   uint32_t         vertex_count;
   uint32_t         index_count;
   uint32_t         triangle_offset;
+  uint32_t         meshlet_offset;
+  uint32_t         meshlet_count;
   uint32_t         padding;
 };
+static_assert(sizeof(gpu_mesh_t) == 64, "sizeof(gpu_mesh_t) should be 64");
+
+// one indirect draw per mesh, the record doubles as per draw data, the
+// vertex shader reads mesh_index from it through SV_DrawIndex, culling copies
+// the visible ones into a compacted list
+struct draw_command_t {
+  VkDrawIndirectCommand command;
+  uint32_t              mesh_index;
+};
+static_assert(sizeof(draw_command_t) == 20,
+              "sizeof(draw_command_t) should be 20");
+
+// draw_command_t for the mesh shader path, a task workgroup culls 32 of the
+// mesh's meshlets
+struct task_command_t {
+  VkDrawMeshTasksIndirectCommandEXT command;
+  uint32_t                          mesh_index;
+};
+static_assert(sizeof(task_command_t) == 16,
+              "sizeof(task_command_t) should be 16");
+
+// a visible meshlet drawn by the compute fallback, 3 vertices per triangle,
+// mesh_index is the draw's, meshlets are shared by every instance of a mesh
+struct meshlet_draw_t {
+  VkDrawIndirectCommand command;
+  uint32_t              meshlet_index;
+  uint32_t              mesh_index;
+};
+static_assert(sizeof(meshlet_draw_t) == 24,
+              "sizeof(meshlet_draw_t) should be 24");
 
-// // TODO: experiment with more efficient triangle data formats for
 struct triangle_t {
   math::triangle_t triangle;
   uint32_t         mesh_index;
 };
 static_assert(sizeof(triangle_t) == 40, "sizeof(triangle_t) should be 40");
 
+enum class triangle_format_t : uint32_t {
+  // triangle_t, 40 bytes per triangle
+  e_full,
+  // float3 vertex pool + uint3 indices + mesh index, vertices are shared
+  e_indexed,
+  // e_indexed with vertices quantized to 3 x uint16 over the scene bounds
+  e_quantized,
+};
+
+// how the gpu reads triangles, only the arrays of the selected format are set
+struct triangle_storage_t {
+  triangle_t *triangles;
+  math::vec3 *positions;
+  uint32_t   *quantized_positions;
+  uint32_t   *indices;
+  uint32_t   *mesh_indices;
+  math::vec3  quantization_min;
+  math::vec3  quantization_scale;
+  uint32_t    format;
+  uint32_t    padding;
+};
+static_assert(sizeof(triangle_storage_t) == 72,
+              "sizeof(triangle_storage_t) should be 72");
+
+// memory mapped clusters of the scene, see streaming.hpp
+struct cluster_file_t;
+// memory mapped texture pages of the scene, see virtual_texture.hpp
+struct virtual_texture_file_t;
+
 struct renderer_data_t {
   gfx::handle_buffer_t triangles_buffer;
+  gfx::handle_buffer_t triangle_positions;
+  gfx::handle_buffer_t triangle_indices;
+  gfx::handle_buffer_t triangle_mesh_indices;
+  // holds a triangle_storage_t
+  gfx::handle_buffer_t triangle_storage;
+  // the flat bvh, null if meshes are instanced, see blas_bvh2_nodes
   gfx::handle_buffer_t bvh2_nodes;
   gfx::handle_buffer_t bvh2_prim_indices;
+  gfx::handle_buffer_t cwbvh_nodes;
+  gfx::handle_buffer_t cwbvh_prim_indices;
   gfx::handle_buffer_t materials_buffer;
   gfx::handle_buffer_t meshes_buffer;
+  // draw_command_t per mesh built once on upload, culling compacts it
+  gfx::handle_buffer_t draw_commands;
+  gfx::handle_buffer_t mesh_bounds;
+  // meshlet_t of every mesh, in mesh order, null when streaming
+  gfx::handle_buffer_t meshlets_buffer;
+  // bottom level of the two level bvh, null if it was not built, always
+  // built for instanced meshes, see tlas_t
+  gfx::handle_buffer_t blas_bvh2_nodes;
+  gfx::handle_buffer_t blas_bvh2_prim_indices;
+  gfx::handle_buffer_t blas_cwbvh_nodes;
+  gfx::handle_buffer_t blas_cwbvh_prim_indices;
 
   std::vector<cpu_mesh_t> cpu_meshes;
 
   uint32_t materials_count;
   uint32_t meshes_count;
+  // triangles_count counts every instance's triangles, this only the ones
+  // of distinct geometry
   uint32_t triangles_count;
+  uint32_t meshlets_count;
+  uint32_t unique_triangles_count;
+  // meshlets of every instance, what one frame can draw at most
+  uint32_t meshlet_instances_count;
+
+  // bytes of the uploaded textures and what they would take as rgba8 mip 0
+  VkDeviceSize texture_bytes;
+  VkDeviceSize uncompressed_texture_bytes;
+
+  // set when the scene was prepared for streaming, the flat triangles and
+  // bvhs are null then and no mesh has vertices or indices, see
+  // geometry_streamer_t
+  core::ref<cluster_file_t> clusters;
+  // set when the textures were cut into pages, no per texture image is
+  // uploaded then, see texture_streamer_t
+  core::ref<virtual_texture_file_t> virtual_textures;
+};
+
+enum class bvh_builder_t : uint32_t {
+  e_sweep_sah,
+  e_binned_sah_parallel,
 };
 
+struct bvh_build_config_t {
+  bvh_builder_t     builder         = bvh_builder_t::e_sweep_sah;
+  float             presplit_factor = 0.3f;
+  // quantized formats snap vertices before the build, so the format is part
+  // of the build inputs
+  triangle_format_t triangle_format = triangle_format_t::e_full;
+  // also builds with the other builder and logs both sah costs
+  bool compare_builders = false;
+  // also builds a blas per mesh so meshes can move, see tlas_t, the blases
+  // are not cached
+  bool two_level = false;
+  // splits the triangles into spatial clusters with a bvh each, written to a
+  // cluster file that is paged into vram on demand instead of uploading the
+  // flat bvh, see geometry_streamer_t, the cluster file is always written
+  bool     streaming         = false;
+  uint32_t cluster_triangles = 8192;
+
+  // built bvhs are cached on disk, keyed by a hash of the meshes and config
+  bool                  use_cache       = true;
+  std::filesystem::path cache_directory = ".aurora_cache";
+};
+
+enum class texture_compression_t : uint32_t {
+  // rgba8 mip 0 only
+  e_none,
+  // 4 bits per texel, alpha is dropped
+  e_bc1,
+  // 8 bits per texel
+  e_bc7,
+  // bc1 for opaque textures, bc7 for the others
+  e_auto,
+};
+
+struct texture_config_t {
+  // transcodes every diffuse texture with a full mip chain to a dds file
+  // that later loads map and upload as is, see texture_compression.hpp,
+  // ignored with virtual textures
+  texture_compression_t compression = texture_compression_t::e_auto;
+  // cuts every diffuse texture into pages with their mips, written to a page
+  // file that is paged into a physical cache on demand instead of uploading
+  // the images, see texture_streamer_t
+  bool virtual_textures = false;
+
+  // page files and dds files are cached on disk, keyed by the image paths
+  // and timestamps
+  bool                  use_cache       = true;
+  std::filesystem::path cache_directory = ".aurora_cache";
+};
+
+// the triangles and binary bvh prepare uploads, in host memory
+struct cpu_scene_t {
+  std::vector<triangle_t> triangles;
+  bvh::bvh_t              bvh;
+};
+
+enum class load_stage_t : uint32_t {
+  e_model,
+  e_textures,
+  e_triangles,
+  e_bvh,
+  e_meshlets,
+  e_upload,
+  e_done,
+};
+
+const char *to_string(load_stage_t stage);
+
+// written by the loading jobs, read by the ui while loading, total is 0 if
+// the stage cannot report progress
+struct load_progress_t {
+  void begin(load_stage_t stage, uint32_t total);
+
+  std::atomic<load_stage_t> stage = load_stage_t::e_model;
+  std::atomic<uint32_t>     done  = 0;
+  std::atomic<uint32_t>     total = 0;
+};
+
+// decoded textures, triangles and bvhs waiting for upload, see assets.cpp
+struct prepared_assets_t;
+
 struct assets_manager_t {
   void            load_model_from_path(const std::filesystem::path &model_path);
+  // prepare_cpu followed by upload
   renderer_data_t prepare(core::ref<gfx::base_t>       base,
                           core::ref<gfx::context_t>    context,
                           gfx::handle_bindless_image_t bdefault);
+  // falls back to rgba8 if the device can not sample the configured texture
+  // compression, prepare_cpu can not check since it runs without a gpu
+  void            fit_texture_config(gfx::context_t &context);
+  // cpu half of prepare, decodes textures and builds the triangles and bvhs
+  // on the job system, does not touch the gpu so it can run on any thread
+  void            prepare_cpu();
+  // gpu half of prepare, must run on the thread that owns the context,
+  // uploads everything in a few batched staging transfers
+  renderer_data_t upload(core::ref<gfx::base_t>       base,
+                         core::ref<gfx::context_t>    context,
+                         gfx::handle_bindless_image_t bdefault);
+  // builds or loads from the cache exactly what prepare would, without a gpu
+  cpu_scene_t     build_cpu_scene();
+  // prepare_cpu releases the vertices and indices of instances
   std::vector<model::raw_mesh_t> loaded_meshes;
+  bvh_build_config_t             bvh_build_config;
+  texture_config_t               texture_config;
+  load_progress_t                progress;
+  core::ref<prepared_assets_t>   prepared;
 };
 
 #endif
@@ -0,0 +1,35 @@
+#include "buffer_arena.hpp"
+
+#include <algorithm>
+
+buffer_arena_t::buffer_arena_t(core::ref<gfx::context_t> context,
+                               gfx::config_buffer_t      config,
+                               VkDeviceSize              expected_bytes)
+    : context(context), config(config), expected_bytes(expected_bytes) {}
+
+buffer_arena_t::allocation_t buffer_arena_t::allocate(VkDeviceSize size,
+                                                      VkDeviceSize alignment) {
+  VkDeviceSize offset = (block_used + alignment - 1) / alignment * alignment;
+  if (blocks.empty() || offset + size > block_size) {
+    // used_bytes leaves out the alignment padding, the rounded up
+    // expected_bytes covers it, so what is left never comes up short
+    VkDeviceSize block = config.vk_size;
+    if (expected_bytes > used_bytes)
+      block = std::min(block, expected_bytes - used_bytes);
+    gfx::config_buffer_t cb = config;
+    cb.vk_size              = std::max(block, size);
+    blocks.push_back(context->create_buffer(cb));
+    allocated_bytes += cb.vk_size;
+    block_size = cb.vk_size;
+    offset     = 0;
+  }
+  block_used = offset + size;
+  used_bytes += size;
+
+  allocation_t allocation{};
+  allocation.buffer  = blocks.back();
+  allocation.offset  = offset;
+  allocation.address =
+      context->get_buffer_device_address(allocation.buffer) + offset;
+  return allocation;
+}
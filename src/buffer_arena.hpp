@@ -0,0 +1,49 @@
+#ifndef BUFFER_ARENA_HPP
+#define BUFFER_ARENA_HPP
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan_core.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "horizon/core/core.hpp"
+#include "horizon/gfx/context.hpp"
+#include "horizon/gfx/types.hpp"
+
+// sub-allocates ranges out of a few large buffers, a range never spans two
+// buffers, buffers live as long as the context like every other scene buffer
+struct buffer_arena_t {
+  struct allocation_t {
+    gfx::handle_buffer_t buffer;
+    VkDeviceSize         offset;
+    // device address of the range itself, offset is already applied
+    VkDeviceAddress      address;
+  };
+
+  // config.vk_size is the size of each block, ranges larger than a block
+  // get a block of their own, expected_bytes is the total of every range
+  // the arena will hand out, each rounded up to its alignment, if it is
+  // known a new block only takes what is left of it so a small scene does
+  // not reserve a whole block
+  buffer_arena_t(core::ref<gfx::context_t> context,
+                 gfx::config_buffer_t      config,
+                 VkDeviceSize              expected_bytes = 0);
+
+  allocation_t allocate(VkDeviceSize size, VkDeviceSize alignment);
+
+  core::ref<gfx::context_t> context;
+  gfx::config_buffer_t      config;
+  VkDeviceSize              expected_bytes;
+
+  std::vector<gfx::handle_buffer_t> blocks;
+  // bytes handed out and bytes reserved by blocks
+  VkDeviceSize                      used_bytes      = 0;
+  VkDeviceSize                      allocated_bytes = 0;
+
+ private:
+  VkDeviceSize block_used = 0, block_size = 0;
+};
+
+#endif
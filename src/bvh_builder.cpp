@@ -0,0 +1,486 @@
+#include "bvh_builder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+namespace {
+
+constexpr uint32_t bin_count     = 32;
+constexpr uint32_t max_leaf_size = 16;
+// subtrees smaller than this are built by the job that reached them
+constexpr uint32_t task_threshold = 4096;
+// nodes larger than this bin and partition across the pool
+constexpr uint32_t parallel_node_threshold = 1 << 16;
+
+constexpr float traversal_cost    = 1.f;
+constexpr float intersection_cost = 1.f;
+
+struct bounds_t {
+  math::vec3 min{std::numeric_limits<float>::max()};
+  math::vec3 max{-std::numeric_limits<float>::max()};
+
+  void grow(const math::vec3 &point) {
+    min = math::min(min, point);
+    max = math::max(max, point);
+  }
+  void grow(const bounds_t &other) {
+    min = math::min(min, other.min);
+    max = math::max(max, other.max);
+  }
+  float area() const {
+    if (min.x > max.x) return 0.f;
+    const math::vec3 e = max - min;
+    return 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+  }
+};
+
+bounds_t to_bounds(const math::aabb_t &aabb) { return {aabb.min, aabb.max}; }
+
+struct bin_t {
+  bounds_t bounds;
+  uint32_t count = 0;
+};
+
+struct split_t {
+  float    cost = std::numeric_limits<float>::max();
+  uint32_t axis = 0;
+  uint32_t bin  = 0;
+};
+
+// runs fn(chunk) for every chunk, chunk 0 on the calling thread
+template <typename fn_t>
+void run_chunks(job_system_t &job_system, uint32_t chunks, const fn_t &fn) {
+  job_counter_t counter;
+  for (uint32_t chunk = 1; chunk < chunks; chunk++)
+    job_system.submit([&fn, chunk] { fn(chunk); }, counter);
+  fn(0);
+  job_system.wait(counter);
+}
+
+struct binned_builder_t {
+  const std::vector<math::aabb_t> &aabbs;
+  std::vector<math::vec3>          centers;
+  std::vector<uint32_t>            scratch;
+  bvh::bvh_t                      &bvh;
+  job_system_t                    &job_system;
+  std::atomic<uint32_t>            node_count = 1;
+  job_counter_t                    counter;
+
+  uint32_t chunks_for(uint32_t count) const {
+    return count < parallel_node_threshold ? 1 : job_system.thread_count() * 2;
+  }
+
+  std::pair<bounds_t, bounds_t> compute_bounds(uint32_t begin, uint32_t end) {
+    auto compute = [&](uint32_t b, uint32_t e) {
+      std::pair<bounds_t, bounds_t> bounds;
+      for (uint32_t i = b; i < e; i++) {
+        const uint32_t prim = bvh.prim_indices[i];
+        bounds.first.grow(to_bounds(aabbs[prim]));
+        bounds.second.grow(centers[prim]);
+      }
+      return bounds;
+    };
+    const uint32_t chunks = chunks_for(end - begin);
+    if (chunks == 1) return compute(begin, end);
+
+    std::vector<std::pair<bounds_t, bounds_t>> chunk_bounds(chunks);
+    run_chunks(job_system, chunks, [&](uint32_t chunk) {
+      const uint32_t size = (end - begin + chunks - 1) / chunks;
+      const uint32_t b    = begin + chunk * size;
+      chunk_bounds[chunk] = compute(b, std::min(end, b + size));
+    });
+    for (uint32_t chunk = 1; chunk < chunks; chunk++) {
+      chunk_bounds[0].first.grow(chunk_bounds[chunk].first);
+      chunk_bounds[0].second.grow(chunk_bounds[chunk].second);
+    }
+    return chunk_bounds[0];
+  }
+
+  uint32_t bin_of(uint32_t prim, uint32_t axis, const bounds_t &center_bounds,
+                  float scale) const {
+    const float offset = centers[prim][axis] - center_bounds.min[axis];
+    return std::min(bin_count - 1, static_cast<uint32_t>(offset * scale));
+  }
+
+  split_t find_split(uint32_t begin, uint32_t end,
+                     const bounds_t &center_bounds, float parent_area) {
+    using bins_t = std::array<std::array<bin_t, bin_count>, 3>;
+    auto fill = [&](bins_t &bins, uint32_t b, uint32_t e) {
+      for (uint32_t axis = 0; axis < 3; axis++) {
+        const float extent = center_bounds.max[axis] - center_bounds.min[axis];
+        if (extent <= 0.f) continue;
+        const float scale = bin_count / extent;
+        for (uint32_t i = b; i < e; i++) {
+          const uint32_t prim = bvh.prim_indices[i];
+          bin_t &bin = bins[axis][bin_of(prim, axis, center_bounds, scale)];
+          bin.bounds.grow(to_bounds(aabbs[prim]));
+          bin.count++;
+        }
+      }
+    };
+
+    bins_t         bins{};
+    const uint32_t chunks = chunks_for(end - begin);
+    if (chunks == 1) {
+      fill(bins, begin, end);
+    } else {
+      std::vector<bins_t> chunk_bins(chunks);
+      run_chunks(job_system, chunks, [&](uint32_t chunk) {
+        const uint32_t size = (end - begin + chunks - 1) / chunks;
+        const uint32_t b    = begin + chunk * size;
+        fill(chunk_bins[chunk], b, std::min(end, b + size));
+      });
+      for (const auto &chunk : chunk_bins)
+        for (uint32_t axis = 0; axis < 3; axis++)
+          for (uint32_t i = 0; i < bin_count; i++) {
+            bins[axis][i].bounds.grow(chunk[axis][i].bounds);
+            bins[axis][i].count += chunk[axis][i].count;
+          }
+    }
+
+    split_t best{};
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      if (center_bounds.max[axis] - center_bounds.min[axis] <= 0.f) continue;
+
+      // sweep from the right to get the cost of every right hand side
+      std::array<float, bin_count> right_costs{};
+      bounds_t                     right_bounds;
+      uint32_t                     right_count = 0;
+      for (uint32_t i = bin_count - 1; i > 0; i--) {
+        right_bounds.grow(bins[axis][i].bounds);
+        right_count += bins[axis][i].count;
+        right_costs[i] = right_bounds.area() * right_count;
+      }
+      bounds_t left_bounds;
+      uint32_t left_count = 0;
+      for (uint32_t i = 0; i + 1 < bin_count; i++) {
+        left_bounds.grow(bins[axis][i].bounds);
+        left_count += bins[axis][i].count;
+        const float cost =
+            traversal_cost +
+            intersection_cost *
+                (left_bounds.area() * left_count + right_costs[i + 1]) /
+                parent_area;
+        if (cost < best.cost) best = {cost, axis, i + 1};
+      }
+    }
+    return best;
+  }
+
+  // stable two pass partition through scratch, so it can run in parallel
+  uint32_t partition(uint32_t begin, uint32_t end, const split_t &split,
+                     const bounds_t &center_bounds) {
+    const float scale = bin_count / (center_bounds.max[split.axis] -
+                                     center_bounds.min[split.axis]);
+    auto is_left = [&](uint32_t prim) {
+      return bin_of(prim, split.axis, center_bounds, scale) < split.bin;
+    };
+
+    const uint32_t chunks = chunks_for(end - begin);
+    if (chunks == 1) {
+      return std::partition(bvh.prim_indices.begin() + begin,
+                            bvh.prim_indices.begin() + end, is_left) -
+             bvh.prim_indices.begin();
+    }
+
+    const uint32_t        size = (end - begin + chunks - 1) / chunks;
+    std::vector<uint32_t> left_counts(chunks, 0);
+    run_chunks(job_system, chunks, [&](uint32_t chunk) {
+      const uint32_t b = begin + chunk * size;
+      const uint32_t e = std::min(end, b + size);
+      for (uint32_t i = b; i < e; i++)
+        left_counts[chunk] += is_left(bvh.prim_indices[i]);
+    });
+    std::vector<uint32_t> left_offsets(chunks), right_offsets(chunks);
+    uint32_t              total_left = 0;
+    for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+      left_offsets[chunk] = total_left;
+      total_left += left_counts[chunk];
+    }
+    uint32_t right_offset = total_left;
+    for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+      right_offsets[chunk] = right_offset;
+      const uint32_t b     = begin + chunk * size;
+      const uint32_t e     = std::min(end, b + size);
+      right_offset += (e > b ? e - b : 0) - left_counts[chunk];
+    }
+    run_chunks(job_system, chunks, [&](uint32_t chunk) {
+      const uint32_t b     = begin + chunk * size;
+      const uint32_t e     = std::min(end, b + size);
+      uint32_t       left  = begin + left_offsets[chunk];
+      uint32_t       right = begin + right_offsets[chunk];
+      for (uint32_t i = b; i < e; i++) {
+        const uint32_t prim = bvh.prim_indices[i];
+        scratch[is_left(prim) ? left++ : right++] = prim;
+      }
+    });
+    run_chunks(job_system, chunks, [&](uint32_t chunk) {
+      const uint32_t b = begin + chunk * size;
+      const uint32_t e = std::min(end, b + size);
+      if (b < e)
+        std::copy(scratch.begin() + b, scratch.begin() + e,
+                  bvh.prim_indices.begin() + b);
+    });
+    return begin + total_left;
+  }
+
+  void make_leaf(bvh::node_t &node, uint32_t begin, uint32_t end) {
+    node.first_index = begin;
+    node.prim_count  = end - begin;
+  }
+
+  void build(uint32_t node_index, uint32_t begin, uint32_t end) {
+    const uint32_t count              = end - begin;
+    auto [node_bounds, center_bounds] = compute_bounds(begin, end);
+    bvh::node_t &node                 = bvh.nodes[node_index];
+    node.min                          = node_bounds.min;
+    node.max                          = node_bounds.max;
+
+    if (count == 1) return make_leaf(node, begin, end);
+
+    const float   parent_area = std::max(node_bounds.area(),
+                                         std::numeric_limits<float>::min());
+    const split_t split = find_split(begin, end, center_bounds, parent_area);
+
+    uint32_t mid;
+    if (split.cost == std::numeric_limits<float>::max()) {
+      // every centroid is in the same spot, binning cannot separate them
+      if (count <= max_leaf_size) return make_leaf(node, begin, end);
+      mid = begin + count / 2;
+    } else {
+      if (split.cost >= intersection_cost * count && count <= max_leaf_size)
+        return make_leaf(node, begin, end);
+      mid = partition(begin, end, split, center_bounds);
+      if (mid == begin || mid == end) mid = begin + count / 2;
+    }
+
+    const uint32_t children = node_count.fetch_add(2);
+    node.first_index        = children;
+    node.prim_count         = 0;
+
+    if (count > task_threshold) {
+      job_system.submit([this, children, begin,
+                         mid] { build(children + 0, begin, mid); },
+                        counter);
+    } else {
+      build(children + 0, begin, mid);
+    }
+    build(children + 1, mid, end);
+  }
+};
+
+bounds_t clipped_bounds(const math::triangle_t &triangle, const bounds_t &box) {
+  // sutherland hodgman against the 6 box planes, a triangle gains at most one
+  // vertex per plane
+  std::array<math::vec3, 9> polygon{triangle.v0, triangle.v1, triangle.v2};
+  std::array<math::vec3, 9> clipped;
+  uint32_t                  size = 3;
+  for (uint32_t plane = 0; plane < 6 && size > 0; plane++) {
+    const uint32_t axis  = plane % 3;
+    const bool     upper = plane >= 3;
+    const float    bound = upper ? box.max[axis] : box.min[axis];
+    auto inside = [&](const math::vec3 &p) {
+      return upper ? p[axis] <= bound : p[axis] >= bound;
+    };
+    uint32_t clipped_size = 0;
+    for (uint32_t i = 0; i < size; i++) {
+      const math::vec3 &a = polygon[i];
+      const math::vec3 &b = polygon[(i + 1) % size];
+      if (inside(a)) clipped[clipped_size++] = a;
+      if (inside(a) != inside(b) && clipped_size < clipped.size()) {
+        const float t = (bound - a[axis]) / (b[axis] - a[axis]);
+        math::vec3  p = a + (b - a) * t;
+        p[axis]       = bound;
+        clipped[clipped_size++] = p;
+      }
+    }
+    polygon = clipped;
+    size    = clipped_size;
+  }
+  bounds_t bounds;
+  for (uint32_t i = 0; i < size; i++) bounds.grow(polygon[i]);
+  if (size == 0) return box;
+  bounds.min = math::max(bounds.min, box.min);
+  bounds.max = math::min(bounds.max, box.max);
+  return bounds;
+}
+
+// picks the coarsest plane of the power of two grid over the scene that
+// crosses the box, planes shared by many triangles split the scene best
+float split_position(const bounds_t &box, uint32_t axis,
+                     const bounds_t &scene) {
+  const float extent = scene.max[axis] - scene.min[axis];
+  if (extent <= 0.f) return (box.min[axis] + box.max[axis]) * 0.5f;
+  const float lo = (box.min[axis] - scene.min[axis]) / extent;
+  const float hi = (box.max[axis] - scene.min[axis]) / extent;
+  for (uint32_t level = 1; level < 24; level++) {
+    const float cells = float(1u << level);
+    const float plane = std::ceil(lo * cells) / cells;
+    if (plane > lo && plane < hi) return scene.min[axis] + plane * extent;
+  }
+  return (box.min[axis] + box.max[axis]) * 0.5f;
+}
+
+void split_triangle(const math::triangle_t &triangle, const bounds_t &box,
+                    uint32_t splits, const bounds_t &scene,
+                    math::aabb_t *out) {
+  if (splits == 0) {
+    out->min = box.min;
+    out->max = box.max;
+    return;
+  }
+  const math::vec3 extent = box.max - box.min;
+  const uint32_t   axis   = extent.x > extent.y
+                                ? (extent.x > extent.z ? 0 : 2)
+                                : (extent.y > extent.z ? 1 : 2);
+  const float      position = split_position(box, axis, scene);
+
+  bounds_t left_box = box, right_box = box;
+  left_box.max[axis]  = position;
+  right_box.min[axis] = position;
+  left_box            = clipped_bounds(triangle, left_box);
+  right_box           = clipped_bounds(triangle, right_box);
+
+  // remaining splits go where the surface area is
+  const float left_area  = left_box.area();
+  const float right_area = right_box.area();
+  const float total_area = left_area + right_area;
+  const uint32_t left_splits =
+      total_area > 0.f ? static_cast<uint32_t>(
+                             std::round((splits - 1) * left_area / total_area))
+                       : (splits - 1) / 2;
+  split_triangle(triangle, left_box, left_splits, scene, out);
+  split_triangle(triangle, right_box, splits - 1 - left_splits, scene,
+                 out + left_splits + 1);
+}
+
+}  // namespace
+
+bvh::bvh_t build_bvh_binned_sah_parallel(const std::vector<math::aabb_t> &aabbs,
+                                         job_system_t &job_system) {
+  bvh::bvh_t bvh{};
+  if (aabbs.empty()) return bvh;
+
+  const uint32_t count = aabbs.size();
+  binned_builder_t builder{aabbs, {}, {}, bvh, job_system};
+  builder.centers.resize(count);
+  builder.scratch.resize(count);
+  bvh.prim_indices.resize(count);
+  bvh.nodes.resize(2 * count);
+  job_system.parallel_for(count, 1 << 14, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; i++) {
+      builder.centers[i]     = (aabbs[i].min + aabbs[i].max) * 0.5f;
+      bvh.prim_indices[i] = i;
+    }
+  });
+
+  builder.build(0, 0, count);
+  job_system.wait(builder.counter);
+
+  bvh.nodes.resize(builder.node_count);
+  return bvh;
+}
+
+std::pair<std::vector<math::aabb_t>, std::vector<uint32_t>> presplit_parallel(
+    const std::vector<math::triangle_t> &triangles, float split_factor,
+    job_system_t &job_system) {
+  const uint32_t count = triangles.size();
+
+  std::vector<bounds_t> boxes(count);
+  bounds_t              scene;
+  std::mutex            scene_mutex;
+  job_system.parallel_for(count, 1 << 14, [&](uint32_t begin, uint32_t end) {
+    bounds_t local;
+    for (uint32_t i = begin; i < end; i++) {
+      boxes[i].grow(triangles[i].v0);
+      boxes[i].grow(triangles[i].v1);
+      boxes[i].grow(triangles[i].v2);
+      local.grow(boxes[i]);
+    }
+    std::lock_guard lock{scene_mutex};
+    scene.grow(local);
+  });
+
+  // priority from karras and aila, "fast parallel construction of high
+  // quality bounding volume hierarchies": boxes that cross coarse grid planes
+  // and are much larger than their triangle get most of the split budget
+  std::vector<float> priorities(count);
+  double             priority_sum = 0;
+  job_system.parallel_for(count, 1 << 14, [&](uint32_t begin, uint32_t end) {
+    double local = 0;
+    for (uint32_t i = begin; i < end; i++) {
+      const math::triangle_t &t = triangles[i];
+      const float ideal_area =
+          math::length(math::cross(t.v1 - t.v0, t.v2 - t.v0));
+      float importance = 0.f;
+      for (uint32_t axis = 0; axis < 3; axis++) {
+        const float extent = scene.max[axis] - scene.min[axis];
+        if (extent <= 0.f) continue;
+        auto quantize = [&](float x) {
+          return static_cast<uint32_t>((x - scene.min[axis]) / extent *
+                                       float(1u << 20));
+        };
+        const uint32_t crossed =
+            quantize(boxes[i].min[axis]) ^ quantize(boxes[i].max[axis]);
+        if (crossed == 0) continue;
+        const int highest_bit = 31 - std::countl_zero(crossed);
+        importance = std::max(importance, std::ldexp(1.f, highest_bit - 20));
+      }
+      priorities[i] = std::cbrt(
+          importance * std::max(0.f, boxes[i].area() - ideal_area));
+      local += priorities[i];
+    }
+    std::lock_guard lock{scene_mutex};
+    priority_sum += local;
+  });
+
+  const double budget = double(split_factor) * count;
+  const double scale  = priority_sum > 0 ? budget / priority_sum : 0;
+
+  std::vector<uint32_t> offsets(count + 1);
+  offsets[0] = 0;
+  for (uint32_t i = 0; i < count; i++)
+    offsets[i + 1] = offsets[i] + 1 +
+                     std::min<uint32_t>(64, uint32_t(priorities[i] * scale));
+
+  std::vector<math::aabb_t> aabbs(offsets[count]);
+  std::vector<uint32_t>     tri_indices(offsets[count]);
+  job_system.parallel_for(count, 1 << 12, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; i++) {
+      const uint32_t splits = offsets[i + 1] - offsets[i] - 1;
+      split_triangle(triangles[i], boxes[i], splits, scene,
+                     aabbs.data() + offsets[i]);
+      std::fill(tri_indices.begin() + offsets[i],
+                tri_indices.begin() + offsets[i + 1], i);
+    }
+  });
+  return {aabbs, tri_indices};
+}
+
+float bvh_sah_cost(const bvh::bvh_t &bvh) {
+  if (bvh.nodes.empty()) return 0.f;
+  auto area = [](const bvh::node_t &node) {
+    return bounds_t{node.min, node.max}.area();
+  };
+  const float root_area = std::max(area(bvh.nodes[0]),
+                                   std::numeric_limits<float>::min());
+  double      cost      = 0;
+  std::vector<uint32_t> stack{0};
+  while (!stack.empty()) {
+    const bvh::node_t &node = bvh.nodes[stack.back()];
+    stack.pop_back();
+    if (node.prim_count > 0) {
+      cost += intersection_cost * node.prim_count * area(node) / root_area;
+    } else {
+      cost += traversal_cost * area(node) / root_area;
+      stack.push_back(node.first_index + 0);
+      stack.push_back(node.first_index + 1);
+    }
+  }
+  return cost;
+}
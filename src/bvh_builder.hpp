@@ -0,0 +1,28 @@
+#ifndef BVH_BUILDER_HPP
+#define BVH_BUILDER_HPP
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "bvh/bvh.hpp"
+#include "job_system.hpp"
+#include "math/triangle.hpp"
+
+// same node layout as bvh::build_bvh_sweep_sah: root at 0, siblings stored
+// next to each other, leaves have prim_count > 0
+bvh::bvh_t build_bvh_binned_sah_parallel(
+    const std::vector<math::aabb_t> &aabbs,
+    job_system_t                    &job_system = job_system_t::global());
+
+// drop in replacement for bvh::presplit, the result can be passed to
+// bvh::presplit_remove_indirection and bvh::presplit_remove_duplicates
+std::pair<std::vector<math::aabb_t>, std::vector<uint32_t>> presplit_parallel(
+    const std::vector<math::triangle_t> &triangles, float split_factor,
+    job_system_t &job_system = job_system_t::global());
+
+// expected cost of a random ray hitting the root, traversal steps and
+// primitive intersections both cost 1
+float bvh_sah_cost(const bvh::bvh_t &bvh);
+
+#endif
@@ -0,0 +1,210 @@
+#include "bvh_cache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#ifdef _WIN32
+#include <vector>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "horizon/core/logger.hpp"
+
+namespace {
+
+constexpr uint32_t bvh_cache_magic = 0x42525541;  // "AURB"
+
+struct header_t {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t hash;
+  uint32_t node_size;
+  uint32_t triangle_size;
+  uint64_t nodes_count;
+  uint64_t prim_indices_count;
+  uint64_t triangles_count;
+};
+
+// every array starts on a 16 byte boundary so the mapping can be used as is
+constexpr uint64_t align_up(uint64_t offset) { return (offset + 15) & ~15ull; }
+
+uint64_t mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  x ^= x >> 33;
+  return x;
+}
+
+}  // namespace
+
+bvh_cache_t::~bvh_cache_t() { unmap_file(mapping, mapping_size); }
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+  uint64_t       hash  = mix(seed ^ size);
+  size_t         i     = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, bytes + i, 8);
+    hash = (hash ^ mix(word)) * 0x9e3779b97f4a7c15ull;
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, bytes + i, size - i);
+  return mix(hash ^ mix(tail));
+}
+
+void *map_file(const std::filesystem::path &path, size_t &size) {
+  std::error_code error;
+  if (!std::filesystem::exists(path, error)) return nullptr;
+  size = std::filesystem::file_size(path, error);
+  if (error || size == 0) return nullptr;
+#ifdef _WIN32
+  uint8_t      *mapping = new uint8_t[size];
+  std::ifstream file{path, std::ios::binary};
+  file.read(reinterpret_cast<char *>(mapping), size);
+  if (!file.good()) {
+    delete[] mapping;
+    return nullptr;
+  }
+  return mapping;
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return nullptr;
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) return nullptr;
+  return mapping;
+#endif
+}
+
+void unmap_file(void *mapping, size_t size) {
+  if (!mapping) return;
+#ifdef _WIN32
+  delete[] reinterpret_cast<uint8_t *>(mapping);
+#else
+  munmap(mapping, size);
+#endif
+}
+
+bool write_file_atomically(const std::filesystem::path              &path,
+                           const std::function<void(std::ofstream &)> &write) {
+  std::error_code error;
+  std::filesystem::create_directories(path.parent_path(), error);
+  std::filesystem::path tmp_path = path;
+  tmp_path += ".tmp";
+  {
+    std::ofstream file{tmp_path, std::ios::binary | std::ios::trunc};
+    if (!file.is_open()) return false;
+    write(file);
+    if (!file.good()) return false;
+  }
+  std::filesystem::rename(tmp_path, path, error);
+  return !error;
+}
+
+uint64_t hash_bvh_inputs(const std::vector<model::raw_mesh_t> &meshes,
+                         const bvh_build_config_t             &config) {
+  uint64_t hash = hash_bytes(&bvh_cache_version, sizeof(bvh_cache_version), 0);
+  hash = hash_bytes(&config.builder, sizeof(config.builder), hash);
+  hash = hash_bytes(&config.presplit_factor, sizeof(config.presplit_factor),
+                    hash);
+  // only quantization moves vertices, full and indexed share a cache entry
+  const bool quantized =
+      config.triangle_format == triangle_format_t::e_quantized;
+  hash = hash_bytes(&quantized, sizeof(quantized), hash);
+  for (const auto &mesh : meshes) {
+    hash = hash_bytes(mesh.vertices.data(),
+                      sizeof(mesh.vertices[0]) * mesh.vertices.size(), hash);
+    hash = hash_bytes(mesh.indices.data(),
+                      sizeof(mesh.indices[0]) * mesh.indices.size(), hash);
+  }
+  return hash;
+}
+
+std::filesystem::path bvh_cache_path(const bvh_build_config_t &config,
+                                     uint64_t                  hash) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.bvh",
+                static_cast<unsigned long long>(hash));
+  return config.cache_directory / name;
+}
+
+core::ref<bvh_cache_t> load_bvh_cache(const std::filesystem::path &path,
+                                      uint64_t                     hash) {
+  size_t size    = 0;
+  void  *mapping = map_file(path, size);
+  if (!mapping) return nullptr;
+
+  auto cache          = core::make_ref<bvh_cache_t>();
+  cache->mapping      = mapping;
+  cache->mapping_size = size;
+  if (size < sizeof(header_t)) return nullptr;
+
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(cache->mapping);
+  header_t       header;
+  std::memcpy(&header, bytes, sizeof(header));
+  if (header.magic != bvh_cache_magic || header.version != bvh_cache_version ||
+      header.hash != hash || header.node_size != sizeof(bvh::node_t) ||
+      header.triangle_size != sizeof(triangle_t)) {
+    horizon_info("bvh cache {} is stale, rebuilding", path.string());
+    return nullptr;
+  }
+
+  uint64_t offset    = align_up(sizeof(header_t));
+  cache->nodes       = reinterpret_cast<const bvh::node_t *>(bytes + offset);
+  cache->nodes_count = header.nodes_count;
+  offset = align_up(offset + header.nodes_count * sizeof(bvh::node_t));
+  cache->prim_indices = reinterpret_cast<const uint32_t *>(bytes + offset);
+  cache->prim_indices_count = header.prim_indices_count;
+  offset = align_up(offset + header.prim_indices_count * sizeof(uint32_t));
+  cache->triangles       = reinterpret_cast<const triangle_t *>(bytes + offset);
+  cache->triangles_count = header.triangles_count;
+  offset += header.triangles_count * sizeof(triangle_t);
+  if (offset > size) {
+    horizon_info("bvh cache {} is truncated, rebuilding", path.string());
+    return nullptr;
+  }
+  return cache;
+}
+
+void save_bvh_cache(const std::filesystem::path   &path,
+                    uint64_t                       hash,
+                    const bvh::bvh_t              &bvh,
+                    const std::vector<triangle_t> &triangles) {
+  header_t header{};
+  header.magic              = bvh_cache_magic;
+  header.version            = bvh_cache_version;
+  header.hash               = hash;
+  header.node_size          = sizeof(bvh::node_t);
+  header.triangle_size      = sizeof(triangle_t);
+  header.nodes_count        = bvh.nodes.size();
+  header.prim_indices_count = bvh.prim_indices.size();
+  header.triangles_count    = triangles.size();
+
+  const bool saved = write_file_atomically(path, [&](std::ofstream &file) {
+    uint64_t offset = 0;
+    auto     write  = [&](const void *data, uint64_t size) {
+      const char padding[16] = {};
+      file.write(padding, align_up(offset) - offset);
+      offset = align_up(offset);
+      file.write(reinterpret_cast<const char *>(data), size);
+      offset += size;
+    };
+    write(&header, sizeof(header));
+    write(bvh.nodes.data(), bvh.nodes.size() * sizeof(bvh::node_t));
+    write(bvh.prim_indices.data(), bvh.prim_indices.size() * sizeof(uint32_t));
+    write(triangles.data(), triangles.size() * sizeof(triangle_t));
+  });
+  if (!saved)
+    horizon_info("failed to write bvh cache {}", path.string());
+  else
+    horizon_info("wrote bvh cache {}", path.string());
+}
@@ -0,0 +1,61 @@
+#ifndef BVH_CACHE_HPP
+#define BVH_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <vector>
+
+#include "assets.hpp"
+#include "bvh/bvh.hpp"
+#include "horizon/core/core.hpp"
+#include "model/model.hpp"
+
+// bump whenever the file layout or the build pipeline changes meaning
+static constexpr uint32_t bvh_cache_version = 1;
+
+// read only, memory mapped view of a cache file, unmapped on destruction
+struct bvh_cache_t {
+  ~bvh_cache_t();
+
+  const bvh::node_t *nodes;
+  uint64_t           nodes_count;
+  const uint32_t    *prim_indices;
+  uint64_t           prim_indices_count;
+  const triangle_t  *triangles;
+  uint64_t           triangles_count;
+
+  void  *mapping      = nullptr;
+  size_t mapping_size = 0;
+};
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed);
+
+// maps a whole file read only, nullptr if it can not be mapped, where there
+// is no mmap the file is read into memory instead
+void *map_file(const std::filesystem::path &path, size_t &size);
+void  unmap_file(void *mapping, size_t size);
+// creates the directories and writes the file next to path through write
+// before renaming it into place, so a crash never leaves a half written file
+// behind that matches its hash, false if anything failed
+bool  write_file_atomically(const std::filesystem::path              &path,
+                            const std::function<void(std::ofstream &)> &write);
+
+// hashes the source geometry together with everything that affects the build
+uint64_t hash_bvh_inputs(const std::vector<model::raw_mesh_t> &meshes,
+                         const bvh_build_config_t             &config);
+
+std::filesystem::path bvh_cache_path(const bvh_build_config_t &config,
+                                     uint64_t                  hash);
+
+// returns nullptr if the file is missing, stale or from another version
+core::ref<bvh_cache_t> load_bvh_cache(const std::filesystem::path &path,
+                                      uint64_t                     hash);
+void                   save_bvh_cache(const std::filesystem::path   &path,
+                                      uint64_t                       hash,
+                                      const bvh::bvh_t              &bvh,
+                                      const std::vector<triangle_t> &triangles);
+
+#endif
@@ -0,0 +1,258 @@
+#include "cpu_tracer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+// traversal stack that lives on the call stack for the usual depths and
+// spills to the heap past them, so a degenerate bvh of any depth still
+// traverses exactly, unlike the gpu's fixed stack
+template <typename value_t>
+struct traversal_stack_t {
+  static constexpr uint32_t local_size = 64;
+
+  void push(value_t value) {
+    if (top < local_size)
+      local[top] = value;
+    else
+      spilled.push_back(value);
+    top++;
+  }
+
+  value_t pop() {
+    top--;
+    if (top < local_size) return local[top];
+    const value_t value = spilled.back();
+    spilled.pop_back();
+    return value;
+  }
+
+  bool empty() const { return top == 0; }
+
+  std::array<value_t, local_size> local;
+  std::vector<value_t>            spilled;
+  uint32_t                        top = 0;
+};
+
+static float safe_inverse(float x) {
+  const float epsilon = 0.0001f;
+  const float sign_x  = x >= 0 ? 1.f : -1.f;
+  return sign_x / std::max(std::abs(x), epsilon);
+}
+
+cpu_ray_t cpu_ray_t::create(math::vec3 origin, math::vec3 direction) {
+  cpu_ray_t ray;
+  ray.origin            = origin;
+  ray.direction         = direction;
+  ray.inverse_direction = {safe_inverse(direction.x),
+                           safe_inverse(direction.y),
+                           safe_inverse(direction.z)};
+  ray.tmax              = 1e30f;
+  ray.tmin              = 0.0001f;
+  return ray;
+}
+
+bool intersect_triangle(const math::triangle_t &triangle, const cpu_ray_t &ray,
+                        float &t, float &u, float &v) {
+  const math::vec3 e1          = triangle.v0 - triangle.v1;
+  const math::vec3 e2          = triangle.v2 - triangle.v0;
+  const math::vec3 n           = math::cross(e1, e2);
+  const math::vec3 c           = triangle.v0 - ray.origin;
+  const math::vec3 r           = math::cross(ray.direction, c);
+  const float      inverse_det = 1.f / math::dot(n, ray.direction);
+
+  const float hit_u = math::dot(r, e2) * inverse_det;
+  const float hit_v = math::dot(r, e1) * inverse_det;
+  const float hit_w = 1.f - hit_u - hit_v;
+  if (hit_u >= 0 && hit_v >= 0 && hit_w >= 0) {
+    const float hit_t = math::dot(n, c) * inverse_det;
+    if (hit_t > ray.tmin && hit_t < ray.tmax) {
+      t = hit_t;
+      u = hit_u;
+      v = hit_v;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool intersect_aabb(math::vec3 min, math::vec3 max, const cpu_ray_t &ray,
+                           float &tmin) {
+  const math::vec3 t0 = (min - ray.origin) * ray.inverse_direction;
+  const math::vec3 t1 = (max - ray.origin) * ray.inverse_direction;
+  const math::vec3 near = math::min(t0, t1), far = math::max(t0, t1);
+  tmin = std::max(near.x, std::max(near.y, std::max(near.z, ray.tmin)));
+  const float tmax =
+      std::min(far.x, std::min(far.y, std::min(far.z, ray.tmax)));
+  return tmin <= tmax;
+}
+
+static void intersect_leaf(const bvh::node_t &leaf,
+                           const uint32_t    *prim_indices,
+                           const triangle_t *triangles, cpu_ray_t &ray,
+                           cpu_hit_t &hit, traversal_stats_t &stats) {
+  for (uint32_t i = 0; i < leaf.prim_count; i++) {
+    const uint32_t prim_index = prim_indices[leaf.first_index + i];
+    stats.triangle_tests++;
+    if (intersect_triangle(triangles[prim_index].triangle, ray, hit.t, hit.u,
+                           hit.v)) {
+      ray.tmax       = hit.t;
+      hit.prim_index = prim_index;
+    }
+  }
+}
+
+cpu_hit_t intersect_bvh(const bvh::node_t *nodes, const uint32_t *prim_indices,
+                        const triangle_t *triangles, cpu_ray_t ray,
+                        traversal_stats_t &stats) {
+  cpu_hit_t hit{};
+
+  float root_tmin;
+  if (!intersect_aabb(nodes[0].min, nodes[0].max, ray, root_tmin)) return hit;
+  if (nodes[0].is_leaf()) {
+    intersect_leaf(nodes[0], prim_indices, triangles, ray, hit, stats);
+    return hit;
+  }
+
+  traversal_stack_t<uint32_t> stack;
+  uint32_t                    current = nodes[0].first_index;
+
+  while (true) {
+    const bvh::node_t &left  = nodes[current + 0];
+    const bvh::node_t &right = nodes[current + 1];
+    stats.node_visits++;
+
+    float      left_tmin, right_tmin;
+    const bool left_hit  = intersect_aabb(left.min, left.max, ray, left_tmin);
+    const bool right_hit =
+        intersect_aabb(right.min, right.max, ray, right_tmin);
+
+    if (left_hit && left.is_leaf())
+      intersect_leaf(left, prim_indices, triangles, ray, hit, stats);
+    if (right_hit && right.is_leaf())
+      intersect_leaf(right, prim_indices, triangles, ray, hit, stats);
+
+    const bool left_internal  = left_hit && !left.is_leaf();
+    const bool right_internal = right_hit && !right.is_leaf();
+    if (left_internal && right_internal) {
+      if (left_tmin <= right_tmin) {
+        current = left.first_index;
+        stack.push(right.first_index);
+      } else {
+        current = right.first_index;
+        stack.push(left.first_index);
+      }
+    } else if (left_internal) {
+      current = left.first_index;
+    } else if (right_internal) {
+      current = right.first_index;
+    } else {
+      if (stack.empty()) return hit;
+      current = stack.pop();
+    }
+  }
+}
+
+// returns a hitmask, bits 24..31 are internal children in traversal order and
+// bits 0..23 are triangles relative to base_index_triangle, see
+// intersect_cwbvh_node in intersection.slang
+static uint32_t intersect_cwbvh_node(const cwbvh_node_t &node,
+                                     const cpu_ray_t    &ray,
+                                     uint32_t            oct_inv) {
+  std::array<float, 8> tmin, tmax;
+  tmin.fill(ray.tmin);
+  tmax.fill(ray.tmax);
+
+  const uint8_t *q_lo[3] = {node.q_lo_x, node.q_lo_y, node.q_lo_z};
+  const uint8_t *q_hi[3] = {node.q_hi_x, node.q_hi_y, node.q_hi_z};
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    // folds the power of two scale into the inverse direction
+    const float adjusted_inverse_direction =
+        std::bit_cast<float>(uint32_t(node.e[axis]) << 23) *
+        ray.inverse_direction[axis];
+    const float adjusted_origin =
+        (node.p[axis] - ray.origin[axis]) * ray.inverse_direction[axis];
+    // near and far planes swap for negative directions
+    const bool     negative = ray.direction[axis] < 0;
+    const uint8_t *near     = negative ? q_hi[axis] : q_lo[axis];
+    const uint8_t *far      = negative ? q_lo[axis] : q_hi[axis];
+    for (uint32_t i = 0; i < 8; i++) {
+      const float t0 = float(near[i]) * adjusted_inverse_direction;
+      const float t1 = float(far[i]) * adjusted_inverse_direction;
+      tmin[i]        = std::max(tmin[i], t0 + adjusted_origin);
+      tmax[i]        = std::min(tmax[i], t1 + adjusted_origin);
+    }
+  }
+
+  uint32_t hitmask = 0;
+  for (uint32_t i = 0; i < 8; i++) {
+    if (tmin[i] > tmax[i]) continue;
+    const uint32_t meta       = node.meta[i];
+    const bool     is_inner   = (meta & (meta << 1)) & 0x10;
+    const uint32_t bit_index  = (meta ^ (is_inner ? oct_inv : 0)) & 0x1f;
+    const uint32_t child_bits = meta >> 5;
+    hitmask |= child_bits << bit_index;
+  }
+  return hitmask;
+}
+
+cpu_hit_t intersect_cwbvh(const cwbvh_node_t *nodes,
+                          const uint32_t     *prim_indices,
+                          const triangle_t *triangles, cpu_ray_t ray,
+                          traversal_stats_t &stats) {
+  cpu_hit_t hit{};
+
+  // slot s of a node holds the child closest to a ray going into octant s,
+  // xor-ing with the inverse octant makes it the highest bit of the hitmask
+  const uint32_t octant = (ray.direction.x < 0 ? 4 : 0) |
+                          (ray.direction.y < 0 ? 2 : 0) |
+                          (ray.direction.z < 0 ? 1 : 0);
+  const uint32_t oct_inv = 7 - octant;
+
+  // (base index, hitmask), the root is the only child of a virtual node
+  using group_t = std::pair<uint32_t, uint32_t>;
+  traversal_stack_t<group_t> stack;
+  group_t                    node_group     = {0, 0x80000000};
+  group_t                    triangle_group = {0, 0};
+
+  while (true) {
+    if (node_group.second > 0x00ffffff) {
+      const uint32_t hits = node_group.second;
+      const uint32_t bit  = 31 - std::countl_zero(hits);
+      node_group.second &= ~(1u << bit);
+      if (node_group.second > 0x00ffffff) stack.push(node_group);
+
+      const uint32_t slot_index = (bit - 24) ^ oct_inv;
+      const uint32_t relative_index =
+          std::popcount(hits & ~(0xffffffffu << slot_index));
+      const cwbvh_node_t &node = nodes[node_group.first + relative_index];
+      stats.node_visits++;
+
+      const uint32_t hitmask = intersect_cwbvh_node(node, ray, oct_inv);
+      node_group     = {node.base_index_child,
+                        (hitmask & 0xff000000) | node.imask};
+      triangle_group = {node.base_index_triangle, hitmask & 0x00ffffff};
+    }
+
+    while (triangle_group.second != 0) {
+      const uint32_t bit = 31 - std::countl_zero(triangle_group.second);
+      triangle_group.second &= ~(1u << bit);
+
+      const uint32_t prim_index = prim_indices[triangle_group.first + bit];
+      stats.triangle_tests++;
+      if (intersect_triangle(triangles[prim_index].triangle, ray, hit.t, hit.u,
+                             hit.v)) {
+        ray.tmax       = hit.t;
+        hit.prim_index = prim_index;
+      }
+    }
+
+    if (node_group.second <= 0x00ffffff) {
+      if (stack.empty()) return hit;
+      node_group = stack.pop();
+    }
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef CPU_TRACER_HPP
+#define CPU_TRACER_HPP
+
+#include <cstdint>
+#include <limits>
+
+#include "assets.hpp"
+#include "bvh/bvh.hpp"
+#include "cwbvh.hpp"
+#include "math/math.hpp"
+#include "math/triangle.hpp"
+
+// cpu versions of the traversal in assets/shaders/intersection.slang, they
+// read the same buffers prepare uploads and serve as a gpu free baseline and
+// as a correctness oracle for the kernels
+
+static constexpr uint32_t cpu_null_index = std::numeric_limits<uint32_t>::max();
+
+// mirrors ray_t in assets/shaders/types.slang
+struct cpu_ray_t {
+  static cpu_ray_t create(math::vec3 origin, math::vec3 direction);
+
+  math::vec3 origin, direction, inverse_direction;
+  float      tmax, tmin;
+};
+
+struct cpu_hit_t {
+  bool did_intersect() const { return prim_index != cpu_null_index; }
+
+  uint32_t prim_index = cpu_null_index;
+  float    t          = 1e30f;
+  float    u = 0, v = 0;
+};
+
+// same units as the DEBUG_HIT counters, a node visit tests all children of
+// one node
+struct traversal_stats_t {
+  uint64_t node_visits    = 0;
+  uint64_t triangle_tests = 0;
+};
+
+bool intersect_triangle(const math::triangle_t &triangle, const cpu_ray_t &ray,
+                        float &t, float &u, float &v);
+
+cpu_hit_t intersect_bvh(const bvh::node_t *nodes, const uint32_t *prim_indices,
+                        const triangle_t *triangles, cpu_ray_t ray,
+                        traversal_stats_t &stats);
+
+// single ray, all 8 child boxes of a node are tested at once in lanes the
+// compiler can vectorize
+cpu_hit_t intersect_cwbvh(const cwbvh_node_t *nodes,
+                          const uint32_t     *prim_indices,
+                          const triangle_t *triangles, cpu_ray_t ray,
+                          traversal_stats_t &stats);
+
+#endif
@@ -0,0 +1,246 @@
+#include "culling.hpp"
+
+#include <volk.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "horizon/core/logger.hpp"
+#include "renderer.hpp"
+
+static gfx::handle_pipeline_t create_kernel(
+    shader_cache_t &shader_cache, gfx::handle_pipeline_layout_t pl,
+    const std::string &name) {
+  return shader_cache.create_compute_pipeline(
+      pl, "assets/shaders/" + name + ".slang");
+}
+
+static void barrier(gfx::context_t &context, gfx::handle_commandbuffer_t cbuf,
+                    VkPipelineStageFlags src_stage, VkAccessFlags src_access,
+                    VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) {
+  VkMemoryBarrier vk_memory_barrier{};
+  vk_memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  vk_memory_barrier.srcAccessMask = src_access;
+  vk_memory_barrier.dstAccessMask = dst_access;
+  vkCmdPipelineBarrier(context.get_commandbuffer(cbuf).vk_commandbuffer,
+                       src_stage, dst_stage, 0, 1, &vk_memory_barrier, 0,
+                       nullptr, 0, nullptr);
+}
+
+culling_t::culling_t(core::ref<gfx::context_t>   context,       //
+                     core::ref<gfx::base_t>      base,          //
+                     core::ref<gpu_auto_timer_t> auto_timer,    //
+                     core::ref<shader_cache_t>   shader_cache,  //
+                     core::ref<deletion_queue_t> deletion_queue)
+    : context(context),
+      base(base),
+      auto_timer(auto_timer),
+      shader_cache(shader_cache),
+      deletion_queue(deletion_queue) {
+  gfx::config_pipeline_layout_t cpl{};
+  cpl.add_descriptor_set_layout(base->_bindless_descriptor_set_layout);
+  cpl.add_push_constant(sizeof(push_constant_t), VK_SHADER_STAGE_ALL);
+  pl = context->create_pipeline_layout(cpl);
+
+  hiz_build     = create_kernel(*shader_cache, pl, "culling_hiz");
+  cull          = create_kernel(*shader_cache, pl, "culling_draws");
+  cull_meshlets = create_kernel(*shader_cache, pl, "culling_meshlets");
+
+  gfx::config_buffer_t cb{};
+  cb.vk_size               = sizeof(culling_counters_t);
+  cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                             VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                             VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  cb.vma_allocation_create_flags =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+  counters =
+      base->create_buffer(gfx::resource_update_policy_t::e_every_frame, cb);
+
+  cb.vk_size               = sizeof(core::camera_t);
+  cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  cb.vma_allocation_create_flags =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+  depth_camera_buffer =
+      base->create_buffer(gfx::resource_update_policy_t::e_every_frame, cb);
+}
+
+culling_t::~culling_t() {
+  for (auto buffer : {draws, tasks, meshlet_draws, hiz})
+    if (buffer != core::null_handle) context->destroy_buffer(buffer);
+}
+
+void culling_t::reserve(uint32_t draws_count, uint32_t meshlets_count,
+                        uint32_t width, uint32_t height) {
+  // the frames in flight keep culling into the old buffers
+  auto recreate = [&](gfx::handle_buffer_t &buffer, size_t size) {
+    deletion_queue->destroy_buffer(buffer);
+    gfx::config_buffer_t cb{};
+    cb.vk_size               = size;
+    cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                               VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    cb.vma_allocation_create_flags =
+        VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+    buffer = context->create_buffer(cb);
+  };
+  if (draws_count > draws_capacity) {
+    draws_capacity = draws_count;
+    recreate(draws, sizeof(draw_command_t) * draws_capacity);
+    recreate(tasks, sizeof(task_command_t) * draws_capacity);
+  }
+  if (meshlets_count > meshlets_capacity) {
+    meshlets_capacity = meshlets_count;
+    recreate(meshlet_draws, sizeof(meshlet_draw_t) * meshlets_capacity);
+  }
+
+  if (width == this->width && height == this->height) return;
+  deletion_queue->destroy_buffer(hiz);
+  this->width  = width;
+  this->height = height;
+
+  // level 0 is half the depth resolution, every level halves rounding up so
+  // a texel covers its whole 2x2 footprint including odd edges
+  size_t   texels = 0;
+  uint32_t w = width, h = height;
+  levels = 0;
+  do {
+    w = (w + 1) / 2;
+    h = (h + 1) / 2;
+    texels += size_t(w) * h;
+    levels++;
+  } while (w > 1 || h > 1);
+
+  gfx::config_buffer_t cb{};
+  cb.vk_size                     = sizeof(float) * texels;
+  cb.vk_buffer_usage_flags       = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  cb.vma_allocation_create_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+  hiz                            = context->create_buffer(cb);
+
+  horizon_info("culling: {} draws, {} meshlets, {} hi-z levels for {}x{}",
+               draws_capacity, meshlets_capacity, levels, width, height);
+}
+
+gfx::handle_buffer_t culling_t::frame_counters() const {
+  return base->buffer(counters);
+}
+
+void culling_t::render(gfx::handle_commandbuffer_t  cbuf,
+                       renderer_data_t             &renderer_data,
+                       gfx::handle_buffer_t         camera,
+                       const core::camera_t        &depth_camera,
+                       gfx::handle_bindless_image_t bdepth, bool depth_valid,
+                       bool meshlets) {
+  static const auto hiz_timer      = intern_timer("culling hi-z");
+  static const auto draws_timer    = intern_timer("culling draws");
+  static const auto meshlets_timer = intern_timer("culling meshlets");
+
+  horizon_assert(renderer_data.meshes_count <= draws_capacity &&
+                     renderer_data.meshlet_instances_count <=
+                         meshlets_capacity &&
+                     hiz != core::null_handle,
+                 "culling_t::reserve was not called");
+
+  // this frame in flight's counters were last written frames ago and are
+  // done, the gpu clears them below
+  gfx::handle_buffer_t counters_buffer = base->buffer(counters);
+  std::memcpy(&last_counters, context->map_buffer(counters_buffer),
+              sizeof(culling_counters_t));
+  std::memcpy(context->map_buffer(base->buffer(depth_camera_buffer)),
+              &depth_camera, sizeof(core::camera_t));
+
+  push_constant_t pc;
+  pc.camera =
+      gfx::to<core::camera_t *>(context->get_buffer_device_address(camera));
+  pc.depth_camera =
+      gfx::to<core::camera_t *>(context->get_buffer_device_address(
+          base->buffer(depth_camera_buffer)));
+  pc.meshes = gfx::to<gpu_mesh_t *>(
+      context->get_buffer_device_address(renderer_data.meshes_buffer));
+  pc.bounds = gfx::to<mesh_bounds_t *>(
+      context->get_buffer_device_address(renderer_data.mesh_bounds));
+  pc.source_draws = gfx::to<draw_command_t *>(
+      context->get_buffer_device_address(renderer_data.draw_commands));
+  pc.draws =
+      gfx::to<draw_command_t *>(context->get_buffer_device_address(draws));
+  pc.counters = gfx::to<culling_counters_t *>(
+      context->get_buffer_device_address(counters_buffer));
+  pc.hiz      = gfx::to<float *>(context->get_buffer_device_address(hiz));
+  pc.meshlets = gfx::to<meshlet_t *>(
+      context->get_buffer_device_address(renderer_data.meshlets_buffer));
+  pc.tasks =
+      gfx::to<task_command_t *>(context->get_buffer_device_address(tasks));
+  pc.meshlet_draws = gfx::to<meshlet_draw_t *>(
+      context->get_buffer_device_address(meshlet_draws));
+  pc.draws_count = renderer_data.meshes_count;
+  pc.width       = width;
+  pc.height      = height;
+  pc.levels      = levels;
+  pc.level       = 0;
+  pc.bdepth      = bdepth;
+  pc.frustum     = frustum;
+  pc.occlusion   = occlusion && depth_valid;
+  pc.backface    = backface;
+
+  auto bind = [&](gfx::handle_pipeline_t pipeline) {
+    context->cmd_bind_pipeline(cbuf, pipeline);
+    context->cmd_bind_descriptor_sets(cbuf, pipeline, 0,
+                                      {base->_bindless_descriptor_set});
+    context->cmd_push_constants(cbuf, pipeline, VK_SHADER_STAGE_ALL, 0,
+                                sizeof(push_constant_t), &pc);
+  };
+
+  // stages that read what culling writes
+  VkPipelineStageFlags draw_stages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                                     VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+#ifdef AURORA_MESH_SHADERS
+  draw_stages |= VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT;
+#endif
+
+  // the previous frame's draw may still read the draw lists and the pyramid
+  vkCmdFillBuffer(context->get_commandbuffer(cbuf).vk_commandbuffer,
+                  context->get_buffer(counters_buffer).vk_buffer, 0,
+                  sizeof(culling_counters_t), 0);
+  barrier(*context, cbuf,
+          VK_PIPELINE_STAGE_TRANSFER_BIT |
+              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | draw_stages,
+          VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+          VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+  if (pc.occlusion) {
+    auto_timer->start(cbuf, hiz_timer);
+    uint32_t w = width, h = height;
+    for (pc.level = 0; pc.level < levels; pc.level++) {
+      w = (w + 1) / 2;
+      h = (h + 1) / 2;
+      bind(hiz_build);
+      context->cmd_dispatch(cbuf, (w + 7) / 8, (h + 7) / 8, 1);
+      barrier(*context, cbuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+              VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+              VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+    auto_timer->end(cbuf, hiz_timer);
+  }
+
+  auto_timer->start(cbuf, draws_timer);
+  bind(cull);
+  context->cmd_dispatch(cbuf, (renderer_data.meshes_count + 63) / 64, 1, 1);
+  auto_timer->end(cbuf, draws_timer);
+
+  if (meshlets) {
+    barrier(*context, cbuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    // a workgroup per draw slot, slots past the visible count exit early
+    const uint32_t rows =
+        (renderer_data.meshes_count + meshlet_cull_row - 1) / meshlet_cull_row;
+    auto_timer->start(cbuf, meshlets_timer);
+    bind(cull_meshlets);
+    context->cmd_dispatch(
+        cbuf, std::min(renderer_data.meshes_count, meshlet_cull_row), rows, 1);
+    auto_timer->end(cbuf, meshlets_timer);
+  }
+
+  barrier(*context, cbuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+          VK_ACCESS_SHADER_WRITE_BIT, draw_stages,
+          VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+}
@@ -0,0 +1,123 @@
+#ifndef CULLING_HPP
+#define CULLING_HPP
+
+#include "assets.hpp"
+#include "frame_resources.hpp"
+#include "horizon/core/components.hpp"
+#include "horizon/core/core.hpp"
+#include "horizon/gfx/base.hpp"
+#include "horizon/gfx/context.hpp"
+#include "horizon/gfx/types.hpp"
+#include "shader_cache.hpp"
+#include "meshlet.hpp"
+
+struct gpu_auto_timer_t;
+
+// see assets/shaders/types.slang, draw_count and meshlet_draw_count are the
+// count buffers of the indirect draws
+struct culling_counters_t {
+  uint32_t draw_count;
+  uint32_t frustum_culled;
+  uint32_t occlusion_culled;
+  uint32_t meshlet_draw_count;
+  uint32_t meshlet_frustum_culled;
+  uint32_t meshlet_backface_culled;
+  uint32_t padding[2];
+};
+
+// per mesh culling ahead of the diffuse pass, meshes whose bounds are outside
+// the frustum or behind the hi-z pyramid of the previous frame's depth are
+// dropped from the draw list, the survivors are compacted into draws
+// occlusion is tested with the camera the depth was rendered with, a mesh
+// that becomes visible this frame shows up one frame late
+// every visible draw also gets a task_command_t for the mesh shader path, and
+// the compute fallback culls the meshlets of the visible draws into
+// meshlet_draws
+struct culling_t {
+  struct push_constant_t {
+    core::camera_t              *camera;
+    core::camera_t              *depth_camera;
+    gpu_mesh_t                  *meshes;
+    mesh_bounds_t               *bounds;
+    draw_command_t              *source_draws;
+    draw_command_t              *draws;
+    culling_counters_t          *counters;
+    float                       *hiz;
+    meshlet_t                   *meshlets;
+    task_command_t              *tasks;
+    meshlet_draw_t              *meshlet_draws;
+    uint32_t                     draws_count;
+    uint32_t                     width;
+    uint32_t                     height;
+    uint32_t                     levels;
+    uint32_t                     level;
+    gfx::handle_bindless_image_t bdepth;
+    uint32_t                     frustum;
+    uint32_t                     occlusion;
+    uint32_t                     backface;
+  };
+  static_assert(sizeof(push_constant_t) <= 128,
+                "push constants past 128 bytes are not guaranteed");
+
+  // the meshlet culling workgroups are laid out in rows of this many so the
+  // draw count can go past maxComputeWorkGroupCount[0], which is only
+  // guaranteed to be 65535, see culling_meshlets.slang
+  static constexpr uint32_t meshlet_cull_row = 1024;
+
+  culling_t(core::ref<gfx::context_t>   context,     //
+            core::ref<gfx::base_t>      base,        //
+            core::ref<gpu_auto_timer_t> auto_timer,  //
+            core::ref<shader_cache_t>   shader_cache,
+            core::ref<deletion_queue_t> deletion_queue);
+  ~culling_t();
+
+  // grows the compacted draw lists to draws_count and meshlets_count and the
+  // pyramid to a width x height depth, waits for the device if anything has
+  // to be reallocated
+  void reserve(uint32_t draws_count, uint32_t meshlets_count, uint32_t width,
+               uint32_t height);
+
+  // fills draws, tasks and this frame's counters, and meshlet_draws if
+  // meshlets is set, depth_valid says whether bdepth holds what depth_camera
+  // saw, the pyramid is only built and tested if so
+  void render(gfx::handle_commandbuffer_t cbuf, renderer_data_t &renderer_data,
+              gfx::handle_buffer_t camera, const core::camera_t &depth_camera,
+              gfx::handle_bindless_image_t bdepth, bool depth_valid,
+              bool meshlets);
+
+  // this frame in flight's counters, the draw counts are read from it
+  gfx::handle_buffer_t frame_counters() const;
+
+  core::ref<gfx::context_t>   context;
+  core::ref<gfx::base_t>      base;
+  core::ref<gpu_auto_timer_t> auto_timer;
+  core::ref<shader_cache_t>   shader_cache;
+  core::ref<deletion_queue_t> deletion_queue;
+
+  gfx::handle_pipeline_layout_t pl;
+  gfx::handle_pipeline_t        hiz_build;
+  gfx::handle_pipeline_t        cull;
+  gfx::handle_pipeline_t        cull_meshlets;
+
+  gfx::handle_buffer_t         draws         = core::null_handle;
+  gfx::handle_buffer_t         tasks         = core::null_handle;
+  gfx::handle_buffer_t         meshlet_draws = core::null_handle;
+  gfx::handle_buffer_t         hiz           = core::null_handle;
+  // host visible, read back frames in flight later like the noise counter
+  gfx::handle_managed_buffer_t counters;
+  gfx::handle_managed_buffer_t depth_camera_buffer;
+  uint32_t                     draws_capacity    = 0;
+  uint32_t                     meshlets_capacity = 0;
+  uint32_t                     width             = 0;
+  uint32_t                     height            = 0;
+  uint32_t                     levels            = 0;
+
+  bool frustum   = true;
+  bool occlusion = true;
+  // meshlet normal cones, only the meshlet paths test them
+  bool backface  = true;
+  // the counters as of the last time this frame in flight finished
+  culling_counters_t last_counters{};
+};
+
+#endif
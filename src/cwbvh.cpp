@@ -0,0 +1,259 @@
+#include "cwbvh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <deque>
+#include <limits>
+
+namespace {
+
+// a leaf slot in a cwbvh node holds at most 3 triangles
+constexpr uint32_t max_leaf_triangles = 3;
+
+struct binary_node_t {
+  math::vec3 min, max;
+  uint32_t   left = 0, right = 0;
+  uint32_t   first_index = 0, prim_count = 0;
+
+  bool  is_leaf() const { return prim_count > 0; }
+  float area() const {
+    const math::vec3 e = max - min;
+    return 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+  }
+};
+
+struct binary_tree_t {
+  std::vector<binary_node_t> nodes;
+  std::vector<uint32_t>      prim_indices;
+};
+
+void triangle_bounds(const triangle_t &triangle, math::vec3 &min,
+                     math::vec3 &max) {
+  const math::triangle_t &t = triangle.triangle;
+  min = math::min(t.v0, math::min(t.v1, t.v2));
+  max = math::max(t.v0, math::max(t.v1, t.v2));
+}
+
+// splits leaves with more than max_leaf_triangles in half along their longest
+// axis, presplit leaves can reference more triangles than a slot can hold
+void split_leaf(binary_tree_t &tree, uint32_t node_index,
+                const triangle_t *triangles) {
+  binary_node_t node = tree.nodes[node_index];
+  if (node.prim_count <= max_leaf_triangles) return;
+
+  const math::vec3 extent = node.max - node.min;
+  const uint32_t   axis   = extent.x > extent.y
+                                ? (extent.x > extent.z ? 0 : 2)
+                                : (extent.y > extent.z ? 1 : 2);
+  auto             begin  = tree.prim_indices.begin() + node.first_index;
+  auto             end    = begin + node.prim_count;
+  auto             center = [&](uint32_t prim) {
+    math::vec3 min, max;
+    triangle_bounds(triangles[prim], min, max);
+    return math::max(min, node.min)[axis] + math::min(max, node.max)[axis];
+  };
+  std::sort(begin, end,
+            [&](uint32_t a, uint32_t b) { return center(a) < center(b); });
+
+  const uint32_t half = node.prim_count / 2;
+  const uint32_t left = tree.nodes.size();
+  for (uint32_t i = 0; i < 2; i++) {
+    binary_node_t child{};
+    child.first_index = node.first_index + (i == 0 ? 0 : half);
+    child.prim_count  = i == 0 ? half : node.prim_count - half;
+    child.min         = math::vec3{std::numeric_limits<float>::max()};
+    child.max         = math::vec3{-std::numeric_limits<float>::max()};
+    for (uint32_t j = 0; j < child.prim_count; j++) {
+      math::vec3 min, max;
+      triangle_bounds(triangles[tree.prim_indices[child.first_index + j]], min,
+                      max);
+      child.min = math::min(child.min, min);
+      child.max = math::max(child.max, max);
+    }
+    // presplit references are only valid inside the original leaf
+    child.min = math::max(child.min, node.min);
+    child.max = math::min(child.max, node.max);
+    tree.nodes.push_back(child);
+  }
+  tree.nodes[node_index].left       = left;
+  tree.nodes[node_index].right      = left + 1;
+  tree.nodes[node_index].prim_count = 0;
+  split_leaf(tree, left, triangles);
+  split_leaf(tree, left + 1, triangles);
+}
+
+binary_tree_t copy_binary_tree(const bvh::node_t *nodes,
+                               const uint32_t    *prim_indices,
+                               size_t             prim_indices_count,
+                               const triangle_t  *triangles) {
+  binary_tree_t tree{};
+  tree.prim_indices.assign(prim_indices, prim_indices + prim_indices_count);
+
+  // (source node, destination node)
+  std::vector<std::pair<uint32_t, uint32_t>> stack{{0, 0}};
+  tree.nodes.emplace_back();
+  while (!stack.empty()) {
+    auto [source, destination] = stack.back();
+    stack.pop_back();
+    const bvh::node_t &node         = nodes[source];
+    tree.nodes[destination].min     = node.min;
+    tree.nodes[destination].max     = node.max;
+    if (node.prim_count > 0) {
+      tree.nodes[destination].first_index = node.first_index;
+      tree.nodes[destination].prim_count  = node.prim_count;
+      continue;
+    }
+    const uint32_t left            = tree.nodes.size();
+    tree.nodes[destination].left   = left;
+    tree.nodes[destination].right  = left + 1;
+    tree.nodes.resize(tree.nodes.size() + 2);
+    stack.push_back({node.first_index + 0, left});
+    stack.push_back({node.first_index + 1, left + 1});
+  }
+
+  const uint32_t count = tree.nodes.size();
+  for (uint32_t i = 0; i < count; i++)
+    if (tree.nodes[i].is_leaf()) split_leaf(tree, i, triangles);
+  return tree;
+}
+
+// greedily opens the internal child with the largest surface area until the
+// node has 8 children
+std::vector<uint32_t> collect_children(const binary_tree_t &tree,
+                                       uint32_t             node_index) {
+  const binary_node_t &node = tree.nodes[node_index];
+  if (node.is_leaf()) return {node_index};
+
+  std::vector<uint32_t> children{node.left, node.right};
+  while (children.size() < 8) {
+    int32_t best = -1;
+    for (uint32_t i = 0; i < children.size(); i++) {
+      const binary_node_t &child = tree.nodes[children[i]];
+      if (child.is_leaf()) continue;
+      if (best == -1 || child.area() > tree.nodes[children[best]].area())
+        best = i;
+    }
+    if (best == -1) break;
+    const binary_node_t &child = tree.nodes[children[best]];
+    children[best]             = child.left;
+    children.push_back(child.right);
+  }
+  return children;
+}
+
+// slot s is meant for the child that a ray travelling into octant s reaches
+// first, traversal then visits children front to back by walking the slots in
+// an order derived from the ray octant
+std::array<int32_t, 8> assign_slots(const binary_tree_t        &tree,
+                                    const binary_node_t        &parent,
+                                    const std::vector<uint32_t> &children) {
+  const math::vec3 parent_center = (parent.min + parent.max) * 0.5f;
+  float            cost[8][8];
+  for (uint32_t c = 0; c < children.size(); c++) {
+    const binary_node_t &child = tree.nodes[children[c]];
+    const math::vec3     d     = (child.min + child.max) * 0.5f - parent_center;
+    for (uint32_t s = 0; s < 8; s++) {
+      const math::vec3 direction{(s & 4) ? -1.f : 1.f, (s & 2) ? -1.f : 1.f,
+                                 (s & 1) ? -1.f : 1.f};
+      cost[c][s] = math::dot(d, direction);
+    }
+  }
+
+  std::array<int32_t, 8> slots;
+  slots.fill(-1);
+  std::vector<bool> assigned(children.size(), false);
+  for (uint32_t n = 0; n < children.size(); n++) {
+    float    best_cost = std::numeric_limits<float>::max();
+    uint32_t best_c = 0, best_s = 0;
+    for (uint32_t c = 0; c < children.size(); c++) {
+      if (assigned[c]) continue;
+      for (uint32_t s = 0; s < 8; s++) {
+        if (slots[s] != -1 || cost[c][s] >= best_cost) continue;
+        best_cost = cost[c][s];
+        best_c    = c;
+        best_s    = s;
+      }
+    }
+    slots[best_s]    = best_c;
+    assigned[best_c] = true;
+  }
+  return slots;
+}
+
+}  // namespace
+
+cwbvh_t build_cwbvh(const bvh::node_t *nodes, const uint32_t *prim_indices,
+                    size_t prim_indices_count, const triangle_t *triangles) {
+  const binary_tree_t tree =
+      copy_binary_tree(nodes, prim_indices, prim_indices_count, triangles);
+
+  cwbvh_t cwbvh{};
+  cwbvh.nodes.emplace_back();
+  // (cwbvh node, binary node)
+  std::deque<std::pair<uint32_t, uint32_t>> queue{{0, 0}};
+  while (!queue.empty()) {
+    auto [wide_index, binary_index] = queue.front();
+    queue.pop_front();
+
+    const binary_node_t  &parent   = tree.nodes[binary_index];
+    std::vector<uint32_t> children = collect_children(tree, binary_index);
+    std::array<int32_t, 8> slots   = assign_slots(tree, parent, children);
+
+    cwbvh_node_t node{};
+    node.p = parent.min;
+    math::vec3 scale;
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      const float extent = parent.max[axis] - parent.min[axis];
+      int32_t     exponent =
+          extent > 0.f ? int32_t(std::ceil(std::log2(extent / 255.f))) : -126;
+      exponent       = std::clamp(exponent, -126, 127);
+      node.e[axis]   = uint8_t(exponent + 127);
+      scale[axis]    = std::ldexp(1.f, exponent);
+    }
+
+    uint32_t internal_count = 0;
+    for (int32_t child : slots)
+      if (child != -1 && !tree.nodes[children[child]].is_leaf())
+        internal_count++;
+    node.base_index_child    = cwbvh.nodes.size();
+    node.base_index_triangle = cwbvh.prim_indices.size();
+
+    uint32_t internal_offset = 0, triangle_offset = 0;
+    for (uint32_t s = 0; s < 8; s++) {
+      if (slots[s] == -1) continue;
+      const uint32_t       child_index = children[slots[s]];
+      const binary_node_t &child       = tree.nodes[child_index];
+
+      auto quantize = [&](uint32_t axis, bool upper) {
+        const float value = upper ? child.max[axis] : child.min[axis];
+        const float q     = (value - node.p[axis]) / scale[axis];
+        return uint8_t(std::clamp(upper ? std::ceil(q) : std::floor(q), 0.f,
+                                  255.f));
+      };
+      node.q_lo_x[s] = quantize(0, false);
+      node.q_hi_x[s] = quantize(0, true);
+      node.q_lo_y[s] = quantize(1, false);
+      node.q_hi_y[s] = quantize(1, true);
+      node.q_lo_z[s] = quantize(2, false);
+      node.q_hi_z[s] = quantize(2, true);
+
+      if (child.is_leaf()) {
+        const uint32_t unary = (1u << child.prim_count) - 1;
+        node.meta[s]         = uint8_t((unary << 5) | triangle_offset);
+        for (uint32_t i = 0; i < child.prim_count; i++)
+          cwbvh.prim_indices.push_back(
+              tree.prim_indices[child.first_index + i]);
+        triangle_offset += child.prim_count;
+      } else {
+        node.meta[s] = uint8_t((1u << 5) | (24 + s));
+        node.imask |= uint8_t(1u << s);
+        queue.push_back({node.base_index_child + internal_offset, child_index});
+        internal_offset++;
+      }
+    }
+    cwbvh.nodes.resize(cwbvh.nodes.size() + internal_count);
+    cwbvh.nodes[wide_index] = node;
+  }
+  return cwbvh;
+}
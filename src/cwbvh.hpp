@@ -0,0 +1,43 @@
+#ifndef CWBVH_HPP
+#define CWBVH_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "assets.hpp"
+#include "bvh/bvh.hpp"
+#include "math/math.hpp"
+
+// compressed 8 wide node from ylitie et al., "efficient incoherent ray
+// traversal on gpus through compressed wide bvhs"
+// child bounds are quantized to 8 bits relative to p with a power of two
+// scale per axis, e holds the biased float exponent of that scale
+struct cwbvh_node_t {
+  math::vec3 p;
+  uint8_t    e[3];
+  uint8_t    imask;  // bit i set if slot i is an internal node
+  uint32_t   base_index_child;
+  uint32_t   base_index_triangle;
+  // internal: 001 in the top 3 bits, 24 + slot in the low 5
+  // leaf: triangle count in unary in the top 3 bits, triangle offset in the low
+  // 5, empty: 0
+  uint8_t    meta[8];
+  uint8_t    q_lo_x[8];
+  uint8_t    q_hi_x[8];
+  uint8_t    q_lo_y[8];
+  uint8_t    q_hi_y[8];
+  uint8_t    q_lo_z[8];
+  uint8_t    q_hi_z[8];
+};
+static_assert(sizeof(cwbvh_node_t) == 80, "sizeof(cwbvh_node_t) should be 80");
+
+struct cwbvh_t {
+  std::vector<cwbvh_node_t> nodes;
+  std::vector<uint32_t>     prim_indices;
+};
+
+// collapses a binary bvh whose prim indices point into triangles
+cwbvh_t build_cwbvh(const bvh::node_t *nodes, const uint32_t *prim_indices,
+                    size_t prim_indices_count, const triangle_t *triangles);
+
+#endif
@@ -18,12 +18,12 @@ class editor_camera_t : public core::camera_t {
   }
 
   void update_projection(float aspect_ratio) {
-    static float s_aspect_ratio = 0;
-    if (s_aspect_ratio != aspect_ratio) {
+    if (_aspect_ratio != aspect_ratio || _projection_fov != fov) {
       projection =
           glm::perspective(glm::radians(fov), aspect_ratio, near, far) *
           math::scale(math::mat4{1.f}, math::vec3{1.f, -1.f, 1.f});
-      s_aspect_ratio = aspect_ratio;
+      _aspect_ratio   = aspect_ratio;
+      _projection_fov = fov;
     }
   }
 
@@ -61,6 +61,25 @@ class editor_camera_t : public core::camera_t {
       if (_pitch < -89.0f) _pitch = -89.0f;
     }
 
+    update_view(position);
+  }
+
+  // places the camera without reading any input, used by the headless path
+  void set_pose(glm::vec3 position, float yaw, float pitch, float width,
+                float height) {
+    _yaw   = yaw;
+    _pitch = glm::clamp(pitch, -89.0f, 89.0f);
+    update_projection(float(width) / float(height));
+    update_view(position);
+  }
+
+  float fov{45.0f};
+  float camera_speed_multiplyer{1.0f};
+  float far{10000.0f};
+  float near{0.1f};
+
+ private:
+  void update_view(glm::vec3 position) {
     glm::vec3 front;
     front.x = glm::cos(glm::radians(_yaw)) * glm::cos(glm::radians(_pitch));
     front.y = glm::sin(glm::radians(_pitch));
@@ -74,12 +93,6 @@ class editor_camera_t : public core::camera_t {
     core::camera_t::update();
   }
 
-  float fov{45.0f};
-  float camera_speed_multiplyer{1.0f};
-  float far{10000.0f};
-  float near{0.1f};
-
- private:
   core::window_t &_window;
 
   glm::vec3 _front{0.0f};
@@ -92,6 +105,9 @@ class editor_camera_t : public core::camera_t {
   float _pitch{0.0f};
   float _mouse_speed{0.005f};
   float _mouse_sensitivity{100.0f};
+
+  float _aspect_ratio{0.0f};
+  float _projection_fov{0.0f};
 };
 
 #endif
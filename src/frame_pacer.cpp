@@ -0,0 +1,115 @@
+#include "frame_pacer.hpp"
+
+#include <volk.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "horizon/core/logger.hpp"
+#include "horizon/gfx/context.hpp"
+#include "vulkan_handles.hpp"
+
+present_mode_t present_mode_from_string(const std::string &mode) {
+  if (mode == "mailbox") return present_mode_t::e_mailbox;
+  if (mode == "immediate") return present_mode_t::e_immediate;
+  return present_mode_t::e_fifo;
+}
+
+const char *to_string(present_mode_t mode) {
+  switch (mode) {
+    case present_mode_t::e_fifo:
+      return "fifo";
+    case present_mode_t::e_mailbox:
+      return "mailbox";
+    case present_mode_t::e_immediate:
+      return "immediate";
+  }
+  return "fifo";
+}
+
+VkPresentModeKHR to_vk_present_mode(present_mode_t mode) {
+  switch (mode) {
+    case present_mode_t::e_fifo:
+      return VK_PRESENT_MODE_FIFO_KHR;
+    case present_mode_t::e_mailbox:
+      return VK_PRESENT_MODE_MAILBOX_KHR;
+    case present_mode_t::e_immediate:
+      return VK_PRESENT_MODE_IMMEDIATE_KHR;
+  }
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+present_mode_t set_present_mode(gfx::base_t &base, present_mode_t mode) {
+  VkPhysicalDevice physical_device = vk_physical_device(*base._context);
+  VkSurfaceKHR     surface         = vk_surface(base);
+  uint32_t         count           = 0;
+  vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &count,
+                                            nullptr);
+  std::vector<VkPresentModeKHR> vk_present_modes(count);
+  vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &count,
+                                            vk_present_modes.data());
+  if (std::find(vk_present_modes.begin(), vk_present_modes.end(),
+                to_vk_present_mode(mode)) == vk_present_modes.end()) {
+    horizon_info("present mode {} is not supported, using fifo",
+                 to_string(mode));
+    mode = present_mode_t::e_fifo;
+  }
+
+  base._context->wait_idle();
+  base.recreate_swapchain(to_vk_present_mode(mode));
+  horizon_info("present mode {}", to_string(mode));
+  return mode;
+}
+
+frame_pacer_t::frame_pacer_t(float target_fps) {
+  set_target_fps(target_fps);
+  deadline    = std::chrono::steady_clock::now();
+  frame_start = deadline;
+}
+
+void frame_pacer_t::set_target_fps(float target_fps) {
+  this->target_fps = target_fps;
+  period           = {};
+  if (target_fps > 0.f)
+    period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / target_fps));
+}
+
+void frame_pacer_t::wait() {
+  if (period.count() > 0) {
+    deadline += period;
+    auto now = std::chrono::steady_clock::now();
+    if (deadline < now) {
+      // a frame that ran long restarts the schedule instead of rushing the
+      // next ones to catch up
+      deadline = now;
+    } else {
+      if (deadline - now > spin_threshold)
+        std::this_thread::sleep_until(deadline - spin_threshold);
+      while (std::chrono::steady_clock::now() < deadline)
+        std::this_thread::yield();
+    }
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  interval.push(
+      std::chrono::duration<float, std::milli>(now - frame_start).count());
+  frame_start = now;
+  presenting  = {};
+}
+
+void frame_pacer_t::present_begin() {
+  present_start = std::chrono::steady_clock::now();
+}
+
+void frame_pacer_t::present_end() {
+  presenting += std::chrono::steady_clock::now() - present_start;
+}
+
+void frame_pacer_t::end_frame() {
+  const auto frame = std::chrono::steady_clock::now() - frame_start;
+  cpu.push(std::chrono::duration<float, std::milli>(frame - presenting)
+               .count());
+  present.push(std::chrono::duration<float, std::milli>(presenting).count());
+}
@@ -0,0 +1,64 @@
+#ifndef FRAME_PACER_HPP
+#define FRAME_PACER_HPP
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan_core.h>
+
+#include <chrono>
+#include <string>
+
+#include "gpu_timer.hpp"
+#include "horizon/gfx/base.hpp"
+
+enum class present_mode_t {
+  e_fifo,
+  e_mailbox,
+  e_immediate,
+};
+
+present_mode_t   present_mode_from_string(const std::string &mode);
+const char      *to_string(present_mode_t mode);
+VkPresentModeKHR to_vk_present_mode(present_mode_t mode);
+
+// recreates base's swapchain with mode, waits for the device first, modes
+// the surface does not support fall back to fifo, which every surface has,
+// returns the mode that was set
+present_mode_t set_present_mode(gfx::base_t &base, present_mode_t mode);
+
+// paces the interactive loop to target_fps on the steady clock, the thread
+// sleeps until shortly before the frame is due and spins the rest, a target
+// of 0 is uncapped, cpu time is what the frame spent outside of wait and
+// the present calls, present time is what it spent blocked in them
+struct frame_pacer_t {
+  // how much earlier than the deadline a sleep has to end, covers the
+  // scheduler's wake up latency
+  static constexpr auto spin_threshold = std::chrono::microseconds(1500);
+
+  frame_pacer_t(float target_fps);
+
+  void set_target_fps(float target_fps);
+
+  // blocks until the next frame is due
+  void wait();
+
+  // around base_t::begin and base_t::end, they block on the swapchain and
+  // the frames in flight
+  void present_begin();
+  void present_end();
+
+  // pushes the frame's cpu and present time into their histories
+  void end_frame();
+
+  float                                 target_fps;
+  std::chrono::steady_clock::duration   period{};
+  std::chrono::steady_clock::time_point deadline;
+  std::chrono::steady_clock::time_point frame_start;
+  std::chrono::steady_clock::time_point present_start;
+  std::chrono::steady_clock::duration   presenting{};
+  // wall clock between frames, cpu work and blocked in present, in ms
+  timer_history_t                       interval;
+  timer_history_t                       cpu;
+  timer_history_t                       present;
+};
+
+#endif
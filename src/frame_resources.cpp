@@ -0,0 +1,49 @@
+#include "frame_resources.hpp"
+
+#include <algorithm>
+
+#include "horizon/core/logger.hpp"
+
+deletion_queue_t::deletion_queue_t(core::ref<gfx::context_t> context)
+    : context(context) {}
+
+deletion_queue_t::~deletion_queue_t() {
+  for (auto &r : retired) r.destroy();
+}
+
+void deletion_queue_t::destroy_buffer(gfx::handle_buffer_t buffer) {
+  if (buffer == core::null_handle) return;
+  retired.push_back({frame, [=, this] { context->destroy_buffer(buffer); }});
+}
+
+void deletion_queue_t::destroy_image(gfx::handle_image_t image) {
+  if (image == core::null_handle) return;
+  retired.push_back({frame, [=, this] { context->destroy_image(image); }});
+}
+
+void deletion_queue_t::destroy_image_view(
+    gfx::handle_image_view_t image_view) {
+  if (image_view == core::null_handle) return;
+  retired.push_back(
+      {frame, [=, this] { context->destroy_image_view(image_view); }});
+}
+
+void deletion_queue_t::update() {
+  frame++;
+  // retired in order, the oldest are at the front
+  while (!retired.empty() && retired.front().frame + frame_ring_size <= frame) {
+    retired.front().destroy();
+    retired.pop_front();
+  }
+}
+
+void frames_in_flight_check_t::update(gfx::handle_buffer_t frame_buffer) {
+  if (frames == frames_count) return;
+  frames++;
+  if (std::find(copies.begin(), copies.end(), frame_buffer) == copies.end())
+    copies.push_back(frame_buffer);
+  horizon_assert(copies.size() <= max_frames_in_flight,
+                 "horizon keeps at least {} frames in flight, "
+                 "max_frames_in_flight is {}",
+                 copies.size(), max_frames_in_flight);
+}
@@ -0,0 +1,62 @@
+#ifndef FRAME_RESOURCES_HPP
+#define FRAME_RESOURCES_HPP
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "horizon/core/core.hpp"
+#include "horizon/gfx/context.hpp"
+#include "horizon/gfx/types.hpp"
+
+// horizon's base_t keeps at most this many frames in flight, begin waits for
+// the frame that last used the slot it is about to record into, horizon does
+// not expose its count, frames_in_flight_check_t checks it at runtime
+static constexpr uint32_t max_frames_in_flight = 3;
+// slots of a per frame ring that the cpu reads back or frees, a slot is only
+// touched again once the frame that last used it has finished
+static constexpr uint32_t frame_ring_size = max_frames_in_flight + 1;
+
+// destroys resources once no frame in flight can still use them, instead of
+// waiting for the device, a resource retired during a frame's recording is
+// still used by the frames before it, so it lives for frame_ring_size more
+// calls to update
+struct deletion_queue_t {
+  deletion_queue_t(core::ref<gfx::context_t> context);
+  // destroys whatever is left, the device has to be idle
+  ~deletion_queue_t();
+
+  void destroy_buffer(gfx::handle_buffer_t buffer);
+  void destroy_image(gfx::handle_image_t image);
+  void destroy_image_view(gfx::handle_image_view_t image_view);
+
+  // once per frame before recording, destroys what has aged out
+  void update();
+
+  struct retired_t {
+    uint64_t              frame;
+    std::function<void()> destroy;
+  };
+
+  core::ref<gfx::context_t> context;
+
+  uint64_t              frame = 0;
+  std::deque<retired_t> retired;
+};
+
+// a managed buffer has a copy per frame in flight, so the distinct copies
+// base_t::buffer hands out over the first frames are horizon's frame count,
+// asserts that it is at most max_frames_in_flight
+struct frames_in_flight_check_t {
+  // frames watched, enough for any ring to wrap around
+  static constexpr uint32_t frames_count = 4 * frame_ring_size;
+
+  // once per frame with the current copy of the same managed buffer
+  void update(gfx::handle_buffer_t frame_buffer);
+
+  std::vector<gfx::handle_buffer_t> copies;
+  uint32_t                          frames = 0;
+};
+
+#endif
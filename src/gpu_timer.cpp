@@ -0,0 +1,297 @@
+#include "gpu_timer.hpp"
+
+#include <volk.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <mutex>
+
+#include "horizon/core/logger.hpp"
+#include "horizon/gfx/context.hpp"
+#include "json.hpp"
+#include "vulkan_handles.hpp"
+
+namespace {
+
+std::mutex                                     intern_mutex;
+std::map<std::string, timer_id_t, std::less<>> interned;
+// a deque keeps the names in place as it grows
+std::deque<std::string>                        names;
+
+float query_timestamp_period(gfx::context_t &context) {
+  VkPhysicalDeviceProperties vk_physical_device_properties;
+  vkGetPhysicalDeviceProperties(vk_physical_device(context),
+                                &vk_physical_device_properties);
+  return vk_physical_device_properties.limits.timestampPeriod;
+}
+
+}  // namespace
+
+timer_id_t intern_timer(std::string_view name) {
+  std::scoped_lock lock{intern_mutex};
+  auto             itr = interned.find(name);
+  if (itr != interned.end()) return itr->second;
+  const timer_id_t id = timer_id_t(names.size());
+  names.emplace_back(name);
+  interned.emplace(names.back(), id);
+  return id;
+}
+
+const std::string &timer_name(timer_id_t id) {
+  std::scoped_lock lock{intern_mutex};
+  return names[id];
+}
+
+void timer_history_t::push(float ms) {
+  last = ms;
+  if (samples.size() < capacity) {
+    samples.push_back(ms);
+    return;
+  }
+  samples[next] = ms;
+  next          = (next + 1) % capacity;
+}
+
+void timer_history_t::clear() {
+  samples.clear();
+  next = 0;
+  last = 0.f;
+}
+
+float timer_history_t::min() const {
+  if (samples.empty()) return 0.f;
+  return *std::min_element(samples.begin(), samples.end());
+}
+
+float timer_history_t::avg() const {
+  if (samples.empty()) return 0.f;
+  double sum = 0;
+  for (float sample : samples) sum += sample;
+  return float(sum / samples.size());
+}
+
+float timer_history_t::p99() const {
+  if (samples.empty()) return 0.f;
+  std::vector<float> sorted = samples;
+  auto nth = sorted.begin() + size_t(0.99 * (sorted.size() - 1));
+  std::nth_element(sorted.begin(), nth, sorted.end());
+  return *nth;
+}
+
+gpu_auto_timer_t::gpu_auto_timer_t(core::ref<gfx::base_t> base) : base(base) {
+  gfx::context_t &context = *base->_context;
+  timestamp_period        = query_timestamp_period(context);
+
+  VkQueryPoolCreateInfo vk_query_pool_create_info{};
+  vk_query_pool_create_info.sType =
+      VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  vk_query_pool_create_info.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+  vk_query_pool_create_info.queryCount = frames_count * frame_queries;
+  check(vkCreateQueryPool(vk_device(context), &vk_query_pool_create_info,
+                          nullptr, &vk_query_pool) == VK_SUCCESS,
+        "failed to create the timer query pool");
+
+  frames.resize(frames_count);
+  for (auto &frame : frames) frame.scopes.reserve(max_scopes);
+}
+
+gpu_auto_timer_t::~gpu_auto_timer_t() {
+  vkDestroyQueryPool(vk_device(*base->_context), vk_query_pool, nullptr);
+}
+
+gpu_auto_timer_t::scope_t &gpu_auto_timer_t::scope(timer_id_t id) {
+  if (id >= scopes.size()) scopes.resize(id + 1);
+  return scopes[id];
+}
+
+double gpu_auto_timer_t::now() const {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - epoch)
+      .count();
+}
+
+void gpu_auto_timer_t::begin_frame(gfx::handle_commandbuffer_t cbuf) {
+  frame++;
+  const uint32_t index = frame % frames_count;
+  frame_t       &slot  = frames[index];
+  if (slot.frame != 0) read_back(slot);
+
+  // the cpu scopes of the frame that just ended
+  for (auto &s : scopes) {
+    if (!s.cpu_seen) continue;
+    s.cpu.push(s.cpu_frame_ms);
+    s.cpu_frame_ms = 0.f;
+    s.cpu_seen     = false;
+  }
+
+  VkCommandBuffer vk_commandbuffer =
+      base->_context->get_commandbuffer(cbuf).vk_commandbuffer;
+  vkCmdResetQueryPool(vk_commandbuffer, vk_query_pool, index * frame_queries,
+                      frame_queries);
+  vkCmdWriteTimestamp(vk_commandbuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                      vk_query_pool, index * frame_queries);
+
+  slot.frame      = frame;
+  slot.generation = generation;
+  slot.cpu_begin  = now();
+  slot.queries    = 2;
+  slot.ended      = false;
+  slot.scopes.clear();
+  current = &slot;
+  open.clear();
+}
+
+void gpu_auto_timer_t::start(gfx::handle_commandbuffer_t cbuf,
+                             timer_id_t                  id) {
+  // a scope that does not fit is still pushed so its end matches
+  if (!current || current->queries + 2 > frame_queries) {
+    dropped++;
+    open.push_back(uint32_t(-1));
+    return;
+  }
+  const uint32_t index = uint32_t(current - frames.data());
+  gpu_scope_t    s{id, uint32_t(open.size()), current->queries++, 0};
+  vkCmdWriteTimestamp(
+      base->_context->get_commandbuffer(cbuf).vk_commandbuffer,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, vk_query_pool,
+      index * frame_queries + s.begin_query);
+  open.push_back(uint32_t(current->scopes.size()));
+  current->scopes.push_back(s);
+}
+
+void gpu_auto_timer_t::end(gfx::handle_commandbuffer_t cbuf, timer_id_t id) {
+  horizon_assert(!open.empty(), "{} ended without a start", timer_name(id));
+  const uint32_t top = open.back();
+  open.pop_back();
+  if (top == uint32_t(-1)) return;
+  gpu_scope_t &s = current->scopes[top];
+  horizon_assert(s.id == id, "{} ended inside {}", timer_name(id),
+                 timer_name(s.id));
+  const uint32_t index = uint32_t(current - frames.data());
+  s.end_query          = current->queries++;
+  vkCmdWriteTimestamp(
+      base->_context->get_commandbuffer(cbuf).vk_commandbuffer,
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, vk_query_pool,
+      index * frame_queries + s.end_query);
+}
+
+void gpu_auto_timer_t::end_frame(gfx::handle_commandbuffer_t cbuf) {
+  if (!current) return;
+  const uint32_t index = uint32_t(current - frames.data());
+  vkCmdWriteTimestamp(
+      base->_context->get_commandbuffer(cbuf).vk_commandbuffer,
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, vk_query_pool,
+      index * frame_queries + 1);
+  current->ended = true;
+}
+
+void gpu_auto_timer_t::cpu_start(timer_id_t id) {
+  cpu_open.push_back({id, now()});
+}
+
+void gpu_auto_timer_t::cpu_end(timer_id_t id) {
+  horizon_assert(!cpu_open.empty() && cpu_open.back().first == id,
+                 "{} ended without a start", timer_name(id));
+  const double begin    = cpu_open.back().second;
+  const double duration = now() - begin;
+  cpu_open.pop_back();
+  scope_t &s = scope(id);
+  s.cpu_frame_ms += float(duration / 1000.0);
+  s.cpu_seen = true;
+  s.depth    = uint32_t(cpu_open.size());
+  trace.push_back({id, false, s.depth, begin, duration});
+  if (trace.size() > max_trace_events) trace.pop_front();
+}
+
+void gpu_auto_timer_t::read_back(frame_t &f) {
+  const uint64_t frame_generation = f.generation;
+  f.frame                         = 0;
+  if (frame_generation != generation) return;
+
+  // a value and an availability word per query
+  std::vector<uint64_t> results(size_t(f.queries) * 2);
+  const uint32_t        index     = uint32_t(&f - frames.data());
+  const VkResult        vk_result = vkGetQueryPoolResults(
+      vk_device(*base->_context), vk_query_pool, index * frame_queries,
+      f.queries, results.size() * sizeof(uint64_t), results.data(),
+      2 * sizeof(uint64_t),
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+  if (vk_result != VK_SUCCESS && vk_result != VK_NOT_READY) return;
+  auto available = [&](uint32_t query) { return results[query * 2 + 1]; };
+  auto timestamp = [&](uint32_t query) {
+    return double(results[query * 2]);
+  };
+  if (!available(0)) return;
+
+  // ticks to microseconds
+  const double to_us = timestamp_period / 1000.0;
+  if (f.ended && available(1))
+    gpu_frame.push(float((timestamp(1) - timestamp(0)) * to_us / 1000.0));
+
+  std::vector<double>  frame_ms(scopes.size(), 0.0);
+  std::vector<uint8_t> seen(scopes.size(), 0);
+  for (const auto &s : f.scopes) {
+    if (s.end_query == 0 || !available(s.begin_query) ||
+        !available(s.end_query))
+      continue;
+    const double begin =
+        f.cpu_begin + (timestamp(s.begin_query) - timestamp(0)) * to_us;
+    const double duration =
+        (timestamp(s.end_query) - timestamp(s.begin_query)) * to_us;
+    if (s.id >= seen.size()) {
+      scope(s.id);
+      frame_ms.resize(scopes.size(), 0.0);
+      seen.resize(scopes.size(), 0);
+    }
+    frame_ms[s.id] += duration / 1000.0;
+    seen[s.id]         = 1;
+    scopes[s.id].depth = s.depth;
+    trace.push_back({s.id, true, s.depth, begin, duration});
+    if (trace.size() > max_trace_events) trace.pop_front();
+  }
+  for (timer_id_t id = 0; id < seen.size(); id++)
+    if (seen[id]) scopes[id].gpu.push(float(frame_ms[id]));
+}
+
+void gpu_auto_timer_t::flush() {
+  std::vector<frame_t *> pending;
+  for (auto &f : frames)
+    if (f.frame != 0) pending.push_back(&f);
+  std::sort(pending.begin(), pending.end(),
+            [](const frame_t *a, const frame_t *b) {
+              return a->frame < b->frame;
+            });
+  for (frame_t *f : pending) read_back(*f);
+  current = nullptr;
+}
+
+void gpu_auto_timer_t::clear() {
+  generation++;
+  for (auto &s : scopes) s = {};
+  gpu_frame.clear();
+  trace.clear();
+  dropped = 0;
+}
+
+void gpu_auto_timer_t::write_chrome_trace(
+    const std::filesystem::path &path) const {
+  std::ofstream file{path};
+  file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  file << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+          "\"tid\": 0, \"args\": {\"name\": \"cpu\"}},\n";
+  file << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+          "\"tid\": 1, \"args\": {\"name\": \"gpu\"}}";
+  for (const auto &event : trace)
+    file << ",\n  {\"name\": \"" << escape_json(timer_name(event.id))
+         << "\", \"cat\": \"" << (event.gpu ? "gpu" : "cpu")
+         << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << (event.gpu ? 1 : 0)
+         << ", \"ts\": " << event.begin << ", \"dur\": " << event.duration
+         << "}";
+  file << "\n]}\n";
+  if (!file.good()) {
+    horizon_info("failed to write {}", path.string());
+    return;
+  }
+  horizon_info("wrote {} trace events to {}", trace.size(), path.string());
+}
@@ -0,0 +1,166 @@
+#ifndef GPU_TIMER_HPP
+#define GPU_TIMER_HPP
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan_core.h>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "frame_resources.hpp"
+#include "horizon/core/core.hpp"
+#include "horizon/gfx/base.hpp"
+#include "horizon/gfx/types.hpp"
+
+// dense id of an interned timer name, ids are process wide so call sites
+// can intern once into a static
+using timer_id_t = uint32_t;
+
+// the same name always returns the same id, thread safe
+timer_id_t         intern_timer(std::string_view name);
+const std::string &timer_name(timer_id_t id);
+
+// rolling window of per frame milliseconds, capacity can be raised before
+// the first push to keep a whole run
+struct timer_history_t {
+  static constexpr uint32_t default_capacity = 256;
+
+  void push(float ms);
+  void clear();
+
+  float min() const;
+  float avg() const;
+  float p99() const;
+
+  std::vector<float> samples;
+  uint32_t           capacity = default_capacity;
+  uint32_t           next     = 0;
+  float              last     = 0.f;
+};
+
+// gpu scopes write timestamps into a query pool allocated up front, the
+// pool is a ring of frames_count frames of max_scopes scopes, begin_frame
+// reads back the frame it is about to reuse, by then no frame in flight can
+// still write it, scopes nest and a scope that runs more than once in a
+// frame adds up, cpu scopes are timed with steady_clock and land in the same
+// histories and trace
+struct gpu_auto_timer_t {
+  static constexpr uint32_t frames_count = frame_ring_size;
+  static constexpr uint32_t max_scopes   = 128;
+  // queries 0 and 1 of a frame are its begin and end, every scope takes a
+  // begin and an end
+  static constexpr uint32_t frame_queries = 2 + 2 * max_scopes;
+  // events kept for write_chrome_trace, the oldest are dropped
+  static constexpr size_t   max_trace_events = 1 << 16;
+
+  gpu_auto_timer_t(core::ref<gfx::base_t> base);
+  ~gpu_auto_timer_t();
+
+  // starts recording a frame, has to be recorded before any scope of it and
+  // outside of rendering
+  void begin_frame(gfx::handle_commandbuffer_t cbuf);
+  // after the last scope of the frame, times the whole frame into gpu_frame
+  void end_frame(gfx::handle_commandbuffer_t cbuf);
+
+  void start(gfx::handle_commandbuffer_t cbuf, timer_id_t id);
+  void end(gfx::handle_commandbuffer_t cbuf, timer_id_t id);
+
+  // cpu scopes, from the thread recording the frame
+  void cpu_start(timer_id_t id);
+  void cpu_end(timer_id_t id);
+
+  // reads back every frame still in the ring, oldest first, only once the
+  // device is idle
+  void flush();
+
+  // forgets the histories, results of frames already in flight are dropped
+  void clear();
+
+  // chrome://tracing and perfetto json of the recorded events, gpu events
+  // are placed relative to the cpu time of their frame's begin_frame
+  void write_chrome_trace(const std::filesystem::path &path) const;
+
+  struct scope_t {
+    timer_history_t gpu;
+    timer_history_t cpu;
+    // nesting depth the scope was last seen at
+    uint32_t        depth = 0;
+    // cpu time of the current frame, pushed into cpu on the next frame
+    float           cpu_frame_ms = 0.f;
+    bool            cpu_seen     = false;
+  };
+
+  struct gpu_scope_t {
+    timer_id_t id;
+    uint32_t   depth;
+    uint32_t   begin_query;
+    uint32_t   end_query;
+  };
+
+  struct frame_t {
+    uint64_t                 frame      = 0;
+    uint64_t                 generation = 0;
+    // microseconds since epoch when begin_frame was recorded
+    double                   cpu_begin  = 0;
+    uint32_t                 queries    = 0;
+    bool                     ended      = false;
+    std::vector<gpu_scope_t> scopes;
+  };
+
+  struct trace_event_t {
+    timer_id_t id;
+    bool       gpu;
+    uint32_t   depth;
+    double     begin;
+    double     duration;
+  };
+
+  // the scope of every interned id, indexed by id
+  scope_t &scope(timer_id_t id);
+  // drains frame's queries into the histories and trace
+  void     read_back(frame_t &frame);
+  double   now() const;
+
+  core::ref<gfx::base_t> base;
+
+  VkQueryPool vk_query_pool = VK_NULL_HANDLE;
+  // nanoseconds per timestamp tick
+  float       timestamp_period;
+
+  std::vector<frame_t>                       frames;
+  frame_t                                   *current    = nullptr;
+  uint64_t                                   frame      = 0;
+  uint64_t                                   generation = 0;
+  // open gpu scopes of the current frame, indices into current->scopes
+  std::vector<uint32_t>                      open;
+  // id and begin time of the open cpu scopes
+  std::vector<std::pair<timer_id_t, double>> cpu_open;
+  // scopes that did not fit into max_scopes
+  uint32_t                                   dropped = 0;
+
+  std::vector<scope_t>      scopes;
+  // begin_frame to end_frame on the gpu
+  timer_history_t           gpu_frame;
+  std::deque<trace_event_t> trace;
+  std::chrono::steady_clock::time_point epoch =
+      std::chrono::steady_clock::now();
+};
+
+// times the enclosing block on the cpu
+struct cpu_scope_t {
+  cpu_scope_t(gpu_auto_timer_t &timer, timer_id_t id) : timer(timer), id(id) {
+    timer.cpu_start(id);
+  }
+  ~cpu_scope_t() { timer.cpu_end(id); }
+
+  gpu_auto_timer_t &timer;
+  timer_id_t        id;
+};
+
+#endif
@@ -0,0 +1,215 @@
+#include "image_writer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "horizon/core/core.hpp"
+#include "horizon/core/logger.hpp"
+
+namespace {
+
+void put_u32_be(std::vector<uint8_t> &out, uint32_t value) {
+  out.push_back(value >> 24);
+  out.push_back(value >> 16);
+  out.push_back(value >> 8);
+  out.push_back(value);
+}
+
+template <typename T>
+void put_le(std::vector<uint8_t> &out, T value) {
+  uint8_t bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void put_str(std::vector<uint8_t> &out, const char *str) {
+  out.insert(out.end(), str, str + std::strlen(str) + 1);
+}
+
+uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0) {
+  static const std::array<uint32_t, 256> table = [] {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (uint32_t k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+    return table;
+  }();
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+void put_png_chunk(std::vector<uint8_t> &out, const char *type,
+                   const std::vector<uint8_t> &data) {
+  put_u32_be(out, data.size());
+  size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  put_u32_be(out, crc32(out.data() + start, out.size() - start));
+}
+
+uint8_t linear_to_srgb8(float x) {
+  x = std::clamp(x, 0.f, 1.f);
+  x = x <= 0.0031308f ? x * 12.92f
+                      : 1.055f * std::pow(x, 1.f / 2.4f) - 0.055f;
+  return static_cast<uint8_t>(x * 255.f + 0.5f);
+}
+
+void write_file(const std::filesystem::path &path,
+                const std::vector<uint8_t>  &bytes) {
+  std::ofstream file{path, std::ios::binary};
+  check(file.is_open(), "failed to open {}", path.string());
+  file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+  check(file.good(), "failed to write {}", path.string());
+}
+
+}  // namespace
+
+// png with stored (uncompressed) deflate blocks, keeps this dependency free
+void write_png(const std::filesystem::path &path, const math::vec4 *pixels,
+               uint32_t width, uint32_t height) {
+  std::vector<uint8_t> raw;
+  raw.reserve((width * 4 + 1) * height);
+  for (uint32_t y = 0; y < height; y++) {
+    raw.push_back(0);  // filter: none
+    for (uint32_t x = 0; x < width; x++) {
+      const math::vec4 &p = pixels[y * width + x];
+      raw.push_back(linear_to_srgb8(p.x));
+      raw.push_back(linear_to_srgb8(p.y));
+      raw.push_back(linear_to_srgb8(p.z));
+      raw.push_back(static_cast<uint8_t>(std::clamp(p.w, 0.f, 1.f) * 255.f + 0.5f));
+    }
+  }
+
+  std::vector<uint8_t> zlib{0x78, 0x01};
+  for (size_t offset = 0; offset < raw.size() || offset == 0;) {
+    size_t   block = std::min<size_t>(raw.size() - offset, 65535);
+    bool     last  = offset + block == raw.size();
+    uint16_t len   = block;
+    zlib.push_back(last ? 1 : 0);
+    put_le<uint16_t>(zlib, len);
+    put_le<uint16_t>(zlib, ~len);
+    zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + block);
+    offset += block;
+    if (last) break;
+  }
+  uint32_t a = 1, b = 0;
+  for (uint8_t byte : raw) {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+  put_u32_be(zlib, (b << 16) | a);
+
+  std::vector<uint8_t> ihdr;
+  put_u32_be(ihdr, width);
+  put_u32_be(ihdr, height);
+  ihdr.insert(ihdr.end(), {8 /*depth*/, 6 /*rgba*/, 0, 0, 0});
+
+  std::vector<uint8_t> png{0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  put_png_chunk(png, "IHDR", ihdr);
+  put_png_chunk(png, "IDAT", zlib);
+  put_png_chunk(png, "IEND", {});
+  write_file(path, png);
+}
+
+// single part scanline exr, 32 bit float channels, no compression
+void write_exr(const std::filesystem::path &path, const math::vec4 *pixels,
+               uint32_t width, uint32_t height) {
+  std::vector<uint8_t> exr;
+  put_le<uint32_t>(exr, 20000630);  // magic
+  put_le<uint32_t>(exr, 2);         // version 2, scanline
+
+  // channels are stored in alphabetical order
+  const char *channels[] = {"A", "B", "G", "R"};
+  put_str(exr, "channels");
+  put_str(exr, "chlist");
+  put_le<uint32_t>(exr, 4 * (2 + 16) + 1);
+  for (const char *channel : channels) {
+    put_str(exr, channel);
+    put_le<int32_t>(exr, 2);  // float
+    put_le<uint8_t>(exr, 0);  // plinear
+    put_le<uint8_t>(exr, 0);
+    put_le<uint8_t>(exr, 0);
+    put_le<uint8_t>(exr, 0);
+    put_le<int32_t>(exr, 1);  // x sampling
+    put_le<int32_t>(exr, 1);  // y sampling
+  }
+  put_le<uint8_t>(exr, 0);
+
+  put_str(exr, "compression");
+  put_str(exr, "compression");
+  put_le<uint32_t>(exr, 1);
+  put_le<uint8_t>(exr, 0);
+
+  for (const char *window : {"dataWindow", "displayWindow"}) {
+    put_str(exr, window);
+    put_str(exr, "box2i");
+    put_le<uint32_t>(exr, 16);
+    put_le<int32_t>(exr, 0);
+    put_le<int32_t>(exr, 0);
+    put_le<int32_t>(exr, width - 1);
+    put_le<int32_t>(exr, height - 1);
+  }
+
+  put_str(exr, "lineOrder");
+  put_str(exr, "lineOrder");
+  put_le<uint32_t>(exr, 1);
+  put_le<uint8_t>(exr, 0);  // increasing y
+
+  put_str(exr, "pixelAspectRatio");
+  put_str(exr, "float");
+  put_le<uint32_t>(exr, 4);
+  put_le<float>(exr, 1.f);
+
+  put_str(exr, "screenWindowCenter");
+  put_str(exr, "v2f");
+  put_le<uint32_t>(exr, 8);
+  put_le<float>(exr, 0.f);
+  put_le<float>(exr, 0.f);
+
+  put_str(exr, "screenWindowWidth");
+  put_str(exr, "float");
+  put_le<uint32_t>(exr, 4);
+  put_le<float>(exr, 1.f);
+
+  put_le<uint8_t>(exr, 0);  // end of header
+
+  const uint64_t line_size   = 4 + 4 + uint64_t(width) * 4 * sizeof(float);
+  const uint64_t table_start = exr.size();
+  const uint64_t data_start  = table_start + uint64_t(height) * 8;
+  for (uint32_t y = 0; y < height; y++)
+    put_le<uint64_t>(exr, data_start + y * line_size);
+
+  exr.reserve(data_start + height * line_size);
+  for (uint32_t y = 0; y < height; y++) {
+    put_le<int32_t>(exr, y);
+    put_le<uint32_t>(exr, width * 4 * sizeof(float));
+    const math::vec4 *row = pixels + size_t(y) * width;
+    for (uint32_t x = 0; x < width; x++) put_le<float>(exr, row[x].w);
+    for (uint32_t x = 0; x < width; x++) put_le<float>(exr, row[x].z);
+    for (uint32_t x = 0; x < width; x++) put_le<float>(exr, row[x].y);
+    for (uint32_t x = 0; x < width; x++) put_le<float>(exr, row[x].x);
+  }
+  write_file(path, exr);
+}
+
+void write_image(const std::filesystem::path &path, const math::vec4 *pixels,
+                 uint32_t width, uint32_t height) {
+  std::string extension = path.extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  if (extension == ".exr") {
+    write_exr(path, pixels, width, height);
+  } else {
+    check(extension == ".png", "unsupported image format {}", extension);
+    write_png(path, pixels, width, height);
+  }
+  horizon_info("wrote {}x{} image to {}", width, height, path.string());
+}
@@ -0,0 +1,19 @@
+#ifndef IMAGE_WRITER_HPP
+#define IMAGE_WRITER_HPP
+
+#include <cstdint>
+#include <filesystem>
+
+#include "math/math.hpp"
+
+// pixels are tightly packed linear rgba32f rows, top row first
+void write_png(const std::filesystem::path &path, const math::vec4 *pixels,
+               uint32_t width, uint32_t height);
+void write_exr(const std::filesystem::path &path, const math::vec4 *pixels,
+               uint32_t width, uint32_t height);
+
+// picks the writer from the extension of path
+void write_image(const std::filesystem::path &path, const math::vec4 *pixels,
+                 uint32_t width, uint32_t height);
+
+#endif
@@ -0,0 +1,88 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+
+job_system_t::job_system_t(uint32_t thread_count) {
+  if (thread_count == 0)
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  // the thread calling wait() works too
+  for (uint32_t i = 0; i + 1 < thread_count; i++)
+    threads.emplace_back([this] { worker(); });
+}
+
+job_system_t::~job_system_t() {
+  {
+    std::lock_guard lock{mutex};
+    stopping = true;
+  }
+  condition.notify_all();
+  for (auto &thread : threads) thread.join();
+}
+
+void job_system_t::submit(std::function<void()> job, job_counter_t &counter) {
+  counter.pending.fetch_add(1, std::memory_order_relaxed);
+  {
+    std::lock_guard lock{mutex};
+    jobs.push_back({std::move(job), &counter});
+  }
+  condition.notify_one();
+}
+
+bool job_system_t::try_run_one() {
+  job_t job;
+  {
+    std::lock_guard lock{mutex};
+    if (jobs.empty()) return false;
+    // newest first, keeps recursive builds depth first and cache warm
+    job = std::move(jobs.back());
+    jobs.pop_back();
+  }
+  job.fn();
+  job.counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+  return true;
+}
+
+void job_system_t::wait(job_counter_t &counter) {
+  while (counter.pending.load(std::memory_order_acquire) != 0) {
+    if (!try_run_one()) std::this_thread::yield();
+  }
+}
+
+void job_system_t::worker() {
+  while (true) {
+    job_t job;
+    {
+      std::unique_lock lock{mutex};
+      condition.wait(lock, [this] { return stopping || !jobs.empty(); });
+      if (stopping && jobs.empty()) return;
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    job.fn();
+    job.counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+  }
+}
+
+void job_system_t::parallel_for(
+    uint32_t count, uint32_t min_chunk,
+    const std::function<void(uint32_t, uint32_t)> &fn) {
+  const uint32_t chunks = std::clamp<uint32_t>(
+      count / std::max(1u, min_chunk), 1, thread_count() * 4);
+  if (chunks == 1) {
+    fn(0, count);
+    return;
+  }
+  job_counter_t counter;
+  const uint32_t chunk_size = (count + chunks - 1) / chunks;
+  for (uint32_t begin = chunk_size; begin < count; begin += chunk_size) {
+    const uint32_t end = std::min(count, begin + chunk_size);
+    submit([&fn, begin, end] { fn(begin, end); }, counter);
+  }
+  fn(0, std::min(count, chunk_size));
+  wait(counter);
+}
+
+job_system_t &job_system_t::global() {
+  static job_system_t job_system{};
+  return job_system;
+}
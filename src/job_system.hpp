@@ -0,0 +1,53 @@
+#ifndef JOB_SYSTEM_HPP
+#define JOB_SYSTEM_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// counts outstanding jobs, wait() returns once it reaches zero
+struct job_counter_t {
+  std::atomic<uint32_t> pending = 0;
+};
+
+// fixed size worker pool, waiting threads help run queued jobs, so jobs can
+// submit and wait on other jobs without deadlocking the pool
+struct job_system_t {
+  explicit job_system_t(uint32_t thread_count = 0);
+  ~job_system_t();
+
+  void submit(std::function<void()> job, job_counter_t &counter);
+  void wait(job_counter_t &counter);
+
+  // splits [0, count) into chunks of at least min_chunk and runs them on the
+  // pool, fn is called as fn(begin, end)
+  void parallel_for(uint32_t count, uint32_t min_chunk,
+                    const std::function<void(uint32_t, uint32_t)> &fn);
+
+  uint32_t thread_count() const { return threads.size() + 1; }
+
+  // shared pool sized to the machine, lives for the whole program
+  static job_system_t &global();
+
+ private:
+  struct job_t {
+    std::function<void()> fn;
+    job_counter_t        *counter;
+  };
+
+  bool try_run_one();
+  void worker();
+
+  std::vector<std::thread> threads;
+  std::deque<job_t>        jobs;
+  std::mutex               mutex;
+  std::condition_variable  condition;
+  bool                     stopping = false;
+};
+
+#endif
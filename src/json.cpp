@@ -0,0 +1,10 @@
+#include "json.hpp"
+
+std::string escape_json(const std::string &text) {
+  std::string escaped;
+  for (char c : text) {
+    if (c == '"' || c == '\\') escaped += '\\';
+    escaped += c;
+  }
+  return escaped;
+}
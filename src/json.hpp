@@ -0,0 +1,10 @@
+#ifndef JSON_HPP
+#define JSON_HPP
+
+#include <string>
+
+// names written into the json exports are pass and counter names, only
+// quotes and backslashes need escaping
+std::string escape_json(const std::string &text);
+
+#endif
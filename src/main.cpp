@@ -4,12 +4,14 @@
 #include "app.hpp"
 
 int main(int argc, char **argv) {
-  app_t *app = new app_t(argc, (const char **)(argv));
+  // bad options and failed renders exit nonzero, headless runs are judged by
+  // the exit code alone
   try {
-    app->run();
+    app_t app{argc, (const char **)(argv)};
+    app.run();
   } catch (const std::exception &e) {
-    std::cout << e.what() << '\n';
+    std::cerr << e.what() << '\n';
+    return 1;
   }
-  delete app;
   return 0;
 }
@@ -0,0 +1,108 @@
+#include "meshlet.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// bounding sphere around the box of the meshlet's vertices and the cone of
+// its triangle normals
+static void compute_meshlet_bounds(meshlet_t                   &meshlet,
+                                   const model::raw_mesh_t     &mesh,
+                                   const std::vector<uint32_t> &vertices,
+                                   const std::vector<uint32_t> &triangles) {
+  auto position = [&](uint32_t triangle, uint32_t corner) {
+    const uint32_t local = (triangles[triangle] >> (corner * 8)) & 0xff;
+    return mesh.vertices[vertices[meshlet.vertex_offset + local]].position;
+  };
+
+  math::vec3 min{std::numeric_limits<float>::max()};
+  math::vec3 max{-std::numeric_limits<float>::max()};
+  for (uint32_t i = 0; i < meshlet.vertex_count; i++) {
+    const math::vec3 p =
+        mesh.vertices[vertices[meshlet.vertex_offset + i]].position;
+    min = math::min(min, p);
+    max = math::max(max, p);
+  }
+  meshlet.center = (min + max) * 0.5f;
+  meshlet.radius = 0;
+  for (uint32_t i = 0; i < meshlet.vertex_count; i++)
+    meshlet.radius = std::max(
+        meshlet.radius,
+        math::length(
+            mesh.vertices[vertices[meshlet.vertex_offset + i]].position -
+            meshlet.center));
+
+  std::vector<math::vec3> normals;
+  math::vec3              sum{0};
+  for (uint32_t i = 0; i < meshlet.triangle_count; i++) {
+    const uint32_t   triangle = meshlet.triangle_offset + i;
+    const math::vec3 n =
+        math::cross(position(triangle, 1) - position(triangle, 0),
+                    position(triangle, 2) - position(triangle, 0));
+    const float area = math::length(n);
+    // degenerate triangles face nowhere
+    if (area <= 0.f) continue;
+    normals.push_back(n / area);
+    sum = sum + normals.back();
+  }
+
+  meshlet.cone_axis   = math::vec3{0, 0, 1};
+  meshlet.cone_cutoff = 1;
+  const float sum_length = math::length(sum);
+  if (normals.empty() || sum_length <= 1e-6f) return;
+  meshlet.cone_axis = sum / sum_length;
+
+  float min_dot = 1;
+  for (const math::vec3 &n : normals)
+    min_dot = std::min(min_dot, math::dot(n, meshlet.cone_axis));
+  // a cone wider than a hemisphere can not be back facing as a whole
+  if (min_dot <= 0.f) return;
+  meshlet.cone_cutoff = std::sqrt(1.f - min_dot * min_dot);
+}
+
+mesh_meshlets_t build_meshlets(const model::raw_mesh_t &mesh,
+                               uint32_t                 mesh_index) {
+  mesh_meshlets_t result{};
+  // mesh vertex to local index in the open meshlet, -1 if not in it
+  std::vector<int32_t> local(mesh.vertices.size(), -1);
+
+  meshlet_t meshlet{};
+  meshlet.mesh_index = mesh_index;
+  auto close = [&]() {
+    if (meshlet.triangle_count == 0) return;
+    compute_meshlet_bounds(meshlet, mesh, result.vertices, result.triangles);
+    result.meshlets.push_back(meshlet);
+    for (uint32_t i = 0; i < meshlet.vertex_count; i++)
+      local[result.vertices[meshlet.vertex_offset + i]] = -1;
+    meshlet                 = {};
+    meshlet.mesh_index      = mesh_index;
+    meshlet.vertex_offset   = result.vertices.size();
+    meshlet.triangle_offset = result.triangles.size();
+  };
+
+  for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+    const uint32_t *corners = &mesh.indices[i];
+    uint32_t        new_vertices = 0;
+    for (uint32_t c = 0; c < 3; c++)
+      if (local[corners[c]] == -1 &&
+          (c == 0 || corners[c] != corners[0]) &&
+          (c < 2 || corners[c] != corners[1]))
+        new_vertices++;
+    if (meshlet.vertex_count + new_vertices > meshlet_max_vertices ||
+        meshlet.triangle_count == meshlet_max_triangles)
+      close();
+
+    uint32_t packed = 0;
+    for (uint32_t c = 0; c < 3; c++) {
+      if (local[corners[c]] == -1) {
+        local[corners[c]] = meshlet.vertex_count++;
+        result.vertices.push_back(corners[c]);
+      }
+      packed |= uint32_t(local[corners[c]]) << (c * 8);
+    }
+    result.triangles.push_back(packed);
+    meshlet.triangle_count++;
+  }
+  close();
+  return result;
+}
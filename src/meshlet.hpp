@@ -0,0 +1,46 @@
+#ifndef MESHLET_HPP
+#define MESHLET_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "math/math.hpp"
+#include "model/model.hpp"
+
+// limits recommended for mesh shaders, a meshlet's local indices fit in 8 bits
+constexpr uint32_t meshlet_max_vertices  = 64;
+constexpr uint32_t meshlet_max_triangles = 124;
+
+// a cluster of up to meshlet_max_triangles triangles of one mesh
+// vertex_offset indexes the mesh's meshlet vertices, which index the mesh's
+// vertices, triangle_offset indexes its meshlet triangles, 3 local vertex
+// indices packed into the low 24 bits of a uint32_t
+// center and radius bound the cluster in object space, every triangle normal
+// is within the cone around cone_axis, cone_cutoff is the sine of the cone's
+// half angle and 1 if the cone is too wide to cull anything, mesh_index is
+// the mesh that owns the geometry, draws of its instances bring their own
+struct meshlet_t {
+  math::vec3 center;
+  float      radius;
+  math::vec3 cone_axis;
+  float      cone_cutoff;
+  uint32_t   vertex_offset;
+  uint32_t   triangle_offset;
+  uint32_t   vertex_count;
+  uint32_t   triangle_count;
+  uint32_t   mesh_index;
+};
+static_assert(sizeof(meshlet_t) == 52, "sizeof(meshlet_t) should be 52");
+
+struct mesh_meshlets_t {
+  std::vector<meshlet_t> meshlets;
+  std::vector<uint32_t>  vertices;
+  std::vector<uint32_t>  triangles;
+};
+
+// greedily fills meshlets in index order, index buffers are usually ordered
+// for vertex reuse so neighbouring triangles end up in the same meshlet
+mesh_meshlets_t build_meshlets(const model::raw_mesh_t &mesh,
+                               uint32_t                 mesh_index);
+
+#endif
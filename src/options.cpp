@@ -0,0 +1,192 @@
+#include "options.hpp"
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "horizon/core/core.hpp"
+
+static constexpr const char *usage =
+    "Usage: [aurora] [options] [model]\n"
+    "  --headless                 render offscreen, write --output and exit\n"
+    "  --width <n>                render width (headless)\n"
+    "  --height <n>               render height (headless)\n"
+    "  --frames <n>               frames to render before writing (headless)\n"
+    "  --mode <name>              diffuse | debug_raytracer | raytracer |\n"
+    "                             path_tracer | wavefront\n"
+    "  --output <path>            .png or .exr output (headless)\n"
+    "  --stats <path>             .csv or .json timings and traversal stats\n"
+    "                             (headless)\n"
+    "  --trace <path>             chrome trace json of the cpu and gpu\n"
+    "                             scopes (headless)\n"
+    "  --camera-position <x,y,z>  camera position\n"
+    "  --camera-yaw <degrees>     camera yaw\n"
+    "  --camera-pitch <degrees>   camera pitch\n"
+    "  --fov <degrees>            vertical field of view\n"
+    "  --no-bvh-cache             always rebuild the bvh\n"
+    "  --bvh-builder <name>       sweep | binned (parallel binned sah)\n"
+    "  --bvh-compare-builders     build with both builders, log sah costs\n"
+    "  --cwbvh                    trace rays against the compressed wide bvh\n"
+    "  --two-level                trace a bvh per mesh under a per frame tlas\n"
+    "  --triangle-format <name>   full | indexed | quantized\n"
+    "  --streaming                page ray traced clusters and their vertices\n"
+    "                             into a vram budget, ray traced modes only\n"
+    "  --streaming-budget <mib>   vram for resident clusters\n"
+    "  --cluster-triangles <n>    triangles per streamed cluster\n"
+    "  --texture-compression <x>  none | bc1 | bc7 | auto (bc1 if opaque)\n"
+    "  --no-texture-cache         always transcode and cut textures again\n"
+    "  --virtual-textures         page textures into a fixed size cache\n"
+    "  --texture-budget <mib>     vram for resident texture pages\n"
+    "  --no-shader-cache          always compile shaders and pipelines again\n"
+    "  --fps <n>                  frame rate limit, 0 is uncapped\n"
+    "  --present-mode <name>      fifo | mailbox | immediate\n"
+    "  --benchmark <frames>       uncapped and immediate, logs frame times\n"
+    "                             after n frames and exits\n"
+    "  --spp <n>                  path tracer samples per pixel per frame\n"
+    "  --bounces <n>              path tracer bounces\n"
+    "  --samples <n>              path tracer stops after n samples\n"
+    "  --noise-threshold <x>      path tracer stops below this relative error\n"
+    "  --no-temporal              path tracer restarts when the camera moves\n"
+    "  --no-restir                path tracer samples direct light per path";
+
+options_t parse_options(const int argc, const char **argv) {
+  options_t options{};
+
+  auto next = [&](int &i) -> std::string_view {
+    check(i + 1 < argc, "{} expects a value\n{}", argv[i], usage);
+    return argv[++i];
+  };
+  auto to_uint = [&](std::string_view value) -> uint32_t {
+    return static_cast<uint32_t>(std::stoul(std::string{value}));
+  };
+  auto to_float = [&](std::string_view value) -> float {
+    return std::stof(std::string{value});
+  };
+
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    if (arg == "--headless") {
+      options.headless = true;
+    } else if (arg == "--width") {
+      options.width = to_uint(next(i));
+    } else if (arg == "--height") {
+      options.height = to_uint(next(i));
+    } else if (arg == "--frames") {
+      options.frames = to_uint(next(i));
+    } else if (arg == "--mode") {
+      options.mode = next(i);
+    } else if (arg == "--output") {
+      options.output = next(i);
+    } else if (arg == "--stats") {
+      options.stats_output = next(i);
+    } else if (arg == "--trace") {
+      options.trace_output = next(i);
+    } else if (arg == "--camera-position") {
+      std::string value{next(i)};
+      check(std::sscanf(value.c_str(), "%f,%f,%f", &options.camera_position.x,
+                        &options.camera_position.y,
+                        &options.camera_position.z) == 3,
+            "--camera-position expects x,y,z\n{}", usage);
+    } else if (arg == "--camera-yaw") {
+      options.camera_yaw = to_float(next(i));
+    } else if (arg == "--camera-pitch") {
+      options.camera_pitch = to_float(next(i));
+    } else if (arg == "--fov") {
+      options.camera_fov = to_float(next(i));
+    } else if (arg == "--no-bvh-cache") {
+      options.bvh_cache = false;
+    } else if (arg == "--bvh-builder") {
+      options.bvh_builder = next(i);
+    } else if (arg == "--bvh-compare-builders") {
+      options.bvh_compare_builders = true;
+    } else if (arg == "--cwbvh") {
+      options.cwbvh = true;
+    } else if (arg == "--two-level") {
+      options.two_level = true;
+    } else if (arg == "--triangle-format") {
+      options.triangle_format = next(i);
+    } else if (arg == "--streaming") {
+      options.streaming = true;
+    } else if (arg == "--streaming-budget") {
+      options.streaming_budget = to_uint(next(i));
+    } else if (arg == "--cluster-triangles") {
+      options.streaming_triangles = to_uint(next(i));
+    } else if (arg == "--texture-compression") {
+      options.texture_compression = next(i);
+    } else if (arg == "--no-texture-cache") {
+      options.texture_cache = false;
+    } else if (arg == "--virtual-textures") {
+      options.virtual_textures = true;
+    } else if (arg == "--texture-budget") {
+      options.texture_budget = to_uint(next(i));
+    } else if (arg == "--no-shader-cache") {
+      options.shader_cache = false;
+    } else if (arg == "--fps") {
+      options.target_fps = to_float(next(i));
+    } else if (arg == "--present-mode") {
+      options.present_mode = next(i);
+    } else if (arg == "--benchmark") {
+      options.benchmark_frames = to_uint(next(i));
+    } else if (arg == "--spp") {
+      options.spp = to_uint(next(i));
+    } else if (arg == "--bounces") {
+      options.bounces = to_uint(next(i));
+    } else if (arg == "--samples") {
+      options.target_samples = to_uint(next(i));
+    } else if (arg == "--noise-threshold") {
+      options.noise_threshold = to_float(next(i));
+    } else if (arg == "--no-temporal") {
+      options.temporal = false;
+    } else if (arg == "--no-restir") {
+      options.restir = false;
+    } else {
+      check(!arg.starts_with("--"), "unknown option {}\n{}", arg, usage);
+      check(options.model_path.empty(), "{}", usage);
+      options.model_path = arg;
+    }
+  }
+
+  check(!options.model_path.empty(), "{}", usage);
+  check(options.width > 0 && options.height > 0 && options.frames > 0,
+        "width, height and frames must be non zero");
+  check(options.spp > 0 && options.target_samples > 0,
+        "spp and samples must be non zero");
+  check(options.mode == "diffuse" || options.mode == "debug_raytracer" ||
+            options.mode == "raytracer" || options.mode == "path_tracer" ||
+            options.mode == "wavefront",
+        "unknown mode {}\n{}", options.mode, usage);
+  check(options.present_mode == "fifo" || options.present_mode == "mailbox" ||
+            options.present_mode == "immediate",
+        "unknown present mode {}\n{}", options.present_mode, usage);
+  check(options.target_fps >= 0.f, "fps must not be negative");
+  if (options.benchmark_frames > 0) {
+    options.target_fps   = 0.f;
+    options.present_mode = "immediate";
+  }
+  check(options.bvh_builder == "sweep" || options.bvh_builder == "binned",
+        "unknown bvh builder {}\n{}", options.bvh_builder, usage);
+  check(options.triangle_format == "full" ||
+            options.triangle_format == "indexed" ||
+            options.triangle_format == "quantized",
+        "unknown triangle format {}\n{}", options.triangle_format, usage);
+  // the wavefront kernels and the tlas only know the flat triangles, the
+  // diffuse mode rasterizes vertices streaming never uploads
+  check(!options.streaming ||
+            (!options.two_level && options.mode != "wavefront" &&
+             options.mode != "diffuse" && options.triangle_format == "full"),
+        "--streaming does not support --two-level, the diffuse or wavefront "
+        "modes or packed triangle formats");
+  check(options.streaming_budget > 0 && options.streaming_triangles > 0,
+        "streaming budget and cluster triangles must be non zero");
+  check(options.texture_compression == "none" ||
+            options.texture_compression == "bc1" ||
+            options.texture_compression == "bc7" ||
+            options.texture_compression == "auto",
+        "unknown texture compression {}\n{}", options.texture_compression,
+        usage);
+  // the wavefront shade kernel samples the materials' images directly
+  check(!options.virtual_textures || options.mode != "wavefront",
+        "--virtual-textures does not support the wavefront mode");
+  check(options.texture_budget > 0, "texture budget must be non zero");
+  return options;
+}
@@ -0,0 +1,75 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "math/math.hpp"
+
+// command line options, shared by the interactive and headless paths
+struct options_t {
+  std::filesystem::path model_path;
+
+  // headless renders `frames` frames offscreen, writes `output` and exits
+  bool                  headless = false;
+  uint32_t              width    = 1280;
+  uint32_t              height   = 720;
+  uint32_t              frames   = 1;
+  std::string           mode     = "diffuse";
+  std::filesystem::path output   = "aurora.png";
+  // .csv or .json of the gpu timings and, in debug_raytracer mode, the
+  // traversal statistics of the last frame, not written if empty
+  std::filesystem::path stats_output;
+  // chrome://tracing json of the cpu and gpu scopes, not written if empty
+  std::filesystem::path trace_output;
+
+  // editor camera pose, yaw and pitch are in degrees
+  math::vec3 camera_position{0, 0, 0};
+  float      camera_yaw   = 0.f;
+  float      camera_pitch = 0.f;
+  float      camera_fov   = 45.f;
+
+  bool        bvh_cache            = true;
+  std::string bvh_builder          = "sweep";
+  bool        bvh_compare_builders = false;
+  bool        cwbvh                = false;
+  bool        two_level            = false;
+  std::string triangle_format      = "full";
+
+  // ray traced geometry is paged from a cluster file into a budget of vram
+  bool     streaming           = false;
+  uint32_t streaming_budget    = 512;
+  uint32_t streaming_triangles = 8192;
+
+  // none | bc1 | bc7 | auto, transcoded once and cached as dds files
+  std::string texture_compression = "auto";
+  bool        texture_cache       = true;
+
+  // textures are paged from a page file into a cache of texture_budget mib
+  bool     virtual_textures = false;
+  uint32_t texture_budget   = 256;
+
+  // compiled spir-v and the vulkan pipeline cache persist across runs
+  bool shader_cache = true;
+
+  // interactive frame pacing, a target_fps of 0 is uncapped, a benchmark
+  // runs uncapped with immediate present for benchmark_frames frames
+  float       target_fps       = 60.f;
+  std::string present_mode     = "fifo";
+  uint32_t    benchmark_frames = 0;
+
+  // path tracer, headless accumulates frames * spp samples at most
+  uint32_t spp             = 1;
+  uint32_t bounces         = 3;
+  uint32_t target_samples  = 4096;
+  float    noise_threshold = 0.02f;
+  // camera motion reprojects the accumulation, direct environment light is
+  // resampled through per pixel reservoirs
+  bool     temporal        = true;
+  bool     restir          = true;
+};
+
+options_t parse_options(const int argc, const char **argv);
+
+#endif
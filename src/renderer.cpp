@@ -1,6 +1,10 @@
 #include "renderer.hpp"
 
+#include <volk.h>
+
 #include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <optional>
 #include <string>
 #include <vector>
@@ -19,67 +23,54 @@
 #include "math/triangle.hpp"
 #include "model/model.hpp"
 
-gpu_auto_timer_t::gpu_auto_timer_t(core::ref<gfx::base_t> base) : base(base) {}
-gpu_auto_timer_t::~gpu_auto_timer_t() {
-  base->_context->wait_idle();
-  for (auto [name, timer] : timers) {
-    base->destroy_timer(timer);
-  }
-}
-
-void gpu_auto_timer_t::start(gfx::handle_commandbuffer_t cbuf,
-                             const std::string          &name) {
-  auto itr = timers.find(name);
-  if (itr == timers.end()) {
-    // didnt find
-    timers[name] =
-        base->create_timer(gfx::resource_update_policy_t::e_every_frame, {});
-  }
-  base->_context->cmd_begin_timer(cbuf, base->timer(timers[name]));
-}
-
-void gpu_auto_timer_t::end(gfx::handle_commandbuffer_t cbuf,
-                           const std::string          &name) {
-  horizon_assert(timers.contains(name), "{} not in timers", name);
-  base->_context->cmd_end_timer(cbuf, base->timer(timers[name]));
+VkDeviceAddress device_address(gfx::context_t      &context,
+                               gfx::handle_buffer_t buffer) {
+  if (buffer == core::null_handle) return 0;
+  return context.get_buffer_device_address(buffer);
 }
 
-void gpu_auto_timer_t::clear() {
-  base->_context->wait_idle();
-  for (auto [name, timer] : timers) {
-    base->destroy_timer(timer);
-  }
-  timers.clear();
-}
-
-diffuse_t::diffuse_t(core::ref<core::window_t> window,   //
-                     core::ref<gfx::context_t> context,  //
-                     core::ref<gfx::base_t>    base,     //
+diffuse_t::diffuse_t(core::ref<core::window_t> window,        //
+                     core::ref<gfx::context_t> context,       //
+                     core::ref<gfx::base_t>    base,          //
+                     core::ref<shader_cache_t> shader_cache,  //
                      VkFormat                  vk_format)
-    : window(window), context(context), base(base) {
+    : window(window), context(context), base(base), shader_cache(shader_cache) {
   gfx::config_pipeline_layout_t cpl{};
   cpl.add_descriptor_set_layout(base->_bindless_descriptor_set_layout);
   cpl.add_push_constant(sizeof(push_constant_t), VK_SHADER_STAGE_ALL);
   pl = context->create_pipeline_layout(cpl);
 
-  v = gfx::helper::create_slang_shader(*context, "assets/shaders/diffuse.slang",
-                                       gfx::shader_type_t::e_vertex);
-  f = gfx::helper::create_slang_shader(*context, "assets/shaders/diffuse.slang",
-                                       gfx::shader_type_t::e_fragment);
-  gfx::config_pipeline_t cp{};
-  cp.handle_pipeline_layout = pl;
-  cp.add_color_attachment(vk_format, gfx::default_color_blend_attachment());
-  VkPipelineDepthStencilStateCreateInfo vk_pipeline_depth_state{};
-  vk_pipeline_depth_state.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-  vk_pipeline_depth_state.depthTestEnable   = VK_TRUE;
-  vk_pipeline_depth_state.depthWriteEnable  = VK_TRUE;
-  vk_pipeline_depth_state.depthCompareOp    = VK_COMPARE_OP_LESS;
-  vk_pipeline_depth_state.stencilTestEnable = VK_FALSE;
-  cp.set_depth_attachment(VK_FORMAT_D32_SFLOAT, vk_pipeline_depth_state);
-  cp.add_shader(v);
-  cp.add_shader(f);
-  p = context->create_graphics_pipeline(cp);
+  auto create_pipeline = [&](const std::string                &path,
+                             std::vector<gfx::shader_type_t> types) {
+    gfx::config_pipeline_t cp{};
+    cp.handle_pipeline_layout = pl;
+    cp.add_color_attachment(vk_format, gfx::default_color_blend_attachment());
+    VkPipelineDepthStencilStateCreateInfo vk_pipeline_depth_state{};
+    vk_pipeline_depth_state.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    vk_pipeline_depth_state.depthTestEnable   = VK_TRUE;
+    vk_pipeline_depth_state.depthWriteEnable  = VK_TRUE;
+    vk_pipeline_depth_state.depthCompareOp    = VK_COMPARE_OP_LESS;
+    vk_pipeline_depth_state.stencilTestEnable = VK_FALSE;
+    cp.set_depth_attachment(VK_FORMAT_D32_SFLOAT, vk_pipeline_depth_state);
+    for (gfx::shader_type_t type : types)
+      cp.add_shader(shader_cache->create_shader({path, type}));
+    shader_cache->use_pipeline_cache(cp);
+    return context->create_graphics_pipeline(cp);
+  };
+
+  p = create_pipeline(
+      "assets/shaders/diffuse.slang",
+      {gfx::shader_type_t::e_vertex, gfx::shader_type_t::e_fragment});
+  meshlets_p = create_pipeline(
+      "assets/shaders/diffuse_meshlets.slang",
+      {gfx::shader_type_t::e_vertex, gfx::shader_type_t::e_fragment});
+#ifdef AURORA_MESH_SHADERS
+  mesh_p = create_pipeline(
+      "assets/shaders/diffuse_mesh.slang",
+      {gfx::shader_type_t::e_task, gfx::shader_type_t::e_mesh,
+       gfx::shader_type_t::e_fragment});
+#endif
 }
 
 diffuse_t::~diffuse_t() {}
@@ -87,48 +78,90 @@ diffuse_t::~diffuse_t() {}
 void diffuse_t::render(gfx::handle_commandbuffer_t    cbuf,
                        renderer_data_t               &renderer_data,
                        gfx::handle_buffer_t           camera,
+                       gfx::handle_buffer_t           virtual_textures,
                        gfx::handle_bindless_sampler_t bsampler,
-                       VkViewport vk_viewport, VkRect2D vk_scissor) {
-  context->cmd_bind_pipeline(cbuf, p);
-  context->cmd_bind_descriptor_sets(cbuf, p, 0,
+                       VkViewport vk_viewport, VkRect2D vk_scissor,
+                       diffuse_geometry_t geometry, const culling_t &culling) {
+  gfx::handle_pipeline_t pipeline = p;
+  gfx::handle_buffer_t   draws    = culling.draws;
+  if (geometry == diffuse_geometry_t::e_meshlets) {
+    pipeline = meshlets_p;
+    draws    = culling.meshlet_draws;
+  }
+#ifdef AURORA_MESH_SHADERS
+  if (geometry == diffuse_geometry_t::e_mesh_shader) {
+    pipeline = mesh_p;
+    draws    = culling.tasks;
+  }
+#endif
+
+  context->cmd_bind_pipeline(cbuf, pipeline);
+  context->cmd_bind_descriptor_sets(cbuf, pipeline, 0,
                                     {base->_bindless_descriptor_set});
   context->cmd_set_viewport_and_scissor(cbuf, vk_viewport, vk_scissor);
 
-  for (uint32_t mesh_index = 0; mesh_index < renderer_data.cpu_meshes.size();
-       mesh_index++) {
-    const auto     &cpu_mesh = renderer_data.cpu_meshes[mesh_index];
-    push_constant_t pc;
-    pc.camera =
-        gfx::to<core::camera_t *>(context->get_buffer_device_address(camera));
-    pc.materials = gfx::to<material_t *>(
-        context->get_buffer_device_address(renderer_data.materials_buffer));
-    pc.gpu_mesh.vertices = gfx::to<model::vertex_t *>(
-        context->get_buffer_device_address(cpu_mesh.vertex_buffer));
-    pc.gpu_mesh.indices = gfx::to<uint32_t *>(
-        context->get_buffer_device_address(cpu_mesh.index_buffer));
-    pc.gpu_mesh.transform = gfx::to<math::mat4 *>(
-        context->get_buffer_device_address(cpu_mesh.transform));
-    pc.bsampler   = bsampler;
-    pc.mesh_index = mesh_index;
-    context->cmd_push_constants(cbuf, p, VK_SHADER_STAGE_ALL, 0,
-                                sizeof(push_constant_t), &pc);
-    context->cmd_draw(cbuf, cpu_mesh.index_count, 1, 0, 0);
+  gfx::handle_buffer_t counters = culling.frame_counters();
+  push_constant_t      pc;
+  pc.camera =
+      gfx::to<core::camera_t *>(context->get_buffer_device_address(camera));
+  pc.materials = gfx::to<material_t *>(
+      context->get_buffer_device_address(renderer_data.materials_buffer));
+  pc.meshes = gfx::to<gpu_mesh_t *>(
+      context->get_buffer_device_address(renderer_data.meshes_buffer));
+  pc.meshlets = gfx::to<meshlet_t *>(
+      context->get_buffer_device_address(renderer_data.meshlets_buffer));
+  pc.draws    = context->get_buffer_device_address(draws);
+  pc.counters = gfx::to<culling_counters_t *>(
+      context->get_buffer_device_address(counters));
+  pc.virtual_textures = gfx::to<virtual_textures_t *>(
+      device_address(*context, virtual_textures));
+  pc.bsampler = bsampler;
+  pc.frustum  = culling.frustum;
+  pc.backface = culling.backface;
+  context->cmd_push_constants(cbuf, pipeline, VK_SHADER_STAGE_ALL, 0,
+                              sizeof(push_constant_t), &pc);
+
+  VkCommandBuffer vk_commandbuffer =
+      context->get_commandbuffer(cbuf).vk_commandbuffer;
+  VkBuffer vk_draws    = context->get_buffer(draws).vk_buffer;
+  VkBuffer vk_counters = context->get_buffer(counters).vk_buffer;
+  switch (geometry) {
+    case diffuse_geometry_t::e_vertices:
+      vkCmdDrawIndirectCount(vk_commandbuffer, vk_draws, 0, vk_counters,
+                             offsetof(culling_counters_t, draw_count),
+                             renderer_data.meshes_count,
+                             sizeof(draw_command_t));
+      break;
+    case diffuse_geometry_t::e_meshlets:
+      vkCmdDrawIndirectCount(vk_commandbuffer, vk_draws, 0, vk_counters,
+                             offsetof(culling_counters_t, meshlet_draw_count),
+                             renderer_data.meshlet_instances_count,
+                             sizeof(meshlet_draw_t));
+      break;
+    case diffuse_geometry_t::e_mesh_shader:
+#ifdef AURORA_MESH_SHADERS
+      vkCmdDrawMeshTasksIndirectCountEXT(
+          vk_commandbuffer, vk_draws, 0, vk_counters,
+          offsetof(culling_counters_t, draw_count),
+          renderer_data.meshes_count, sizeof(task_command_t));
+#endif
+      break;
   }
 }
 
-debug_raytracer_t::debug_raytracer_t(core::ref<core::window_t> window,   //
-                                     core::ref<gfx::context_t> context,  //
-                                     core::ref<gfx::base_t>    base,     //
+debug_raytracer_t::debug_raytracer_t(core::ref<core::window_t> window,        //
+                                     core::ref<gfx::context_t> context,       //
+                                     core::ref<gfx::base_t>    base,          //
+                                     core::ref<shader_cache_t> shader_cache,  //
                                      VkFormat                  vk_format)
-    : window(window), context(context), base(base) {
+    : window(window), context(context), base(base), shader_cache(shader_cache) {
   gfx::config_pipeline_layout_t cpl{};
   cpl.add_descriptor_set_layout(base->_bindless_descriptor_set_layout);
   cpl.add_push_constant(sizeof(push_constant_t), VK_SHADER_STAGE_ALL);
   pl = context->create_pipeline_layout(cpl);
 
-  c = gfx::helper::create_slang_shader(*context,
-                                       "assets/shaders/debug_raytracing.slang",
-                                       gfx::shader_type_t::e_compute);
+  c = shader_cache->create_shader(
+      {"assets/shaders/debug_raytracing.slang", gfx::shader_type_t::e_compute});
   gfx::config_pipeline_t cp{};
   cp.handle_pipeline_layout = pl;
   cp.add_color_attachment(vk_format, gfx::default_color_blend_attachment());
@@ -141,14 +174,39 @@ debug_raytracer_t::debug_raytracer_t(core::ref<core::window_t> window,   //
   vk_pipeline_depth_state.stencilTestEnable = VK_FALSE;
   cp.set_depth_attachment(VK_FORMAT_D32_SFLOAT, vk_pipeline_depth_state);
   cp.add_shader(c);
+  shader_cache->use_pipeline_cache(cp);
   p = context->create_compute_pipeline(cp);
+
+  gfx::config_buffer_t cb{};
+  cb.vk_size               = sizeof(gpu_traversal_stats_t) * stats_slots;
+  cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  cb.vma_allocation_create_flags =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+  stats_buffer = context->create_buffer(cb);
+  mapped_stats = reinterpret_cast<gpu_traversal_stats_t *>(
+      context->map_buffer(stats_buffer));
+  std::memset(mapped_stats, 0, sizeof(gpu_traversal_stats_t) * stats_slots);
+}
+
+debug_raytracer_t::~debug_raytracer_t() {
+  context->destroy_buffer(stats_buffer);
 }
 
-debug_raytracer_t::~debug_raytracer_t() {}
+void debug_raytracer_t::read_latest_stats() {
+  uint32_t latest = stats_slots;
+  for (uint32_t slot = 0; slot < stats_slots; slot++)
+    if (slot_frames[slot] > stats.frame &&
+        (latest == stats_slots || slot_frames[slot] > slot_frames[latest]))
+      latest = slot;
+  if (latest == stats_slots) return;
+  stats = summarize_traversal_stats(mapped_stats[latest], slot_frames[latest]);
+}
 
 void debug_raytracer_t::render(gfx::handle_commandbuffer_t    cbuf,
                                renderer_data_t               &renderer_data,
                                gfx::handle_buffer_t           camera,
+                               gfx::handle_buffer_t           two_level_bvh,
+                               gfx::handle_buffer_t           streamed_scene,
                                gfx::handle_bindless_sampler_t bsampler,
                                uint32_t width, uint32_t height,
                                gfx::handle_bindless_storage_image_t bsimage) {
@@ -159,34 +217,59 @@ void debug_raytracer_t::render(gfx::handle_commandbuffer_t    cbuf,
   push_constant_t pc;
   pc.camera =
       gfx::to<core::camera_t *>(context->get_buffer_device_address(camera));
-  pc.triangles = gfx::to<triangle_t *>(
-      context->get_buffer_device_address(renderer_data.triangles_buffer));
+  pc.triangle_storage = gfx::to<triangle_storage_t *>(
+      context->get_buffer_device_address(renderer_data.triangle_storage));
   pc.bvh2_nodes = gfx::to<bvh::node_t *>(
-      context->get_buffer_device_address(renderer_data.bvh2_nodes));
+      device_address(*context, renderer_data.bvh2_nodes));
   pc.bvh2_prim_indices = gfx::to<uint32_t *>(
-      context->get_buffer_device_address(renderer_data.bvh2_prim_indices));
-  pc.width   = width;
-  pc.height  = height;
-  pc.bsimage = bsimage;
+      device_address(*context, renderer_data.bvh2_prim_indices));
+  pc.width     = width;
+  pc.height    = height;
+  pc.bsimage   = bsimage;
+  pc.use_cwbvh = use_cwbvh;
+  pc.cwbvh_nodes = gfx::to<cwbvh_node_t *>(
+      device_address(*context, renderer_data.cwbvh_nodes));
+  pc.cwbvh_prim_indices = gfx::to<uint32_t *>(
+      device_address(*context, renderer_data.cwbvh_prim_indices));
+  pc.two_level     = two_level_bvh != core::null_handle;
+  pc.streamed      = streamed_scene != core::null_handle;
+  pc.two_level_bvh =
+      gfx::to<two_level_bvh_t *>(device_address(*context, two_level_bvh));
+  pc.streamed_scene =
+      gfx::to<streamed_scene_t *>(device_address(*context, streamed_scene));
+
+  // the slot about to be reused was written stats_slots frames ago
+  frame++;
+  const uint32_t slot = frame % stats_slots;
+  if (slot_frames[slot] != 0)
+    stats = summarize_traversal_stats(mapped_stats[slot], slot_frames[slot]);
+  std::memset(&mapped_stats[slot], 0, sizeof(gpu_traversal_stats_t));
+  slot_frames[slot] = collect_stats ? frame : 0;
+
+  pc.stats = gfx::to<gpu_traversal_stats_t *>(
+      context->get_buffer_device_address(stats_buffer) +
+      sizeof(gpu_traversal_stats_t) * slot);
+  pc.heatmap_max   = heatmap_max;
+  pc.collect_stats = collect_stats;
   context->cmd_push_constants(cbuf, p, VK_SHADER_STAGE_ALL, 0,
                               sizeof(push_constant_t), &pc);
   context->cmd_dispatch(cbuf, math::ceil(width / 8) + 1,
                         math::ceil(height / 8) + 1, 1);
 }
 
-raytracer_t::raytracer_t(core::ref<core::window_t> window,   //
-                         core::ref<gfx::context_t> context,  //
-                         core::ref<gfx::base_t>    base,     //
+raytracer_t::raytracer_t(core::ref<core::window_t> window,        //
+                         core::ref<gfx::context_t> context,       //
+                         core::ref<gfx::base_t>    base,          //
+                         core::ref<shader_cache_t> shader_cache,  //
                          VkFormat                  vk_format)
-    : window(window), context(context), base(base) {
+    : window(window), context(context), base(base), shader_cache(shader_cache) {
   gfx::config_pipeline_layout_t cpl{};
   cpl.add_descriptor_set_layout(base->_bindless_descriptor_set_layout);
   cpl.add_push_constant(sizeof(push_constant_t), VK_SHADER_STAGE_ALL);
   pl = context->create_pipeline_layout(cpl);
 
-  c = gfx::helper::create_slang_shader(*context,
-                                       "assets/shaders/raytracer.slang",
-                                       gfx::shader_type_t::e_compute);
+  c = shader_cache->create_shader(
+      {"assets/shaders/raytracer.slang", gfx::shader_type_t::e_compute});
   gfx::config_pipeline_t cp{};
   cp.handle_pipeline_layout = pl;
   cp.add_color_attachment(vk_format, gfx::default_color_blend_attachment());
@@ -199,6 +282,7 @@ raytracer_t::raytracer_t(core::ref<core::window_t> window,   //
   vk_pipeline_depth_state.stencilTestEnable = VK_FALSE;
   cp.set_depth_attachment(VK_FORMAT_D32_SFLOAT, vk_pipeline_depth_state);
   cp.add_shader(c);
+  shader_cache->use_pipeline_cache(cp);
   p = context->create_compute_pipeline(cp);
 }
 
@@ -207,9 +291,25 @@ raytracer_t::~raytracer_t() {}
 void raytracer_t::render(gfx::handle_commandbuffer_t    cbuf,
                          renderer_data_t               &renderer_data,
                          gfx::handle_buffer_t           camera,
+                         gfx::handle_buffer_t           two_level_bvh,
+                         gfx::handle_buffer_t           streamed_scene,
+                         gfx::handle_buffer_t           virtual_textures,
                          gfx::handle_bindless_sampler_t bsampler,
                          uint32_t width, uint32_t height,
-                         gfx::handle_bindless_storage_image_t bsimage) {
+                         gfx::handle_bindless_storage_image_t bsimage,
+                         const progressive_t                 &progressive) {
+  if (progressive.enabled) {
+    // the previous frame wrote the reservoirs this one resamples
+    VkMemoryBarrier vk_memory_barrier{};
+    vk_memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    vk_memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vk_memory_barrier.dstAccessMask =
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(context->get_commandbuffer(cbuf).vk_commandbuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &vk_memory_barrier, 0, nullptr, 0, nullptr);
+  }
   context->cmd_bind_pipeline(cbuf, p);
   context->cmd_bind_descriptor_sets(cbuf, p, 0,
                                     {base->_bindless_descriptor_set});
@@ -220,38 +320,98 @@ void raytracer_t::render(gfx::handle_commandbuffer_t    cbuf,
   pc.meshes = context->get_buffer_device_address(renderer_data.meshes_buffer);
   pc.materials =
       context->get_buffer_device_address(renderer_data.materials_buffer);
-  pc.triangles = gfx::to<triangle_t *>(
-      context->get_buffer_device_address(renderer_data.triangles_buffer));
+  pc.triangle_storage = gfx::to<triangle_storage_t *>(
+      context->get_buffer_device_address(renderer_data.triangle_storage));
   pc.bvh2_nodes = gfx::to<bvh::node_t *>(
-      context->get_buffer_device_address(renderer_data.bvh2_nodes));
+      device_address(*context, renderer_data.bvh2_nodes));
   pc.bvh2_prim_indices = gfx::to<uint32_t *>(
-      context->get_buffer_device_address(renderer_data.bvh2_prim_indices));
+      device_address(*context, renderer_data.bvh2_prim_indices));
   pc.width           = width;
   pc.height          = height;
   pc.bsimage         = bsimage;
   pc.bsampler        = bsampler;
-  pc.triangles_count = renderer_data.triangles_count;
-  pc.padding         = 101010101;
-  pc.materials_count = renderer_data.materials_count;
-  pc.meshes_count    = renderer_data.meshes_count;
+  pc.flags           = 0;
+  if (two_level_bvh != core::null_handle) pc.flags |= e_two_level;
+  if (use_cwbvh) pc.flags |= e_cwbvh;
+  if (progressive.enabled) pc.flags |= e_path_tracing;
+  if (streamed_scene != core::null_handle) pc.flags |= e_streamed;
+  pc.baccumulation = progressive.baccumulation;
+  pc.two_level_bvh =
+      gfx::to<two_level_bvh_t *>(device_address(*context, two_level_bvh));
+  pc.streamed_scene =
+      gfx::to<streamed_scene_t *>(device_address(*context, streamed_scene));
+  pc.cwbvh_nodes = gfx::to<cwbvh_node_t *>(
+      device_address(*context, renderer_data.cwbvh_nodes));
+  pc.cwbvh_prim_indices = gfx::to<uint32_t *>(
+      device_address(*context, renderer_data.cwbvh_prim_indices));
+  pc.sample_index     = progressive.sample_index;
+  pc.spp              = progressive.spp;
+  pc.virtual_textures = gfx::to<virtual_textures_t *>(
+      device_address(*context, virtual_textures));
+  pc.progressive_state = gfx::to<progressive_state_t *>(
+      device_address(*context, progressive.state));
   context->cmd_push_constants(cbuf, p, VK_SHADER_STAGE_ALL, 0,
                               sizeof(push_constant_t), &pc);
   context->cmd_dispatch(cbuf, math::ceil(width / 8) + 1,
                         math::ceil(height / 8) + 1, 1);
 }
 
-renderer_t::renderer_t(core::ref<core::window_t>   window,      //
-                       core::ref<gfx::context_t>   context,     //
-                       core::ref<gfx::base_t>      base,        //
-                       core::ref<gpu_auto_timer_t> auto_timer,  //
-                       const int                   argc,        //
+readback_t::readback_t(core::ref<gfx::context_t> context,  //
+                       core::ref<gfx::base_t>    base,     //
+                       core::ref<shader_cache_t> shader_cache)
+    : context(context), base(base), shader_cache(shader_cache) {
+  gfx::config_pipeline_layout_t cpl{};
+  cpl.add_descriptor_set_layout(base->_bindless_descriptor_set_layout);
+  cpl.add_push_constant(sizeof(push_constant_t), VK_SHADER_STAGE_ALL);
+  pl = context->create_pipeline_layout(cpl);
+
+  c = shader_cache->create_shader(
+      {"assets/shaders/readback.slang", gfx::shader_type_t::e_compute});
+  gfx::config_pipeline_t cp{};
+  cp.handle_pipeline_layout = pl;
+  cp.add_shader(c);
+  shader_cache->use_pipeline_cache(cp);
+  p = context->create_compute_pipeline(cp);
+}
+
+readback_t::~readback_t() {}
+
+void readback_t::render(gfx::handle_commandbuffer_t cbuf,
+                        gfx::handle_buffer_t pixels, uint32_t width,
+                        uint32_t                             height,
+                        gfx::handle_bindless_storage_image_t bsimage) {
+  context->cmd_bind_pipeline(cbuf, p);
+  context->cmd_bind_descriptor_sets(cbuf, p, 0,
+                                    {base->_bindless_descriptor_set});
+
+  push_constant_t pc;
+  pc.pixels =
+      gfx::to<math::vec4 *>(context->get_buffer_device_address(pixels));
+  pc.width   = width;
+  pc.height  = height;
+  pc.bsimage = bsimage;
+  context->cmd_push_constants(cbuf, p, VK_SHADER_STAGE_ALL, 0,
+                              sizeof(push_constant_t), &pc);
+  context->cmd_dispatch(cbuf, math::ceil(width / 8) + 1,
+                        math::ceil(height / 8) + 1, 1);
+}
+
+renderer_t::renderer_t(core::ref<core::window_t>   window,        //
+                       core::ref<gfx::context_t>   context,       //
+                       core::ref<gfx::base_t>      base,          //
+                       core::ref<gpu_auto_timer_t> auto_timer,    //
+                       core::ref<shader_cache_t>   shader_cache,  //
+                       const int                   argc,          //
                        const char                **argv)
     : window(window),
       context(context),
       base(base),
       auto_timer(auto_timer),
+      shader_cache(shader_cache),
       argc(argc),
       argv(argv) {
+  deletion_queue = core::make_ref<deletion_queue_t>(context);
+
   sampler  = context->create_sampler({});
   bsampler = base->new_bindless_sampler();
   base->set_bindless_sampler(bsampler, sampler);
@@ -262,8 +422,6 @@ renderer_t::renderer_t(core::ref<core::window_t>   window,      //
   cdsl.use_bindless = false;
   imgui_dsl         = context->create_descriptor_set_layout(cdsl);
 
-  imgui_ds = context->allocate_descriptor_set(
-      {.handle_descriptor_set_layout = imgui_dsl});
 
   white = gfx::helper::load_image_from_path_instant(
       *context, base->_command_pool, "assets/images/White_Pixel_1x1.jpg",
@@ -275,7 +433,16 @@ renderer_t::renderer_t(core::ref<core::window_t>   window,      //
   base->set_bindless_image(bwhite, white_view,
                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-  bsimage = base->new_bindless_storage_image();
+  for (auto &slot : sized_slots) {
+    slot.bsimage          = base->new_bindless_storage_image();
+    slot.bdepth           = base->new_bindless_image();
+    slot.baccumulation    = base->new_bindless_storage_image();
+    slot.bhistory         = base->new_bindless_storage_image();
+    slot.bsurface         = base->new_bindless_storage_image();
+    slot.bhistory_surface = base->new_bindless_storage_image();
+    slot.imgui_ds         = context->allocate_descriptor_set(
+        {.handle_descriptor_set_layout = imgui_dsl});
+  }
 
   {
     gfx::config_buffer_t cb{};
@@ -286,16 +453,49 @@ renderer_t::renderer_t(core::ref<core::window_t>   window,      //
     camera_buffer =
         base->create_buffer(gfx::resource_update_policy_t::e_every_frame, cb);
   }
+  {
+    // one copy per frame in flight, a copy is only read back once the frame
+    // that last wrote it has finished
+    gfx::config_buffer_t cb{};
+    cb.vk_size               = sizeof(progressive_state_t);
+    cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    cb.vma_allocation_create_flags =
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+    progressive_buffer =
+        base->create_buffer(gfx::resource_update_policy_t::e_every_frame, cb);
+  }
 
-  diffuse_renderer = core::make_ref<diffuse_t>(window, context, base,
-                                               VK_FORMAT_R32G32B32A32_SFLOAT);
-  debug_raytracer  = core::make_ref<debug_raytracer_t>(
-      window, context, base, VK_FORMAT_R32G32B32A32_SFLOAT);
-  raytracer = core::make_ref<raytracer_t>(window, context, base,
-                                          VK_FORMAT_R32G32B32A32_SFLOAT);
+  diffuse_renderer = core::make_ref<diffuse_t>(
+      window, context, base, shader_cache, VK_FORMAT_R32G32B32A32_SFLOAT);
+  debug_raytracer = core::make_ref<debug_raytracer_t>(
+      window, context, base, shader_cache, VK_FORMAT_R32G32B32A32_SFLOAT);
+  raytracer = core::make_ref<raytracer_t>(
+      window, context, base, shader_cache, VK_FORMAT_R32G32B32A32_SFLOAT);
+  readback  = core::make_ref<readback_t>(context, base, shader_cache);
+  wavefront = core::make_ref<wavefront_t>(context, base, auto_timer,
+                                          shader_cache, deletion_queue);
+  culling   = core::make_ref<culling_t>(context, base, auto_timer,
+                                      shader_cache, deletion_queue);
+  tlas      = core::make_ref<tlas_t>(context, base);
 }
 
 renderer_t::~renderer_t() {
+  // the device is idle by now, the queue frees them once the last of its
+  // owners is gone
+  deletion_queue->destroy_image_view(image_view);
+  deletion_queue->destroy_image(image);
+  deletion_queue->destroy_image_view(accumulation_view);
+  deletion_queue->destroy_image(accumulation);
+  deletion_queue->destroy_image_view(depth_view);
+  deletion_queue->destroy_image(depth);
+  deletion_queue->destroy_image_view(history_view);
+  deletion_queue->destroy_image(history);
+  deletion_queue->destroy_image_view(surface_view);
+  deletion_queue->destroy_image(surface);
+  deletion_queue->destroy_image_view(history_surface_view);
+  deletion_queue->destroy_image(history_surface);
+  deletion_queue->destroy_buffer(reservoirs);
+  deletion_queue->destroy_buffer(previous_reservoirs);
   context->destroy_image_view(white_view);
   context->destroy_image(white);
   context->destroy_sampler(sampler);
@@ -303,18 +503,34 @@ renderer_t::~renderer_t() {
 
 void renderer_t::recreate_sized_resources(uint32_t width, uint32_t height) {
   if (this->width != width || this->height != height) {
-    context->wait_idle();
-
     this->width  = width;
     this->height = height;
 
-    // destroy sized resources
-    if (image != core::null_handle) {
-      context->destroy_image(image);
-    }
-    if (image_view != core::null_handle) {
-      context->destroy_image_view(image_view);
-    }
+    // the frames in flight still render into the old sized resources, they
+    // go once those frames have finished
+    deletion_queue->destroy_image_view(image_view);
+    deletion_queue->destroy_image(image);
+    deletion_queue->destroy_image_view(accumulation_view);
+    deletion_queue->destroy_image(accumulation);
+    deletion_queue->destroy_image_view(depth_view);
+    deletion_queue->destroy_image(depth);
+    deletion_queue->destroy_image_view(history_view);
+    deletion_queue->destroy_image(history);
+    deletion_queue->destroy_image_view(surface_view);
+    deletion_queue->destroy_image(surface);
+    deletion_queue->destroy_image_view(history_surface_view);
+    deletion_queue->destroy_image(history_surface);
+    deletion_queue->destroy_buffer(reservoirs);
+    deletion_queue->destroy_buffer(previous_reservoirs);
+
+    sized_slot       = (sized_slot + 1) % frame_ring_size;
+    bsimage          = sized_slots[sized_slot].bsimage;
+    bdepth           = sized_slots[sized_slot].bdepth;
+    baccumulation    = sized_slots[sized_slot].baccumulation;
+    bhistory         = sized_slots[sized_slot].bhistory;
+    bsurface         = sized_slots[sized_slot].bsurface;
+    bhistory_surface = sized_slots[sized_slot].bhistory_surface;
+    imgui_ds         = sized_slots[sized_slot].imgui_ds;
 
     // create sized resources
     gfx::config_image_t ci{};
@@ -343,6 +559,9 @@ void renderer_t::recreate_sized_resources(uint32_t width, uint32_t height) {
     civ.handle_image = depth;
     civ.debug_name   = "depth view";
     depth_view       = context->create_image_view(civ);
+    base->set_bindless_image(bdepth, depth_view,
+                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    depth_valid = false;
 
     context->update_descriptor_set(imgui_ds)
         .push_image_write(
@@ -354,12 +573,68 @@ void renderer_t::recreate_sized_resources(uint32_t width, uint32_t height) {
         .commit();
 
     base->set_bindless_storage_image(bsimage, image_view);
+
+    ci.vk_format      = VK_FORMAT_R32G32B32A32_SFLOAT;
+    ci.vk_usage       = VK_IMAGE_USAGE_STORAGE_BIT;
+    ci.debug_name     = "accumulation";
+    accumulation      = context->create_image(ci);
+    civ.handle_image  = accumulation;
+    civ.debug_name    = "accumulation view";
+    accumulation_view = context->create_image_view(civ);
+    base->set_bindless_storage_image(baccumulation, accumulation_view);
+
+    auto create_storage_image = [&](const char *name, gfx::handle_image_t &i,
+                                    gfx::handle_image_view_t            &view,
+                                    gfx::handle_bindless_storage_image_t b) {
+      ci.debug_name    = name;
+      i                = context->create_image(ci);
+      civ.handle_image = i;
+      civ.debug_name   = name;
+      view             = context->create_image_view(civ);
+      base->set_bindless_storage_image(b, view);
+    };
+    create_storage_image("history", history, history_view, bhistory);
+    create_storage_image("surface", surface, surface_view, bsurface);
+    create_storage_image("history surface", history_surface,
+                         history_surface_view, bhistory_surface);
+
+    gfx::config_buffer_t cb{};
+    cb.vk_size               = sizeof(reservoir_t) * width * height;
+    cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    cb.vma_allocation_create_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+    reservoirs                     = context->create_buffer(cb);
+    previous_reservoirs            = context->create_buffer(cb);
+
+    reset_accumulation();
   }
 }
 
+void renderer_t::reset_accumulation() {
+  samples   = 0;
+  converged = false;
+  reproject = false;
+  accumulation_epoch++;
+}
+
 std::vector<gfx::pass_t> renderer_t::get_passes(renderer_data_t &renderer_data,
                                                 const core::camera_t &camera) {
+  // interned once, the names show up in the settings and in traces
+  static const auto streaming_timer = intern_timer("streaming");
+  static const auto textures_timer  = intern_timer("virtual textures");
+  static const auto culling_timer   = intern_timer("culling");
+  static const auto diffuse_timer   = intern_timer("diffuse");
+  static const auto debug_timer     = intern_timer("debug_raytracer");
+  static const auto raytracer_timer = intern_timer("raytracer");
+  static const auto path_timer      = intern_timer("path_tracer");
+  static const auto wavefront_timer = intern_timer("wavefront_path_tracer");
+
+  // frees what the frames in flight can no longer use
+  deletion_queue->update();
+
   std::vector<gfx::pass_t> passes;
+  // recorded first, reads back the timer queries of an earlier frame
+  passes.emplace_back(
+      [&](gfx::handle_commandbuffer_t cbuf) { auto_timer->begin_frame(cbuf); });
 
   VkRect2D vk_rect_2d{};
   vk_rect_2d.extent.width  = width;
@@ -371,14 +646,89 @@ std::vector<gfx::pass_t> renderer_t::get_passes(renderer_data_t &renderer_data,
 
   std::memcpy(context->map_buffer(base->buffer(camera_buffer)), &camera,
               sizeof(core::camera_t));
+  frames_in_flight_check.update(base->buffer(camera_buffer));
+
+  if (std::memcmp(&camera, &last_camera, sizeof(core::camera_t)) != 0) {
+    last_camera = camera;
+    // the path tracer carries its accumulation over to the new view, the
+    // sample count and convergence start over
+    if (temporal && rendering_mode == rendering_mode_t::e_path_tracer &&
+        samples > 0) {
+      samples   = 0;
+      converged = false;
+      reproject = true;
+      accumulation_epoch++;
+    } else {
+      reset_accumulation();
+    }
+  }
+
+  // only the diffuse pass writes depth
+  if (rendering_mode != rendering_mode_t::e_diffuse) depth_valid = false;
+
+  // the ray traced modes follow the mesh transforms through the two level bvh
+  // if it was built, the diffuse pass reads the transforms directly
+  gfx::handle_buffer_t two_level_bvh = core::null_handle;
+  if (rendering_mode != rendering_mode_t::e_diffuse &&
+      renderer_data.blas_bvh2_nodes != core::null_handle) {
+    if (tlas->update(renderer_data)) reset_accumulation();
+    two_level_bvh = tlas->frame_buffer();
+  }
+
+  // pages in what the last frames' rays missed before anything traces, the
+  // image changes whenever the resident clusters do
+  gfx::handle_buffer_t streamed_scene = core::null_handle;
+  if (rendering_mode != rendering_mode_t::e_diffuse && streamer) {
+    if (streamer->update(camera)) reset_accumulation();
+    streamed_scene = streamer->frame_buffer();
+    passes.emplace_back([&](gfx::handle_commandbuffer_t cbuf) {
+      auto_timer->start(cbuf, streaming_timer);
+      streamer->render(cbuf);
+      auto_timer->end(cbuf, streaming_timer);
+    });
+  }
+
+  // every mode samples the materials, so the pages are streamed whatever the
+  // mode, the path tracer restarts when a sharper page arrives
+  gfx::handle_buffer_t virtual_textures = core::null_handle;
+  if (texture_streamer) {
+    if (texture_streamer->update()) reset_accumulation();
+    virtual_textures = texture_streamer->frame_buffer();
+    passes.emplace_back([&](gfx::handle_commandbuffer_t cbuf) {
+      auto_timer->start(cbuf, textures_timer);
+      texture_streamer->render(cbuf);
+      auto_timer->end(cbuf, textures_timer);
+    });
+  }
 
   switch (rendering_mode) {
-    case rendering_mode_t::e_diffuse:
+    case rendering_mode_t::e_diffuse: {
+      culling->reserve(renderer_data.meshes_count,
+                       renderer_data.meshlet_instances_count, width,
+                       height);
+      const bool               cull_depth_valid  = depth_valid;
+      const core::camera_t     cull_depth_camera = depth_camera;
+      const diffuse_geometry_t geometry          = diffuse_geometry;
+      depth_valid                                = true;
+      depth_camera                               = camera;
+
+      passes
+          .emplace_back([&, cull_depth_valid, cull_depth_camera,
+                         geometry](gfx::handle_commandbuffer_t cbuf) {
+            auto_timer->start(cbuf, culling_timer);
+            culling->render(cbuf, renderer_data, base->buffer(camera_buffer),
+                            cull_depth_camera, bdepth, cull_depth_valid,
+                            geometry == diffuse_geometry_t::e_meshlets);
+            auto_timer->end(cbuf, culling_timer);
+          })
+          .add_read_image(depth, VK_ACCESS_SHADER_READ_BIT,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
       passes
-          .emplace_back([&, vk_rect_2d, viewport,
-                         scissor](gfx::handle_commandbuffer_t cbuf) {
-            auto_timer->start(cbuf, "diffuse");
+          .emplace_back([&, vk_rect_2d, viewport, scissor, geometry,
+                         virtual_textures](gfx::handle_commandbuffer_t cbuf) {
+            auto_timer->start(cbuf, diffuse_timer);
 
             gfx::rendering_attachment_t rendering{};
             rendering.handle_image_view = image_view;
@@ -396,42 +746,163 @@ std::vector<gfx::pass_t> renderer_t::get_passes(renderer_data_t &renderer_data,
             context->cmd_begin_rendering(cbuf, {rendering}, depth, vk_rect_2d);
 
             diffuse_renderer->render(cbuf, renderer_data,
-                                     base->buffer(camera_buffer), bsampler,
-                                     viewport, scissor);
+                                     base->buffer(camera_buffer),
+                                     virtual_textures, bsampler, viewport,
+                                     scissor, geometry, *culling);
 
-            auto_timer->end(cbuf, "diffuse");
+            auto_timer->end(cbuf, diffuse_timer);
 
             context->cmd_end_rendering(cbuf);
           })
           .add_write_image(image, 0,
                            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                           VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+                           VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+          .add_write_image(depth, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                           VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                               VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                           VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
       break;
+    }
 
     case rendering_mode_t::e_debug_raytracer:
       passes
-          .emplace_back([&](gfx::handle_commandbuffer_t cbuf) {
-            auto_timer->start(cbuf, "debug_raytracer");
+          .emplace_back([&, two_level_bvh,
+                         streamed_scene](gfx::handle_commandbuffer_t cbuf) {
+            auto_timer->start(cbuf, debug_timer);
             debug_raytracer->render(cbuf, renderer_data,
-                                    base->buffer(camera_buffer), bsampler,
-                                    width, height, bsimage);
-            auto_timer->end(cbuf, "debug_raytracer");
+                                    base->buffer(camera_buffer), two_level_bvh,
+                                    streamed_scene, bsampler, width, height,
+                                    bsimage);
+            auto_timer->end(cbuf, debug_timer);
           })
           .add_write_image(image, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                            VK_IMAGE_LAYOUT_GENERAL);
       break;
     case rendering_mode_t::e_raytracer:
       passes
-          .emplace_back([&](gfx::handle_commandbuffer_t cbuf) {
-            auto_timer->start(cbuf, "raytracer");
+          .emplace_back([&, two_level_bvh, streamed_scene,
+                         virtual_textures](gfx::handle_commandbuffer_t cbuf) {
+            auto_timer->start(cbuf, raytracer_timer);
             raytracer->render(cbuf, renderer_data, base->buffer(camera_buffer),
-                              bsampler, width, height, bsimage);
-            auto_timer->end(cbuf, "raytracer");
+                              two_level_bvh, streamed_scene, virtual_textures,
+                              bsampler, width, height, bsimage, {});
+            auto_timer->end(cbuf, raytracer_timer);
           })
           .add_write_image(image, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                            VK_IMAGE_LAYOUT_GENERAL);
       break;
+    case rendering_mode_t::e_path_tracer: {
+      // this copy was last written frames in flight ago, its count is only
+      // meaningful if it belongs to the current accumulation
+      progressive_state_t *state = reinterpret_cast<progressive_state_t *>(
+          context->map_buffer(base->buffer(progressive_buffer)));
+      if (state->epoch == accumulation_epoch &&
+          state->noisy_pixels <= width * height / 1000)
+        converged = true;
+      if (samples >= target_samples) converged = true;
+      const uint32_t frame_spp =
+          converged ? 0 : std::min(spp, target_samples - samples);
+
+      // the accumulation and surface just written become the history the
+      // reprojection reads from, the reservoirs alternate every traced frame
+      if (reproject) {
+        std::swap(accumulation, history);
+        std::swap(accumulation_view, history_view);
+        std::swap(baccumulation, bhistory);
+        std::swap(surface, history_surface);
+        std::swap(surface_view, history_surface_view);
+        std::swap(bsurface, bhistory_surface);
+      }
+      if (frame_spp > 0) std::swap(reservoirs, previous_reservoirs);
+
+      *state = {0, accumulation_epoch, bounces, noise_threshold};
+      state->flags = 0;
+      if (reproject) state->flags |= progressive_state_t::e_reproject;
+      if (restir) state->flags |= progressive_state_t::e_restir;
+      state->max_history      = max_history;
+      state->bhistory         = bhistory;
+      state->bsurface         = bsurface;
+      state->bhistory_surface = bhistory_surface;
+      state->reservoirs       = gfx::to<reservoir_t *>(
+          context->get_buffer_device_address(reservoirs));
+      state->previous_reservoirs = gfx::to<reservoir_t *>(
+          context->get_buffer_device_address(previous_reservoirs));
+      state->previous_camera = history_camera;
+      if (frame_spp > 0) {
+        history_camera = camera;
+        reproject      = false;
+      }
+
+      raytracer_t::progressive_t progressive{};
+      progressive.enabled       = true;
+      progressive.baccumulation = baccumulation;
+      progressive.sample_index  = samples;
+      progressive.spp           = frame_spp;
+      progressive.state         = base->buffer(progressive_buffer);
+      samples += progressive.spp;
+
+      passes
+          .emplace_back([&, progressive, two_level_bvh, streamed_scene,
+                         virtual_textures](gfx::handle_commandbuffer_t cbuf) {
+            auto_timer->start(cbuf, path_timer);
+            raytracer->render(cbuf, renderer_data, base->buffer(camera_buffer),
+                              two_level_bvh, streamed_scene, virtual_textures,
+                              bsampler, width, height, bsimage, progressive);
+            auto_timer->end(cbuf, path_timer);
+          })
+          .add_write_image(image, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                           VK_IMAGE_LAYOUT_GENERAL)
+          .add_write_image(
+              accumulation,
+              VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_IMAGE_LAYOUT_GENERAL)
+          .add_write_image(
+              surface, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_IMAGE_LAYOUT_GENERAL)
+          .add_read_image(history, VK_ACCESS_SHADER_READ_BIT,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          VK_IMAGE_LAYOUT_GENERAL)
+          .add_read_image(history_surface, VK_ACCESS_SHADER_READ_BIT,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          VK_IMAGE_LAYOUT_GENERAL);
+      break;
+    }
+    case rendering_mode_t::e_wavefront_path_tracer: {
+      if (samples >= target_samples) converged = true;
+      // the image already holds the converged mean
+      if (converged) break;
+
+      wavefront->reserve(width * height, renderer_data.materials_count);
+      const uint32_t sample_index = samples++;
+
+      passes
+          .emplace_back([&, sample_index,
+                         two_level_bvh](gfx::handle_commandbuffer_t cbuf) {
+            auto_timer->start(cbuf, wavefront_timer);
+            wavefront->render(cbuf, renderer_data, base->buffer(camera_buffer),
+                              two_level_bvh, bsampler, width, height, bsimage,
+                              baccumulation, sample_index, bounces);
+            auto_timer->end(cbuf, wavefront_timer);
+          })
+          .add_write_image(image, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                           VK_IMAGE_LAYOUT_GENERAL)
+          .add_write_image(
+              accumulation,
+              VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_IMAGE_LAYOUT_GENERAL);
+      break;
+    }
   }
 
   return passes;
 }
+
+gfx::pass_t renderer_t::get_readback_pass(gfx::handle_buffer_t pixels) {
+  gfx::pass_t pass{[&, pixels](gfx::handle_commandbuffer_t cbuf) {
+    readback->render(cbuf, pixels, width, height, bsimage);
+  }};
+  pass.add_read_image(image, VK_ACCESS_SHADER_READ_BIT,
+                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                      VK_IMAGE_LAYOUT_GENERAL);
+  return pass;
+}
@@ -1,11 +1,15 @@
 #ifndef RENDERER_HPP
 #define RENDERER_HPP
 
-#include <unordered_map>
+#include <cstddef>
 #include <vector>
 
 #include "assets.hpp"
 #include "bvh/bvh.hpp"
+#include "culling.hpp"
+#include "cwbvh.hpp"
+#include "frame_resources.hpp"
+#include "gpu_timer.hpp"
 #include "horizon/core/components.hpp"
 #include "horizon/core/ecs.hpp"
 #include "horizon/core/window.hpp"
@@ -14,116 +18,290 @@
 #include "horizon/gfx/rendergraph.hpp"
 #include "horizon/gfx/types.hpp"
 #include "math/triangle.hpp"
+#include "meshlet.hpp"
 #include "model/model.hpp"
-
-struct gpu_auto_timer_t {
-  gpu_auto_timer_t(core::ref<gfx::base_t> base);
-  ~gpu_auto_timer_t();
-
-  // TODO: use something other than std::string
-  void start(gfx::handle_commandbuffer_t cbuf, const std::string &name);
-  void end(gfx::handle_commandbuffer_t cbuf, const std::string &name);
-
-  void clear();
-
-  core::ref<gfx::base_t>                                       base;
-  std::unordered_map<std::string, gfx::handle_managed_timer_t> timers;
+#include "shader_cache.hpp"
+#include "streaming.hpp"
+#include "tlas.hpp"
+#include "traversal_stats.hpp"
+#include "virtual_texture.hpp"
+#include "wavefront.hpp"
+
+// buffers the current preparation left out, like the flat bvh when
+// streaming or instancing, are null and read as null pointers
+VkDeviceAddress device_address(gfx::context_t      &context,
+                               gfx::handle_buffer_t buffer);
+
+// how the diffuse pass turns the culled draw list into triangles
+enum class diffuse_geometry_t {
+  // a draw per mesh pulling every index in the vertex shader
+  e_vertices,
+  // culling_t culls meshlets in compute, a draw per visible meshlet
+  e_meshlets,
+  // a task shader culls meshlets and a mesh shader emits them, needs
+  // AURORA_MESH_SHADERS
+  e_mesh_shader,
 };
 
 struct diffuse_t {
   struct push_constant_t {
     core::camera_t                *camera;
     material_t                    *materials;
-    gpu_mesh_t                     gpu_mesh;
+    gpu_mesh_t                    *meshes;
+    meshlet_t                     *meshlets;
+    // draw_command_t, meshlet_draw_t or task_command_t by geometry
+    VkDeviceAddress                draws;
+    culling_counters_t            *counters;
+    // null unless the materials are virtual textured
+    virtual_textures_t            *virtual_textures;
     gfx::handle_bindless_sampler_t bsampler;
-    uint32_t                       mesh_index;
+    uint32_t                       frustum;
+    uint32_t                       backface;
   };
 
-  diffuse_t(core::ref<core::window_t> window,   //
-            core::ref<gfx::context_t> context,  //
-            core::ref<gfx::base_t>    base,     //
+  diffuse_t(core::ref<core::window_t> window,        //
+            core::ref<gfx::context_t> context,       //
+            core::ref<gfx::base_t>    base,          //
+            core::ref<shader_cache_t> shader_cache,  //
             VkFormat                  vk_format);
   ~diffuse_t();
 
+  // one indirect draw over the culling_t draw list geometry reads, the count
+  // comes from culling's counters, virtual_textures is the texture
+  // streamer's frame buffer or null
   void render(gfx::handle_commandbuffer_t cbuf, renderer_data_t &renderer_data,
               gfx::handle_buffer_t           camera,
+              gfx::handle_buffer_t           virtual_textures,
               gfx::handle_bindless_sampler_t bsampler, VkViewport vk_viewport,
-              VkRect2D vk_scissor);
+              VkRect2D vk_scissor, diffuse_geometry_t geometry,
+              const culling_t &culling);
 
   core::ref<core::window_t> window;
   core::ref<gfx::context_t> context;
   core::ref<gfx::base_t>    base;
+  core::ref<shader_cache_t> shader_cache;
 
   gfx::handle_pipeline_layout_t pl;
-  gfx::handle_shader_t          v;
-  gfx::handle_shader_t          f;
   gfx::handle_pipeline_t        p;
+  gfx::handle_pipeline_t        meshlets_p;
+#ifdef AURORA_MESH_SHADERS
+  gfx::handle_pipeline_t mesh_p;
+#endif
 };
 
 struct debug_raytracer_t {
   struct push_constant_t {
     core::camera_t                      *camera;
-    triangle_t                          *triangles;
+    triangle_storage_t                  *triangle_storage;
     bvh::node_t                         *bvh2_nodes;
     uint32_t                            *bvh2_prim_indices;
     uint32_t                             width;
     uint32_t                             height;
     gfx::handle_bindless_storage_image_t bsimage;
-    uint32_t                             padding;
+    uint32_t                             use_cwbvh;
+    cwbvh_node_t                        *cwbvh_nodes;
+    uint32_t                            *cwbvh_prim_indices;
+    uint32_t                             two_level;
+    uint32_t                             streamed;
+    two_level_bvh_t                     *two_level_bvh;
+    streamed_scene_t                    *streamed_scene;
+    gpu_traversal_stats_t               *stats;
+    float                                heatmap_max;
+    uint32_t                             collect_stats;
   };
+  static_assert(sizeof(push_constant_t) <= 128,
+                "push constants past 128 bytes are not guaranteed");
 
-  debug_raytracer_t(core::ref<core::window_t> window,   //
-                    core::ref<gfx::context_t> context,  //
-                    core::ref<gfx::base_t>    base,     //
+  // a ring of gpu_traversal_stats_t, a slot is read back when the ring
+  // comes around to it, by then no frame in flight can still write it
+  static constexpr uint32_t stats_slots = frame_ring_size;
+
+  debug_raytracer_t(core::ref<core::window_t> window,        //
+                    core::ref<gfx::context_t> context,       //
+                    core::ref<gfx::base_t>    base,          //
+                    core::ref<shader_cache_t> shader_cache,  //
                     VkFormat                  vk_format);
   ~debug_raytracer_t();
 
+  // traces the streamed clusters if streamed_scene is not null, see
+  // geometry_streamer_t, else the two level bvh if two_level_bvh is not null,
+  // see tlas_t
   void render(gfx::handle_commandbuffer_t cbuf, renderer_data_t &renderer_data,
               gfx::handle_buffer_t           camera,
+              gfx::handle_buffer_t           two_level_bvh,
+              gfx::handle_buffer_t           streamed_scene,
               gfx::handle_bindless_sampler_t bsampler, uint32_t width,
               uint32_t height, gfx::handle_bindless_storage_image_t bsimage);
+  // summarizes the newest slot the device finished, call with the device
+  // idle, render reads the slots back on its own
+  void read_latest_stats();
 
   core::ref<core::window_t> window;
   core::ref<gfx::context_t> context;
   core::ref<gfx::base_t>    base;
+  core::ref<shader_cache_t> shader_cache;
 
   gfx::handle_pipeline_layout_t pl;
   gfx::handle_shader_t          c;
   gfx::handle_pipeline_t        p;
+
+  // traverse the compressed wide bvh instead of the binary one
+  bool use_cwbvh = false;
+
+  // host visible, stats_slots gpu_traversal_stats_t
+  gfx::handle_buffer_t   stats_buffer;
+  gpu_traversal_stats_t *mapped_stats;
+  // frame that wrote each slot, 0 if it holds nothing
+  uint64_t               slot_frames[stats_slots]{};
+  uint64_t               frame         = 0;
+  bool                   collect_stats = true;
+  float                  heatmap_max   = 150.f;
+  // the newest stats read back
+  traversal_summary_t    stats{};
 };
 
+// a pixel's direct environment light sample, see
+// assets/shaders/raytracer.slang
+struct reservoir_t {
+  math::vec3 direction;
+  float      w_sum;
+  float      m;
+  float      w;
+  math::vec3 normal;
+  float      depth;
+};
+static_assert(sizeof(reservoir_t) == 40, "sizeof(reservoir_t) should be 40");
+
+// per frame state of the path tracer, written before the frame, the path
+// tracer counts the pixels whose mean is not yet within the noise threshold
+// into noisy_pixels, epoch tells which accumulation the count belongs to,
+// the rest is temporal reuse, see renderer_t::temporal
+struct progressive_state_t {
+  // bits of flags
+  enum flags_t : uint32_t {
+    // the camera moved since previous_camera rendered the history
+    e_reproject = 1,
+    // direct environment light through reservoir resampling
+    e_restir    = 2,
+  };
+
+  uint32_t                             noisy_pixels;
+  uint32_t                             epoch;
+  uint32_t                             bounces;
+  float                                noise_threshold;
+  uint32_t                             flags;
+  float                                max_history;
+  gfx::handle_bindless_storage_image_t bhistory;
+  gfx::handle_bindless_storage_image_t bsurface;
+  gfx::handle_bindless_storage_image_t bhistory_surface;
+  uint32_t                             padding;
+  reservoir_t                         *reservoirs;
+  reservoir_t                         *previous_reservoirs;
+  core::camera_t                       previous_camera;
+};
+static_assert(offsetof(progressive_state_t, previous_camera) == 56,
+              "progressive_state_t has to match its slang layout");
+
 struct raytracer_t {
+  // bits of push_constant_t::flags, see assets/shaders/raytracer.slang
+  enum flags_t : uint32_t {
+    e_two_level    = 1,
+    e_cwbvh        = 2,
+    e_path_tracing = 4,
+    e_streamed     = 8,
+  };
+
   struct push_constant_t {
     core::camera_t                      *camera;
     VkDeviceAddress                      meshes;
     VkDeviceAddress                      materials;
-    triangle_t                          *triangles;
+    triangle_storage_t                  *triangle_storage;
     bvh::node_t                         *bvh2_nodes;
     uint32_t                            *bvh2_prim_indices;
     uint32_t                             width;
     uint32_t                             height;
     gfx::handle_bindless_storage_image_t bsimage;
     gfx::handle_bindless_sampler_t       bsampler;
-    uint32_t                             triangles_count;
-    uint32_t                             padding;
-    uint32_t                             materials_count;
-    uint32_t                             meshes_count;
+    uint32_t                             flags;
+    gfx::handle_bindless_storage_image_t baccumulation;
+    two_level_bvh_t                     *two_level_bvh;
+    streamed_scene_t                    *streamed_scene;
+    cwbvh_node_t                        *cwbvh_nodes;
+    uint32_t                            *cwbvh_prim_indices;
+    uint32_t                             sample_index;
+    uint32_t                             spp;
+    virtual_textures_t                  *virtual_textures;
+    progressive_state_t                 *progressive_state;
+  };
+  static_assert(sizeof(push_constant_t) <= 128,
+                "push constants past 128 bytes are not guaranteed");
+
+  // accumulation state of the progressive path tracer, see renderer_t
+  // spp 0 only resolves the accumulation image into the output
+  struct progressive_t {
+    bool                                 enabled = false;
+    gfx::handle_bindless_storage_image_t baccumulation{};
+    uint32_t                             sample_index = 0;
+    uint32_t                             spp          = 0;
+    // holds a progressive_state_t
+    gfx::handle_buffer_t                 state        = core::null_handle;
   };
 
-  raytracer_t(core::ref<core::window_t> window,   //
-              core::ref<gfx::context_t> context,  //
-              core::ref<gfx::base_t>    base,     //
+  raytracer_t(core::ref<core::window_t> window,        //
+              core::ref<gfx::context_t> context,       //
+              core::ref<gfx::base_t>    base,          //
+              core::ref<shader_cache_t> shader_cache,  //
               VkFormat                  vk_format);
   ~raytracer_t();
 
+  // traces the streamed clusters if streamed_scene is not null, see
+  // geometry_streamer_t, else the two level bvh if two_level_bvh is not null,
+  // see tlas_t, samples virtual textures if virtual_textures is not null, see
+  // texture_streamer_t
   void render(gfx::handle_commandbuffer_t cbuf, renderer_data_t &renderer_data,
               gfx::handle_buffer_t           camera,
+              gfx::handle_buffer_t           two_level_bvh,
+              gfx::handle_buffer_t           streamed_scene,
+              gfx::handle_buffer_t           virtual_textures,
               gfx::handle_bindless_sampler_t bsampler, uint32_t width,
-              uint32_t height, gfx::handle_bindless_storage_image_t bsimage);
+              uint32_t height, gfx::handle_bindless_storage_image_t bsimage,
+              const progressive_t &progressive);
 
   core::ref<core::window_t> window;
   core::ref<gfx::context_t> context;
   core::ref<gfx::base_t>    base;
+  core::ref<shader_cache_t> shader_cache;
+
+  gfx::handle_pipeline_layout_t pl;
+  gfx::handle_shader_t          c;
+  gfx::handle_pipeline_t        p;
+
+  // traverse the compressed wide bvh instead of the binary one
+  bool use_cwbvh = false;
+};
+
+// copies the output image into a buffer, used by the headless path
+struct readback_t {
+  struct push_constant_t {
+    math::vec4                          *pixels;
+    uint32_t                             width;
+    uint32_t                             height;
+    gfx::handle_bindless_storage_image_t bsimage;
+    uint32_t                             padding;
+  };
+
+  readback_t(core::ref<gfx::context_t> context,  //
+             core::ref<gfx::base_t>    base,     //
+             core::ref<shader_cache_t> shader_cache);
+  ~readback_t();
+
+  void render(gfx::handle_commandbuffer_t cbuf, gfx::handle_buffer_t pixels,
+              uint32_t width, uint32_t height,
+              gfx::handle_bindless_storage_image_t bsimage);
+
+  core::ref<gfx::context_t> context;
+  core::ref<gfx::base_t>    base;
+  core::ref<shader_cache_t> shader_cache;
 
   gfx::handle_pipeline_layout_t pl;
   gfx::handle_shader_t          c;
@@ -131,22 +309,31 @@ struct raytracer_t {
 };
 
 struct renderer_t {
-  renderer_t(core::ref<core::window_t>   window,      //
-             core::ref<gfx::context_t>   context,     //
-             core::ref<gfx::base_t>      base,        //
-             core::ref<gpu_auto_timer_t> auto_timer,  //
-             const int                   argc,        //
+  renderer_t(core::ref<core::window_t>   window,        //
+             core::ref<gfx::context_t>   context,       //
+             core::ref<gfx::base_t>      base,          //
+             core::ref<gpu_auto_timer_t> auto_timer,    //
+             core::ref<shader_cache_t>   shader_cache,  //
+             const int                   argc,          //
              const char                **argv);
   ~renderer_t();
 
   void recreate_sized_resources(uint32_t width, uint32_t height);
+  // restarts the progressive path tracer, call when anything affecting the
+  // image changes, camera movement and resizes are detected automatically
+  void reset_accumulation();
   std::vector<gfx::pass_t> get_passes(renderer_data_t      &renderer_data,
                                       const core::camera_t &camera);
+  // pixels must hold width * height rgba32f texels
+  gfx::pass_t get_readback_pass(gfx::handle_buffer_t pixels);
 
   core::ref<core::window_t>   window;
   core::ref<gfx::context_t>   context;
   core::ref<gfx::base_t>      base;
   core::ref<gpu_auto_timer_t> auto_timer;
+  core::ref<shader_cache_t>   shader_cache;
+  core::ref<deletion_queue_t> deletion_queue;
+  frames_in_flight_check_t    frames_in_flight_check;
 
   const int    argc;
   const char **argv;
@@ -169,6 +356,25 @@ struct renderer_t {
   gfx::handle_image_view_t depth_view = core::null_handle;
 
   gfx::handle_bindless_storage_image_t bsimage;
+  gfx::handle_bindless_image_t         bdepth;
+
+  // every resize moves the sized images to the next slot, the frames in
+  // flight keep reading the old images through the descriptors of theirs
+  struct sized_slot_t {
+    gfx::handle_bindless_storage_image_t bsimage;
+    gfx::handle_bindless_image_t         bdepth;
+    gfx::handle_bindless_storage_image_t baccumulation;
+    gfx::handle_bindless_storage_image_t bhistory;
+    gfx::handle_bindless_storage_image_t bsurface;
+    gfx::handle_bindless_storage_image_t bhistory_surface;
+    gfx::handle_descriptor_set_t         imgui_ds;
+  };
+  sized_slot_t sized_slots[frame_ring_size];
+  uint32_t     sized_slot = 0;
+
+  // depth holds what depth_camera saw, culling tests occlusion against it
+  bool                                 depth_valid = false;
+  core::camera_t                       depth_camera{};
 
   gfx::handle_pipeline_t diffuse;
 
@@ -178,11 +384,71 @@ struct renderer_t {
     e_diffuse,
     e_debug_raytracer,
     e_raytracer,
+    e_path_tracer,
+    e_wavefront_path_tracer,
   } rendering_mode = renderer_t::rendering_mode_t::e_diffuse;
 
+  diffuse_geometry_t diffuse_geometry = diffuse_geometry_t::e_vertices;
+
+  // progressive path tracer, rgb holds the sum of samples and a the sum of
+  // squared luminance, accumulation stops at target_samples or once no more
+  // than 0.1% of the pixels are noisier than noise_threshold, the wavefront
+  // path tracer shares the accumulation but only stops at target_samples
+  gfx::handle_image_t                  accumulation      = core::null_handle;
+  gfx::handle_image_view_t             accumulation_view = core::null_handle;
+  gfx::handle_bindless_storage_image_t baccumulation;
+  gfx::handle_managed_buffer_t         progressive_buffer;
+
+  // temporal reuse of the path tracer, a moving camera reprojects the
+  // accumulation instead of restarting it, history is the accumulation and
+  // history_surface the surface of the frame history_camera rendered, both
+  // swap with the current ones when the camera moves, the surface holds
+  // every pixel's sample count, depth and motion vector
+  gfx::handle_image_t                  history              = core::null_handle;
+  gfx::handle_image_view_t             history_view         = core::null_handle;
+  gfx::handle_bindless_storage_image_t bhistory;
+  gfx::handle_image_t                  surface              = core::null_handle;
+  gfx::handle_image_view_t             surface_view         = core::null_handle;
+  gfx::handle_bindless_storage_image_t bsurface;
+  gfx::handle_image_t                  history_surface      = core::null_handle;
+  gfx::handle_image_view_t             history_surface_view = core::null_handle;
+  gfx::handle_bindless_storage_image_t bhistory_surface;
+  // a reservoir_t per pixel, written and read by alternate frames
+  gfx::handle_buffer_t                 reservoirs           = core::null_handle;
+  gfx::handle_buffer_t                 previous_reservoirs  = core::null_handle;
+  core::camera_t                       history_camera{};
+  // the camera moved since history_camera, cleared by reset_accumulation
+  bool                                 reproject = false;
+
+  bool  temporal    = true;
+  bool  restir      = true;
+  // reprojected pixels keep at most this many samples, so the image follows
+  // the motion
+  float max_history = 32.f;
+
+  uint32_t spp             = 1;
+  uint32_t bounces         = 3;
+  uint32_t target_samples  = 4096;
+  // relative standard error of a pixel's mean luminance
+  float    noise_threshold = 0.02f;
+
+  uint32_t       samples            = 0;
+  uint32_t       accumulation_epoch = 1;
+  bool           converged          = false;
+  core::camera_t last_camera{};
+
   core::ref<diffuse_t>         diffuse_renderer;
   core::ref<debug_raytracer_t> debug_raytracer;
   core::ref<raytracer_t>       raytracer;
+  core::ref<readback_t>        readback;
+  core::ref<wavefront_t>       wavefront;
+  core::ref<culling_t>         culling;
+  // only updated while the ray traced modes run and the blases were built
+  core::ref<tlas_t>            tlas;
+  // only set when the scene was prepared for streaming, see app_t
+  core::ref<geometry_streamer_t> streamer;
+  // only set when the textures were cut into pages, see app_t
+  core::ref<texture_streamer_t>  texture_streamer;
 };
 
 #endif
@@ -0,0 +1,366 @@
+#include "shader_cache.hpp"
+
+#include <slang-com-ptr.h>
+#include <slang.h>
+#include <volk.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include "bvh_cache.hpp"
+#include "horizon/core/logger.hpp"
+#include "vulkan_handles.hpp"
+
+namespace {
+
+constexpr uint32_t spirv_magic = 0x07230203;
+
+std::string read_text(const std::filesystem::path &path) {
+  std::ifstream     file{path, std::ios::binary};
+  std::stringstream stream;
+  stream << file.rdbuf();
+  return stream.str();
+}
+
+void write_file(const std::filesystem::path &path, const void *data,
+                size_t size) {
+  const bool saved = write_file_atomically(path, [&](std::ofstream &file) {
+    file.write(reinterpret_cast<const char *>(data), size);
+  });
+  if (!saved) horizon_info("failed to write {}", path.string());
+}
+
+// the quoted file of an #include line or the module of an import line,
+// empty for every other line
+std::string included_file(const std::string &line) {
+  size_t start = line.find_first_not_of(" \t");
+  if (start == std::string::npos) return {};
+  if (line.compare(start, 8, "#include") == 0) {
+    size_t open  = line.find('"', start);
+    size_t close = line.find('"', open + 1);
+    if (open == std::string::npos || close == std::string::npos) return {};
+    return line.substr(open + 1, close - open - 1);
+  }
+  if (line.compare(start, 7, "import ") == 0) {
+    size_t end  = line.find(';', start);
+    size_t name = line.find_first_not_of(" \t", start + 7);
+    if (end == std::string::npos || name >= end) return {};
+    std::string module = line.substr(name, end - name);
+    for (char &c : module)
+      if (c == '.') c = '/';
+    return module + ".slang";
+  }
+  return {};
+}
+
+const char *entry_point_name(gfx::shader_type_t type) {
+  switch (type) {
+    case gfx::shader_type_t::e_vertex:
+      return "vertex_main";
+    case gfx::shader_type_t::e_fragment:
+      return "fragment_main";
+#ifdef AURORA_MESH_SHADERS
+    case gfx::shader_type_t::e_task:
+      return "task_main";
+    case gfx::shader_type_t::e_mesh:
+      return "mesh_main";
+#endif
+    default:
+      return "compute_main";
+  }
+}
+
+SlangStage entry_point_stage(gfx::shader_type_t type) {
+  switch (type) {
+    case gfx::shader_type_t::e_vertex:
+      return SLANG_STAGE_VERTEX;
+    case gfx::shader_type_t::e_fragment:
+      return SLANG_STAGE_FRAGMENT;
+#ifdef AURORA_MESH_SHADERS
+    case gfx::shader_type_t::e_task:
+      return SLANG_STAGE_AMPLIFICATION;
+    case gfx::shader_type_t::e_mesh:
+      return SLANG_STAGE_MESH;
+#endif
+    default:
+      return SLANG_STAGE_COMPUTE;
+  }
+}
+
+void append_diagnostics(std::string &error, slang::IBlob *diagnostics) {
+  if (!diagnostics) return;
+  error.append(
+      reinterpret_cast<const char *>(diagnostics->getBufferPointer()),
+      diagnostics->getBufferSize());
+}
+
+std::filesystem::path spirv_path(const std::filesystem::path &cache_directory,
+                                 uint64_t                     hash) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.spv",
+                static_cast<unsigned long long>(hash));
+  return cache_directory / name;
+}
+
+std::filesystem::path pipeline_cache_path(
+    const std::filesystem::path &cache_directory) {
+  return cache_directory / "pipelines.bin";
+}
+
+// horizon takes precompiled spir-v for a shader past its slang helper
+gfx::handle_shader_t create_shader_from_spirv(
+    gfx::context_t &context, const std::filesystem::path &path,
+    gfx::shader_type_t type, const std::vector<uint32_t> &spirv) {
+  gfx::config_shader_t config{};
+  config.type       = type;
+  config.spirv      = spirv;
+  config.debug_name = path.string();
+  return context.create_shader(config);
+}
+
+}  // namespace
+
+struct shader_cache_t::compiler_t {
+  Slang::ComPtr<slang::IGlobalSession> global_session;
+};
+
+std::vector<std::filesystem::path> shader_dependencies(
+    const std::filesystem::path &path) {
+  std::vector<std::filesystem::path> dependencies{path.lexically_normal()};
+  std::set<std::filesystem::path>    seen{dependencies[0]};
+  const std::filesystem::path        root = path.parent_path();
+  for (size_t i = 0; i < dependencies.size(); i++) {
+    std::ifstream file{dependencies[i]};
+    std::string   line;
+    while (std::getline(file, line)) {
+      std::string included = included_file(line);
+      if (included.empty()) continue;
+      // relative to the including file, then to the source's directory,
+      // a file found in neither is left for the compiler to report
+      std::filesystem::path candidate =
+          (dependencies[i].parent_path() / included).lexically_normal();
+      if (!std::filesystem::exists(candidate))
+        candidate = (root / included).lexically_normal();
+      if (!std::filesystem::exists(candidate)) continue;
+      if (seen.insert(candidate).second) dependencies.push_back(candidate);
+    }
+  }
+  return dependencies;
+}
+
+uint64_t hash_shader_inputs(const shader_source_t &source) {
+  uint64_t hash =
+      hash_bytes(&shader_cache_version, sizeof(shader_cache_version), 0);
+  const std::string entry_point = entry_point_name(source.type);
+  hash = hash_bytes(entry_point.data(), entry_point.size(), hash);
+  for (const auto &[name, value] : source.defines) {
+    hash = hash_bytes(name.data(), name.size(), hash);
+    hash = hash_bytes(value.data(), value.size(), hash);
+  }
+  for (const auto &dependency : shader_dependencies(source.path)) {
+    const std::string name     = dependency.generic_string();
+    const std::string contents = read_text(dependency);
+    hash = hash_bytes(name.data(), name.size(), hash);
+    hash = hash_bytes(contents.data(), contents.size(), hash);
+  }
+  return hash;
+}
+
+shader_cache_t::shader_cache_t(core::ref<gfx::context_t> context,          //
+                               std::filesystem::path     cache_directory,  //
+                               bool                      use_cache)
+    : context(context),
+      cache_directory(std::move(cache_directory)),
+      use_cache(use_cache) {
+  compiler = core::make_ref<compiler_t>();
+  check(SLANG_SUCCEEDED(slang::createGlobalSession(
+            compiler->global_session.writeRef())),
+        "failed to create a slang session");
+
+  // drivers check the header of the data against their device and version
+  // and start empty on a mismatch
+  size_t size    = 0;
+  void  *mapping = nullptr;
+  if (use_cache)
+    mapping = map_file(pipeline_cache_path(this->cache_directory), size);
+  const bool loaded = mapping != nullptr;
+  VkPipelineCacheCreateInfo vk_pipeline_cache_create_info{};
+  vk_pipeline_cache_create_info.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  vk_pipeline_cache_create_info.initialDataSize = mapping ? size : 0;
+  vk_pipeline_cache_create_info.pInitialData    = mapping;
+  if (vkCreatePipelineCache(vk_device(*context),
+                            &vk_pipeline_cache_create_info, nullptr,
+                            &vk_pipeline_cache) != VK_SUCCESS)
+    vk_pipeline_cache = VK_NULL_HANDLE;
+  unmap_file(mapping, size);
+  horizon_info("pipeline cache {} with {} bytes",
+               loaded ? "loaded" : "created", loaded ? size : 0);
+}
+
+shader_cache_t::~shader_cache_t() {
+  save_pipeline_cache();
+  if (vk_pipeline_cache != VK_NULL_HANDLE)
+    vkDestroyPipelineCache(vk_device(*context), vk_pipeline_cache, nullptr);
+  horizon_info("shaders: {} cached, {} compiled in {:.1f} ms", hits, misses,
+               compile_ms);
+}
+
+bool shader_cache_t::compile(const shader_source_t &source,
+                             std::vector<uint32_t> &spirv,
+                             std::string           &error) {
+  std::scoped_lock lock{mutex};
+  error.clear();
+
+  const uint64_t              hash = hash_shader_inputs(source);
+  const std::filesystem::path path = spirv_path(cache_directory, hash);
+  if (use_cache) {
+    size_t size    = 0;
+    void  *mapping = map_file(path, size);
+    if (mapping && size % 4 == 0 &&
+        *reinterpret_cast<const uint32_t *>(mapping) == spirv_magic) {
+      const uint32_t *words = reinterpret_cast<const uint32_t *>(mapping);
+      spirv.assign(words, words + size / 4);
+      unmap_file(mapping, size);
+      hits++;
+      return true;
+    }
+    unmap_file(mapping, size);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  slang::IGlobalSession *global_session = compiler->global_session.get();
+
+  slang::CompilerOptionEntry options[2]{};
+  options[0].name            = slang::CompilerOptionName::EmitSpirvDirectly;
+  options[0].value.kind      = slang::CompilerOptionValueKind::Int;
+  options[0].value.intValue0 = 1;
+  // shaders read the scene through pointers laid out like the c++ structs
+  options[1].name            = slang::CompilerOptionName::GLSLForceScalarLayout;
+  options[1].value.kind      = slang::CompilerOptionValueKind::Int;
+  options[1].value.intValue0 = 1;
+
+  slang::TargetDesc target{};
+  target.format                   = SLANG_SPIRV;
+  target.profile                  = global_session->findProfile("spirv_1_5");
+  target.compilerOptionEntries    = options;
+  target.compilerOptionEntryCount = 2;
+
+  std::vector<slang::PreprocessorMacroDesc> macros;
+  for (const auto &[name, value] : source.defines)
+    macros.push_back({name.c_str(), value.empty() ? "1" : value.c_str()});
+
+  const std::string search_path  = source.path.parent_path().string();
+  const char       *search_paths = search_path.c_str();
+
+  slang::SessionDesc session_desc{};
+  session_desc.targets                = &target;
+  session_desc.targetCount            = 1;
+  session_desc.searchPaths            = &search_paths;
+  session_desc.searchPathCount        = 1;
+  session_desc.preprocessorMacros     = macros.data();
+  session_desc.preprocessorMacroCount = macros.size();
+
+  Slang::ComPtr<slang::ISession> session;
+  if (SLANG_FAILED(
+          global_session->createSession(session_desc, session.writeRef()))) {
+    error = "failed to create a slang session";
+    return false;
+  }
+
+  const std::string path_string = source.path.string();
+  const std::string text        = read_text(source.path);
+  const std::string module_name = source.path.stem().string();
+
+  Slang::ComPtr<slang::IBlob> diagnostics;
+  slang::IModule             *module = session->loadModuleFromSourceString(
+      module_name.c_str(), path_string.c_str(), text.c_str(),
+      diagnostics.writeRef());
+  append_diagnostics(error, diagnostics);
+  if (!module) return false;
+
+  Slang::ComPtr<slang::IEntryPoint> entry_point;
+  module->findAndCheckEntryPoint(entry_point_name(source.type),
+                                 entry_point_stage(source.type),
+                                 entry_point.writeRef(),
+                                 diagnostics.writeRef());
+  append_diagnostics(error, diagnostics);
+  if (!entry_point) return false;
+
+  slang::IComponentType *components[] = {module, entry_point.get()};
+  Slang::ComPtr<slang::IComponentType> composed;
+  session->createCompositeComponentType(components, 2, composed.writeRef(),
+                                        diagnostics.writeRef());
+  append_diagnostics(error, diagnostics);
+  if (!composed) return false;
+
+  Slang::ComPtr<slang::IComponentType> linked;
+  composed->link(linked.writeRef(), diagnostics.writeRef());
+  append_diagnostics(error, diagnostics);
+  if (!linked) return false;
+
+  Slang::ComPtr<slang::IBlob> code;
+  linked->getEntryPointCode(0, 0, code.writeRef(), diagnostics.writeRef());
+  append_diagnostics(error, diagnostics);
+  if (!code || code->getBufferSize() % 4 != 0) return false;
+
+  const uint32_t *words =
+      reinterpret_cast<const uint32_t *>(code->getBufferPointer());
+  spirv.assign(words, words + code->getBufferSize() / 4);
+
+  misses++;
+  compile_ms += std::chrono::duration<float, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  if (use_cache) write_file(path, spirv.data(), spirv.size() * 4);
+  return true;
+}
+
+gfx::handle_shader_t shader_cache_t::create_shader(
+    const shader_source_t &source) {
+  std::vector<uint32_t> spirv;
+  std::string           error;
+  check(compile(source, spirv, error), "failed to compile {}\n{}",
+        source.path.string(), error);
+  return create_shader(source, spirv);
+}
+
+gfx::handle_shader_t shader_cache_t::create_shader(
+    const shader_source_t &source, const std::vector<uint32_t> &spirv) {
+  return create_shader_from_spirv(*context, source.path, source.type, spirv);
+}
+
+void shader_cache_t::use_pipeline_cache(gfx::config_pipeline_t &cp) const {
+  cp.vk_pipeline_cache = vk_pipeline_cache;
+}
+
+gfx::handle_pipeline_t shader_cache_t::create_compute_pipeline(
+    gfx::handle_pipeline_layout_t       pl,
+    const std::filesystem::path        &path,
+    const std::vector<shader_define_t> &defines) {
+  gfx::config_pipeline_t cp{};
+  cp.handle_pipeline_layout = pl;
+  cp.add_shader(
+      create_shader({path, gfx::shader_type_t::e_compute, defines}));
+  use_pipeline_cache(cp);
+  return context->create_compute_pipeline(cp);
+}
+
+void shader_cache_t::save_pipeline_cache() {
+  if (!use_cache || vk_pipeline_cache == VK_NULL_HANDLE) return;
+  size_t size = 0;
+  if (vkGetPipelineCacheData(vk_device(*context), vk_pipeline_cache, &size,
+                             nullptr) != VK_SUCCESS ||
+      size == 0)
+    return;
+  std::vector<uint8_t> data(size);
+  if (vkGetPipelineCacheData(vk_device(*context), vk_pipeline_cache, &size,
+                             data.data()) != VK_SUCCESS)
+    return;
+  write_file(pipeline_cache_path(cache_directory), data.data(), size);
+}
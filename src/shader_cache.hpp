@@ -0,0 +1,92 @@
+#ifndef SHADER_CACHE_HPP
+#define SHADER_CACHE_HPP
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "horizon/core/core.hpp"
+#include "horizon/gfx/context.hpp"
+#include "horizon/gfx/types.hpp"
+
+// bump whenever the compiler options change the spir-v they produce
+static constexpr uint32_t shader_cache_version = 1;
+
+// name and value of a preprocessor define, an empty value defines it as 1
+using shader_define_t = std::pair<std::string, std::string>;
+
+// an entry point of a slang file, the entry point is named after the stage,
+// compute_main, vertex_main, fragment_main, task_main or mesh_main
+struct shader_source_t {
+  std::filesystem::path        path;
+  gfx::shader_type_t           type;
+  std::vector<shader_define_t> defines;
+};
+
+// every file a source includes, the source first, found by following
+// #include and import lines, a file included under an #ifdef is listed
+// whether or not the define is set
+std::vector<std::filesystem::path> shader_dependencies(
+    const std::filesystem::path &path);
+
+// hashes the contents of the source and every file it includes with the
+// defines and the entry point, edits to any of them miss the cache
+uint64_t hash_shader_inputs(const shader_source_t &source);
+
+// compiles slang to spir-v, a compiled entry point is written to
+// cache_directory keyed by hash_shader_inputs and reused until a file it
+// includes changes, a vulkan pipeline cache is loaded from cache_directory
+// on construction and written back on destruction so drivers skip their own
+// compilation of pipelines they have seen
+struct shader_cache_t {
+  shader_cache_t(core::ref<gfx::context_t> context,          //
+                 std::filesystem::path     cache_directory,  //
+                 bool                      use_cache);
+  ~shader_cache_t();
+
+  // spir-v of source, from the cache or compiled, false with the compiler's
+  // diagnostics in error if it does not compile, safe to call from any
+  // thread
+  bool compile(const shader_source_t &source, std::vector<uint32_t> &spirv,
+               std::string &error);
+
+  // compiles source and creates its shader, fails loudly on errors
+  gfx::handle_shader_t create_shader(const shader_source_t &source);
+  // creates the shader of spir-v compile returned for source
+  gfx::handle_shader_t create_shader(const shader_source_t       &source,
+                                     const std::vector<uint32_t> &spirv);
+  // pipelines created from cp go through the pipeline cache
+  void use_pipeline_cache(gfx::config_pipeline_t &cp) const;
+  // a compute pipeline of path's compute_main
+  gfx::handle_pipeline_t create_compute_pipeline(
+      gfx::handle_pipeline_layout_t       pl,
+      const std::filesystem::path        &path,
+      const std::vector<shader_define_t> &defines = {});
+
+  // writes the pipeline cache, also done on destruction
+  void save_pipeline_cache();
+
+  core::ref<gfx::context_t> context;
+  std::filesystem::path     cache_directory;
+  bool                      use_cache;
+
+  VkPipelineCache vk_pipeline_cache = VK_NULL_HANDLE;
+
+  // the slang session is not thread safe, compiles are serialized
+  std::mutex mutex;
+  // owns the slang global session, only shader_cache.cpp knows its type
+  struct compiler_t;
+  core::ref<compiler_t> compiler;
+
+  uint32_t hits       = 0;
+  uint32_t misses     = 0;
+  float    compile_ms = 0.f;
+};
+
+#endif
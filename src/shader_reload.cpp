@@ -0,0 +1,184 @@
+#include "shader_reload.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+#include "horizon/core/logger.hpp"
+
+namespace {
+
+constexpr auto poll_interval = std::chrono::milliseconds(250);
+// frames a replaced pipeline is kept alive, more than there are in flight
+constexpr uint64_t retire_frames = frame_ring_size;
+
+using file_times_t =
+    std::map<std::filesystem::path, std::filesystem::file_time_type>;
+
+file_times_t scan(const std::filesystem::path &directory) {
+  file_times_t    times;
+  std::error_code error;
+  for (const auto &entry :
+       std::filesystem::recursive_directory_iterator(directory, error)) {
+    if (!entry.is_regular_file(error) ||
+        entry.path().extension() != ".slang")
+      continue;
+    times[entry.path().lexically_normal()] = entry.last_write_time(error);
+  }
+  return times;
+}
+
+}  // namespace
+
+shader_reloader_t::shader_reloader_t(core::ref<gfx::context_t> context,  //
+                                     core::ref<shader_cache_t> shader_cache,
+                                     std::filesystem::path     directory)
+    : context(context),
+      shader_cache(shader_cache),
+      directory(std::move(directory)) {
+  worker = std::thread([this] { run(); });
+}
+
+shader_reloader_t::~shader_reloader_t() {
+  {
+    std::scoped_lock lock{mutex};
+    stop = true;
+  }
+  wake.notify_all();
+  worker.join();
+  for (const auto &r : retired) destroy(r);
+  for (const auto &program : programs)
+    if (program.shader != core::null_handle)
+      context->destroy_shader(program.shader);
+}
+
+void shader_reloader_t::watch(const std::string            &name,
+                              const std::filesystem::path  &path,
+                              gfx::handle_pipeline_layout_t pl,
+                              gfx::handle_pipeline_t       *pipeline) {
+  std::scoped_lock lock{mutex};
+  programs.push_back({name, path, pl, pipeline, core::null_handle, {}});
+}
+
+void shader_reloader_t::set_defines(
+    const std::vector<shader_define_t> &defines) {
+  {
+    std::scoped_lock lock{mutex};
+    if (this->defines == defines) return;
+    this->defines = defines;
+    generation++;
+    queued.clear();
+    for (uint32_t i = 0; i < programs.size(); i++) queued.push_back(i);
+  }
+  wake.notify_all();
+}
+
+bool shader_reloader_t::update() {
+  frame++;
+  std::erase_if(retired, [&](const retired_t &r) {
+    if (r.frame + retire_frames > frame) return false;
+    destroy(r);
+    return true;
+  });
+
+  std::vector<result_t>        finished;
+  std::vector<shader_define_t> current_defines;
+  uint64_t                     current_generation;
+  {
+    std::scoped_lock lock{mutex};
+    finished.swap(results);
+    current_defines    = defines;
+    current_generation = generation;
+  }
+
+  bool changed = false;
+  for (auto &result : finished) {
+    if (result.generation != current_generation) continue;
+    program_t &program = programs[result.program];
+    if (!result.compiled) {
+      horizon_info("failed to reload {}\n{}", program.name, result.error);
+      program.error = std::move(result.error);
+      continue;
+    }
+    program.error.clear();
+
+    // only pipeline creation is left for the frame loop, the driver mostly
+    // finds it in the pipeline cache
+    const gfx::handle_shader_t shader = shader_cache->create_shader(
+        {program.path, gfx::shader_type_t::e_compute, current_defines},
+        result.spirv);
+    gfx::config_pipeline_t cp{};
+    cp.handle_pipeline_layout = program.pl;
+    cp.add_shader(shader);
+    shader_cache->use_pipeline_cache(cp);
+    retired.push_back({*program.pipeline, program.shader, frame});
+    *program.pipeline = context->create_compute_pipeline(cp);
+    program.shader    = shader;
+    reloads++;
+    changed = true;
+    horizon_info("reloaded {}", program.name);
+  }
+  return changed;
+}
+
+void shader_reloader_t::destroy(const retired_t &r) {
+  context->destroy_pipeline(r.pipeline);
+  if (r.shader != core::null_handle) context->destroy_shader(r.shader);
+}
+
+void shader_reloader_t::run() {
+  file_times_t times = scan(directory);
+
+  std::unique_lock lock{mutex};
+  while (!stop) {
+    wake.wait_for(lock, poll_interval);
+    if (stop) break;
+
+    std::vector<std::filesystem::path> paths;
+    for (const auto &program : programs) paths.push_back(program.path);
+    std::vector<shader_define_t> compile_defines    = defines;
+    uint64_t                     compile_generation = generation;
+    std::vector<uint8_t>         dirty(programs.size(), 0);
+    for (uint32_t program : queued) dirty[program] = 1;
+    queued.clear();
+    lock.unlock();
+
+    // a file that appeared, vanished or was written since the last poll
+    file_times_t current = scan(directory);
+    std::vector<std::filesystem::path> changed;
+    for (const auto &[path, time] : current) {
+      auto it = times.find(path);
+      if (it == times.end() || it->second != time) changed.push_back(path);
+    }
+    for (const auto &[path, time] : times)
+      if (!current.contains(path)) changed.push_back(path);
+    times = std::move(current);
+
+    if (!changed.empty()) {
+      for (uint32_t i = 0; i < paths.size(); i++) {
+        if (dirty[i]) continue;
+        for (const auto &dependency : shader_dependencies(paths[i]))
+          if (std::find(changed.begin(), changed.end(), dependency) !=
+              changed.end())
+            dirty[i] = 1;
+      }
+    }
+
+    std::vector<result_t> compiled;
+    for (uint32_t i = 0; i < paths.size(); i++) {
+      if (!dirty[i]) continue;
+      compiling = true;
+      result_t result{};
+      result.program    = i;
+      result.generation = compile_generation;
+      result.compiled   = shader_cache->compile(
+          {paths[i], gfx::shader_type_t::e_compute, compile_defines},
+          result.spirv, result.error);
+      compiled.push_back(std::move(result));
+    }
+    compiling = false;
+
+    lock.lock();
+    for (auto &result : compiled) results.push_back(std::move(result));
+  }
+}
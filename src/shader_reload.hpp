@@ -0,0 +1,97 @@
+#ifndef SHADER_RELOAD_HPP
+#define SHADER_RELOAD_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_resources.hpp"
+#include "horizon/core/core.hpp"
+#include "horizon/gfx/context.hpp"
+#include "horizon/gfx/types.hpp"
+#include "shader_cache.hpp"
+
+// rebuilds compute pipelines while the app runs, a worker thread polls the
+// shader directory for modified files and recompiles the pipelines whose
+// sources include them, update creates the finished pipelines on the frame
+// loop and swaps them in, the pipelines they replace and the shaders of
+// earlier reloads are destroyed once no frame in flight can still use them
+struct shader_reloader_t {
+  shader_reloader_t(core::ref<gfx::context_t> context,       //
+                    core::ref<shader_cache_t> shader_cache,  //
+                    std::filesystem::path     directory);
+  ~shader_reloader_t();
+
+  // *pipeline is replaced with a pipeline of path's compute_main in pl
+  // whenever a file path includes changes, pipeline has to outlive this
+  void watch(const std::string &name, const std::filesystem::path &path,
+             gfx::handle_pipeline_layout_t pl,
+             gfx::handle_pipeline_t       *pipeline);
+  // defines every watched pipeline is compiled with, recompiles all of them
+  // if they changed
+  void set_defines(const std::vector<shader_define_t> &defines);
+  // swaps in the pipelines the worker finished, call once per frame before
+  // recording, returns true if a pipeline changed
+  bool update();
+
+  struct program_t {
+    std::string                   name;
+    std::filesystem::path         path;
+    gfx::handle_pipeline_layout_t pl;
+    gfx::handle_pipeline_t       *pipeline;
+    // the shader of the last reload, the one the first pipeline was built
+    // from belongs to whoever built it
+    gfx::handle_shader_t          shader = core::null_handle;
+    // diagnostics of the last compile, empty if it succeeded, written by
+    // update only
+    std::string                   error;
+  };
+
+  struct result_t {
+    uint32_t              program;
+    // results of a generation before the last set_defines are dropped
+    uint64_t              generation;
+    bool                  compiled;
+    std::vector<uint32_t> spirv;
+    std::string           error;
+  };
+
+  // shader is null if the pipeline was not built by a reload
+  struct retired_t {
+    gfx::handle_pipeline_t pipeline;
+    gfx::handle_shader_t   shader;
+    uint64_t               frame;
+  };
+
+  void destroy(const retired_t &r);
+  void run();
+
+  core::ref<gfx::context_t> context;
+  core::ref<shader_cache_t> shader_cache;
+  std::filesystem::path     directory;
+
+  std::vector<program_t> programs;
+  std::vector<retired_t> retired;
+  uint64_t               frame = 0;
+
+  // shared with the worker
+  std::mutex                   mutex;
+  std::condition_variable      wake;
+  bool                         stop       = false;
+  uint64_t                     generation = 0;
+  std::vector<shader_define_t> defines;
+  // programs to compile whether or not a file changed
+  std::vector<uint32_t>        queued;
+  std::vector<result_t>        results;
+  std::atomic<bool>            compiling  = false;
+  std::thread                  worker;
+
+  uint32_t reloads = 0;
+};
+
+#endif
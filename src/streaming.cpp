@@ -0,0 +1,647 @@
+#include "streaming.hpp"
+
+#include <volk.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+
+#include "bvh_builder.hpp"
+#include "bvh_cache.hpp"
+#include "frame_resources.hpp"
+#include "horizon/core/logger.hpp"
+#include "job_system.hpp"
+#include "math/triangle.hpp"
+#include "upload_batch.hpp"
+
+namespace {
+
+constexpr uint32_t cluster_file_magic = 0x43525541;  // "AURC"
+
+struct header_t {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t hash;
+  uint32_t cluster_size;
+  uint32_t node_size;
+  uint32_t triangle_size;
+  uint32_t clusters_count;
+  uint64_t nodes_count;
+  uint64_t prim_indices_count;
+};
+
+// every array starts on a 16 byte boundary so the mapping can be used as is
+constexpr uint64_t align_up(uint64_t offset) { return (offset + 15) & ~15ull; }
+
+struct cluster_t {
+  bvh::bvh_t                   bvh;
+  std::vector<triangle_t>      triangles;
+  std::vector<uint32_t>        triangle_vertices;
+  std::vector<model::vertex_t> vertices;
+};
+
+// median cuts of [begin, end) along the longest axis of its centroids, until
+// no range holds more than max_triangles
+std::vector<std::pair<uint32_t, uint32_t>> split_clusters(
+    const std::vector<math::vec3> &centroids, std::vector<uint32_t> &indices,
+    uint32_t max_triangles) {
+  std::vector<std::pair<uint32_t, uint32_t>> ranges;
+  std::vector<std::pair<uint32_t, uint32_t>> stack{
+      {0, static_cast<uint32_t>(indices.size())}};
+  while (!stack.empty()) {
+    auto [begin, end] = stack.back();
+    stack.pop_back();
+    if (end - begin <= max_triangles) {
+      ranges.push_back({begin, end});
+      continue;
+    }
+    math::vec3 min{std::numeric_limits<float>::max()};
+    math::vec3 max{-std::numeric_limits<float>::max()};
+    for (uint32_t i = begin; i < end; i++) {
+      min = math::min(min, centroids[indices[i]]);
+      max = math::max(max, centroids[indices[i]]);
+    }
+    const math::vec3 extent = max - min;
+    const uint32_t   axis   = extent.x > extent.y && extent.x > extent.z ? 0
+                              : extent.y > extent.z                      ? 1
+                                                                         : 2;
+    const uint32_t middle = begin + (end - begin) / 2;
+    std::nth_element(indices.begin() + begin, indices.begin() + middle,
+                     indices.begin() + end, [&](uint32_t a, uint32_t b) {
+                       return centroids[a][axis] < centroids[b][axis];
+                     });
+    stack.push_back({begin, middle});
+    stack.push_back({middle, end});
+  }
+  return ranges;
+}
+
+// same presplit build assets.cpp uses for the flat bvh, prim indices index
+// the cluster's triangles
+bvh::bvh_t build_cluster_bvh(const std::vector<math::triangle_t> &triangles,
+                             const bvh_build_config_t            &config) {
+  bvh::bvh_t bvh;
+  if (config.builder == bvh_builder_t::e_binned_sah_parallel) {
+    auto [aabbs, tri_indices] =
+        presplit_parallel(triangles, config.presplit_factor);
+    bvh = build_bvh_binned_sah_parallel(aabbs);
+    bvh::presplit_remove_indirection(bvh, tri_indices);
+  } else {
+    auto [aabbs, tri_indices] =
+        bvh::presplit(triangles, config.presplit_factor);
+    bvh = bvh::build_bvh_sweep_sah(aabbs);
+    bvh::presplit_remove_indirection(bvh, tri_indices);
+  }
+  bvh::presplit_remove_duplicates(bvh);
+  return bvh;
+}
+
+void barrier(gfx::context_t &context, gfx::handle_commandbuffer_t cbuf,
+             VkPipelineStageFlags src_stage, VkAccessFlags src_access,
+             VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) {
+  VkMemoryBarrier vk_memory_barrier{};
+  vk_memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  vk_memory_barrier.srcAccessMask = src_access;
+  vk_memory_barrier.dstAccessMask = dst_access;
+  vkCmdPipelineBarrier(context.get_commandbuffer(cbuf).vk_commandbuffer,
+                       src_stage, dst_stage, 0, 1, &vk_memory_barrier, 0,
+                       nullptr, 0, nullptr);
+}
+
+}  // namespace
+
+cluster_layout_t cluster_layout(const cluster_info_t &cluster) {
+  cluster_layout_t layout{};
+  layout.nodes        = 0;
+  layout.prim_indices =
+      align_up(layout.nodes + sizeof(bvh::node_t) * cluster.nodes_count);
+  layout.triangles    = align_up(layout.prim_indices +
+                                 sizeof(uint32_t) * cluster.prim_indices_count);
+  layout.triangle_vertices =
+      align_up(layout.triangles + sizeof(triangle_t) * cluster.triangles_count);
+  layout.vertices = align_up(layout.triangle_vertices +
+                             sizeof(uint32_t) * 3 * cluster.triangles_count);
+  layout.size =
+      layout.vertices + sizeof(model::vertex_t) * cluster.vertices_count;
+  return layout;
+}
+
+cluster_file_t::~cluster_file_t() { unmap_file(mapping, mapping_size); }
+
+const uint8_t *cluster_file_t::page(uint32_t cluster) const {
+  return reinterpret_cast<const uint8_t *>(mapping) + clusters[cluster].offset;
+}
+
+uint64_t hash_cluster_inputs(const std::vector<model::raw_mesh_t> &meshes,
+                             const bvh_build_config_t             &config) {
+  uint64_t hash = hash_bvh_inputs(meshes, config);
+  hash = hash_bytes(&cluster_file_version, sizeof(cluster_file_version), hash);
+  return hash_bytes(&config.cluster_triangles,
+                    sizeof(config.cluster_triangles), hash);
+}
+
+std::filesystem::path cluster_file_path(const bvh_build_config_t &config,
+                                        uint64_t                  hash) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.clusters",
+                static_cast<unsigned long long>(hash));
+  return config.cache_directory / name;
+}
+
+core::ref<cluster_file_t> load_cluster_file(const std::filesystem::path &path,
+                                            uint64_t                     hash) {
+  size_t size    = 0;
+  void  *mapping = map_file(path, size);
+  if (!mapping) return nullptr;
+
+  auto file          = core::make_ref<cluster_file_t>();
+  file->mapping      = mapping;
+  file->mapping_size = size;
+  if (size < sizeof(header_t)) return nullptr;
+
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(mapping);
+  header_t       header;
+  std::memcpy(&header, bytes, sizeof(header));
+  if (header.magic != cluster_file_magic ||
+      header.version != cluster_file_version || header.hash != hash ||
+      header.cluster_size != sizeof(cluster_info_t) ||
+      header.node_size != sizeof(bvh::node_t) ||
+      header.triangle_size != sizeof(triangle_t)) {
+    horizon_info("cluster file {} is stale, rebuilding", path.string());
+    return nullptr;
+  }
+
+  uint64_t offset      = align_up(sizeof(header_t));
+  file->clusters = reinterpret_cast<const cluster_info_t *>(bytes + offset);
+  file->clusters_count = header.clusters_count;
+  offset = align_up(offset + header.clusters_count * sizeof(cluster_info_t));
+  file->nodes       = reinterpret_cast<const bvh::node_t *>(bytes + offset);
+  file->nodes_count = header.nodes_count;
+  offset = align_up(offset + header.nodes_count * sizeof(bvh::node_t));
+  file->prim_indices = reinterpret_cast<const uint32_t *>(bytes + offset);
+  file->prim_indices_count = header.prim_indices_count;
+  offset += header.prim_indices_count * sizeof(uint32_t);
+  if (offset > size) {
+    horizon_info("cluster file {} is truncated, rebuilding", path.string());
+    return nullptr;
+  }
+
+  for (uint32_t i = 0; i < file->clusters_count; i++) {
+    const cluster_info_t &cluster = file->clusters[i];
+    const size_t          page    = cluster_layout(cluster).size;
+    if (cluster.offset + page > size) {
+      horizon_info("cluster file {} is truncated, rebuilding", path.string());
+      return nullptr;
+    }
+    file->max_nodes        = std::max(file->max_nodes, cluster.nodes_count);
+    file->max_prim_indices =
+        std::max(file->max_prim_indices, cluster.prim_indices_count);
+    file->max_triangles =
+        std::max(file->max_triangles, cluster.triangles_count);
+    file->max_vertices = std::max(file->max_vertices, cluster.vertices_count);
+    file->pages_size += page;
+  }
+  return file;
+}
+
+void save_cluster_file(const std::filesystem::path          &path,
+                       uint64_t                              hash,
+                       const std::vector<model::raw_mesh_t> &meshes,
+                       const std::vector<triangle_t>        &triangles,
+                       const bvh_build_config_t             &config,
+                       load_progress_t                      &progress) {
+  auto start = std::chrono::steady_clock::now();
+
+  // of every mesh's first triangle in triangles
+  std::vector<uint32_t> first_triangles(meshes.size());
+  uint32_t              triangles_count = 0;
+  for (uint32_t i = 0; i < meshes.size(); i++) {
+    first_triangles[i] = triangles_count;
+    triangles_count += meshes[i].indices.size() / 3;
+  }
+
+  std::vector<math::vec3> centroids(triangles.size());
+  std::vector<uint32_t>   indices(triangles.size());
+  for (uint32_t i = 0; i < triangles.size(); i++) {
+    const math::triangle_t &triangle = triangles[i].triangle;
+    centroids[i] = (triangle.v0 + triangle.v1 + triangle.v2) / 3.f;
+    indices[i]   = i;
+  }
+  const auto ranges =
+      split_clusters(centroids, indices, config.cluster_triangles);
+
+  progress.begin(load_stage_t::e_bvh, ranges.size());
+  std::vector<cluster_t> clusters(ranges.size());
+  job_system_t::global().parallel_for(
+      ranges.size(), 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t c = begin; c < end; c++) {
+          cluster_t &cluster = clusters[c];
+          std::vector<math::triangle_t> cluster_triangles;
+          // mesh and vertex index to the vertex's index in the cluster
+          std::unordered_map<uint64_t, uint32_t> local_vertices;
+          for (uint32_t i = ranges[c].first; i < ranges[c].second; i++) {
+            const triangle_t        &triangle = triangles[indices[i]];
+            const model::raw_mesh_t &mesh     = meshes[triangle.mesh_index];
+            const uint32_t           first =
+                (indices[i] - first_triangles[triangle.mesh_index]) * 3;
+            for (uint32_t k = 0; k < 3; k++) {
+              const uint32_t vertex = mesh.indices[first + k];
+              const auto [it, inserted] = local_vertices.try_emplace(
+                  (uint64_t(triangle.mesh_index) << 32) | vertex,
+                  uint32_t(cluster.vertices.size()));
+              if (inserted) cluster.vertices.push_back(mesh.vertices[vertex]);
+              cluster.triangle_vertices.push_back(it->second);
+            }
+            cluster.triangles.push_back(triangle);
+            cluster_triangles.push_back(triangle.triangle);
+          }
+          cluster.bvh = build_cluster_bvh(cluster_triangles, config);
+          progress.done++;
+        }
+      });
+
+  std::vector<cluster_info_t> infos(clusters.size());
+  std::vector<math::aabb_t>   bounds(clusters.size());
+  for (uint32_t c = 0; c < clusters.size(); c++) {
+    const bvh::bvh_t &bvh   = clusters[c].bvh;
+    cluster_info_t   &info  = infos[c];
+    info.min                = bvh.nodes[0].min;
+    info.max                = bvh.nodes[0].max;
+    info.nodes_count        = bvh.nodes.size();
+    info.prim_indices_count = bvh.prim_indices.size();
+    info.triangles_count    = clusters[c].triangles.size();
+    info.vertices_count     = clusters[c].vertices.size();
+    bounds[c].min           = info.min;
+    bounds[c].max           = info.max;
+  }
+  const bvh::bvh_t cluster_bvh = bvh::build_bvh_sweep_sah(bounds);
+
+  header_t header{};
+  header.magic              = cluster_file_magic;
+  header.version            = cluster_file_version;
+  header.hash               = hash;
+  header.cluster_size       = sizeof(cluster_info_t);
+  header.node_size          = sizeof(bvh::node_t);
+  header.triangle_size      = sizeof(triangle_t);
+  header.clusters_count     = infos.size();
+  header.nodes_count        = cluster_bvh.nodes.size();
+  header.prim_indices_count = cluster_bvh.prim_indices.size();
+
+  // pages follow the cluster table and bvh
+  uint64_t offset = align_up(sizeof(header_t));
+  offset = align_up(offset + infos.size() * sizeof(cluster_info_t));
+  offset = align_up(offset + cluster_bvh.nodes.size() * sizeof(bvh::node_t));
+  offset += cluster_bvh.prim_indices.size() * sizeof(uint32_t);
+  for (cluster_info_t &info : infos) {
+    offset      = align_up(offset);
+    info.offset = offset;
+    offset += cluster_layout(info).size;
+  }
+
+  const bool saved = write_file_atomically(path, [&](std::ofstream &file) {
+    uint64_t written = 0;
+    auto     write   = [&](const void *data, uint64_t size) {
+      const char padding[16] = {};
+      file.write(padding, align_up(written) - written);
+      written = align_up(written);
+      file.write(reinterpret_cast<const char *>(data), size);
+      written += size;
+    };
+    write(&header, sizeof(header));
+    write(infos.data(), infos.size() * sizeof(cluster_info_t));
+    write(cluster_bvh.nodes.data(),
+          cluster_bvh.nodes.size() * sizeof(bvh::node_t));
+    write(cluster_bvh.prim_indices.data(),
+          cluster_bvh.prim_indices.size() * sizeof(uint32_t));
+    for (const cluster_t &cluster : clusters) {
+      write(cluster.bvh.nodes.data(),
+            cluster.bvh.nodes.size() * sizeof(bvh::node_t));
+      write(cluster.bvh.prim_indices.data(),
+            cluster.bvh.prim_indices.size() * sizeof(uint32_t));
+      write(cluster.triangles.data(),
+            cluster.triangles.size() * sizeof(triangle_t));
+      write(cluster.triangle_vertices.data(),
+            cluster.triangle_vertices.size() * sizeof(uint32_t));
+      write(cluster.vertices.data(),
+            cluster.vertices.size() * sizeof(model::vertex_t));
+    }
+  });
+  if (!saved) {
+    horizon_info("failed to write cluster file {}", path.string());
+    return;
+  }
+
+  std::chrono::duration<float, std::milli> took =
+      std::chrono::steady_clock::now() - start;
+  horizon_info("wrote cluster file {}: {} clusters, {} bytes, took {}ms",
+               path.string(), infos.size(), offset, took.count());
+}
+
+// clusters used this recently are never evicted, their feedback may still be
+// in flight
+static constexpr uint64_t keep_frames = frame_ring_size;
+
+geometry_streamer_t::geometry_streamer_t(core::ref<gfx::context_t> context,
+                                         core::ref<gfx::base_t>    base,
+                                         core::ref<cluster_file_t> clusters,
+                                         VkDeviceSize              budget,
+                                         VkDeviceSize upload_budget)
+    : context(context), base(base), clusters(clusters) {
+  const cluster_file_t &file = *clusters;
+
+  {
+    upload_batch_t       batch{context, base};
+    gfx::config_buffer_t cb{};
+    cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    cb.vma_allocation_create_flags =
+        VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+    cb.vk_size    = sizeof(cluster_info_t) * file.clusters_count;
+    cluster_table = batch.create_buffer(cb, file.clusters);
+    cb.vk_size    = sizeof(bvh::node_t) * file.nodes_count;
+    cluster_nodes = batch.create_buffer(cb, file.nodes);
+    cb.vk_size    = sizeof(uint32_t) * file.prim_indices_count;
+    cluster_prim_indices = batch.create_buffer(cb, file.prim_indices);
+    batch.submit();
+  }
+
+  // a page has room for the largest arrays of any cluster
+  const VkDeviceSize page_size =
+      align_up(sizeof(bvh::node_t) * file.max_nodes) +
+      align_up(sizeof(uint32_t) * file.max_prim_indices) +
+      align_up(sizeof(triangle_t) * file.max_triangles) +
+      align_up(sizeof(uint32_t) * 3 * file.max_triangles) +
+      align_up(sizeof(model::vertex_t) * file.max_vertices);
+  pages_count = std::clamp<VkDeviceSize>(budget / page_size, 1,
+                                         file.clusters_count);
+
+  nodes_region        = 0;
+  prim_indices_region = align_up(
+      nodes_region + sizeof(bvh::node_t) * file.max_nodes * pages_count);
+  triangles_region = align_up(prim_indices_region + sizeof(uint32_t) *
+                                                        file.max_prim_indices *
+                                                        pages_count);
+  triangle_vertices_region = align_up(
+      triangles_region + sizeof(triangle_t) * file.max_triangles * pages_count);
+  vertices_region = align_up(triangle_vertices_region +
+                             sizeof(uint32_t) * 3 * file.max_triangles *
+                                 pages_count);
+  pool_size = vertices_region +
+              sizeof(model::vertex_t) * file.max_vertices * pages_count;
+
+  gfx::config_buffer_t cb{};
+  cb.vk_size               = pool_size;
+  cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                             VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  cb.vma_allocation_create_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+  pool                           = context->create_buffer(cb);
+
+  cb = {};
+  cb.vk_size =
+      sizeof(streamed_scene_t) + sizeof(uint32_t) * file.clusters_count;
+  cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  cb.vma_allocation_create_flags =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+  buffer =
+      base->create_buffer(gfx::resource_update_policy_t::e_every_frame, cb);
+
+  cb.vk_size = sizeof(uint32_t) * file.clusters_count;
+  cb.vma_allocation_create_flags =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+  feedback =
+      base->create_buffer(gfx::resource_update_policy_t::e_every_frame, cb);
+
+  // a frame can always page in at least one cluster
+  staging_size             = std::max(upload_budget, page_size);
+  cb.vk_size               = staging_size;
+  cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  cb.vma_allocation_create_flags =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+  staging =
+      base->create_buffer(gfx::resource_update_policy_t::e_every_frame, cb);
+
+  residency.assign(file.clusters_count, null_page);
+  last_used.assign(file.clusters_count, 0);
+  page_clusters.assign(pages_count, null_page);
+  for (uint32_t page = pages_count; page-- > 0;) free_pages.push_back(page);
+
+  horizon_info(
+      "streaming: {} clusters, {} pages of {} bytes in a {} byte pool, every "
+      "cluster resident would take {} bytes",
+      file.clusters_count, pages_count, page_size, pool_size,
+      file.pages_size);
+  const VkDeviceSize resident_bytes =
+      sizeof(cluster_info_t) * file.clusters_count +
+      sizeof(bvh::node_t) * file.nodes_count +
+      sizeof(uint32_t) * file.prim_indices_count;
+  scene_to_vram = float(resident_bytes + file.pages_size) /
+                  float(resident_bytes + pool_size);
+  horizon_info(
+      "streaming: {} bytes of cluster table and bvh stay resident, the scene "
+      "takes {}x the vram it is given",
+      resident_bytes, scene_to_vram);
+}
+
+geometry_streamer_t::~geometry_streamer_t() {
+  for (auto handle : {cluster_table, cluster_nodes, cluster_prim_indices, pool})
+    context->destroy_buffer(handle);
+}
+
+bool geometry_streamer_t::update(const core::camera_t &camera) {
+  auto start = std::chrono::steady_clock::now();
+  frame++;
+
+  const cluster_file_t &file = *clusters;
+
+  // this frame in flight's buffers were last used frames ago and are done,
+  // the header still holds the stamp that frame wrote into the feedback
+  const gfx::handle_buffer_t frame_buffer = base->buffer(buffer);
+  uint8_t *data =
+      reinterpret_cast<uint8_t *>(context->map_buffer(frame_buffer));
+  uint32_t previous_frame;
+  std::memcpy(&previous_frame, data + offsetof(streamed_scene_t, frame),
+              sizeof(uint32_t));
+  const uint32_t *entered = reinterpret_cast<const uint32_t *>(
+      context->map_buffer(base->buffer(feedback)));
+
+  const math::vec3 eye = math::vec3{camera.inv_view[3]};
+  auto distance = [&](uint32_t cluster) {
+    const cluster_info_t &info = file.clusters[cluster];
+    const math::vec3      d =
+        math::max(math::max(info.min - eye, eye - info.max), math::vec3{0});
+    return math::dot(d, d);
+  };
+
+  // buffers this frame in flight never used hold garbage, not a stamp
+  const bool has_feedback = previous_frame != 0 && previous_frame < frame;
+  std::vector<uint32_t> requests;
+  for (uint32_t cluster = 0; has_feedback && cluster < file.clusters_count;
+       cluster++) {
+    if (entered[cluster] != previous_frame) continue;
+    if (residency[cluster] != null_page)
+      last_used[cluster] =
+          std::max<uint64_t>(last_used[cluster], previous_frame);
+    else
+      requests.push_back(cluster);
+  }
+  misses = requests.size();
+  std::sort(requests.begin(), requests.end(), [&](uint32_t a, uint32_t b) {
+    return distance(a) < distance(b);
+  });
+
+  // the page whose cluster went unused the longest, the farther the better
+  // on ties, null_page if every page was used too recently
+  auto find_victim = [&]() {
+    uint32_t victim = null_page;
+    for (uint32_t page = 0; page < pages_count; page++) {
+      const uint32_t cluster = page_clusters[page];
+      if (last_used[cluster] + keep_frames >= frame) continue;
+      if (victim == null_page) {
+        victim = page;
+        continue;
+      }
+      const uint32_t other = page_clusters[victim];
+      if (last_used[cluster] < last_used[other] ||
+          (last_used[cluster] == last_used[other] &&
+           distance(cluster) > distance(other)))
+        victim = page;
+    }
+    return victim;
+  };
+
+  uint8_t *staging_data = reinterpret_cast<uint8_t *>(
+      context->map_buffer(base->buffer(staging)));
+  copies.clear();
+  page_ins       = 0;
+  evictions      = 0;
+  uploaded_bytes = 0;
+
+  // false once the frame's upload budget or the pool is exhausted
+  auto page_in = [&](uint32_t cluster, bool evict) {
+    const cluster_info_t  &info   = file.clusters[cluster];
+    const cluster_layout_t layout = cluster_layout(info);
+    if (uploaded_bytes + layout.size > staging_size) return false;
+    uint32_t page = null_page;
+    if (!free_pages.empty()) {
+      page = free_pages.back();
+      free_pages.pop_back();
+    } else if (evict) {
+      page = find_victim();
+      if (page == null_page) return false;
+      residency[page_clusters[page]] = null_page;
+      evictions++;
+    } else {
+      return false;
+    }
+
+    // reading the page is what faults it in from disk
+    std::memcpy(staging_data + uploaded_bytes, file.page(cluster), layout.size);
+    auto copy = [&](size_t src, VkDeviceSize dst, VkDeviceSize size) {
+      if (size == 0) return;
+      copies.push_back({uploaded_bytes + src, dst, size});
+    };
+    copy(layout.nodes,
+         nodes_region + sizeof(bvh::node_t) * file.max_nodes * page,
+         sizeof(bvh::node_t) * info.nodes_count);
+    copy(layout.prim_indices,
+         prim_indices_region + sizeof(uint32_t) * file.max_prim_indices * page,
+         sizeof(uint32_t) * info.prim_indices_count);
+    copy(layout.triangles,
+         triangles_region + sizeof(triangle_t) * file.max_triangles * page,
+         sizeof(triangle_t) * info.triangles_count);
+    copy(layout.triangle_vertices,
+         triangle_vertices_region +
+             sizeof(uint32_t) * 3 * file.max_triangles * page,
+         sizeof(uint32_t) * 3 * info.triangles_count);
+    copy(layout.vertices,
+         vertices_region + sizeof(model::vertex_t) * file.max_vertices * page,
+         sizeof(model::vertex_t) * info.vertices_count);
+    uploaded_bytes = align_up(uploaded_bytes + layout.size);
+
+    residency[cluster]  = page;
+    page_clusters[page] = cluster;
+    last_used[cluster]  = frame;
+    page_ins++;
+    return true;
+  };
+
+  for (uint32_t cluster : requests)
+    if (!page_in(cluster, true)) break;
+
+  // prefetching only fills free pages, it never evicts
+  if (!free_pages.empty()) {
+    std::vector<uint32_t> candidates;
+    for (uint32_t cluster = 0; cluster < file.clusters_count; cluster++)
+      if (residency[cluster] == null_page) candidates.push_back(cluster);
+    const size_t count = std::min(candidates.size(), free_pages.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + count,
+                      candidates.end(), [&](uint32_t a, uint32_t b) {
+                        return distance(a) < distance(b);
+                      });
+    for (size_t i = 0; i < count; i++)
+      if (!page_in(candidates[i], false)) break;
+  }
+  resident = pages_count - free_pages.size();
+
+  const VkDeviceAddress address =
+      context->get_buffer_device_address(frame_buffer);
+  const VkDeviceAddress pool_address =
+      context->get_buffer_device_address(pool);
+  streamed_scene_t header{};
+  header.cluster_nodes = gfx::to<bvh::node_t *>(
+      context->get_buffer_device_address(cluster_nodes));
+  header.cluster_prim_indices = gfx::to<uint32_t *>(
+      context->get_buffer_device_address(cluster_prim_indices));
+  header.clusters = gfx::to<cluster_info_t *>(
+      context->get_buffer_device_address(cluster_table));
+  header.residency = gfx::to<uint32_t *>(address + sizeof(streamed_scene_t));
+  header.page_nodes = gfx::to<bvh::node_t *>(pool_address + nodes_region);
+  header.page_prim_indices =
+      gfx::to<uint32_t *>(pool_address + prim_indices_region);
+  header.page_triangles =
+      gfx::to<triangle_t *>(pool_address + triangles_region);
+  header.page_triangle_vertices =
+      gfx::to<uint32_t *>(pool_address + triangle_vertices_region);
+  header.page_vertices =
+      gfx::to<model::vertex_t *>(pool_address + vertices_region);
+  header.feedback = gfx::to<uint32_t *>(
+      context->get_buffer_device_address(base->buffer(feedback)));
+  header.max_nodes        = file.max_nodes;
+  header.max_prim_indices = file.max_prim_indices;
+  header.max_triangles    = file.max_triangles;
+  header.max_vertices     = file.max_vertices;
+  header.clusters_count   = file.clusters_count;
+  // 0 is never written, so a fresh feedback buffer reads as untouched
+  header.frame            = uint32_t(frame);
+  std::memcpy(data, &header, sizeof(header));
+  std::memcpy(data + sizeof(streamed_scene_t), residency.data(),
+              sizeof(uint32_t) * residency.size());
+
+  std::chrono::duration<float, std::milli> took =
+      std::chrono::steady_clock::now() - start;
+  last_update_ms = took.count();
+  return page_ins > 0;
+}
+
+void geometry_streamer_t::render(gfx::handle_commandbuffer_t cbuf) {
+  if (copies.empty()) return;
+  // earlier frames may still trace the pages being replaced
+  barrier(*context, cbuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+          VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+          VK_ACCESS_TRANSFER_WRITE_BIT);
+  vkCmdCopyBuffer(context->get_commandbuffer(cbuf).vk_commandbuffer,
+                  context->get_buffer(base->buffer(staging)).vk_buffer,
+                  context->get_buffer(pool).vk_buffer, copies.size(),
+                  copies.data());
+  barrier(*context, cbuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+          VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+          VK_ACCESS_SHADER_READ_BIT);
+}
+
+gfx::handle_buffer_t geometry_streamer_t::frame_buffer() const {
+  return base->buffer(buffer);
+}
@@ -0,0 +1,199 @@
+#ifndef STREAMING_HPP
+#define STREAMING_HPP
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan_core.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "assets.hpp"
+#include "bvh/bvh.hpp"
+#include "horizon/core/components.hpp"
+#include "horizon/core/core.hpp"
+#include "horizon/gfx/base.hpp"
+#include "horizon/gfx/context.hpp"
+#include "horizon/gfx/types.hpp"
+#include "math/math.hpp"
+#include "model/model.hpp"
+
+// bump whenever the file layout or the cluster build changes meaning
+static constexpr uint32_t cluster_file_version = 2;
+
+// a spatial cluster of the scene's triangles with a binary bvh of its own,
+// bounds are world space, offset is where the cluster's page starts in the
+// file, see cluster_layout_t for what a page holds
+struct cluster_info_t {
+  math::vec3 min;
+  uint32_t   nodes_count;
+  math::vec3 max;
+  uint32_t   prim_indices_count;
+  uint32_t   triangles_count;
+  uint32_t   vertices_count;
+  uint64_t   offset;
+};
+static_assert(sizeof(cluster_info_t) == 48,
+              "sizeof(cluster_info_t) should be 48");
+
+// byte offsets of a page's arrays relative to its start, nodes index each
+// other and prim indices index triangles within the page, triangle_vertices
+// are three indices per triangle into vertices, the cluster's own copy of
+// every vertex its triangles use, so hits are shaded from the page alone
+struct cluster_layout_t {
+  size_t nodes, prim_indices, triangles, triangle_vertices, vertices, size;
+};
+
+cluster_layout_t cluster_layout(const cluster_info_t &cluster);
+
+// read only, memory mapped view of a cluster file, pages are only touched
+// when they are copied into vram, so the os pages them in from disk on demand
+struct cluster_file_t {
+  ~cluster_file_t();
+
+  const uint8_t *page(uint32_t cluster) const;
+
+  const cluster_info_t *clusters;
+  uint32_t              clusters_count;
+  // bvh over the cluster bounds, prims are clusters
+  const bvh::node_t    *nodes;
+  uint64_t              nodes_count;
+  const uint32_t       *prim_indices;
+  uint64_t              prim_indices_count;
+
+  // the largest arrays of any cluster, every page of the pool fits them
+  uint32_t max_nodes        = 0;
+  uint32_t max_prim_indices = 0;
+  uint32_t max_triangles    = 0;
+  uint32_t max_vertices     = 0;
+  // every page together, what keeping the whole scene resident would take
+  uint64_t pages_size       = 0;
+
+  void  *mapping      = nullptr;
+  size_t mapping_size = 0;
+};
+
+// hash_bvh_inputs together with the cluster size
+uint64_t hash_cluster_inputs(const std::vector<model::raw_mesh_t> &meshes,
+                             const bvh_build_config_t             &config);
+
+std::filesystem::path cluster_file_path(const bvh_build_config_t &config,
+                                        uint64_t                  hash);
+
+// returns nullptr if the file is missing, stale or from another version
+core::ref<cluster_file_t> load_cluster_file(const std::filesystem::path &path,
+                                            uint64_t                     hash);
+// splits triangles into clusters of at most config.cluster_triangles by
+// median cuts along the longest axis, builds their bvhs on the job system and
+// writes them to path, triangles are the flattened meshes, the vertices of a
+// cluster are copied out of the meshes its triangles come from
+void save_cluster_file(const std::filesystem::path          &path,
+                       uint64_t                              hash,
+                       const std::vector<model::raw_mesh_t> &meshes,
+                       const std::vector<triangle_t>        &triangles,
+                       const bvh_build_config_t             &config,
+                       load_progress_t                      &progress);
+
+// everything the streamed traversal reads, see assets/shaders/types.slang,
+// the header and the residency live in a per frame buffer, the cluster
+// table and bvh are static and the page arrays are regions of the pool,
+// page p's arrays start at p times the max count of their kind, triangle
+// vertices count three per triangle
+struct streamed_scene_t {
+  bvh::node_t     *cluster_nodes;
+  uint32_t        *cluster_prim_indices;
+  cluster_info_t  *clusters;
+  // page per cluster, null_page if the cluster is not resident
+  uint32_t        *residency;
+  bvh::node_t     *page_nodes;
+  uint32_t        *page_prim_indices;
+  triangle_t      *page_triangles;
+  uint32_t        *page_triangle_vertices;
+  model::vertex_t *page_vertices;
+  // the traversal writes frame for every cluster a ray entered
+  uint32_t        *feedback;
+  uint32_t         max_nodes;
+  uint32_t         max_prim_indices;
+  uint32_t         max_triangles;
+  uint32_t         max_vertices;
+  uint32_t         clusters_count;
+  // written into feedback, tells this frame's entries from older ones
+  uint32_t         frame;
+};
+static_assert(sizeof(streamed_scene_t) == 104,
+              "sizeof(streamed_scene_t) should be 104");
+
+// keeps the clusters rays need in a fixed budget of vram
+// every frame the feedback of the frame that last used this frame in
+// flight's buffers is read back, clusters rays entered but found missing
+// are paged in nearest to the camera first, evicting the pages that have
+// gone unused the longest, free pages are filled with the clusters nearest
+// to the camera, copies come straight from the mapped file and at most
+// upload_budget bytes are copied per frame, a page holds the cluster's
+// vertices too, so only the cluster table and bvh are resident whatever the
+// size of the scene, see scene_to_vram
+struct geometry_streamer_t {
+  static constexpr uint32_t null_page = uint32_t(-1);
+
+  geometry_streamer_t(core::ref<gfx::context_t>  context,   //
+                      core::ref<gfx::base_t>     base,      //
+                      core::ref<cluster_file_t>  clusters,  //
+                      VkDeviceSize               budget,    //
+                      VkDeviceSize               upload_budget);
+  ~geometry_streamer_t();
+
+  // picks this frame's page ins and outs and writes this frame in flight's
+  // buffer, returns true if the resident set changed
+  bool update(const core::camera_t &camera);
+  // copies the pages update picked into the pool, has to be recorded before
+  // anything traverses the frame's buffer
+  void render(gfx::handle_commandbuffer_t cbuf);
+
+  // this frame in flight's streamed_scene_t, valid after update
+  gfx::handle_buffer_t frame_buffer() const;
+
+  core::ref<gfx::context_t> context;
+  core::ref<gfx::base_t>    base;
+  core::ref<cluster_file_t> clusters;
+
+  gfx::handle_buffer_t cluster_table;
+  gfx::handle_buffer_t cluster_nodes;
+  gfx::handle_buffer_t cluster_prim_indices;
+  // device local page pool, one region per array kind, offsets in bytes
+  gfx::handle_buffer_t pool;
+  VkDeviceSize         nodes_region        = 0;
+  VkDeviceSize         prim_indices_region = 0;
+  VkDeviceSize         triangles_region         = 0;
+  VkDeviceSize         triangle_vertices_region = 0;
+  VkDeviceSize         vertices_region          = 0;
+  VkDeviceSize         pool_size                = 0;
+  uint32_t             pages_count              = 0;
+  // the scene's geometry over the vram it takes, the resident cluster table
+  // and bvh count on both sides
+  float                scene_to_vram            = 1.f;
+
+  // host visible, header followed by the residency
+  gfx::handle_managed_buffer_t buffer;
+  // host visible, a uint32_t per cluster, read back frames in flight later
+  gfx::handle_managed_buffer_t feedback;
+  gfx::handle_managed_buffer_t staging;
+  VkDeviceSize                 staging_size;
+
+  std::vector<uint32_t>     residency;
+  std::vector<uint32_t>     page_clusters;
+  std::vector<uint32_t>     free_pages;
+  std::vector<uint64_t>     last_used;
+  std::vector<VkBufferCopy> copies;
+  uint64_t                  frame = 0;
+
+  // the last update
+  uint32_t     resident       = 0;
+  uint32_t     misses         = 0;
+  uint32_t     page_ins       = 0;
+  uint32_t     evictions      = 0;
+  VkDeviceSize uploaded_bytes = 0;
+  float        last_update_ms = 0.f;
+};
+
+#endif
@@ -0,0 +1,485 @@
+#include "texture_compression.hpp"
+
+#include <volk.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "bvh_cache.hpp"
+#include "horizon/core/logger.hpp"
+#include "vulkan_handles.hpp"
+
+namespace {
+
+constexpr uint32_t dds_magic = 0x20534444;  // "DDS "
+// written into the reserved words of the header so stale files are caught
+constexpr uint32_t dds_tag   = 0x54525541;  // "AURT"
+
+struct dds_pixel_format_t {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t four_cc;
+  uint32_t rgb_bit_count;
+  uint32_t r_mask, g_mask, b_mask, a_mask;
+};
+
+struct dds_header_t {
+  uint32_t           magic;
+  uint32_t           size;
+  uint32_t           flags;
+  uint32_t           height;
+  uint32_t           width;
+  uint32_t           pitch_or_linear_size;
+  uint32_t           depth;
+  uint32_t           mip_map_count;
+  // tag, version, hash
+  uint32_t           reserved1[11];
+  dds_pixel_format_t pixel_format;
+  uint32_t           caps, caps2, caps3, caps4;
+  uint32_t           reserved2;
+  // DDS_HEADER_DXT10
+  uint32_t           dxgi_format;
+  uint32_t           resource_dimension;
+  uint32_t           misc_flag;
+  uint32_t           array_size;
+  uint32_t           misc_flags2;
+};
+static_assert(sizeof(dds_header_t) == 148,
+              "sizeof(dds_header_t) should be 148");
+
+constexpr uint32_t dds_flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+constexpr uint32_t dds_caps  = 0x8 | 0x1000 | 0x400000;
+constexpr uint32_t dds_fourcc_flag  = 0x4;
+constexpr uint32_t dds_fourcc_dx10  = 0x30315844;  // "DX10"
+constexpr uint32_t dxgi_bc1_srgb    = 72;
+constexpr uint32_t dxgi_bc7_srgb    = 99;
+constexpr uint32_t dds_texture_2d   = 3;
+
+// pixels of a 4x4 block, rgba as floats for the endpoint search
+using block_t = float[16][4];
+
+void load_block(const uint8_t *texels, uint32_t width, uint32_t height,
+                uint32_t block_x, uint32_t block_y, block_t &block) {
+  for (uint32_t i = 0; i < 16; i++) {
+    const uint32_t x = std::min(block_x * 4 + i % 4, width - 1);
+    const uint32_t y = std::min(block_y * 4 + i / 4, height - 1);
+    for (uint32_t c = 0; c < 4; c++)
+      block[i][c] = texels[(size_t(y) * width + x) * 4 + c];
+  }
+}
+
+// the line through the block's colors that endpoints are picked on, the
+// principal axis of the first channels channels by power iteration
+void fit_line(const block_t &block, uint32_t channels, float mean[4],
+              float low[4], float high[4]) {
+  float min[4], max[4];
+  for (uint32_t c = 0; c < 4; c++) {
+    mean[c] = 0;
+    min[c]  = 255;
+    max[c]  = 0;
+  }
+  for (uint32_t i = 0; i < 16; i++)
+    for (uint32_t c = 0; c < channels; c++) {
+      mean[c] += block[i][c] / 16.f;
+      min[c] = std::min(min[c], block[i][c]);
+      max[c] = std::max(max[c], block[i][c]);
+    }
+
+  float covariance[4][4] = {};
+  for (uint32_t i = 0; i < 16; i++)
+    for (uint32_t a = 0; a < channels; a++)
+      for (uint32_t b = 0; b < channels; b++)
+        covariance[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+
+  float axis[4] = {};
+  for (uint32_t c = 0; c < channels; c++) axis[c] = max[c] - min[c];
+  for (uint32_t iteration = 0; iteration < 8; iteration++) {
+    float next[4] = {};
+    float length  = 0;
+    for (uint32_t a = 0; a < channels; a++) {
+      for (uint32_t b = 0; b < channels; b++)
+        next[a] += covariance[a][b] * axis[b];
+      length += next[a] * next[a];
+    }
+    if (length < 1e-12f) break;
+    length = std::sqrt(length);
+    for (uint32_t c = 0; c < channels; c++) axis[c] = next[c] / length;
+  }
+  float length = 0;
+  for (uint32_t c = 0; c < channels; c++) length += axis[c] * axis[c];
+  if (length < 1e-12f) {
+    // a flat block, both endpoints on the mean
+    for (uint32_t c = 0; c < 4; c++) low[c] = high[c] = mean[c];
+    return;
+  }
+  length = std::sqrt(length);
+  for (uint32_t c = 0; c < channels; c++) axis[c] /= length;
+
+  float t_min = 1e30f, t_max = -1e30f;
+  for (uint32_t i = 0; i < 16; i++) {
+    float t = 0;
+    for (uint32_t c = 0; c < channels; c++)
+      t += (block[i][c] - mean[c]) * axis[c];
+    t_min = std::min(t_min, t);
+    t_max = std::max(t_max, t);
+  }
+  for (uint32_t c = 0; c < 4; c++) {
+    low[c]  = std::clamp(mean[c] + axis[c] * t_min, 0.f, 255.f);
+    high[c] = std::clamp(mean[c] + axis[c] * t_max, 0.f, 255.f);
+  }
+}
+
+uint16_t to_565(const float color[4]) {
+  const uint32_t r = uint32_t(color[0] * 31.f / 255.f + 0.5f);
+  const uint32_t g = uint32_t(color[1] * 63.f / 255.f + 0.5f);
+  const uint32_t b = uint32_t(color[2] * 31.f / 255.f + 0.5f);
+  return uint16_t(r << 11 | g << 5 | b);
+}
+
+void from_565(uint16_t packed, float color[4]) {
+  const uint32_t r = packed >> 11 & 31, g = packed >> 5 & 63, b = packed & 31;
+  color[0] = float(r << 3 | r >> 2);
+  color[1] = float(g << 2 | g >> 4);
+  color[2] = float(b << 3 | b >> 2);
+  color[3] = 255;
+}
+
+// four color mode only, alpha is dropped
+void encode_bc1(const block_t &block, uint8_t *out) {
+  float mean[4], low[4], high[4];
+  fit_line(block, 3, mean, low, high);
+  uint16_t c0 = to_565(high), c1 = to_565(low);
+  if (c0 < c1) std::swap(c0, c1);
+
+  float palette[4][4];
+  from_565(c0, palette[0]);
+  from_565(c1, palette[1]);
+  for (uint32_t c = 0; c < 3; c++) {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+
+  uint32_t indices = 0;
+  // equal endpoints would select the three color mode, index 0 is exact
+  if (c0 != c1) {
+    for (uint32_t i = 0; i < 16; i++) {
+      uint32_t best = 0;
+      float    best_error = 1e30f;
+      for (uint32_t p = 0; p < 4; p++) {
+        float error = 0;
+        for (uint32_t c = 0; c < 3; c++) {
+          const float d = block[i][c] - palette[p][c];
+          error += d * d;
+        }
+        if (error < best_error) {
+          best_error = error;
+          best       = p;
+        }
+      }
+      indices |= best << (2 * i);
+    }
+  }
+  std::memcpy(out + 0, &c0, 2);
+  std::memcpy(out + 2, &c1, 2);
+  std::memcpy(out + 4, &indices, 4);
+}
+
+// 7 bit rgba endpoints with a shared low bit each, picked per endpoint
+void quantize_bc7_endpoint(const float color[4], uint32_t quantized[4],
+                           uint32_t &p_bit) {
+  float best_error = 1e30f;
+  for (uint32_t p = 0; p < 2; p++) {
+    uint32_t q[4];
+    float    error = 0;
+    for (uint32_t c = 0; c < 4; c++) {
+      q[c] = uint32_t(
+          std::clamp(std::round((color[c] - float(p)) / 2.f), 0.f, 127.f));
+      const float d = color[c] - float(q[c] * 2 + p);
+      error += d * d;
+    }
+    if (error < best_error) {
+      best_error = error;
+      p_bit      = p;
+      std::memcpy(quantized, q, sizeof(q));
+    }
+  }
+}
+
+struct bit_writer_t {
+  void write(uint32_t value, uint32_t bits) {
+    for (uint32_t i = 0; i < bits; i++, position++)
+      if (value >> i & 1) out[position / 8] |= uint8_t(1 << position % 8);
+  }
+  uint8_t *out;
+  uint32_t position = 0;
+};
+
+// mode 6, a single rgba subset with 4 bit indices
+void encode_bc7(const block_t &block, uint8_t *out) {
+  float mean[4], low[4], high[4];
+  fit_line(block, 4, mean, low, high);
+  uint32_t endpoints[2][4], p_bits[2];
+  quantize_bc7_endpoint(low, endpoints[0], p_bits[0]);
+  quantize_bc7_endpoint(high, endpoints[1], p_bits[1]);
+
+  static constexpr uint32_t weights[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                           34, 38, 43, 47, 51, 55, 60, 64};
+  float palette[16][4];
+  for (uint32_t p = 0; p < 16; p++)
+    for (uint32_t c = 0; c < 4; c++) {
+      const uint32_t a = endpoints[0][c] << 1 | p_bits[0];
+      const uint32_t b = endpoints[1][c] << 1 | p_bits[1];
+      palette[p][c] =
+          float(((64 - weights[p]) * a + weights[p] * b + 32) >> 6);
+    }
+
+  uint32_t indices[16];
+  for (uint32_t i = 0; i < 16; i++) {
+    float best_error = 1e30f;
+    for (uint32_t p = 0; p < 16; p++) {
+      float error = 0;
+      for (uint32_t c = 0; c < 4; c++) {
+        const float d = block[i][c] - palette[p][c];
+        error += d * d;
+      }
+      if (error < best_error) {
+        best_error = error;
+        indices[i] = p;
+      }
+    }
+  }
+  // the first index is stored without its top bit, which has to be 0
+  if (indices[0] & 8) {
+    std::swap(endpoints[0], endpoints[1]);
+    std::swap(p_bits[0], p_bits[1]);
+    for (uint32_t &index : indices) index = 15 - index;
+  }
+
+  std::memset(out, 0, 16);
+  bit_writer_t writer{out};
+  writer.write(1 << 6, 7);
+  for (uint32_t c = 0; c < 4; c++) {
+    writer.write(endpoints[0][c], 7);
+    writer.write(endpoints[1][c], 7);
+  }
+  writer.write(p_bits[0], 1);
+  writer.write(p_bits[1], 1);
+  writer.write(indices[0], 3);
+  for (uint32_t i = 1; i < 16; i++) writer.write(indices[i], 4);
+}
+
+VkFormat to_format(texture_compression_t compression) {
+  return compression == texture_compression_t::e_bc1
+             ? VK_FORMAT_BC1_RGB_SRGB_BLOCK
+             : VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+}  // namespace
+
+std::vector<uint8_t> downsample_rgba8(const uint8_t *texels, uint32_t &width,
+                                      uint32_t &height) {
+  const uint32_t       src_width = width, src_height = height;
+  width  = std::max(src_width / 2, 1u);
+  height = std::max(src_height / 2, 1u);
+  std::vector<uint8_t> dst(size_t(width) * height * 4);
+  for (uint32_t y = 0; y < height; y++) {
+    const uint32_t y0 = std::min(y * 2, src_height - 1);
+    const uint32_t y1 = std::min(y * 2 + 1, src_height - 1);
+    for (uint32_t x = 0; x < width; x++) {
+      const uint32_t x0 = std::min(x * 2, src_width - 1);
+      const uint32_t x1 = std::min(x * 2 + 1, src_width - 1);
+      for (uint32_t c = 0; c < 4; c++) {
+        const uint32_t sum = texels[(size_t(y0) * src_width + x0) * 4 + c] +
+                             texels[(size_t(y0) * src_width + x1) * 4 + c] +
+                             texels[(size_t(y1) * src_width + x0) * 4 + c] +
+                             texels[(size_t(y1) * src_width + x1) * 4 + c];
+        dst[(size_t(y) * width + x) * 4 + c] = (sum + 2) / 4;
+      }
+    }
+  }
+  return dst;
+}
+
+size_t mip_size(VkFormat format, uint32_t width, uint32_t height) {
+  const size_t blocks = size_t((width + 3) / 4) * ((height + 3) / 4);
+  switch (format) {
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+      return blocks * 8;
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+      return blocks * 16;
+    default:
+      return size_t(width) * height * 4;
+  }
+}
+
+compressed_texture_t::~compressed_texture_t() {
+  unmap_file(mapping, mapping_size);
+}
+
+bool texture_compression_supported(gfx::context_t       &context,
+                                   texture_compression_t compression) {
+  auto sampled = [&](texture_compression_t resolved) {
+    VkFormatProperties vk_format_properties;
+    vkGetPhysicalDeviceFormatProperties(vk_physical_device(context),
+                                        to_format(resolved),
+                                        &vk_format_properties);
+    return (vk_format_properties.optimalTilingFeatures &
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+  };
+  switch (compression) {
+    case texture_compression_t::e_none:
+      return true;
+    case texture_compression_t::e_auto:
+      return sampled(texture_compression_t::e_bc1) &&
+             sampled(texture_compression_t::e_bc7);
+    default:
+      return sampled(compression);
+  }
+}
+
+texture_compression_t choose_compression(texture_compression_t compression,
+                                         const uint8_t        *texels,
+                                         uint32_t width, uint32_t height) {
+  if (compression != texture_compression_t::e_auto) return compression;
+  for (size_t i = 0; i < size_t(width) * height; i++)
+    if (texels[i * 4 + 3] != 255) return texture_compression_t::e_bc7;
+  return texture_compression_t::e_bc1;
+}
+
+uint64_t hash_compressed_texture_inputs(const std::filesystem::path &path,
+                                        texture_compression_t compression) {
+  uint64_t hash = hash_bytes(&compressed_texture_version,
+                             sizeof(compressed_texture_version), 0);
+  hash          = hash_bytes(&compression, sizeof(compression), hash);
+  const std::string name = path.string();
+  hash = hash_bytes(name.data(), name.size(), hash);
+  std::error_code error;
+  const uint64_t  size = std::filesystem::file_size(path, error);
+  hash = hash_bytes(&size, sizeof(size), hash);
+  const int64_t time = std::filesystem::last_write_time(path, error)
+                           .time_since_epoch()
+                           .count();
+  return hash_bytes(&time, sizeof(time), hash);
+}
+
+std::filesystem::path compressed_texture_path(const texture_config_t &config,
+                                              uint64_t                hash) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.dds",
+                static_cast<unsigned long long>(hash));
+  return config.cache_directory / name;
+}
+
+core::ref<compressed_texture_t> load_compressed_texture(
+    const std::filesystem::path &path, uint64_t hash) {
+  size_t size    = 0;
+  void  *mapping = map_file(path, size);
+  if (!mapping) return nullptr;
+
+  auto texture          = core::make_ref<compressed_texture_t>();
+  texture->mapping      = mapping;
+  texture->mapping_size = size;
+  if (size < sizeof(dds_header_t)) return nullptr;
+
+  dds_header_t header;
+  std::memcpy(&header, mapping, sizeof(header));
+  uint64_t stored_hash;
+  std::memcpy(&stored_hash, &header.reserved1[2], sizeof(stored_hash));
+  if (header.magic != dds_magic || header.reserved1[0] != dds_tag ||
+      header.reserved1[1] != compressed_texture_version ||
+      stored_hash != hash ||
+      header.pixel_format.four_cc != dds_fourcc_dx10 ||
+      (header.dxgi_format != dxgi_bc1_srgb &&
+       header.dxgi_format != dxgi_bc7_srgb)) {
+    horizon_info("compressed texture {} is stale, rebuilding", path.string());
+    return nullptr;
+  }
+
+  texture->format     = header.dxgi_format == dxgi_bc1_srgb
+                            ? VK_FORMAT_BC1_RGB_SRGB_BLOCK
+                            : VK_FORMAT_BC7_SRGB_BLOCK;
+  texture->width      = header.width;
+  texture->height     = header.height;
+  texture->mips_count = header.mip_map_count;
+  texture->data =
+      reinterpret_cast<const uint8_t *>(mapping) + sizeof(dds_header_t);
+  texture->size = 0;
+  uint32_t width = header.width, height = header.height;
+  for (uint32_t mip = 0; mip < header.mip_map_count; mip++) {
+    texture->size += mip_size(texture->format, width, height);
+    width  = std::max(width / 2, 1u);
+    height = std::max(height / 2, 1u);
+  }
+  if (sizeof(dds_header_t) + texture->size > size) {
+    horizon_info("compressed texture {} is truncated, rebuilding",
+                 path.string());
+    return nullptr;
+  }
+  return texture;
+}
+
+void save_compressed_texture(const std::filesystem::path &path, uint64_t hash,
+                             const uint8_t *texels, uint32_t width,
+                             uint32_t height,
+                             texture_compression_t compression) {
+  const VkFormat format = to_format(compression);
+  void (*encode)(const block_t &, uint8_t *) =
+      compression == texture_compression_t::e_bc1 ? encode_bc1 : encode_bc7;
+  const size_t block_bytes = compression == texture_compression_t::e_bc1 ? 8
+                                                                         : 16;
+
+  dds_header_t header{};
+  header.magic                = dds_magic;
+  header.size                 = 124;
+  header.flags                = dds_flags;
+  header.height               = height;
+  header.width                = width;
+  header.pitch_or_linear_size = mip_size(format, width, height);
+  header.mip_map_count = 1;
+  for (uint32_t size = std::max(width, height); size > 1; size /= 2)
+    header.mip_map_count++;
+  header.reserved1[0]         = dds_tag;
+  header.reserved1[1]         = compressed_texture_version;
+  std::memcpy(&header.reserved1[2], &hash, sizeof(hash));
+  header.pixel_format.size    = 32;
+  header.pixel_format.flags   = dds_fourcc_flag;
+  header.pixel_format.four_cc = dds_fourcc_dx10;
+  header.caps                 = dds_caps;
+  header.dxgi_format =
+      compression == texture_compression_t::e_bc1 ? dxgi_bc1_srgb
+                                                  : dxgi_bc7_srgb;
+  header.resource_dimension = dds_texture_2d;
+  header.array_size         = 1;
+
+  // every mip is encoded from the box filtered previous one
+  std::vector<uint8_t> data;
+  std::vector<uint8_t> mip(texels, texels + size_t(width) * height * 4);
+  uint32_t             mip_width = width, mip_height = height;
+  for (uint32_t m = 0; m < header.mip_map_count; m++) {
+    const uint32_t blocks_x = (mip_width + 3) / 4;
+    const uint32_t blocks_y = (mip_height + 3) / 4;
+    const size_t   offset   = data.size();
+    data.resize(offset + size_t(blocks_x) * blocks_y * block_bytes);
+    for (uint32_t by = 0; by < blocks_y; by++)
+      for (uint32_t bx = 0; bx < blocks_x; bx++) {
+        block_t block;
+        load_block(mip.data(), mip_width, mip_height, bx, by, block);
+        encode(block, data.data() + offset +
+                          (size_t(by) * blocks_x + bx) * block_bytes);
+      }
+    if (m + 1 < header.mip_map_count)
+      mip = downsample_rgba8(mip.data(), mip_width, mip_height);
+  }
+
+  const bool saved = write_file_atomically(path, [&](std::ofstream &file) {
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+  });
+  if (!saved)
+    horizon_info("failed to write compressed texture {}", path.string());
+}
@@ -0,0 +1,72 @@
+#ifndef TEXTURE_COMPRESSION_HPP
+#define TEXTURE_COMPRESSION_HPP
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan_core.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "assets.hpp"
+#include "horizon/core/core.hpp"
+#include "horizon/gfx/context.hpp"
+
+// bump whenever the encoders or the mip generation change their output
+static constexpr uint32_t compressed_texture_version = 1;
+
+// halves rgba8 texels with a box filter, odd edges clamp, width and height
+// become the halved size, never below 1
+std::vector<uint8_t> downsample_rgba8(const uint8_t *texels, uint32_t &width,
+                                      uint32_t &height);
+
+// bytes of a width x height mip of format, block compressed formats round
+// up to whole 4x4 blocks
+size_t mip_size(VkFormat format, uint32_t width, uint32_t height);
+
+// a full mip chain down to 1x1, mip after mip in data, read only, memory
+// mapped view of a dds file when loaded
+struct compressed_texture_t {
+  ~compressed_texture_t();
+
+  VkFormat       format;
+  uint32_t       width;
+  uint32_t       height;
+  uint32_t       mips_count;
+  const uint8_t *data;
+  size_t         size;
+
+  void  *mapping      = nullptr;
+  size_t mapping_size = 0;
+};
+
+// false unless the device can sample every format compression may resolve
+// to, e_none is always supported
+bool texture_compression_supported(gfx::context_t       &context,
+                                   texture_compression_t compression);
+
+// resolves e_auto, bc1 for opaque texels and bc7 where alpha matters
+texture_compression_t choose_compression(texture_compression_t compression,
+                                         const uint8_t        *texels,
+                                         uint32_t width, uint32_t height);
+
+// hashes the image path with its size and modification time and the
+// requested compression, so a hit does not have to decode anything
+uint64_t hash_compressed_texture_inputs(const std::filesystem::path &path,
+                                        texture_compression_t compression);
+
+std::filesystem::path compressed_texture_path(const texture_config_t &config,
+                                              uint64_t                hash);
+
+// returns nullptr if the file is missing, stale or from another version
+core::ref<compressed_texture_t> load_compressed_texture(
+    const std::filesystem::path &path, uint64_t hash);
+// encodes rgba8 mip 0 and its box filtered mips as bc1 or bc7 and writes
+// them to path as a dds file, compression must be resolved
+void save_compressed_texture(const std::filesystem::path &path, uint64_t hash,
+                             const uint8_t *texels, uint32_t width,
+                             uint32_t              height,
+                             texture_compression_t compression);
+
+#endif
@@ -0,0 +1,175 @@
+#include "tlas.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+
+#include "bvh_builder.hpp"
+#include "horizon/core/logger.hpp"
+
+// byte offsets of the arrays behind the header in a frame's buffer
+struct tlas_layout_t {
+  size_t nodes, prim_indices, instances, size;
+};
+
+static tlas_layout_t tlas_layout(uint32_t instances_count) {
+  tlas_layout_t layout{};
+  layout.nodes        = sizeof(two_level_bvh_t);
+  // a binary bvh over n instances has at most 2n - 1 nodes
+  layout.prim_indices =
+      layout.nodes + sizeof(bvh::node_t) * (2 * instances_count - 1);
+  layout.instances =
+      (layout.prim_indices + sizeof(uint32_t) * instances_count + 15) / 16 *
+      16;
+  layout.size = layout.instances + sizeof(blas_instance_t) * instances_count;
+  return layout;
+}
+
+static math::aabb_t transform_bounds(const mesh_bounds_t &bounds,
+                                     const math::mat4    &transform) {
+  math::aabb_t aabb{};
+  aabb.min = math::vec3{std::numeric_limits<float>::max()};
+  aabb.max = math::vec3{-std::numeric_limits<float>::max()};
+  for (uint32_t corner = 0; corner < 8; corner++) {
+    const math::vec4 p =
+        transform * math::vec4{corner & 1 ? bounds.max.x : bounds.min.x,
+                               corner & 2 ? bounds.max.y : bounds.min.y,
+                               corner & 4 ? bounds.max.z : bounds.min.z, 1.f};
+    aabb.min = math::min(aabb.min, math::vec3{p.x, p.y, p.z});
+    aabb.max = math::max(aabb.max, math::vec3{p.x, p.y, p.z});
+  }
+  return aabb;
+}
+
+tlas_t::tlas_t(core::ref<gfx::context_t> context,  //
+               core::ref<gfx::base_t>    base)
+    : context(context), base(base) {}
+
+bool tlas_t::update(const renderer_data_t &renderer_data) {
+  auto start = std::chrono::steady_clock::now();
+
+  // meshes without triangles have no blas and are left out
+  if (instances.empty()) {
+    for (uint32_t mesh_index = 0; mesh_index < renderer_data.meshes_count;
+         mesh_index++) {
+      const cpu_mesh_t &cpu_mesh = renderer_data.cpu_meshes[mesh_index];
+      if (cpu_mesh.bvh2_root == blas_set_t::null_root) continue;
+      blas_instance_t &instance = instances.emplace_back();
+      instance.bvh2_root        = cpu_mesh.bvh2_root;
+      instance.cwbvh_root       = cpu_mesh.cwbvh_root;
+      instance.mesh_index       = mesh_index;
+      instance.padding          = 0;
+    }
+    horizon_assert(!instances.empty(), "two level bvh without instances");
+    transforms.resize(instances.size());
+    bounds.resize(instances.size());
+  }
+
+  bool moved = false;
+  for (uint32_t i = 0; i < instances.size(); i++) {
+    const cpu_mesh_t &cpu_mesh =
+        renderer_data.cpu_meshes[instances[i].mesh_index];
+    const math::mat4 &transform = *reinterpret_cast<const math::mat4 *>(
+        reinterpret_cast<const uint8_t *>(
+            context->map_buffer(cpu_mesh.transform)) +
+        cpu_mesh.transform_offset);
+    if (!bvh.nodes.empty() &&
+        std::memcmp(&transform, &transforms[i], sizeof(math::mat4)) == 0)
+      continue;
+    moved                          = true;
+    transforms[i]                  = transform;
+    instances[i].inverse_transform = math::inverse(transform);
+    bounds[i] = transform_bounds(cpu_mesh.bounds, transform);
+  }
+
+  if (bvh.nodes.empty()) {
+    bvh        = bvh::build_bvh_sweep_sah(bounds);
+    built_cost = bvh_sah_cost(bvh);
+    rebuilds++;
+  } else if (moved) {
+    // children are stored after their parents, so walking the nodes
+    // backwards visits every child before its parent
+    for (size_t i = bvh.nodes.size(); i-- > 0;) {
+      bvh::node_t &node = bvh.nodes[i];
+      node.min = math::vec3{std::numeric_limits<float>::max()};
+      node.max = math::vec3{-std::numeric_limits<float>::max()};
+      if (node.is_leaf()) {
+        for (uint32_t j = 0; j < node.prim_count; j++) {
+          const math::aabb_t &aabb =
+              bounds[bvh.prim_indices[node.first_index + j]];
+          node.min = math::min(node.min, aabb.min);
+          node.max = math::max(node.max, aabb.max);
+        }
+      } else {
+        for (uint32_t j = 0; j < 2; j++) {
+          const bvh::node_t &child = bvh.nodes[node.first_index + j];
+          node.min                 = math::min(node.min, child.min);
+          node.max                 = math::max(node.max, child.max);
+        }
+      }
+    }
+    refits++;
+    if (bvh_sah_cost(bvh) > rebuild_threshold * built_cost) {
+      bvh        = bvh::build_bvh_sweep_sah(bounds);
+      built_cost = bvh_sah_cost(bvh);
+      rebuilds++;
+    }
+  }
+
+  const tlas_layout_t layout = tlas_layout(instances.size());
+  if (instances_capacity == 0) {
+    instances_capacity = instances.size();
+    gfx::config_buffer_t cb{};
+    cb.vk_size               = layout.size;
+    cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    cb.vma_allocation_create_flags =
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+    buffer =
+        base->create_buffer(gfx::resource_update_policy_t::e_every_frame, cb);
+    horizon_info("tlas: {} instances, {} bytes per frame", instances.size(),
+                 layout.size);
+  }
+  horizon_assert(instances.size() == instances_capacity,
+                 "the instances of a tlas can not change");
+
+  // every frame in flight has its own copy, so this one is rewritten even if
+  // nothing moved since it was last written
+  const gfx::handle_buffer_t frame = base->buffer(buffer);
+  const VkDeviceAddress address = context->get_buffer_device_address(frame);
+  uint8_t *data = reinterpret_cast<uint8_t *>(context->map_buffer(frame));
+
+  two_level_bvh_t header{};
+  header.tlas_nodes = gfx::to<bvh::node_t *>(address + layout.nodes);
+  header.tlas_prim_indices =
+      gfx::to<uint32_t *>(address + layout.prim_indices);
+  header.instances = gfx::to<blas_instance_t *>(address + layout.instances);
+  header.blas_bvh2_nodes = gfx::to<bvh::node_t *>(
+      context->get_buffer_device_address(renderer_data.blas_bvh2_nodes));
+  header.blas_bvh2_prim_indices = gfx::to<uint32_t *>(
+      context->get_buffer_device_address(
+          renderer_data.blas_bvh2_prim_indices));
+  header.blas_cwbvh_nodes = gfx::to<cwbvh_node_t *>(
+      context->get_buffer_device_address(renderer_data.blas_cwbvh_nodes));
+  header.blas_cwbvh_prim_indices = gfx::to<uint32_t *>(
+      context->get_buffer_device_address(
+          renderer_data.blas_cwbvh_prim_indices));
+  header.instances_count = instances.size();
+
+  std::memcpy(data, &header, sizeof(header));
+  std::memcpy(data + layout.nodes, bvh.nodes.data(),
+              sizeof(bvh::node_t) * bvh.nodes.size());
+  std::memcpy(data + layout.prim_indices, bvh.prim_indices.data(),
+              sizeof(uint32_t) * bvh.prim_indices.size());
+  std::memcpy(data + layout.instances, instances.data(),
+              sizeof(blas_instance_t) * instances.size());
+
+  std::chrono::duration<float, std::milli> took =
+      std::chrono::steady_clock::now() - start;
+  last_update_ms = took.count();
+  return moved;
+}
+
+gfx::handle_buffer_t tlas_t::frame_buffer() const {
+  return base->buffer(buffer);
+}
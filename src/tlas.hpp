@@ -0,0 +1,97 @@
+#ifndef TLAS_HPP
+#define TLAS_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "assets.hpp"
+#include "bvh/bvh.hpp"
+#include "cwbvh.hpp"
+#include "horizon/core/core.hpp"
+#include "horizon/gfx/base.hpp"
+#include "horizon/gfx/context.hpp"
+#include "horizon/gfx/types.hpp"
+#include "math/aabb.hpp"
+#include "math/math.hpp"
+
+// a mesh placed in the scene, rays are moved into the mesh's object space
+// with inverse_transform before its blas is traversed, see
+// assets/shaders/types.slang
+struct blas_instance_t {
+  math::mat4 inverse_transform;
+  uint32_t   bvh2_root;
+  uint32_t   cwbvh_root;
+  uint32_t   mesh_index;
+  uint32_t   padding;
+};
+static_assert(sizeof(blas_instance_t) == 80,
+              "sizeof(blas_instance_t) should be 80");
+
+// everything the two level traversal reads, the tlas half lives in the same
+// per frame buffer as this header, the blas half is static
+struct two_level_bvh_t {
+  bvh::node_t     *tlas_nodes;
+  uint32_t        *tlas_prim_indices;
+  blas_instance_t *instances;
+  bvh::node_t     *blas_bvh2_nodes;
+  uint32_t        *blas_bvh2_prim_indices;
+  cwbvh_node_t    *blas_cwbvh_nodes;
+  uint32_t        *blas_cwbvh_prim_indices;
+  uint32_t         instances_count;
+  uint32_t         padding;
+};
+static_assert(sizeof(two_level_bvh_t) == 64,
+              "sizeof(two_level_bvh_t) should be 64");
+
+// a bvh per mesh over its object space triangles, concatenated, child and
+// leaf indices are already offset into the concatenated arrays and prim
+// indices index the scene's triangles, roots are null_root for meshes without
+// triangles
+struct blas_set_t {
+  static constexpr uint32_t null_root = uint32_t(-1);
+
+  std::vector<bvh::node_t>  bvh2_nodes;
+  std::vector<uint32_t>     bvh2_prim_indices;
+  std::vector<cwbvh_node_t> cwbvh_nodes;
+  std::vector<uint32_t>     cwbvh_prim_indices;
+  std::vector<uint32_t>     bvh2_roots;
+  std::vector<uint32_t>     cwbvh_roots;
+};
+
+// top level of the two level bvh, a small binary bvh over the world bounds
+// of every mesh, kept on the cpu and refit every frame from the host visible
+// transforms, it is rebuilt once refitting has degraded its sah cost past
+// rebuild_threshold times the cost of the last build
+struct tlas_t {
+  tlas_t(core::ref<gfx::context_t> context,  //
+         core::ref<gfx::base_t>    base);
+
+  // refits or rebuilds over the current transforms and writes this frame in
+  // flight's buffer, returns true if any instance moved since the last call
+  bool update(const renderer_data_t &renderer_data);
+
+  // this frame in flight's two_level_bvh_t, valid after update
+  gfx::handle_buffer_t frame_buffer() const;
+
+  core::ref<gfx::context_t> context;
+  core::ref<gfx::base_t>    base;
+
+  // host visible, header followed by nodes, prim indices and instances
+  gfx::handle_managed_buffer_t buffer;
+  uint32_t                     instances_capacity = 0;
+
+  bvh::bvh_t                   bvh;
+  std::vector<blas_instance_t> instances;
+  std::vector<math::mat4>      transforms;
+  std::vector<math::aabb_t>    bounds;
+
+  float rebuild_threshold = 1.5f;
+  float built_cost        = 0.f;
+
+  // since the scene was loaded
+  uint32_t rebuilds       = 0;
+  uint32_t refits         = 0;
+  float    last_update_ms = 0.f;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "traversal_stats.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include "horizon/core/logger.hpp"
+#include "json.hpp"
+
+namespace {
+
+// the value below which a fraction q of the rays fall
+float percentile(const std::vector<uint32_t> &histogram, uint32_t rays,
+                 uint32_t max, float q) {
+  if (rays == 0) return 0.f;
+  const double target     = double(q) * rays;
+  double       cumulative = 0;
+  for (uint32_t bin = 0; bin < histogram.size(); bin++) {
+    if (histogram[bin] == 0) continue;
+    if (cumulative + histogram[bin] >= target) {
+      const double fraction = (target - cumulative) / histogram[bin];
+      const double value =
+          (bin + fraction) * double(traversal_histogram_bin_width);
+      return float(std::min(value, double(max)));
+    }
+    cumulative += histogram[bin];
+  }
+  return float(max);
+}
+
+traversal_counter_t summarize_counter(const uint32_t *histogram,
+                                      uint32_t low, uint32_t high,
+                                      uint32_t max, uint32_t rays) {
+  traversal_counter_t counter{};
+  counter.histogram.assign(histogram, histogram + traversal_histogram_bins);
+  counter.total = (uint64_t(high) << 32) | low;
+  counter.mean  = rays ? float(double(counter.total) / rays) : 0.f;
+  counter.max   = max;
+  counter.p50   = percentile(counter.histogram, rays, max, 0.50f);
+  counter.p90   = percentile(counter.histogram, rays, max, 0.90f);
+  counter.p99   = percentile(counter.histogram, rays, max, 0.99f);
+  return counter;
+}
+
+void write_counter_csv(std::ofstream &file, const char *section,
+                       const traversal_counter_t &counter) {
+  file << section << ",total," << counter.total << "\n";
+  file << section << ",mean," << counter.mean << "\n";
+  file << section << ",max," << counter.max << "\n";
+  file << section << ",p50," << counter.p50 << "\n";
+  file << section << ",p90," << counter.p90 << "\n";
+  file << section << ",p99," << counter.p99 << "\n";
+  for (uint32_t bin = 0; bin < counter.histogram.size(); bin++)
+    file << section << "_histogram," << bin * traversal_histogram_bin_width
+         << "," << counter.histogram[bin] << "\n";
+}
+
+void write_counter_json(std::ofstream &file, const char *name,
+                        const traversal_counter_t &counter) {
+  file << "  \"" << name << "\": {\n";
+  file << "    \"total\": " << counter.total << ",\n";
+  file << "    \"mean\": " << counter.mean << ",\n";
+  file << "    \"max\": " << counter.max << ",\n";
+  file << "    \"p50\": " << counter.p50 << ",\n";
+  file << "    \"p90\": " << counter.p90 << ",\n";
+  file << "    \"p99\": " << counter.p99 << ",\n";
+  file << "    \"histogram\": [";
+  for (uint32_t bin = 0; bin < counter.histogram.size(); bin++)
+    file << (bin ? ", " : "") << counter.histogram[bin];
+  file << "]\n  },\n";
+}
+
+}  // namespace
+
+traversal_summary_t summarize_traversal_stats(
+    const gpu_traversal_stats_t &stats, uint64_t frame) {
+  traversal_summary_t summary{};
+  summary.frame     = frame;
+  summary.rays      = stats.rays;
+  summary.hits      = stats.hits;
+  summary.nodes     = summarize_counter(stats.node_histogram, stats.nodes_low,
+                                        stats.nodes_high, stats.max_nodes,
+                                        stats.rays);
+  summary.triangles = summarize_counter(
+      stats.triangle_histogram, stats.triangles_low, stats.triangles_high,
+      stats.max_triangles, stats.rays);
+  return summary;
+}
+
+void write_traversal_stats_csv(const std::filesystem::path &path,
+                               const traversal_summary_t   &summary,
+                               const std::vector<timing_t> &timings) {
+  std::ofstream file{path};
+  file << "section,name,value\n";
+  file << "rays,count," << summary.rays << "\n";
+  file << "rays,hits," << summary.hits << "\n";
+  write_counter_csv(file, "nodes", summary.nodes);
+  write_counter_csv(file, "triangles", summary.triangles);
+  for (const auto &[name, ms] : timings)
+    file << "timer_ms," << name << "," << ms << "\n";
+  if (!file.good()) horizon_info("failed to write {}", path.string());
+}
+
+void write_traversal_stats_json(const std::filesystem::path &path,
+                                const traversal_summary_t   &summary,
+                                const std::vector<timing_t> &timings) {
+  std::ofstream file{path};
+  file << "{\n";
+  file << "  \"rays\": " << summary.rays << ",\n";
+  file << "  \"hits\": " << summary.hits << ",\n";
+  file << "  \"histogram_bin_width\": " << traversal_histogram_bin_width
+       << ",\n";
+  write_counter_json(file, "nodes", summary.nodes);
+  write_counter_json(file, "triangles", summary.triangles);
+  file << "  \"timers_ms\": {";
+  for (size_t i = 0; i < timings.size(); i++)
+    file << (i ? ",\n" : "\n") << "    \"" << escape_json(timings[i].first)
+         << "\": " << timings[i].second;
+  file << (timings.empty() ? "}\n" : "\n  }\n");
+  file << "}\n";
+  if (!file.good()) horizon_info("failed to write {}", path.string());
+}
+
+void write_traversal_stats(const std::filesystem::path &path,
+                           const traversal_summary_t   &summary,
+                           const std::vector<timing_t> &timings) {
+  if (path.extension() == ".json")
+    write_traversal_stats_json(path, summary, timings);
+  else
+    write_traversal_stats_csv(path, summary, timings);
+  horizon_info("wrote traversal stats to {}", path.string());
+}
@@ -0,0 +1,72 @@
+#ifndef TRAVERSAL_STATS_HPP
+#define TRAVERSAL_STATS_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+// per ray counts of a count >= histogram_bins * bin_width land in the last
+// bin, see assets/shaders/types.slang
+static constexpr uint32_t traversal_histogram_bins      = 256;
+static constexpr uint32_t traversal_histogram_bin_width = 4;
+
+// what the debug raytracer accumulates over a frame with atomics, the
+// histograms count rays by their node and triangle intersections
+struct gpu_traversal_stats_t {
+  uint32_t rays;
+  uint32_t hits;
+  uint32_t max_nodes;
+  uint32_t max_triangles;
+  uint32_t nodes_low;
+  uint32_t nodes_high;
+  uint32_t triangles_low;
+  uint32_t triangles_high;
+  uint32_t node_histogram[traversal_histogram_bins];
+  uint32_t triangle_histogram[traversal_histogram_bins];
+};
+static_assert(sizeof(gpu_traversal_stats_t) == 2080,
+              "sizeof(gpu_traversal_stats_t) should be 2080");
+
+// per ray distribution of one counter, percentiles are interpolated within
+// a histogram bin
+struct traversal_counter_t {
+  uint64_t              total;
+  float                 mean;
+  uint32_t              max;
+  float                 p50;
+  float                 p90;
+  float                 p99;
+  std::vector<uint32_t> histogram;
+};
+
+struct traversal_summary_t {
+  // debug raytracer frame the stats were gathered in, 0 if there are none
+  uint64_t            frame = 0;
+  uint32_t            rays  = 0;
+  uint32_t            hits  = 0;
+  traversal_counter_t nodes{};
+  traversal_counter_t triangles{};
+};
+
+traversal_summary_t summarize_traversal_stats(
+    const gpu_traversal_stats_t &stats, uint64_t frame);
+
+// name and milliseconds of a gpu timer
+using timing_t = std::pair<std::string, float>;
+
+// one section,name,value row per number, histogram rows are named after the
+// first count of their bin
+void write_traversal_stats_csv(const std::filesystem::path &path,
+                               const traversal_summary_t   &summary,
+                               const std::vector<timing_t> &timings);
+void write_traversal_stats_json(const std::filesystem::path &path,
+                                const traversal_summary_t   &summary,
+                                const std::vector<timing_t> &timings);
+// picks the writer from the extension of path, .json or anything else as csv
+void write_traversal_stats(const std::filesystem::path &path,
+                           const traversal_summary_t   &summary,
+                           const std::vector<timing_t> &timings);
+
+#endif
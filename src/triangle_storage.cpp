@@ -0,0 +1,118 @@
+#include "triangle_storage.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+triangle_quantization_t compute_triangle_quantization(
+    const std::vector<model::raw_mesh_t> &meshes) {
+  math::vec3 min{std::numeric_limits<float>::max()};
+  math::vec3 max{-std::numeric_limits<float>::max()};
+  for (const auto &mesh : meshes) {
+    for (const auto &vertex : mesh.vertices) {
+      min = math::min(min, vertex.position);
+      max = math::max(max, vertex.position);
+    }
+  }
+
+  triangle_quantization_t quantization{};
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    if (min[axis] > max[axis]) min[axis] = max[axis] = 0;
+    const float extent = std::max(max[axis] - min[axis], 1e-20f);
+    // one extra step because min is rounded down below
+    const int exponent =
+        int(std::ceil(std::log2(extent / float(0xffff - 1))));
+    quantization.scale[axis] = std::ldexp(1.f, exponent);
+    quantization.min[axis] =
+        std::floor(min[axis] / quantization.scale[axis]) *
+        quantization.scale[axis];
+  }
+  return quantization;
+}
+
+static uint32_t quantize_axis(const triangle_quantization_t &quantization,
+                              math::vec3 position, uint32_t axis) {
+  const float q = std::round((position[axis] - quantization.min[axis]) /
+                             quantization.scale[axis]);
+  return uint32_t(std::clamp(q, 0.f, float(0xffff)));
+}
+
+math::vec3 quantize_position(const triangle_quantization_t &quantization,
+                             math::vec3                     position) {
+  math::vec3 snapped;
+  for (uint32_t axis = 0; axis < 3; axis++)
+    snapped[axis] = quantization.min[axis] +
+                    float(quantize_axis(quantization, position, axis)) *
+                        quantization.scale[axis];
+  return snapped;
+}
+
+encoded_triangles_t encode_triangles(
+    const std::vector<model::raw_mesh_t> &meshes, triangle_format_t format,
+    const triangle_quantization_t &quantization) {
+  encoded_triangles_t encoded{};
+  if (format == triangle_format_t::e_full) return encoded;
+
+  uint32_t vertex_count = 0;
+  for (uint32_t mesh_index = 0; mesh_index < meshes.size(); mesh_index++) {
+    const auto &mesh = meshes[mesh_index];
+    for (uint32_t index : mesh.indices)
+      encoded.indices.push_back(vertex_count + index);
+    encoded.mesh_indices.insert(encoded.mesh_indices.end(),
+                                mesh.indices.size() / 3, mesh_index);
+    vertex_count += mesh.vertices.size();
+  }
+
+  if (format == triangle_format_t::e_indexed) {
+    encoded.positions.reserve(vertex_count);
+    for (const auto &mesh : meshes)
+      for (const auto &vertex : mesh.vertices)
+        encoded.positions.push_back(vertex.position);
+    return encoded;
+  }
+
+  // halves are written in order, vertex i starts at half 3 * i
+  encoded.quantized_positions.assign((vertex_count * 3 + 1) / 2, 0);
+  uint32_t half = 0;
+  for (const auto &mesh : meshes) {
+    for (const auto &vertex : mesh.vertices) {
+      for (uint32_t axis = 0; axis < 3; axis++, half++)
+        encoded.quantized_positions[half / 2] |=
+            quantize_axis(quantization, vertex.position, axis)
+            << ((half % 2) * 16);
+    }
+  }
+  return encoded;
+}
+
+size_t triangle_storage_size(const std::vector<model::raw_mesh_t> &meshes,
+                             triangle_format_t                     format) {
+  size_t triangles_count = 0, vertex_count = 0;
+  for (const auto &mesh : meshes) {
+    triangles_count += mesh.indices.size() / 3;
+    vertex_count += mesh.vertices.size();
+  }
+  switch (format) {
+    case triangle_format_t::e_full:
+      return triangles_count * sizeof(triangle_t);
+    case triangle_format_t::e_indexed:
+      return triangles_count * 4 * sizeof(uint32_t) +
+             vertex_count * sizeof(math::vec3);
+    case triangle_format_t::e_quantized:
+      return triangles_count * 4 * sizeof(uint32_t) +
+             (vertex_count * 3 + 1) / 2 * sizeof(uint32_t);
+  }
+  return 0;
+}
+
+const char *to_string(triangle_format_t format) {
+  switch (format) {
+    case triangle_format_t::e_full:
+      return "full";
+    case triangle_format_t::e_indexed:
+      return "indexed";
+    case triangle_format_t::e_quantized:
+      return "quantized";
+  }
+  return "unknown";
+}
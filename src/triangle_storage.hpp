@@ -0,0 +1,47 @@
+#ifndef TRIANGLE_STORAGE_HPP
+#define TRIANGLE_STORAGE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "assets.hpp"
+#include "math/math.hpp"
+#include "model/model.hpp"
+
+// vertices snap to a grid of power of two spacing scale, under
+// 2 * extent / 65534 per axis, so a vertex moves by at most scale / 2, the
+// grid's origin min is a multiple of scale, so min + q * scale is exact and
+// the same on the cpu and the gpu while |min| + 65535 * scale < 2^24 * scale,
+// a scene farther from the origin relative to its extent also rounds each
+// axis by up to half an ulp of the reconstructed coordinate
+struct triangle_quantization_t {
+  math::vec3 min;
+  math::vec3 scale;
+};
+
+triangle_quantization_t compute_triangle_quantization(
+    const std::vector<model::raw_mesh_t> &meshes);
+math::vec3 quantize_position(const triangle_quantization_t &quantization,
+                             math::vec3                     position);
+
+// soa arrays for the indexed and quantized formats, unused arrays stay empty
+struct encoded_triangles_t {
+  std::vector<math::vec3> positions;
+  // 3 uint16 per vertex packed into uint32 words
+  std::vector<uint32_t>   quantized_positions;
+  std::vector<uint32_t>   indices;
+  std::vector<uint32_t>   mesh_indices;
+};
+
+encoded_triangles_t encode_triangles(
+    const std::vector<model::raw_mesh_t> &meshes, triangle_format_t format,
+    const triangle_quantization_t &quantization);
+
+// bytes the triangles take on the gpu in the given format
+size_t triangle_storage_size(const std::vector<model::raw_mesh_t> &meshes,
+                             triangle_format_t                     format);
+
+const char *to_string(triangle_format_t format);
+
+#endif
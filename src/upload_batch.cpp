@@ -0,0 +1,210 @@
+#include "upload_batch.hpp"
+
+#include <volk.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "horizon/core/logger.hpp"
+#include "job_system.hpp"
+#include "texture_compression.hpp"
+
+// vkCmdCopyBufferToImage needs offsets aligned to the texel or block size, 16
+// covers every format we upload
+static constexpr size_t staging_alignment = 16;
+
+static size_t align_up(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+upload_batch_t::upload_batch_t(core::ref<gfx::context_t> context,  //
+                               core::ref<gfx::base_t>    base,     //
+                               size_t                    staging_size)
+    : context(context), base(base), staging_size(staging_size) {}
+
+upload_batch_t::~upload_batch_t() {
+  for (auto &slot : slots) {
+    wait(slot);
+    if (slot.staging != core::null_handle)
+      context->destroy_buffer(slot.staging);
+    if (slot.commandbuffer != core::null_handle)
+      context->free_commandbuffer(slot.commandbuffer);
+    if (slot.fence != core::null_handle) context->destroy_fence(slot.fence);
+  }
+}
+
+gfx::handle_buffer_t upload_batch_t::create_buffer(gfx::config_buffer_t config,
+                                                   const void *data) {
+  config.vk_buffer_usage_flags |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  gfx::handle_buffer_t buffer = context->create_buffer(config);
+  upload_buffer(buffer, 0, data, config.vk_size);
+  return buffer;
+}
+
+void upload_batch_t::upload_buffer(gfx::handle_buffer_t buffer, size_t offset,
+                                   const void *data, size_t size) {
+  // buffers are split so that any piece fits a staging buffer
+  for (size_t begin = 0; begin < size; begin += staging_size) {
+    copy_t copy{};
+    copy.data   = reinterpret_cast<const uint8_t *>(data) + begin;
+    copy.size   = std::min(staging_size, size - begin);
+    copy.buffer = buffer;
+    copy.offset = offset + begin;
+    copies.push_back(copy);
+  }
+}
+
+gfx::handle_image_t upload_batch_t::create_image(gfx::config_image_t config,
+                                                 const void *texels,
+                                                 size_t      size) {
+  config.vk_usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  gfx::handle_image_t image = context->create_image(config);
+  // images are not split, a larger one grows its staging buffer
+  copy_t copy{};
+  copy.data   = texels;
+  copy.size   = size;
+  copy.image  = image;
+  copy.width  = config.vk_width;
+  copy.height = config.vk_height;
+  copy.mips   = config.vk_mips;
+  copy.format = config.vk_format;
+  copies.push_back(copy);
+  return image;
+}
+
+void upload_batch_t::wait(slot_t &slot) {
+  if (!slot.in_flight) return;
+  context->wait_fence(slot.fence);
+  context->reset_fence(slot.fence);
+  slot.in_flight = false;
+}
+
+static void image_barrier(VkCommandBuffer vk_commandbuffer, VkImage vk_image,
+                          uint32_t mips, VkImageLayout old_layout,
+                          VkImageLayout new_layout, VkAccessFlags src_access,
+                          VkAccessFlags        dst_access,
+                          VkPipelineStageFlags src_stage,
+                          VkPipelineStageFlags dst_stage) {
+  VkImageMemoryBarrier vk_image_memory_barrier{};
+  vk_image_memory_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  vk_image_memory_barrier.srcAccessMask       = src_access;
+  vk_image_memory_barrier.dstAccessMask       = dst_access;
+  vk_image_memory_barrier.oldLayout           = old_layout;
+  vk_image_memory_barrier.newLayout           = new_layout;
+  vk_image_memory_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  vk_image_memory_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  vk_image_memory_barrier.image               = vk_image;
+  vk_image_memory_barrier.subresourceRange    = {VK_IMAGE_ASPECT_COLOR_BIT, 0,
+                                                 mips, 0, 1};
+  vkCmdPipelineBarrier(vk_commandbuffer, src_stage, dst_stage, 0, 0, nullptr,
+                       0, nullptr, 1, &vk_image_memory_barrier);
+}
+
+void upload_batch_t::record(slot_t &slot, const copy_t *copies,
+                            const size_t *offsets, size_t count) {
+  context->begin_commandbuffer(slot.commandbuffer, true);
+  VkCommandBuffer vk_commandbuffer =
+      context->get_commandbuffer(slot.commandbuffer).vk_commandbuffer;
+  VkBuffer vk_staging = context->get_buffer(slot.staging).vk_buffer;
+
+  for (size_t i = 0; i < count; i++) {
+    const copy_t &copy = copies[i];
+    if (copy.buffer != core::null_handle) {
+      VkBufferCopy vk_buffer_copy{};
+      vk_buffer_copy.srcOffset = offsets[i];
+      vk_buffer_copy.dstOffset = copy.offset;
+      vk_buffer_copy.size      = copy.size;
+      vkCmdCopyBuffer(vk_commandbuffer, vk_staging,
+                      context->get_buffer(copy.buffer).vk_buffer, 1,
+                      &vk_buffer_copy);
+      continue;
+    }
+    VkImage vk_image = context->get_image(copy.image).vk_image;
+    image_barrier(vk_commandbuffer, vk_image, copy.mips,
+                  VK_IMAGE_LAYOUT_UNDEFINED,
+                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+                  VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                  VK_PIPELINE_STAGE_TRANSFER_BIT);
+    std::vector<VkBufferImageCopy> vk_buffer_image_copies(copy.mips);
+    size_t                         mip_offset = offsets[i];
+    uint32_t width = copy.width, height = copy.height;
+    for (uint32_t mip = 0; mip < copy.mips; mip++) {
+      VkBufferImageCopy &vk_buffer_image_copy = vk_buffer_image_copies[mip];
+      vk_buffer_image_copy.bufferOffset     = mip_offset;
+      vk_buffer_image_copy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, mip,
+                                               0, 1};
+      vk_buffer_image_copy.imageExtent      = {width, height, 1};
+      mip_offset += mip_size(copy.format, width, height);
+      width  = std::max(width / 2, 1u);
+      height = std::max(height / 2, 1u);
+    }
+    vkCmdCopyBufferToImage(vk_commandbuffer, vk_staging, vk_image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           vk_buffer_image_copies.size(),
+                           vk_buffer_image_copies.data());
+    image_barrier(vk_commandbuffer, vk_image, copy.mips,
+                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                  VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                  VK_PIPELINE_STAGE_TRANSFER_BIT,
+                  VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+  }
+
+  context->end_commandbuffer(slot.commandbuffer);
+  context->submit_commandbuffer(slot.commandbuffer, {}, {}, {}, slot.fence);
+  slot.in_flight = true;
+}
+
+void upload_batch_t::submit() {
+  uint32_t current = 0;
+  for (size_t begin = 0; begin < copies.size();) {
+    // as many copies as fit, at least one
+    std::vector<size_t> offsets;
+    size_t              bytes = 0, end = begin;
+    while (end < copies.size()) {
+      const size_t offset = align_up(bytes, staging_alignment);
+      if (end > begin && offset + copies[end].size > staging_size) break;
+      offsets.push_back(offset);
+      bytes = offset + copies[end].size;
+      end++;
+    }
+
+    slot_t &slot = slots[current];
+    wait(slot);
+    if (slot.staging_size < bytes) {
+      if (slot.staging != core::null_handle)
+        context->destroy_buffer(slot.staging);
+      gfx::config_buffer_t cb{};
+      cb.vk_size               = std::max(bytes, staging_size);
+      cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+      cb.vma_allocation_create_flags =
+          VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+      slot.staging      = context->create_buffer(cb);
+      slot.staging_size = cb.vk_size;
+    }
+    if (slot.commandbuffer == core::null_handle) {
+      slot.commandbuffer = context->allocate_commandbuffer(
+          {.handle_command_pool = base->_command_pool,
+           .debug_name          = "upload"});
+      slot.fence = context->create_fence({});
+    }
+
+    uint8_t *staging =
+        reinterpret_cast<uint8_t *>(context->map_buffer(slot.staging));
+    job_system_t::global().parallel_for(
+        end - begin, 1, [&](uint32_t first, uint32_t last) {
+          for (uint32_t i = first; i < last; i++)
+            std::memcpy(staging + offsets[i], copies[begin + i].data,
+                        copies[begin + i].size);
+        });
+    record(slot, copies.data() + begin, offsets.data(), end - begin);
+
+    uploaded_bytes += bytes;
+    submissions++;
+    current ^= 1;
+    begin = end;
+  }
+  for (auto &slot : slots) wait(slot);
+  copies.clear();
+}
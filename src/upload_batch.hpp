@@ -0,0 +1,74 @@
+#ifndef UPLOAD_BATCH_HPP
+#define UPLOAD_BATCH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "horizon/core/core.hpp"
+#include "horizon/gfx/base.hpp"
+#include "horizon/gfx/context.hpp"
+#include "horizon/gfx/types.hpp"
+
+// records buffer and image uploads and performs them through two large
+// staging buffers, one submission per filled staging buffer instead of one
+// blocking submission per resource, the next staging buffer is filled on the
+// job system while the previous copy runs
+struct upload_batch_t {
+  upload_batch_t(core::ref<gfx::context_t> context,  //
+                 core::ref<gfx::base_t>    base,     //
+                 size_t                    staging_size = 64 * 1024 * 1024);
+  ~upload_batch_t();
+
+  // adds VK_BUFFER_USAGE_TRANSFER_DST_BIT, data has to stay valid until
+  // submit, the buffer's device address is usable right away
+  gfx::handle_buffer_t create_buffer(gfx::config_buffer_t config,
+                                     const void          *data);
+  // data replaces size bytes of buffer at offset once submit returns
+  void upload_buffer(gfx::handle_buffer_t buffer, size_t offset,
+                     const void *data, size_t size);
+  // tightly packed texels of every mip, mip after mip, block compressed mips
+  // in whole blocks, see mip_size, adds VK_IMAGE_USAGE_TRANSFER_DST_BIT, the
+  // image ends up in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+  gfx::handle_image_t create_image(gfx::config_image_t config,
+                                   const void *texels, size_t size);
+
+  // blocks until every recorded upload has completed
+  void submit();
+
+  core::ref<gfx::context_t> context;
+  core::ref<gfx::base_t>    base;
+
+  size_t   staging_size;
+  // totals over all submits, for logging
+  size_t   uploaded_bytes = 0;
+  uint32_t submissions    = 0;
+
+ private:
+  struct copy_t {
+    const void          *data;
+    size_t               size;
+    gfx::handle_buffer_t buffer = core::null_handle;
+    size_t               offset = 0;
+    gfx::handle_image_t  image  = core::null_handle;
+    uint32_t             width = 0, height = 0, mips = 0;
+    VkFormat             format = VK_FORMAT_UNDEFINED;
+  };
+
+  struct slot_t {
+    gfx::handle_buffer_t        staging       = core::null_handle;
+    size_t                      staging_size  = 0;
+    gfx::handle_commandbuffer_t commandbuffer = core::null_handle;
+    gfx::handle_fence_t         fence         = core::null_handle;
+    bool                        in_flight     = false;
+  };
+
+  void wait(slot_t &slot);
+  void record(slot_t &slot, const copy_t *copies, const size_t *offsets,
+              size_t count);
+
+  std::vector<copy_t> copies;
+  slot_t              slots[2];
+};
+
+#endif
@@ -0,0 +1,580 @@
+#include "virtual_texture.hpp"
+
+#include <volk.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <utility>
+
+#include "bvh_cache.hpp"
+#include "frame_resources.hpp"
+#include "horizon/core/logger.hpp"
+#include "texture_compression.hpp"
+#include "upload_batch.hpp"
+
+namespace {
+
+constexpr uint32_t virtual_texture_magic = 0x56525541;  // "AURV"
+
+struct header_t {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t hash;
+  uint32_t page_size;
+  uint32_t page_border;
+  uint32_t textures_count;
+  uint32_t mips_count;
+  uint32_t pages_count;
+  uint32_t padding;
+};
+
+constexpr uint64_t align_up(uint64_t offset) { return (offset + 15) & ~15ull; }
+
+struct mip_texels_t {
+  std::vector<uint8_t> texels;
+  uint32_t             width, height;
+};
+
+// box filtered halvings of mip 0 until one fits a page
+std::vector<mip_texels_t> build_mips(const texture_texels_t &texture) {
+  std::vector<mip_texels_t> mips;
+  const size_t bytes = size_t(texture.width) * texture.height * 4;
+  mips.push_back({std::vector<uint8_t>(texture.texels, texture.texels + bytes),
+                  texture.width, texture.height});
+  while (std::max(mips.back().width, mips.back().height) > virtual_page_size) {
+    mip_texels_t mip{{}, mips.back().width, mips.back().height};
+    mip.texels =
+        downsample_rgba8(mips.back().texels.data(), mip.width, mip.height);
+    mips.push_back(std::move(mip));
+  }
+  return mips;
+}
+
+// a page with its border, texels past the mip's edges wrap around like a
+// repeating sampler would
+void cut_page(const mip_texels_t &mip, uint32_t page_x, uint32_t page_y,
+              uint8_t *out) {
+  for (uint32_t y = 0; y < virtual_slot_size; y++) {
+    const int64_t  sy = int64_t(page_y) * virtual_page_size + y -
+                        int64_t(virtual_page_border);
+    const uint32_t wy = uint32_t((sy % mip.height + mip.height) % mip.height);
+    for (uint32_t x = 0; x < virtual_slot_size; x++) {
+      const int64_t  sx = int64_t(page_x) * virtual_page_size + x -
+                          int64_t(virtual_page_border);
+      const uint32_t wx = uint32_t((sx % mip.width + mip.width) % mip.width);
+      std::memcpy(out + (size_t(y) * virtual_slot_size + x) * 4,
+                  mip.texels.data() + (size_t(wy) * mip.width + wx) * 4, 4);
+    }
+  }
+}
+
+void image_barrier(gfx::context_t &context, gfx::handle_commandbuffer_t cbuf,
+                   VkImage vk_image, VkImageLayout old_layout,
+                   VkImageLayout new_layout, VkAccessFlags src_access,
+                   VkAccessFlags dst_access, VkPipelineStageFlags src_stage,
+                   VkPipelineStageFlags dst_stage) {
+  VkImageMemoryBarrier vk_image_memory_barrier{};
+  vk_image_memory_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  vk_image_memory_barrier.srcAccessMask       = src_access;
+  vk_image_memory_barrier.dstAccessMask       = dst_access;
+  vk_image_memory_barrier.oldLayout           = old_layout;
+  vk_image_memory_barrier.newLayout           = new_layout;
+  vk_image_memory_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  vk_image_memory_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  vk_image_memory_barrier.image               = vk_image;
+  vk_image_memory_barrier.subresourceRange    = {VK_IMAGE_ASPECT_COLOR_BIT, 0,
+                                                 1, 0, 1};
+  vkCmdPipelineBarrier(context.get_commandbuffer(cbuf).vk_commandbuffer,
+                       src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1,
+                       &vk_image_memory_barrier);
+}
+
+}  // namespace
+
+virtual_texture_file_t::~virtual_texture_file_t() {
+  unmap_file(mapping, mapping_size);
+}
+
+const uint8_t *virtual_texture_file_t::page(uint32_t page) const {
+  return reinterpret_cast<const uint8_t *>(mapping) + pages_offset +
+         uint64_t(page) * virtual_slot_bytes;
+}
+
+uint64_t hash_texture_inputs(const std::vector<std::filesystem::path> &paths) {
+  uint64_t hash = hash_bytes(&virtual_texture_file_version,
+                             sizeof(virtual_texture_file_version), 0);
+  for (const auto &path : paths) {
+    const std::string name = path.string();
+    hash = hash_bytes(name.data(), name.size(), hash);
+    std::error_code error;
+    const uint64_t  size = std::filesystem::file_size(path, error);
+    hash = hash_bytes(&size, sizeof(size), hash);
+    const int64_t time = std::filesystem::last_write_time(path, error)
+                             .time_since_epoch()
+                             .count();
+    hash = hash_bytes(&time, sizeof(time), hash);
+  }
+  return hash;
+}
+
+std::filesystem::path virtual_texture_file_path(
+    const texture_config_t &config, uint64_t hash) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.pages",
+                static_cast<unsigned long long>(hash));
+  return config.cache_directory / name;
+}
+
+core::ref<virtual_texture_file_t> load_virtual_texture_file(
+    const std::filesystem::path &path, uint64_t hash) {
+  size_t size    = 0;
+  void  *mapping = map_file(path, size);
+  if (!mapping) return nullptr;
+
+  auto file          = core::make_ref<virtual_texture_file_t>();
+  file->mapping      = mapping;
+  file->mapping_size = size;
+  if (size < sizeof(header_t)) return nullptr;
+
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(mapping);
+  header_t       header;
+  std::memcpy(&header, bytes, sizeof(header));
+  if (header.magic != virtual_texture_magic ||
+      header.version != virtual_texture_file_version || header.hash != hash ||
+      header.page_size != virtual_page_size ||
+      header.page_border != virtual_page_border) {
+    horizon_info("page file {} is stale, rebuilding", path.string());
+    return nullptr;
+  }
+
+  uint64_t offset      = align_up(sizeof(header_t));
+  file->textures       = reinterpret_cast<const virtual_texture_info_t *>(
+      bytes + offset);
+  file->textures_count = header.textures_count;
+  offset = align_up(offset + header.textures_count *
+                                 sizeof(virtual_texture_info_t));
+  file->mips = reinterpret_cast<const virtual_texture_mip_t *>(bytes + offset);
+  file->mips_count = header.mips_count;
+  offset = align_up(offset + header.mips_count * sizeof(virtual_texture_mip_t));
+  file->pages_offset = offset;
+  file->pages_count  = header.pages_count;
+  if (offset + uint64_t(header.pages_count) * virtual_slot_bytes > size) {
+    horizon_info("page file {} is truncated, rebuilding", path.string());
+    return nullptr;
+  }
+  return file;
+}
+
+void save_virtual_texture_file(const std::filesystem::path         &path,
+                               uint64_t                             hash,
+                               const std::vector<texture_texels_t> &textures,
+                               load_progress_t                     &progress) {
+  auto start = std::chrono::steady_clock::now();
+
+  // the pages of every texture in file order
+  progress.begin(load_stage_t::e_textures, textures.size());
+  std::vector<std::vector<virtual_texture_mip_t>> texture_mips(
+      textures.size());
+  std::vector<std::vector<uint8_t>> texture_pages(textures.size());
+  job_system_t::global().parallel_for(
+      textures.size(), 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t t = begin; t < end; t++) {
+          if (!textures[t].texels) {
+            progress.done++;
+            continue;
+          }
+          const std::vector<mip_texels_t> mips = build_mips(textures[t]);
+          uint32_t                        pages = 0;
+          for (const mip_texels_t &mip : mips) {
+            virtual_texture_mip_t info{};
+            info.pages_x =
+                (mip.width + virtual_page_size - 1) / virtual_page_size;
+            info.pages_y =
+                (mip.height + virtual_page_size - 1) / virtual_page_size;
+            info.first_page = pages;
+            pages += info.pages_x * info.pages_y;
+            texture_mips[t].push_back(info);
+          }
+          texture_pages[t].resize(size_t(pages) * virtual_slot_bytes);
+          for (uint32_t m = 0; m < mips.size(); m++) {
+            const virtual_texture_mip_t &info = texture_mips[t][m];
+            for (uint32_t y = 0; y < info.pages_y; y++)
+              for (uint32_t x = 0; x < info.pages_x; x++)
+                cut_page(mips[m], x, y,
+                         texture_pages[t].data() +
+                             size_t(info.first_page + y * info.pages_x + x) *
+                                 virtual_slot_bytes);
+          }
+          progress.done++;
+        }
+      });
+
+  std::vector<virtual_texture_info_t> infos(textures.size());
+  std::vector<virtual_texture_mip_t>  mips;
+  uint32_t                            pages_count = 0;
+  for (uint32_t t = 0; t < textures.size(); t++) {
+    virtual_texture_info_t &info = infos[t];
+    info.width      = textures[t].texels ? textures[t].width : 0;
+    info.height     = textures[t].texels ? textures[t].height : 0;
+    info.first_mip  = mips.size();
+    info.mips_count = texture_mips[t].size();
+    for (virtual_texture_mip_t mip : texture_mips[t]) {
+      mip.first_page += pages_count;
+      mips.push_back(mip);
+    }
+    pages_count += texture_pages[t].size() / virtual_slot_bytes;
+  }
+
+  header_t header{};
+  header.magic          = virtual_texture_magic;
+  header.version        = virtual_texture_file_version;
+  header.hash           = hash;
+  header.page_size      = virtual_page_size;
+  header.page_border    = virtual_page_border;
+  header.textures_count = infos.size();
+  header.mips_count     = mips.size();
+  header.pages_count    = pages_count;
+
+  const bool saved = write_file_atomically(path, [&](std::ofstream &file) {
+    uint64_t offset = 0;
+    auto     write  = [&](const void *data, uint64_t size) {
+      const char padding[16] = {};
+      file.write(padding, align_up(offset) - offset);
+      offset = align_up(offset);
+      file.write(reinterpret_cast<const char *>(data), size);
+      offset += size;
+    };
+    write(&header, sizeof(header));
+    write(infos.data(), infos.size() * sizeof(virtual_texture_info_t));
+    write(mips.data(), mips.size() * sizeof(virtual_texture_mip_t));
+    for (const auto &pages : texture_pages) write(pages.data(), pages.size());
+  });
+  if (!saved) {
+    horizon_info("failed to write page file {}", path.string());
+    return;
+  }
+
+  std::chrono::duration<float, std::milli> took =
+      std::chrono::steady_clock::now() - start;
+  horizon_info("wrote page file {}: {} textures, {} pages, took {}ms",
+               path.string(), infos.size(), pages_count, took.count());
+}
+
+// pages used this recently are never evicted, their feedback may still be
+// in flight
+static constexpr uint64_t keep_frames = frame_ring_size;
+// pages queued on the job system at once
+static constexpr uint32_t max_in_flight = 256;
+// the physical cache is square, vulkan guarantees 4096 texels, most devices
+// 16384
+static constexpr uint32_t max_physical_size = 16384;
+
+texture_streamer_t::texture_streamer_t(
+    core::ref<gfx::context_t> context, core::ref<gfx::base_t> base,
+    core::ref<virtual_texture_file_t> file, VkDeviceSize budget,
+    VkDeviceSize upload_budget)
+    : context(context), base(base), file(file) {
+  {
+    upload_batch_t       batch{context, base};
+    gfx::config_buffer_t cb{};
+    cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    cb.vma_allocation_create_flags =
+        VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+    cb.vk_size =
+        sizeof(virtual_texture_info_t) * std::max(file->textures_count, 1u);
+    textures_buffer = batch.create_buffer(cb, file->textures);
+    cb.vk_size =
+        sizeof(virtual_texture_mip_t) * std::max(file->mips_count, 1u);
+    mips_buffer = batch.create_buffer(cb, file->mips);
+    batch.submit();
+  }
+
+  pinned.assign(file->pages_count, 0);
+  uint32_t pinned_count = 0;
+  for (uint32_t t = 0; t < file->textures_count; t++) {
+    const virtual_texture_info_t &info = file->textures[t];
+    if (info.mips_count == 0) continue;
+    const uint32_t page =
+        file->mips[info.first_mip + info.mips_count - 1].first_page;
+    pinned[page] = 1;
+    unqueued_pinned.push_back(page);
+    pinned_count++;
+  }
+
+  // the pinned pages always fit, whatever the budget
+  const uint32_t max_slots_per_row = max_physical_size / virtual_slot_size;
+  const VkDeviceSize slots = std::min<VkDeviceSize>(
+      {std::max<VkDeviceSize>(budget / virtual_slot_bytes, pinned_count + 1),
+       file->pages_count, max_slots_per_row * max_slots_per_row});
+  slots_count   = std::max<uint32_t>(slots, 1);
+  slots_per_row = std::min<uint32_t>(
+      std::ceil(std::sqrt(float(slots_count))), max_slots_per_row);
+  const uint32_t rows = (slots_count + slots_per_row - 1) / slots_per_row;
+  if (slots_count < pinned_count)
+    horizon_info("{} textures do not fit the physical cache, some will "
+                 "sample white until their pages are loaded",
+                 file->textures_count);
+
+  gfx::config_image_t ci{};
+  ci.vk_width  = slots_per_row * virtual_slot_size;
+  ci.vk_height = rows * virtual_slot_size;
+  ci.vk_depth  = 1;
+  ci.vk_type   = VK_IMAGE_TYPE_2D;
+  ci.vk_mips   = 1;
+  ci.vk_format = VK_FORMAT_R8G8B8A8_SRGB;
+  ci.vk_usage  = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  ci.vma_allocation_create_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+  ci.debug_name                  = "virtual texture cache";
+  physical      = context->create_image(ci);
+  physical_view = context->create_image_view(
+      {.handle_image = physical, .debug_name = "virtual texture cache"});
+  bphysical = base->new_bindless_image();
+  base->set_bindless_image(bphysical, physical_view,
+                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+  gfx::config_buffer_t cb{};
+  cb.vk_size = sizeof(virtual_textures_t) +
+               sizeof(uint32_t) * std::max(file->pages_count, 1u);
+  cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  cb.vma_allocation_create_flags =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+  buffer =
+      base->create_buffer(gfx::resource_update_policy_t::e_every_frame, cb);
+
+  cb.vk_size = sizeof(uint32_t) * std::max(file->pages_count, 1u);
+  cb.vma_allocation_create_flags =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+  feedback =
+      base->create_buffer(gfx::resource_update_policy_t::e_every_frame, cb);
+
+  // a frame can always place at least one page
+  staging_size             = std::max<VkDeviceSize>(upload_budget,
+                                                    virtual_slot_bytes);
+  cb.vk_size               = staging_size;
+  cb.vk_buffer_usage_flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  cb.vma_allocation_create_flags =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+  staging =
+      base->create_buffer(gfx::resource_update_policy_t::e_every_frame, cb);
+
+  indirection.assign(file->pages_count, null_slot);
+  last_used.assign(file->pages_count, 0);
+  pending.assign(file->pages_count, 0);
+  slot_pages.assign(slots_count, null_slot);
+  for (uint32_t slot = slots_count; slot-- > 0;) free_slots.push_back(slot);
+
+  horizon_info(
+      "virtual textures: {} textures, {} pages, {} slots in a {}x{} cache, "
+      "every page resident would take {} bytes",
+      file->textures_count, file->pages_count, slots_count, ci.vk_width,
+      ci.vk_height, uint64_t(file->pages_count) * virtual_slot_bytes);
+}
+
+texture_streamer_t::~texture_streamer_t() {
+  job_system_t::global().wait(loading);
+  context->destroy_image_view(physical_view);
+  context->destroy_image(physical);
+  context->destroy_buffer(textures_buffer);
+  context->destroy_buffer(mips_buffer);
+}
+
+bool texture_streamer_t::update() {
+  auto start = std::chrono::steady_clock::now();
+  frame++;
+
+  const gfx::handle_buffer_t frame_buffer = base->buffer(buffer);
+  uint8_t                   *data =
+      reinterpret_cast<uint8_t *>(context->map_buffer(frame_buffer));
+  uint32_t previous_frame;
+  std::memcpy(&previous_frame, data + offsetof(virtual_textures_t, frame),
+              sizeof(uint32_t));
+  const uint32_t *wanted = reinterpret_cast<const uint32_t *>(
+      context->map_buffer(base->buffer(feedback)));
+
+  // the pinned pages are wanted from the start and queued ahead of anything
+  // the samplers asked for, over as many frames as max_in_flight takes, see
+  // the class comment
+  std::vector<uint32_t> requests;
+  while (!unqueued_pinned.empty() &&
+         in_flight + requests.size() < max_in_flight) {
+    const uint32_t page = unqueued_pinned.back();
+    unqueued_pinned.pop_back();
+    if (pending[page] || indirection[page] != null_slot) continue;
+    pending[page] = 1;
+    requests.push_back(page);
+  }
+  const size_t pinned_requests = requests.size();
+
+  // buffers this frame in flight never used hold garbage, not a stamp
+  const bool has_feedback = previous_frame != 0 && previous_frame < frame;
+  misses                  = 0;
+  for (uint32_t page = 0; has_feedback && page < file->pages_count; page++) {
+    if (wanted[page] != previous_frame) continue;
+    if (indirection[page] != null_slot) {
+      last_used[page] = std::max<uint64_t>(last_used[page], previous_frame);
+    } else {
+      misses++;
+      if (!pending[page]) requests.push_back(page);
+    }
+  }
+
+  // pages are numbered finest mip first within a texture, so coarser pages,
+  // which cover more of the screen, are loaded first
+  std::sort(requests.begin() + pinned_requests, requests.end(),
+            std::greater<uint32_t>{});
+  if (requests.size() > max_in_flight - in_flight)
+    requests.resize(max_in_flight - in_flight);
+  if (!requests.empty()) {
+    for (uint32_t page : requests) pending[page] = 1;
+    in_flight += requests.size();
+    // reading the mapping is what faults the pages in from disk, so it
+    // happens off the render thread
+    job_system_t::global().submit(
+        [this, requests] {
+          for (uint32_t page : requests) {
+            loaded_page_t loaded_page{page, {}};
+            loaded_page.texels.assign(file->page(page),
+                                      file->page(page) + virtual_slot_bytes);
+            std::lock_guard lock{loaded_mutex};
+            loaded.push_back(std::move(loaded_page));
+          }
+        },
+        loading);
+  }
+
+  // the slot that went unused the longest, null_slot if every slot was used
+  // too recently or holds a pinned page
+  auto find_victim = [&]() {
+    uint32_t victim = null_slot;
+    for (uint32_t slot = 0; slot < slots_count; slot++) {
+      const uint32_t page = slot_pages[slot];
+      if (pinned[page] || last_used[page] + keep_frames >= frame) continue;
+      if (victim == null_slot ||
+          last_used[page] < last_used[slot_pages[victim]])
+        victim = slot;
+    }
+    return victim;
+  };
+
+  std::vector<loaded_page_t> ready;
+  {
+    std::lock_guard lock{loaded_mutex};
+    ready.swap(loaded);
+  }
+  // pinned pages take the staging space and free slots first
+  std::stable_partition(
+      ready.begin(), ready.end(),
+      [&](const loaded_page_t &page) { return pinned[page.page] != 0; });
+
+  uint8_t *staging_data = reinterpret_cast<uint8_t *>(
+      context->map_buffer(base->buffer(staging)));
+  copies.clear();
+  page_ins       = 0;
+  evictions      = 0;
+  uploaded_bytes = 0;
+  size_t placed  = 0;
+  for (; placed < ready.size(); placed++) {
+    if (uploaded_bytes + virtual_slot_bytes > staging_size) break;
+    uint32_t slot = null_slot;
+    if (!free_slots.empty()) {
+      slot = free_slots.back();
+      free_slots.pop_back();
+    } else {
+      slot = find_victim();
+      if (slot == null_slot) break;
+      indirection[slot_pages[slot]] = null_slot;
+      evictions++;
+    }
+
+    const loaded_page_t &page = ready[placed];
+    std::memcpy(staging_data + uploaded_bytes, page.texels.data(),
+                virtual_slot_bytes);
+    VkBufferImageCopy copy{};
+    copy.bufferOffset     = uploaded_bytes;
+    copy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    copy.imageOffset      = {int32_t(slot % slots_per_row * virtual_slot_size),
+                             int32_t(slot / slots_per_row * virtual_slot_size),
+                             0};
+    copy.imageExtent      = {virtual_slot_size, virtual_slot_size, 1};
+    copies.push_back(copy);
+    uploaded_bytes += virtual_slot_bytes;
+
+    indirection[page.page] = slot;
+    slot_pages[slot]       = page.page;
+    last_used[page.page]   = frame;
+    pending[page.page]     = 0;
+    in_flight--;
+    page_ins++;
+  }
+  // whatever did not fit waits for the next frame
+  if (placed < ready.size()) {
+    std::lock_guard lock{loaded_mutex};
+    loaded.insert(loaded.end(), std::make_move_iterator(ready.begin() + placed),
+                  std::make_move_iterator(ready.end()));
+  }
+  resident = slots_count - free_slots.size();
+
+  const VkDeviceAddress address =
+      context->get_buffer_device_address(frame_buffer);
+  const uint32_t     rows = (slots_count + slots_per_row - 1) / slots_per_row;
+  virtual_textures_t header{};
+  header.textures = gfx::to<virtual_texture_info_t *>(
+      context->get_buffer_device_address(textures_buffer));
+  header.mips = gfx::to<virtual_texture_mip_t *>(
+      context->get_buffer_device_address(mips_buffer));
+  header.indirection =
+      gfx::to<uint32_t *>(address + sizeof(virtual_textures_t));
+  header.feedback    = gfx::to<uint32_t *>(
+      context->get_buffer_device_address(base->buffer(feedback)));
+  header.bphysical         = bphysical;
+  header.slots_per_row     = slots_per_row;
+  header.inv_physical_width  = 1.f / (slots_per_row * virtual_slot_size);
+  header.inv_physical_height = 1.f / (rows * virtual_slot_size);
+  // 0 is never written, so a fresh feedback buffer reads as untouched
+  header.frame             = uint32_t(frame);
+  header.padding           = 0;
+  std::memcpy(data, &header, sizeof(header));
+  std::memcpy(data + sizeof(virtual_textures_t), indirection.data(),
+              sizeof(uint32_t) * indirection.size());
+
+  std::chrono::duration<float, std::milli> took =
+      std::chrono::steady_clock::now() - start;
+  last_update_ms = took.count();
+  return page_ins > 0;
+}
+
+void texture_streamer_t::render(gfx::handle_commandbuffer_t cbuf) {
+  if (copies.empty()) return;
+  VkImage vk_image = context->get_image(physical).vk_image;
+  // earlier frames may still sample the slots being replaced
+  image_barrier(*context, cbuf, vk_image,
+                initialized ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                            : VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_SHADER_READ_BIT,
+                VK_ACCESS_TRANSFER_WRITE_BIT,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT);
+  vkCmdCopyBufferToImage(context->get_commandbuffer(cbuf).vk_commandbuffer,
+                         context->get_buffer(base->buffer(staging)).vk_buffer,
+                         vk_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         copies.size(), copies.data());
+  image_barrier(*context, cbuf, vk_image,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+  initialized = true;
+}
+
+gfx::handle_buffer_t texture_streamer_t::frame_buffer() const {
+  return base->buffer(buffer);
+}
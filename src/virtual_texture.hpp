@@ -0,0 +1,193 @@
+#ifndef VIRTUAL_TEXTURE_HPP
+#define VIRTUAL_TEXTURE_HPP
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan_core.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+#include "assets.hpp"
+#include "horizon/core/core.hpp"
+#include "horizon/gfx/base.hpp"
+#include "horizon/gfx/context.hpp"
+#include "horizon/gfx/types.hpp"
+#include "job_system.hpp"
+#include "math/math.hpp"
+
+// bump whenever the file layout or the mip generation changes meaning
+static constexpr uint32_t virtual_texture_file_version = 1;
+
+// texels of a page, every mip is cut into pages of this size
+static constexpr uint32_t virtual_page_size   = 128;
+// texels repeated around a page so bilinear filtering never reads a
+// neighbouring slot
+static constexpr uint32_t virtual_page_border = 4;
+// texels of a slot in the physical cache, a page with its border
+static constexpr uint32_t virtual_slot_size =
+    virtual_page_size + 2 * virtual_page_border;
+static constexpr size_t   virtual_slot_bytes =
+    size_t(virtual_slot_size) * virtual_slot_size * 4;
+
+// mip 0 is the source image, every mip halves the previous one until it fits
+// a single page, a width of 0 marks an image that failed to decode
+struct virtual_texture_info_t {
+  uint32_t width;
+  uint32_t height;
+  uint32_t first_mip;
+  uint32_t mips_count;
+};
+
+// pages of a mip are numbered row major from first_page
+struct virtual_texture_mip_t {
+  uint32_t pages_x;
+  uint32_t pages_y;
+  uint32_t first_page;
+  uint32_t padding;
+};
+
+// rgba8 texels of mip 0 to cut into pages
+struct texture_texels_t {
+  const uint8_t *texels;
+  uint32_t       width;
+  uint32_t       height;
+};
+
+// read only, memory mapped view of a page file, a page is
+// virtual_slot_bytes of srgb rgba8 texels including its border
+struct virtual_texture_file_t {
+  ~virtual_texture_file_t();
+
+  const uint8_t *page(uint32_t page) const;
+
+  const virtual_texture_info_t *textures;
+  uint32_t                      textures_count;
+  const virtual_texture_mip_t  *mips;
+  uint32_t                      mips_count;
+  uint32_t                      pages_count;
+  uint64_t                      pages_offset;
+
+  void  *mapping      = nullptr;
+  size_t mapping_size = 0;
+};
+
+// hashes the image paths with their sizes and modification times, so a hit
+// does not have to decode anything
+uint64_t hash_texture_inputs(const std::vector<std::filesystem::path> &paths);
+
+std::filesystem::path virtual_texture_file_path(
+    const texture_config_t &config, uint64_t hash);
+
+// returns nullptr if the file is missing, stale or from another version
+core::ref<virtual_texture_file_t> load_virtual_texture_file(
+    const std::filesystem::path &path, uint64_t hash);
+// builds the mip chains and pages of every texture on the job system and
+// writes them to path
+void save_virtual_texture_file(const std::filesystem::path         &path,
+                               uint64_t                             hash,
+                               const std::vector<texture_texels_t> &textures,
+                               load_progress_t                     &progress);
+
+// everything sample_virtual_texture reads, see assets/shaders/types.slang,
+// the header and the indirection live in a per frame buffer
+struct virtual_textures_t {
+  virtual_texture_info_t *textures;
+  virtual_texture_mip_t  *mips;
+  // slot per page, null_slot if the page is not resident
+  uint32_t               *indirection;
+  // samplers write frame for every page they wanted
+  uint32_t               *feedback;
+  gfx::handle_bindless_image_t bphysical;
+  uint32_t                     slots_per_row;
+  float                        inv_physical_width;
+  float                        inv_physical_height;
+  uint32_t                     frame;
+  uint32_t                     padding;
+};
+static_assert(sizeof(virtual_textures_t) == 56,
+              "sizeof(virtual_textures_t) should be 56");
+
+// keeps the texture pages samplers ask for in a fixed size physical cache
+// every frame the feedback of the frame that last used this frame in
+// flight's buffers is read back, missing pages are loaded from the mapped
+// page file on the job system coarsest mip first, loaded pages are copied
+// into free slots or the slots that went unused the longest, at most
+// upload_budget bytes per frame, the coarsest page of every texture is loaded
+// and placed ahead of every other page and never evicted so a sampler can
+// always fall back to it
+struct texture_streamer_t {
+  static constexpr uint32_t null_slot = uint32_t(-1);
+
+  texture_streamer_t(core::ref<gfx::context_t>         context,  //
+                     core::ref<gfx::base_t>            base,     //
+                     core::ref<virtual_texture_file_t> file,     //
+                     VkDeviceSize                      budget,   //
+                     VkDeviceSize                      upload_budget);
+  ~texture_streamer_t();
+
+  // queues this frame's loads, picks the slots of the loaded pages and
+  // writes this frame in flight's buffer, returns true if a slot changed
+  bool update();
+  // copies the pages update placed into the physical cache, has to be
+  // recorded before anything samples the frame's buffer
+  void render(gfx::handle_commandbuffer_t cbuf);
+
+  // this frame in flight's virtual_textures_t, valid after update
+  gfx::handle_buffer_t frame_buffer() const;
+
+  core::ref<gfx::context_t>         context;
+  core::ref<gfx::base_t>            base;
+  core::ref<virtual_texture_file_t> file;
+
+  gfx::handle_buffer_t         textures_buffer;
+  gfx::handle_buffer_t         mips_buffer;
+  gfx::handle_image_t          physical;
+  gfx::handle_image_view_t     physical_view;
+  gfx::handle_bindless_image_t bphysical;
+  uint32_t                     slots_count   = 0;
+  uint32_t                     slots_per_row = 0;
+  // the physical image is undefined until the first copy
+  bool                         initialized   = false;
+
+  // host visible, header followed by the indirection
+  gfx::handle_managed_buffer_t buffer;
+  // host visible, a uint32_t per page, read back frames in flight later
+  gfx::handle_managed_buffer_t feedback;
+  gfx::handle_managed_buffer_t staging;
+  VkDeviceSize                 staging_size;
+
+  std::vector<uint32_t>          indirection;
+  std::vector<uint32_t>          slot_pages;
+  std::vector<uint32_t>          free_slots;
+  std::vector<uint64_t>          last_used;
+  // set for pages queued on the job system and not yet placed
+  std::vector<uint8_t>           pending;
+  std::vector<uint8_t>           pinned;
+  // pinned pages update has not queued yet, taken from the back
+  std::vector<uint32_t>          unqueued_pinned;
+  std::vector<VkBufferImageCopy> copies;
+  uint64_t                       frame = 0;
+
+  // filled by the loading jobs, drained by update
+  struct loaded_page_t {
+    uint32_t             page;
+    std::vector<uint8_t> texels;
+  };
+  std::mutex                 loaded_mutex;
+  std::vector<loaded_page_t> loaded;
+  job_counter_t              loading;
+  uint32_t                   in_flight = 0;
+
+  // the last update
+  uint32_t     resident       = 0;
+  uint32_t     misses         = 0;
+  uint32_t     page_ins       = 0;
+  uint32_t     evictions      = 0;
+  VkDeviceSize uploaded_bytes = 0;
+  float        last_update_ms = 0.f;
+};
+
+#endif
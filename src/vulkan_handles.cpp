@@ -0,0 +1,26 @@
+#include "vulkan_handles.hpp"
+
+VkDevice vk_device(gfx::context_t &context) { return context._vk_device; }
+
+VkPhysicalDevice vk_physical_device(gfx::context_t &context) {
+  return context._vk_physical_device;
+}
+
+VmaAllocator vma_allocator(gfx::context_t &context) {
+  return context._vma_allocator;
+}
+
+VkSurfaceKHR vk_surface(gfx::base_t &base) {
+  return base._context->get_swapchain(base._swapchain).vk_surface;
+}
+
+VkDeviceSize allocated_device_memory(gfx::context_t &context) {
+  const VkPhysicalDeviceMemoryProperties *vk_memory_properties;
+  vmaGetMemoryProperties(vma_allocator(context), &vk_memory_properties);
+  VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+  vmaGetHeapBudgets(vma_allocator(context), budgets);
+  VkDeviceSize bytes = 0;
+  for (uint32_t i = 0; i < vk_memory_properties->memoryHeapCount; i++)
+    bytes += budgets[i].statistics.blockBytes;
+  return bytes;
+}
@@ -0,0 +1,23 @@
+#ifndef VULKAN_HANDLES_HPP
+#define VULKAN_HANDLES_HPP
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan_core.h>
+
+#include "horizon/gfx/base.hpp"
+#include "horizon/gfx/context.hpp"
+#include "horizon/gfx/types.hpp"
+
+// the only place that reaches past horizon's api into the vulkan objects it
+// wraps, for the few calls horizon has no helper for
+VkDevice         vk_device(gfx::context_t &context);
+VkPhysicalDevice vk_physical_device(gfx::context_t &context);
+VmaAllocator     vma_allocator(gfx::context_t &context);
+// the surface base's swapchain presents to
+VkSurfaceKHR     vk_surface(gfx::base_t &base);
+
+// device memory vma holds in blocks across every heap, what the driver
+// actually handed out, including what the allocations leave unused
+VkDeviceSize allocated_device_memory(gfx::context_t &context);
+
+#endif
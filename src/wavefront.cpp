@@ -0,0 +1,248 @@
+#include "wavefront.hpp"
+
+#include <volk.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+#include "horizon/core/logger.hpp"
+#include "renderer.hpp"
+
+static gfx::handle_pipeline_t create_kernel(
+    shader_cache_t &shader_cache, gfx::handle_pipeline_layout_t pl,
+    const std::string &name) {
+  return shader_cache.create_compute_pipeline(
+      pl, "assets/shaders/" + name + ".slang");
+}
+
+// kernels communicate through memory and indirect arguments, every kernel
+// waits for all previous compute writes
+static void compute_barrier(gfx::context_t             &context,
+                            gfx::handle_commandbuffer_t cbuf) {
+  VkMemoryBarrier vk_memory_barrier{};
+  vk_memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  vk_memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  vk_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+                                    VK_ACCESS_SHADER_WRITE_BIT |
+                                    VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  vkCmdPipelineBarrier(context.get_commandbuffer(cbuf).vk_commandbuffer,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                           VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                       0, 1, &vk_memory_barrier, 0, nullptr, 0, nullptr);
+}
+
+wavefront_t::wavefront_t(core::ref<gfx::context_t>   context,       //
+                         core::ref<gfx::base_t>      base,          //
+                         core::ref<gpu_auto_timer_t> auto_timer,    //
+                         core::ref<shader_cache_t>   shader_cache,  //
+                         core::ref<deletion_queue_t> deletion_queue)
+    : context(context),
+      base(base),
+      auto_timer(auto_timer),
+      shader_cache(shader_cache),
+      deletion_queue(deletion_queue) {
+  gfx::config_pipeline_layout_t cpl{};
+  cpl.add_descriptor_set_layout(base->_bindless_descriptor_set_layout);
+  cpl.add_push_constant(sizeof(push_constant_t), VK_SHADER_STAGE_ALL);
+  pl = context->create_pipeline_layout(cpl);
+
+  generate     = create_kernel(*shader_cache, pl, "wavefront_generate");
+  prepare      = create_kernel(*shader_cache, pl, "wavefront_prepare");
+  extend       = create_kernel(*shader_cache, pl, "wavefront_extend");
+  connect      = create_kernel(*shader_cache, pl, "wavefront_connect");
+  sort_count   = create_kernel(*shader_cache, pl, "wavefront_sort_count");
+  sort_scan    = create_kernel(*shader_cache, pl, "wavefront_sort_scan");
+  sort_scatter = create_kernel(*shader_cache, pl, "wavefront_sort_scatter");
+  shade        = create_kernel(*shader_cache, pl, "wavefront_shade");
+  accumulate   = create_kernel(*shader_cache, pl, "wavefront_accumulate");
+}
+
+wavefront_t::~wavefront_t() {
+  for (auto buffer : buffers) context->destroy_buffer(buffer);
+}
+
+void wavefront_t::reserve(uint32_t paths, uint32_t materials) {
+  if (paths <= paths_capacity && materials <= materials_capacity) return;
+  // the frames in flight keep tracing through the old queues
+  for (auto buffer : buffers) deletion_queue->destroy_buffer(buffer);
+  buffers.clear();
+
+  paths_capacity     = std::max(paths, paths_capacity);
+  materials_capacity = std::max(materials, materials_capacity);
+
+  auto create = [&](size_t size, VkBufferUsageFlags usage,
+                    VmaAllocationCreateFlags flags) {
+    gfx::config_buffer_t cb{};
+    cb.vk_size                     = size;
+    cb.vk_buffer_usage_flags       = usage;
+    cb.vma_allocation_create_flags = flags;
+    gfx::handle_buffer_t buffer    = context->create_buffer(cb);
+    buffers.push_back(buffer);
+    return buffer;
+  };
+  auto create_queue = [&](size_t size) {
+    return gfx::to<void *>(context->get_buffer_device_address(
+        create(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+               VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT)));
+  };
+
+  wavefront_queues_t gpu_queues{};
+  for (auto &rays : gpu_queues.rays)
+    rays = reinterpret_cast<wavefront_ray_t *>(
+        create_queue(sizeof(wavefront_ray_t) * paths_capacity));
+  gpu_queues.hits = reinterpret_cast<wavefront_hit_t *>(
+      create_queue(sizeof(wavefront_hit_t) * paths_capacity));
+  gpu_queues.misses = reinterpret_cast<uint32_t *>(
+      create_queue(sizeof(uint32_t) * paths_capacity));
+  gpu_queues.sorted = reinterpret_cast<uint32_t *>(
+      create_queue(sizeof(uint32_t) * paths_capacity));
+  gpu_queues.radiance = reinterpret_cast<math::vec4 *>(
+      create_queue(sizeof(math::vec4) * paths_capacity));
+  gpu_queues.bins = reinterpret_cast<uint32_t *>(
+      create_queue(sizeof(uint32_t) * materials_capacity));
+  gpu_queues.offsets = reinterpret_cast<uint32_t *>(
+      create_queue(sizeof(uint32_t) * materials_capacity));
+
+  counters = create(
+      sizeof(wavefront_counters_t),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+      VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
+  gpu_queues.counters = gfx::to<wavefront_counters_t *>(
+      context->get_buffer_device_address(counters));
+
+  queues = create(sizeof(wavefront_queues_t),
+                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                  VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+  *reinterpret_cast<wavefront_queues_t *>(context->map_buffer(queues)) =
+      gpu_queues;
+
+  horizon_info("wavefront queues: {} paths, {} materials", paths_capacity,
+               materials_capacity);
+}
+
+void wavefront_t::render(gfx::handle_commandbuffer_t          cbuf,
+                         renderer_data_t                     &renderer_data,
+                         gfx::handle_buffer_t                 camera,
+                         gfx::handle_buffer_t                 two_level_bvh,
+                         gfx::handle_bindless_sampler_t       bsampler,
+                         uint32_t width, uint32_t height,
+                         gfx::handle_bindless_storage_image_t bsimage,
+                         gfx::handle_bindless_storage_image_t baccumulation,
+                         uint32_t sample_index, uint32_t bounces) {
+  static const auto generate_timer     = intern_timer("wavefront generate");
+  static const auto prepare_timer      = intern_timer("wavefront prepare");
+  static const auto extend_timer       = intern_timer("wavefront extend");
+  static const auto connect_timer      = intern_timer("wavefront connect");
+  static const auto sort_count_timer   = intern_timer("wavefront sort count");
+  static const auto sort_scan_timer    = intern_timer("wavefront sort scan");
+  static const auto sort_scatter_timer = intern_timer("wavefront sort scatter");
+  static const auto shade_timer        = intern_timer("wavefront shade");
+  static const auto accumulate_timer   = intern_timer("wavefront accumulate");
+
+  horizon_assert(width * height <= paths_capacity &&
+                     renderer_data.materials_count <= materials_capacity,
+                 "wavefront_t::reserve was not called");
+
+  push_constant_t pc;
+  pc.camera =
+      gfx::to<core::camera_t *>(context->get_buffer_device_address(camera));
+  pc.meshes = context->get_buffer_device_address(renderer_data.meshes_buffer);
+  pc.materials =
+      context->get_buffer_device_address(renderer_data.materials_buffer);
+  pc.triangle_storage = gfx::to<triangle_storage_t *>(
+      context->get_buffer_device_address(renderer_data.triangle_storage));
+  pc.bvh2_nodes = gfx::to<bvh::node_t *>(
+      device_address(*context, renderer_data.bvh2_nodes));
+  pc.bvh2_prim_indices = gfx::to<uint32_t *>(
+      device_address(*context, renderer_data.bvh2_prim_indices));
+  pc.cwbvh_nodes = gfx::to<cwbvh_node_t *>(
+      device_address(*context, renderer_data.cwbvh_nodes));
+  pc.cwbvh_prim_indices = gfx::to<uint32_t *>(
+      device_address(*context, renderer_data.cwbvh_prim_indices));
+  pc.queues = gfx::to<wavefront_queues_t *>(
+      context->get_buffer_device_address(queues));
+  pc.width           = width;
+  pc.height          = height;
+  pc.bsimage         = bsimage;
+  pc.bsampler        = bsampler;
+  pc.baccumulation   = baccumulation;
+  pc.sample_index    = sample_index;
+  pc.bounce          = 0;
+  pc.bounces         = bounces;
+  pc.use_cwbvh       = use_cwbvh;
+  pc.materials_count = renderer_data.materials_count;
+  pc.stage           = 0;
+  pc.two_level       = two_level_bvh != core::null_handle;
+  pc.two_level_bvh   = nullptr;
+  if (two_level_bvh != core::null_handle)
+    pc.two_level_bvh = gfx::to<two_level_bvh_t *>(
+        context->get_buffer_device_address(two_level_bvh));
+
+  VkCommandBuffer vk_commandbuffer =
+      context->get_commandbuffer(cbuf).vk_commandbuffer;
+  VkBuffer vk_counters = context->get_buffer(counters).vk_buffer;
+
+  auto bind = [&](gfx::handle_pipeline_t pipeline) {
+    context->cmd_bind_pipeline(cbuf, pipeline);
+    context->cmd_bind_descriptor_sets(cbuf, pipeline, 0,
+                                      {base->_bindless_descriptor_set});
+    context->cmd_push_constants(cbuf, pipeline, VK_SHADER_STAGE_ALL, 0,
+                                sizeof(push_constant_t), &pc);
+  };
+  auto dispatch = [&](timer_id_t timer, gfx::handle_pipeline_t pipeline,
+                      uint32_t x, uint32_t y) {
+    auto_timer->start(cbuf, timer);
+    bind(pipeline);
+    context->cmd_dispatch(cbuf, x, y, 1);
+    auto_timer->end(cbuf, timer);
+    compute_barrier(*context, cbuf);
+  };
+  auto dispatch_indirect = [&](timer_id_t timer,
+                               gfx::handle_pipeline_t pipeline,
+                               VkDeviceSize           offset) {
+    auto_timer->start(cbuf, timer);
+    bind(pipeline);
+    vkCmdDispatchIndirect(vk_commandbuffer, vk_counters, offset);
+    auto_timer->end(cbuf, timer);
+    compute_barrier(*context, cbuf);
+  };
+
+  // the previous frame may still be using the queues
+  compute_barrier(*context, cbuf);
+
+  const uint32_t groups_x = (width + 7) / 8, groups_y = (height + 7) / 8;
+  dispatch(generate_timer, generate, groups_x, groups_y);
+
+  // kernels nest in the scope of their bounce, interned as bounces grow
+  static std::vector<timer_id_t> bounce_timers;
+  while (bounce_timers.size() <= bounces)
+    bounce_timers.push_back(intern_timer(
+        "wavefront bounce " + std::to_string(bounce_timers.size())));
+
+  for (pc.bounce = 0; pc.bounce <= bounces; pc.bounce++) {
+    auto_timer->start(cbuf, bounce_timers[pc.bounce]);
+    pc.stage = 0;
+    dispatch(prepare_timer, prepare, 1, 1);
+    dispatch_indirect(extend_timer, extend,
+                      offsetof(wavefront_counters_t, ray_args));
+    pc.stage = 1;
+    dispatch(prepare_timer, prepare, 1, 1);
+    dispatch_indirect(connect_timer, connect,
+                      offsetof(wavefront_counters_t, miss_args));
+    // the last bounce only gathers the environment
+    if (pc.bounce < bounces) {
+      dispatch_indirect(sort_count_timer, sort_count,
+                        offsetof(wavefront_counters_t, hit_args));
+      dispatch(sort_scan_timer, sort_scan, 1, 1);
+      dispatch_indirect(sort_scatter_timer, sort_scatter,
+                        offsetof(wavefront_counters_t, hit_args));
+      dispatch_indirect(shade_timer, shade,
+                        offsetof(wavefront_counters_t, hit_args));
+    }
+    auto_timer->end(cbuf, bounce_timers[pc.bounce]);
+  }
+
+  dispatch(accumulate_timer, accumulate, groups_x, groups_y);
+}
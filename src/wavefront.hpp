@@ -0,0 +1,141 @@
+#ifndef WAVEFRONT_HPP
+#define WAVEFRONT_HPP
+
+#include <vector>
+
+#include "assets.hpp"
+#include "bvh/bvh.hpp"
+#include "cwbvh.hpp"
+#include "frame_resources.hpp"
+#include "horizon/core/components.hpp"
+#include "horizon/core/core.hpp"
+#include "horizon/gfx/base.hpp"
+#include "horizon/gfx/context.hpp"
+#include "horizon/gfx/types.hpp"
+#include "shader_cache.hpp"
+#include "tlas.hpp"
+
+struct gpu_auto_timer_t;
+
+// see assets/shaders/wavefront.slang
+struct wavefront_ray_t {
+  math::vec3 origin;
+  uint32_t   pixel;
+  math::vec3 direction;
+  uint32_t   seed;
+  math::vec3 throughput;
+  uint32_t   padding;
+};
+static_assert(sizeof(wavefront_ray_t) == 48,
+              "sizeof(wavefront_ray_t) should be 48");
+
+struct wavefront_hit_t {
+  uint32_t ray_index;
+  uint32_t prim_index;
+  float    t, u, v;
+  uint32_t material;
+};
+static_assert(sizeof(wavefront_hit_t) == 24,
+              "sizeof(wavefront_hit_t) should be 24");
+
+struct wavefront_counters_t {
+  uint32_t                  ray_count[2];
+  uint32_t                  hit_count;
+  uint32_t                  miss_count;
+  VkDispatchIndirectCommand ray_args;
+  VkDispatchIndirectCommand hit_args;
+  VkDispatchIndirectCommand miss_args;
+};
+
+struct wavefront_queues_t {
+  wavefront_ray_t      *rays[2];
+  wavefront_hit_t      *hits;
+  uint32_t             *misses;
+  uint32_t             *sorted;
+  math::vec4           *radiance;
+  uint32_t             *bins;
+  uint32_t             *offsets;
+  wavefront_counters_t *counters;
+};
+
+// path tracer split into kernels that communicate through queues in memory,
+// per bounce: extend traces the ray queue, connect adds the environment for
+// misses, hits are counting sorted by material and shade appends the
+// scattered rays to the next queue, queue sizes stay on the gpu and drive
+// indirect dispatches
+struct wavefront_t {
+  struct push_constant_t {
+    core::camera_t                      *camera;
+    VkDeviceAddress                      meshes;
+    VkDeviceAddress                      materials;
+    triangle_storage_t                  *triangle_storage;
+    bvh::node_t                         *bvh2_nodes;
+    uint32_t                            *bvh2_prim_indices;
+    cwbvh_node_t                        *cwbvh_nodes;
+    uint32_t                            *cwbvh_prim_indices;
+    wavefront_queues_t                  *queues;
+    uint32_t                             width;
+    uint32_t                             height;
+    gfx::handle_bindless_storage_image_t bsimage;
+    gfx::handle_bindless_sampler_t       bsampler;
+    gfx::handle_bindless_storage_image_t baccumulation;
+    uint32_t                             sample_index;
+    uint32_t                             bounce;
+    uint32_t                             bounces;
+    uint32_t                             use_cwbvh;
+    uint32_t                             materials_count;
+    uint32_t                             stage;
+    uint32_t                             two_level;
+    two_level_bvh_t                     *two_level_bvh;
+  };
+  static_assert(sizeof(push_constant_t) <= 128,
+                "push constants past 128 bytes are not guaranteed");
+
+  wavefront_t(core::ref<gfx::context_t>   context,     //
+              core::ref<gfx::base_t>      base,        //
+              core::ref<gpu_auto_timer_t> auto_timer,  //
+              core::ref<shader_cache_t>   shader_cache,
+              core::ref<deletion_queue_t> deletion_queue);
+  ~wavefront_t();
+
+  // grows the queues to hold paths paths and the sort to materials bins,
+  // waits for the device if anything has to be reallocated
+  void reserve(uint32_t paths, uint32_t materials);
+
+  // traces one sample per pixel and accumulates it like the path tracer does,
+  // through the two level bvh if two_level_bvh is not null
+  void render(gfx::handle_commandbuffer_t cbuf, renderer_data_t &renderer_data,
+              gfx::handle_buffer_t           camera,
+              gfx::handle_buffer_t           two_level_bvh,
+              gfx::handle_bindless_sampler_t bsampler, uint32_t width,
+              uint32_t height, gfx::handle_bindless_storage_image_t bsimage,
+              gfx::handle_bindless_storage_image_t baccumulation,
+              uint32_t sample_index, uint32_t bounces);
+
+  core::ref<gfx::context_t>   context;
+  core::ref<gfx::base_t>      base;
+  core::ref<gpu_auto_timer_t> auto_timer;
+  core::ref<shader_cache_t>   shader_cache;
+  core::ref<deletion_queue_t> deletion_queue;
+
+  gfx::handle_pipeline_layout_t pl;
+  gfx::handle_pipeline_t        generate;
+  gfx::handle_pipeline_t        prepare;
+  gfx::handle_pipeline_t        extend;
+  gfx::handle_pipeline_t        connect;
+  gfx::handle_pipeline_t        sort_count;
+  gfx::handle_pipeline_t        sort_scan;
+  gfx::handle_pipeline_t        sort_scatter;
+  gfx::handle_pipeline_t        shade;
+  gfx::handle_pipeline_t        accumulate;
+
+  std::vector<gfx::handle_buffer_t> buffers;
+  gfx::handle_buffer_t              counters = core::null_handle;
+  gfx::handle_buffer_t              queues   = core::null_handle;
+  uint32_t                          paths_capacity     = 0;
+  uint32_t                          materials_capacity = 0;
+
+  bool use_cwbvh = false;
+};
+
+#endif